@@ -0,0 +1,622 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAVE_PERF_EVENTS 1
+#endif
+
+#include "base64.h"
+#include "decrypt.h"
+#include "encrypt.h"
+#include "keygen.h"
+#include "utils.h"
+
+// Repeat small buffers until each sample takes at least this long, so the
+// clock's resolution doesn't matter
+static const uint64_t MIN_SAMPLE_NS = 20 * 1000000ULL;
+static const int DEFAULT_REPS = 7;
+// Sizes this big take long enough on their own to not need as many runs
+static const size_t BIG_BUFFER = (size_t) 256 << 20;
+static const int BIG_BUFFER_REPS = 3;
+
+static const size_t KEY_BITS[] = { 256, 512, 1024, 2048 };
+static const int KEY_COUNTS[] = { 1, 2, 4, 8, 16 };
+static const size_t BUFFER_SIZES[] = {
+    (size_t) 1 << 10,  (size_t) 64 << 10,  (size_t) 1 << 20,
+    (size_t) 16 << 20, (size_t) 256 << 20, (size_t) 1 << 30,
+    (size_t) 4 << 30
+};
+#define NUM_KEY_BITS (sizeof(KEY_BITS) / sizeof(KEY_BITS[0]))
+#define NUM_KEY_COUNTS (sizeof(KEY_COUNTS) / sizeof(KEY_COUNTS[0]))
+#define NUM_BUFFER_SIZES (sizeof(BUFFER_SIZES) / sizeof(BUFFER_SIZES[0]))
+
+// The sizes used while sweeping the other parameters
+static const size_t DEFAULT_BITS = 512;
+static const int DEFAULT_COUNT = 3;
+static const size_t DEFAULT_SIZE = (size_t) 1 << 20;
+
+/**
+ * @enum BenchKernels
+ * @brief The code paths that can be benchmarked
+ */
+typedef enum
+{
+    KERNEL_ENCRYPT = 0,
+    KERNEL_DECRYPT = 1,
+    KERNEL_BASE64_ENCODE = 2,
+    KERNEL_BASE64_DECODE = 3
+} BenchKernels;
+
+static const char *KERNEL_NAMES[] = { "encrypt", "decrypt", "base64_encode",
+                                      "base64_decode" };
+
+/**
+ * @enum PerfCounters
+ * @brief The hardware counters read around each benchmark
+ */
+typedef enum
+{
+    COUNTER_CYCLES = 0,
+    COUNTER_INSTRUCTIONS = 1,
+    COUNTER_CACHE_MISSES = 2,
+    COUNTER_BRANCH_MISSES = 3,
+    NUM_COUNTERS = 4
+} PerfCounters;
+
+/**
+ * @struct perf_counters_t
+ * @brief The open hardware counters. They are opened as one group, so they
+ * all count over exactly the same runs.
+ */
+typedef struct
+{
+    // -1 for counters that couldn't be opened
+    int fds[NUM_COUNTERS];
+    // The first counter that opened, which the others are grouped with
+    int leader;
+    // The value, time enabled and time running of each counter when started
+    uint64_t start[NUM_COUNTERS][3];
+} perf_counters_t;
+
+/**
+ * @struct bench_options_t
+ * @brief Options from the command line
+ */
+typedef struct
+{
+    size_t max_size;
+    int reps;
+    int full;
+    int json;
+    int counters;
+} bench_options_t;
+
+/**
+ * @struct bench_case_t
+ * @brief The inputs for a single benchmark
+ */
+typedef struct
+{
+    int kernel;
+    const char **keys;
+    int num_keys;
+    size_t key_bits;
+    unsigned char *input;
+    size_t input_len;
+    // The size of the plain text, which the throughput is measured against
+    size_t size;
+} bench_case_t;
+
+/**
+ * @brief Read the CPU's time stamp counter
+ * @return The time stamp counter, 0 if it isn't available
+ */
+static uint64_t read_cycles(void)
+{
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static perf_counters_t counters = { { -1, -1, -1, -1 }, -1, { { 0 } } };
+
+/**
+ * @brief Open the hardware counters. Any that aren't permitted or supported
+ * are left closed, and reported as unavailable.
+ */
+static void counters_open(void)
+{
+#ifdef HAVE_PERF_EVENTS
+    static const uint64_t CONFIGS[NUM_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    int err = 0;
+    for (int c = 0; c < NUM_COUNTERS; c++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = CONFIGS[c];
+        // Only count the benchmark itself, which is also all that
+        // unprivileged users are allowed to count
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counters.fds[c] = syscall(SYS_perf_event_open, &attr, 0, -1,
+                                  counters.leader, 0);
+        if (counters.fds[c] == -1)
+            err = errno;
+        else if (counters.leader == -1)
+            counters.leader = counters.fds[c];
+    }
+    if (err == 0)
+        return;
+
+    if (err == EACCES || err == EPERM)
+        fprintf(stderr,
+                "Some hardware counters are not permitted (%s). Lower "
+                "/proc/sys/kernel/perf_event_paranoid to 2 to read them.\n",
+                strerror(err));
+    else
+        fprintf(stderr,
+                "Some hardware counters are not available (%s), such as when "
+                "running in a VM.\n",
+                strerror(err));
+#else
+    fprintf(stderr, "Hardware counters are only supported on Linux.\n");
+#endif
+}
+
+/**
+ * @brief Close the hardware counters
+ */
+static void counters_close(void)
+{
+#ifdef HAVE_PERF_EVENTS
+    for (int c = 0; c < NUM_COUNTERS; c++)
+        if (counters.fds[c] != -1)
+            close(counters.fds[c]);
+#endif
+}
+
+/**
+ * @brief Read the value, time enabled and time running of a counter
+ * @param[in] c The counter to read
+ * @param[out] data Where to read it to
+ * @return If the counter was read
+ */
+static int counter_read(int c, uint64_t data[3])
+{
+#ifdef HAVE_PERF_EVENTS
+    return counters.fds[c] != -1 &&
+           read(counters.fds[c], data, 3 * sizeof(uint64_t)) ==
+               3 * sizeof(uint64_t);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Start measuring with the hardware counters
+ */
+static void counters_start(void)
+{
+    // The counters are left running, and measured from where they were
+    // when started
+    for (int c = 0; c < NUM_COUNTERS; c++)
+        if (!counter_read(c, counters.start[c]))
+            memset(counters.start[c], 0, sizeof(counters.start[c]));
+}
+
+/**
+ * @brief Stop measuring with the hardware counters
+ * @param[out] values The value of each counter, scaled up if the counter
+ * was only running for part of the time, or -1 if it isn't available
+ */
+static void counters_stop(double values[NUM_COUNTERS])
+{
+    for (int c = 0; c < NUM_COUNTERS; c++)
+    {
+        uint64_t data[3];
+        values[c] = -1;
+        if (!counter_read(c, data) || data[2] == counters.start[c][2])
+            continue;
+        values[c] = (double) (data[0] - counters.start[c][0]) *
+                    (data[1] - counters.start[c][1]) /
+                    (data[2] - counters.start[c][2]);
+    }
+}
+
+/**
+ * @brief Run the kernel once
+ * @param[in] bench The benchmark to run
+ * @return If the kernel succeeded
+ */
+static int run_once(const bench_case_t *bench)
+{
+    unsigned char *output = NULL;
+    size_t output_len = 0;
+    switch (bench->kernel)
+    {
+        case KERNEL_ENCRYPT:
+            output_len = encrypt(bench->input, bench->input_len, &output,
+                                 bench->keys, bench->num_keys);
+            break;
+        case KERNEL_DECRYPT:
+            output_len = decrypt(bench->input, bench->input_len, &output,
+                                 bench->keys, bench->num_keys);
+            break;
+        case KERNEL_BASE64_ENCODE:
+            output = (unsigned char *) base64_encode(
+                bench->input, bench->input_len, &output_len);
+            break;
+        case KERNEL_BASE64_DECODE:
+            output = base64_decode(bench->input, bench->input_len,
+                                   &output_len);
+            break;
+    }
+    free(output);
+    return output != NULL && output_len > 0;
+}
+
+/**
+ * @brief Compare function for sorting the samples
+ */
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Format a metric from the hardware counters for the table
+ * @param[out] buf Where to write the metric
+ * @param[in] size The size of buf
+ * @param[in] value The metric, negative if it isn't available
+ * @param[in] precision The number of decimal places
+ */
+static void format_metric(char *buf, size_t size, double value,
+                          int precision)
+{
+    if (value < 0)
+        snprintf(buf, size, "-");
+    else
+        snprintf(buf, size, "%.*f", precision, value);
+}
+
+/**
+ * @brief Print a metric from the hardware counters as a JSON field
+ * @param[in] name The name of the field
+ * @param[in] value The metric, negative if it isn't available
+ * @param[in] precision The number of decimal places
+ */
+static void print_json_metric(const char *name, double value, int precision)
+{
+    if (value < 0)
+        printf(",\"%s\":null", name);
+    else
+        printf(",\"%s\":%.*f", name, precision, value);
+}
+
+/**
+ * @brief Time a benchmark and print the results
+ * @param[in] bench The benchmark to run
+ * @param[in] opts The options from the command line
+ */
+static void measure(const bench_case_t *bench, const bench_options_t *opts)
+{
+    // Warm up, and work out how many runs make up a sample
+    uint64_t start = get_time_ns();
+    if (!run_once(bench))
+    {
+        fprintf(stderr, "%s failed for %zu bytes\n",
+                KERNEL_NAMES[bench->kernel], bench->size);
+        return;
+    }
+    uint64_t once = get_time_ns() - start;
+    uint64_t iters = once >= MIN_SAMPLE_NS ? 1 : MIN_SAMPLE_NS / (once + 1);
+    if (iters < 1)
+        iters = 1;
+
+    int reps = bench->size >= BIG_BUFFER && opts->reps > BIG_BUFFER_REPS
+                   ? BIG_BUFFER_REPS
+                   : opts->reps;
+    uint64_t ns[reps], cycles[reps];
+    double hw[NUM_COUNTERS];
+    counters_start();
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t c0 = read_cycles();
+        uint64_t t0 = get_time_ns();
+        for (uint64_t i = 0; i < iters; i++)
+            run_once(bench);
+        ns[r] = (get_time_ns() - t0) / iters;
+        cycles[r] = (read_cycles() - c0) / iters;
+    }
+    counters_stop(hw);
+    qsort(ns, reps, sizeof(uint64_t), compare_u64);
+    qsort(cycles, reps, sizeof(uint64_t), compare_u64);
+
+    uint64_t median_ns = ns[reps / 2];
+    double gb_per_s = median_ns ? (double) bench->size / median_ns : 0;
+    double cycles_per_byte = (double) cycles[reps / 2] / bench->size;
+    // How far the runs strayed from the median, to tell if it is stable
+    double spread = median_ns ? 100.0 * (ns[reps - 1] - ns[0]) / median_ns
+                              : 0;
+
+    // The counters covered every run, so are averaged over all of them
+    double kb = (double) bench->size * reps * iters / 1024;
+    double ipc = hw[COUNTER_CYCLES] > 0 && hw[COUNTER_INSTRUCTIONS] >= 0
+                     ? hw[COUNTER_INSTRUCTIONS] / hw[COUNTER_CYCLES]
+                     : -1;
+    double cache_per_kb = hw[COUNTER_CACHE_MISSES] >= 0
+                              ? hw[COUNTER_CACHE_MISSES] / kb
+                              : -1;
+    double branch_per_kb = hw[COUNTER_BRANCH_MISSES] >= 0
+                               ? hw[COUNTER_BRANCH_MISSES] / kb
+                               : -1;
+
+    if (opts->json)
+    {
+        printf("{\"kernel\":\"%s\",\"key_bits\":%zu,\"keys\":%d,"
+               "\"bytes\":%zu,\"reps\":%d,\"median_ns\":%" PRIu64
+               ",\"gb_per_s\":%.4f,\"cycles_per_byte\":",
+               KERNEL_NAMES[bench->kernel], bench->key_bits, bench->num_keys,
+               bench->size, reps, median_ns, gb_per_s);
+        if (read_cycles() != 0)
+            printf("%.3f", cycles_per_byte);
+        else
+            printf("null");
+        printf(",\"spread_pct\":%.1f", spread);
+        print_json_metric("ipc", ipc, 3);
+        print_json_metric("cache_misses_per_kb", cache_per_kb, 3);
+        print_json_metric("branch_misses_per_kb", branch_per_kb, 3);
+        printf("}\n");
+    }
+    else
+    {
+        char cpb[32] = "-", ipc_str[32], cache_str[32], branch_str[32];
+        if (read_cycles() != 0)
+            snprintf(cpb, sizeof(cpb), "%.3f", cycles_per_byte);
+        format_metric(ipc_str, sizeof(ipc_str), ipc, 2);
+        format_metric(cache_str, sizeof(cache_str), cache_per_kb, 2);
+        format_metric(branch_str, sizeof(branch_str), branch_per_kb, 2);
+        printf("%-14s %8zu %5d %12zu %12.4f %10.4f %10s %7.1f%% %6s %9s "
+               "%9s\n",
+               KERNEL_NAMES[bench->kernel], bench->key_bits, bench->num_keys,
+               bench->size, median_ns / 1e6, gb_per_s, cpb, spread, ipc_str,
+               cache_str, branch_str);
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Fill a buffer with plain text that won't be changed by removing
+ * the padding during decryption
+ * @param[in] size The size of the buffer
+ * @return The buffer, NULL if allocating it failed
+ */
+static unsigned char *make_plain_text(size_t size)
+{
+    unsigned char *data = malloc(size);
+    if (data == NULL)
+        return NULL;
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t x = 0; x < size; x++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        data[x] = (unsigned char) state;
+    }
+    data[size - 1] |= 1;
+    return data;
+}
+
+/**
+ * @brief Benchmark encrypt() and decrypt() with the given keys and size
+ * @param[in] key_bits The size of the keys
+ * @param[in] num_keys The number of keys
+ * @param[in] size The size of the plain text
+ * @param[in] opts The options from the command line
+ */
+static void bench_crypt(size_t key_bits, int num_keys, size_t size,
+                        const bench_options_t *opts)
+{
+    char **keys = generate_keys(key_bits, num_keys);
+    unsigned char *plain_text = make_plain_text(size);
+    if (keys == NULL || plain_text == NULL)
+    {
+        fprintf(stderr, "Skipping %zu bytes: out of memory\n", size);
+        free(plain_text);
+        if (keys != NULL)
+            free_keys(keys, num_keys, NULL);
+        return;
+    }
+
+    bench_case_t bench = { KERNEL_ENCRYPT, (const char **) keys, num_keys,
+                           key_bits, plain_text, size, size };
+    measure(&bench, opts);
+
+    unsigned char *cipher_text = NULL;
+    size_t cipher_text_len = encrypt(plain_text, size, &cipher_text,
+                                     (const char **) keys, num_keys);
+    free(plain_text);
+    if (cipher_text != NULL)
+    {
+        bench.kernel = KERNEL_DECRYPT;
+        bench.input = cipher_text;
+        bench.input_len = cipher_text_len;
+        measure(&bench, opts);
+    }
+    else
+        fprintf(stderr, "Skipping decrypt of %zu bytes: out of memory\n",
+                size);
+
+    free(cipher_text);
+    free_keys(keys, num_keys, NULL);
+}
+
+/**
+ * @brief Benchmark base64_encode() and base64_decode() with the given size
+ * @param[in] size The size of the data before encoding
+ * @param[in] opts The options from the command line
+ */
+static void bench_base64(size_t size, const bench_options_t *opts)
+{
+    unsigned char *data = make_plain_text(size);
+    if (data == NULL)
+    {
+        fprintf(stderr, "Skipping %zu bytes: out of memory\n", size);
+        return;
+    }
+
+    bench_case_t bench = { KERNEL_BASE64_ENCODE, NULL, 0, 0, data, size,
+                           size };
+    measure(&bench, opts);
+
+    size_t encoded_len = 0;
+    char *encoded = base64_encode(data, size, &encoded_len);
+    free(data);
+    if (encoded != NULL)
+    {
+        bench.kernel = KERNEL_BASE64_DECODE;
+        bench.input = (unsigned char *) encoded;
+        bench.input_len = encoded_len;
+        measure(&bench, opts);
+    }
+    free(encoded);
+}
+
+/**
+ * @brief Parse a size such as 4096, 64K, 16M or 4G
+ * @param[in] str The size
+ * @return The size in bytes, 0 if it isn't valid
+ */
+static size_t parse_size(const char *str)
+{
+    char *end = NULL;
+    unsigned long long size = strtoull(str, &end, 10);
+    switch (*end)
+    {
+        case 'G':
+        case 'g':
+            size <<= 10;
+            // fall through
+        case 'M':
+        case 'm':
+            size <<= 10;
+            // fall through
+        case 'K':
+        case 'k':
+            size <<= 10;
+            break;
+        case '\0':
+            break;
+        default:
+            return 0;
+    }
+    return (size_t) size;
+}
+
+/**
+ * @brief Print how to use the benchmark
+ * @param[in] name The name of the executable
+ */
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --max-size <size>  Largest buffer to test, e.g. 64K, 16M, 4G "
+            "(default: 16M)\n"
+            "  --reps <n>         Samples per result, the median is reported "
+            "(default: %d)\n"
+            "  --full             Test every combination of key size, key "
+            "count and buffer size\n"
+            "  --json             Print a JSON object per result\n"
+            "  --no-counters      Don't read the hardware counters\n",
+            name, DEFAULT_REPS);
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t opts = { (size_t) 16 << 20, DEFAULT_REPS, 0, 0, 1 };
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--max-size") == 0 && a + 1 < argc)
+            opts.max_size = parse_size(argv[++a]);
+        else if (strcmp(argv[a], "--reps") == 0 && a + 1 < argc)
+            opts.reps = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--full") == 0)
+            opts.full = 1;
+        else if (strcmp(argv[a], "--json") == 0)
+            opts.json = 1;
+        else if (strcmp(argv[a], "--no-counters") == 0)
+            opts.counters = 0;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opts.max_size == 0 || opts.reps < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (opts.counters)
+        counters_open();
+    if (!opts.json)
+        printf("%-14s %8s %5s %12s %12s %10s %10s %8s %6s %9s %9s\n",
+               "kernel", "key_bits", "keys", "bytes", "median_ms", "GB/s",
+               "cyc/B", "spread", "IPC", "cmiss/KB", "bmiss/KB");
+
+    if (opts.full)
+    {
+        for (size_t b = 0; b < NUM_KEY_BITS; b++)
+            for (size_t c = 0; c < NUM_KEY_COUNTS; c++)
+                for (size_t s = 0; s < NUM_BUFFER_SIZES; s++)
+                    if (BUFFER_SIZES[s] <= opts.max_size)
+                        bench_crypt(KEY_BITS[b], KEY_COUNTS[c],
+                                    BUFFER_SIZES[s], &opts);
+    }
+    else
+    {
+        // Sweep one parameter at a time, holding the others at the defaults
+        size_t sweep_size = (DEFAULT_SIZE < opts.max_size) ? DEFAULT_SIZE
+                                                           : opts.max_size;
+        for (size_t b = 0; b < NUM_KEY_BITS; b++)
+            bench_crypt(KEY_BITS[b], DEFAULT_COUNT, sweep_size, &opts);
+        for (size_t c = 0; c < NUM_KEY_COUNTS; c++)
+            bench_crypt(DEFAULT_BITS, KEY_COUNTS[c], sweep_size, &opts);
+        for (size_t s = 0; s < NUM_BUFFER_SIZES; s++)
+            if (BUFFER_SIZES[s] <= opts.max_size)
+                bench_crypt(DEFAULT_BITS, DEFAULT_COUNT, BUFFER_SIZES[s],
+                            &opts);
+    }
+
+    for (size_t s = 0; s < NUM_BUFFER_SIZES; s++)
+        if (BUFFER_SIZES[s] <= opts.max_size)
+            bench_base64(BUFFER_SIZES[s], &opts);
+    counters_close();
+    return 0;
+}
@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+# Compares two runs of eea_bench, printing the speedup of the second over the
+# first for every result they share, and the geometric mean of the speedups.
+#
+# Usage: bench/compare.sh <baseline.txt> <candidate.txt>
+#   Both files are the table eea_bench prints, without --json.
+
+set -euo pipefail
+
+if [ $# -ne 2 ]; then
+    sed -n '5,6s/^# \{0,1\}//p' "$0" >&2
+    exit 1
+fi
+
+awk '
+# Results are matched on the kernel, key size, key count and buffer size
+FNR == 1 { next }
+NR == FNR { base[$1, $2, $3, $4] = $6; next }
+($1, $2, $3, $4) in base && base[$1, $2, $3, $4] > 0 {
+    if (!shown++)
+        printf "%-14s %8s %5s %12s %10s %10s %8s\n", "kernel", "key_bits",
+            "keys", "bytes", "base GB/s", "new GB/s", "speedup"
+    speedup = $6 / base[$1, $2, $3, $4]
+    printf "%-14s %8s %5s %12s %10.4f %10.4f %7.3fx\n", $1, $2, $3, $4,
+        base[$1, $2, $3, $4], $6, speedup
+    log_sum += log(speedup)
+    count++
+}
+END {
+    if (count)
+        printf "\nGeometric mean speedup over %d results: %.3fx\n", count,
+            exp(log_sum / count)
+    else
+        print "No results in common" > "/dev/stderr"
+}
+' "$1" "$2"
@@ -0,0 +1,368 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/sha.h>
+
+#include "decrypt.h"
+#include "encrypt.h"
+#include "utils.h"
+
+// Repeat small inputs until each sample takes at least this long, so the
+// clock's resolution doesn't matter
+static const uint64_t MIN_SAMPLE_NS = 10 * 1000000ULL;
+static const int DEFAULT_REPS = 5;
+
+static const size_t KEY_BITS[] = { 256, 512, 1024, 2048 };
+static const int KEY_COUNTS[] = { 1, 3, 8 };
+#define NUM_KEY_BITS (sizeof(KEY_BITS) / sizeof(KEY_BITS[0]))
+#define NUM_KEY_COUNTS (sizeof(KEY_COUNTS) / sizeof(KEY_COUNTS[0]))
+
+// Sizes are picked around the key length, where the padding rules differ,
+// plus a couple big enough to time
+#define NUM_SIZES 7
+
+// The largest name, key size, count, size and seed that a line may have
+#define MAX_LINE 256
+
+/**
+ * @struct vector_t
+ * @brief A single test vector. The keys and plain text are generated from
+ * the seed, so every implementation works on the same input.
+ */
+typedef struct
+{
+    char name[64];
+    size_t key_bits;
+    int num_keys;
+    size_t size;
+    uint64_t seed;
+} vector_t;
+
+/**
+ * @brief Get the next value from the splitmix64 generator. The Java and
+ * Swift harnesses use the same generator, so any change must be made in all
+ * three.
+ * @param[in,out] state The state of the generator
+ * @return The next value
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Generate the keys and plain text of a vector
+ * @param[in] vec The vector to generate
+ * @param[out] plain_text The plain text, whose last byte is never padding
+ * @return The keys, NULL if allocating them failed
+ */
+static char **make_inputs(const vector_t *vec, unsigned char **plain_text)
+{
+    static const char HEX[] = "0123456789abcdef";
+    uint64_t state = vec->seed;
+    size_t key_len = vec->key_bits / 4;
+
+    char **keys = calloc(vec->num_keys, sizeof(char *));
+    *plain_text = malloc(vec->size);
+    if (keys == NULL || *plain_text == NULL)
+    {
+        free(keys);
+        free(*plain_text);
+        *plain_text = NULL;
+        return NULL;
+    }
+
+    for (int k = 0; k < vec->num_keys; k++)
+    {
+        keys[k] = malloc(key_len + 1);
+        if (keys[k] == NULL)
+        {
+            for (int x = 0; x < k; x++)
+                free(keys[x]);
+            free(keys);
+            free(*plain_text);
+            *plain_text = NULL;
+            return NULL;
+        }
+        for (size_t c = 0; c < key_len; c++)
+            keys[k][c] = HEX[next_random(&state) & 0xF];
+        keys[k][key_len] = '\0';
+    }
+
+    for (size_t x = 0; x < vec->size; x++)
+        (*plain_text)[x] = (unsigned char) next_random(&state);
+    if ((*plain_text)[vec->size - 1] == 0)
+        (*plain_text)[vec->size - 1] = 1;
+    return keys;
+}
+
+/**
+ * @brief Hash the cipher text
+ * @param[in] data The cipher text
+ * @param[in] size The size of the cipher text
+ * @param[out] digest The SHA-256 of the cipher text, in hex
+ */
+static void hash_cipher_text(const unsigned char *data, size_t size,
+                             char digest[(SHA256_DIGEST_LENGTH * 2) + 1])
+{
+    unsigned char md[SHA256_DIGEST_LENGTH];
+    SHA256(data, size, md);
+    for (int x = 0; x < SHA256_DIGEST_LENGTH; x++)
+        sprintf(&digest[x * 2], "%02x", md[x]);
+}
+
+/**
+ * @brief Compare function for sorting the samples
+ */
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Time encrypt() or decrypt()
+ * @param[in] encrypting If encrypt() should be timed, otherwise decrypt()
+ * @param[in] input The input to time it on
+ * @param[in] input_len The size of the input
+ * @param[in] keys The keys
+ * @param[in] num_keys The number of keys
+ * @param[in] reps The number of samples, the median is returned
+ * @return The median time of a single call, in nanoseconds
+ */
+static uint64_t time_crypt(int encrypting, unsigned char *input,
+                           size_t input_len, const char **keys, int num_keys,
+                           int reps)
+{
+    uint64_t iters = 0, ns[reps];
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t start = get_time_ns(), elapsed = 0, runs = 0;
+        do
+        {
+            unsigned char *output = NULL;
+            if (encrypting)
+                encrypt(input, input_len, &output, keys, num_keys);
+            else
+                decrypt(input, input_len, &output, keys, num_keys);
+            free(output);
+            runs++;
+            elapsed = get_time_ns() - start;
+        } while ((iters == 0 && elapsed < MIN_SAMPLE_NS) || runs < iters);
+        // The first sample works out how many runs make up a sample
+        if (iters == 0)
+            iters = runs;
+        ns[r] = elapsed / runs;
+    }
+    qsort(ns, reps, sizeof(uint64_t), compare_u64);
+    return ns[reps / 2];
+}
+
+/**
+ * @brief Encrypt a vector, check it decrypts back to the plain text, and
+ * optionally time it
+ * @param[in] vec The vector
+ * @param[in] reps The number of samples to time, 0 to not time it
+ * @param[out] digest The SHA-256 of the cipher text, in hex
+ * @param[out] enc_ns The median time to encrypt, in nanoseconds
+ * @param[out] dec_ns The median time to decrypt, in nanoseconds
+ * @return 1 if it decrypted back to the plain text, 0 if it didn't, and -1
+ * if it couldn't be run
+ */
+static int run_vector(const vector_t *vec, int reps,
+                      char digest[(SHA256_DIGEST_LENGTH * 2) + 1],
+                      uint64_t *enc_ns, uint64_t *dec_ns)
+{
+    unsigned char *plain_text = NULL;
+    char **keys = make_inputs(vec, &plain_text);
+    if (keys == NULL)
+        return -1;
+
+    unsigned char *cipher_text = NULL, *decrypted = NULL;
+    size_t cipher_text_len = encrypt(plain_text, vec->size, &cipher_text,
+                                     (const char **) keys, vec->num_keys);
+    if (cipher_text == NULL)
+    {
+        free(plain_text);
+        free_keys(keys, vec->num_keys, NULL);
+        return -1;
+    }
+    hash_cipher_text(cipher_text, cipher_text_len, digest);
+
+    size_t decrypted_len = decrypt(cipher_text, cipher_text_len, &decrypted,
+                                   (const char **) keys, vec->num_keys);
+    int round_trip = decrypted != NULL && decrypted_len == vec->size &&
+                     memcmp(decrypted, plain_text, vec->size) == 0;
+    free(decrypted);
+
+    *enc_ns = *dec_ns = 0;
+    if (reps > 0)
+    {
+        *enc_ns = time_crypt(1, plain_text, vec->size, (const char **) keys,
+                             vec->num_keys, reps);
+        *dec_ns = time_crypt(0, cipher_text, cipher_text_len,
+                             (const char **) keys, vec->num_keys, reps);
+    }
+
+    free(cipher_text);
+    free(plain_text);
+    free_keys(keys, vec->num_keys, NULL);
+    return round_trip;
+}
+
+/**
+ * @brief Write the built in set of vectors, and the digests of their cipher
+ * text from this implementation, which the others are checked against
+ * @param[in] filename The file to write the vectors to
+ * @return 0 on success, 1 on failure
+ */
+static int generate_vectors(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        perror(filename);
+        return 1;
+    }
+    fprintf(file, "# EEA cross-implementation test vectors, generated by "
+                  "eea_compat --generate\n");
+    fprintf(file, "# name key_bits num_keys size seed "
+                  "sha256_of_base64_cipher_text\n");
+
+    uint64_t seed = 1;
+    for (size_t b = 0; b < NUM_KEY_BITS; b++)
+    {
+        size_t key_len = KEY_BITS[b] / 4;
+        const size_t sizes[NUM_SIZES] = { 1,
+                                          key_len - 1,
+                                          key_len,
+                                          key_len * 2,
+                                          key_len * 3 + 5,
+                                          (size_t) 64 << 10,
+                                          ((size_t) 1 << 20) + 3 };
+        for (size_t c = 0; c < NUM_KEY_COUNTS; c++)
+        {
+            for (int s = 0; s < NUM_SIZES; s++)
+            {
+                vector_t vec = { "", KEY_BITS[b], KEY_COUNTS[c], sizes[s],
+                                 seed++ };
+                snprintf(vec.name, sizeof(vec.name), "b%zu-k%d-s%zu",
+                         vec.key_bits, vec.num_keys, vec.size);
+
+                char digest[(SHA256_DIGEST_LENGTH * 2) + 1];
+                uint64_t enc_ns, dec_ns;
+                if (run_vector(&vec, 0, digest, &enc_ns, &dec_ns) != 1)
+                {
+                    fprintf(stderr, "%s did not round trip\n", vec.name);
+                    fclose(file);
+                    return 1;
+                }
+                fprintf(file, "%s %zu %d %zu %" PRIu64 " %s\n", vec.name,
+                        vec.key_bits, vec.num_keys, vec.size, vec.seed,
+                        digest);
+            }
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief Run every vector in the file, printing a line per vector of
+ * "name digest round_trip enc_ns dec_ns", the format the Java and Swift
+ * harnesses print as well
+ * @param[in] filename The file of vectors
+ * @param[in] reps The number of samples to time each vector with
+ * @return 0 if every vector ran, 1 otherwise
+ */
+static int run_vectors(const char *filename, int reps)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        perror(filename);
+        return 1;
+    }
+
+    int ret = 0;
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        vector_t vec;
+        if (sscanf(line, "%63s %zu %d %zu %" SCNu64, vec.name, &vec.key_bits,
+                   &vec.num_keys, &vec.size, &vec.seed) != 5 ||
+            vec.key_bits < 4 || vec.num_keys < 1 || vec.size < 1)
+        {
+            fprintf(stderr, "Invalid vector: %s", line);
+            ret = 1;
+            continue;
+        }
+
+        char digest[(SHA256_DIGEST_LENGTH * 2) + 1];
+        uint64_t enc_ns, dec_ns;
+        int round_trip = run_vector(&vec, reps, digest, &enc_ns, &dec_ns);
+        if (round_trip < 0)
+        {
+            fprintf(stderr, "Unable to run %s: out of memory\n", vec.name);
+            ret = 1;
+            continue;
+        }
+        printf("%s %s %d %" PRIu64 " %" PRIu64 "\n", vec.name, digest,
+               round_trip, enc_ns, dec_ns);
+        fflush(stdout);
+    }
+    fclose(file);
+    return ret;
+}
+
+/**
+ * @brief Print how to use the harness
+ * @param[in] name The name of the executable
+ */
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s --generate <vectors file>\n"
+            "       %s [--reps <n>] <vectors file>\n"
+            "  --generate  Write the test vectors, with the digests of "
+            "this implementation's cipher text\n"
+            "  --reps <n>  Samples per vector, the median is reported, 0 "
+            "to skip timing (default: %d)\n",
+            name, name, DEFAULT_REPS);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = NULL;
+    int generate = 0, reps = DEFAULT_REPS;
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--generate") == 0)
+            generate = 1;
+        else if (strcmp(argv[a], "--reps") == 0 && a + 1 < argc)
+            reps = atoi(argv[++a]);
+        else if (argv[a][0] != '-' && filename == NULL)
+            filename = argv[a];
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (filename == NULL || reps < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    return generate ? generate_vectors(filename)
+                    : run_vectors(filename, reps);
+}
@@ -0,0 +1,328 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "daemon_client.h"
+#include "eea.h"
+#include "histogram.h"
+#include "utils.h"
+
+static const int DEFAULT_CLIENTS = 4;
+static const int DEFAULT_REQUESTS = 10000;
+static const size_t DEFAULT_SIZE = 1024;
+
+/**
+ * @struct daemon_bench_options_t
+ * @brief Options from the command line
+ */
+typedef struct
+{
+    const char *socket_path;
+    const char *keyset;
+    int clients;
+    int requests;
+    size_t size;
+    int json;
+} daemon_bench_options_t;
+
+/**
+ * @struct client_t
+ * @brief A client thread, with its own connection to the daemon
+ */
+typedef struct
+{
+    const daemon_bench_options_t *opts;
+    pthread_t thread;
+    histogram_t *encrypt_hist;
+    histogram_t *decrypt_hist;
+    int ret;
+} client_t;
+
+/**
+ * @brief Fill a message with text that won't be changed by removing the
+ * padding during decryption
+ * @param[in] size The size of the message
+ * @param[in] seed Makes each client's message different
+ * @return The message, NULL if allocating it failed
+ */
+static unsigned char *make_message(size_t size, uint64_t seed)
+{
+    unsigned char *data = malloc(size);
+    if (data == NULL)
+        return NULL;
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ seed;
+    for (size_t x = 0; x < size; x++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        data[x] = (unsigned char) (' ' + state % 95);
+    }
+    return data;
+}
+
+/**
+ * @brief Send a request, connecting again and retrying while the daemon is
+ * too busy to take it
+ * @param[in] opts The options from the command line
+ * @param[in,out] fd The connection, replaced when the daemon closes it
+ * @param[in] op One of DaemonOps
+ * @param[in] data The data for the request
+ * @param[in] data_len The size of the data
+ * @param[out] out Set to the result
+ * @param[out] out_len Set to the size of the result
+ * @return EEA_OK, or one of EeaErrors
+ */
+static int request_retrying(const daemon_bench_options_t *opts, int *fd,
+                            int op, const unsigned char *data,
+                            size_t data_len, unsigned char **out,
+                            size_t *out_len)
+{
+    int ret;
+    while ((ret = daemon_request(*fd, op, opts->keyset, data, data_len, out,
+                                 out_len))
+           == EEA_ERR_BUSY)
+    {
+        eea_daemon_close(*fd);
+        *fd = -1;
+        usleep(1000);
+        ret = eea_daemon_connect(opts->socket_path, fd);
+        if (ret != EEA_OK)
+            break;
+    }
+    return ret;
+}
+
+/**
+ * @brief Send encrypt then decrypt requests for a message, checking each
+ * round trip gives back the message
+ * @param[in] arg The client_t of the thread
+ * @return NULL
+ */
+static void *run_client(void *arg)
+{
+    client_t *client = arg;
+    const daemon_bench_options_t *opts = client->opts;
+    client->ret = 1;
+
+    unsigned char *message = make_message(opts->size,
+                                          (uint64_t) (uintptr_t) client);
+    int fd = -1;
+    int ret = (message == NULL) ? EEA_ERR_NO_MEMORY
+                                : eea_daemon_connect(opts->socket_path, &fd);
+    if (ret != EEA_OK)
+    {
+        fprintf(stderr, "Failed to connect to the daemon: %s\n",
+                eea_strerror(ret));
+        free(message);
+        return NULL;
+    }
+
+    for (int r = 0; r < opts->requests && ret == EEA_OK; r++)
+    {
+        unsigned char *cipher_text = NULL;
+        size_t cipher_text_len = 0;
+        uint64_t start = get_time_ns();
+        ret = request_retrying(opts, &fd, DAEMON_OP_ENCRYPT, message,
+                               opts->size, &cipher_text, &cipher_text_len);
+        uint64_t elapsed = get_time_ns() - start;
+        if (ret != EEA_OK)
+            break;
+        histogram_record(client->encrypt_hist, elapsed);
+
+        unsigned char *plain_text = NULL;
+        size_t plain_text_len = 0;
+        start = get_time_ns();
+        ret = request_retrying(opts, &fd, DAEMON_OP_DECRYPT, cipher_text,
+                               cipher_text_len, &plain_text,
+                               &plain_text_len);
+        elapsed = get_time_ns() - start;
+        free(cipher_text);
+        if (ret != EEA_OK)
+            break;
+        histogram_record(client->decrypt_hist, elapsed);
+
+        if (plain_text_len != opts->size
+            || memcmp(plain_text, message, opts->size) != 0)
+        {
+            fprintf(stderr, "Decrypting did not give back the message\n");
+            ret = EEA_ERR_INVALID_DATA;
+        }
+        free(plain_text);
+    }
+    if (ret != EEA_OK)
+        fprintf(stderr, "Request failed: %s\n", eea_strerror(ret));
+    else
+        client->ret = 0;
+
+    eea_daemon_close(fd);
+    free(message);
+    return NULL;
+}
+
+/**
+ * @brief Add the values recorded in one histogram to another
+ * @param[in,out] into The histogram to add to
+ * @param[in] from The histogram to add
+ */
+static void merge_histogram(histogram_t *into, const histogram_t *from)
+{
+    if (from->total == 0)
+        return;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+        into->counts[b] += from->counts[b];
+    if (into->total == 0 || from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+    into->total += from->total;
+    into->sum += from->sum;
+}
+
+/**
+ * @brief Print the throughput and latency percentiles of one operation
+ * @param[in] op The operation, encrypt or decrypt
+ * @param[in] hist The latencies of the requests, in nanoseconds
+ * @param[in] seconds How long all the clients took
+ * @param[in] opts The options from the command line
+ */
+static void print_result(const char *op, const histogram_t *hist,
+                         double seconds, const daemon_bench_options_t *opts)
+{
+    double per_second = hist->total / seconds;
+    uint64_t p50 = histogram_percentile(hist, 50);
+    uint64_t p99 = histogram_percentile(hist, 99);
+    uint64_t p999 = histogram_percentile(hist, 99.9);
+    if (opts->json)
+        printf("{\"op\":\"%s\",\"clients\":%d,\"bytes\":%zu,"
+               "\"requests\":%" PRIu64 ",\"requests_per_s\":%.0f,"
+               "\"mean_ns\":%.0f,\"p50_ns\":%" PRIu64 ",\"p99_ns\":%" PRIu64
+               ",\"p999_ns\":%" PRIu64 ",\"max_ns\":%" PRIu64 "}\n",
+               op, opts->clients, opts->size, hist->total, per_second,
+               histogram_mean(hist), p50, p99, p999, hist->max);
+    else
+        printf("%-8s %10" PRIu64 " %12.0f %10.2f %10.2f %10.2f %10.2f "
+               "%10.2f\n",
+               op, hist->total, per_second, histogram_mean(hist) / 1e3,
+               p50 / 1e3, p99 / 1e3, p999 / 1e3, hist->max / 1e3);
+}
+
+/**
+ * @brief Print how to use the benchmark
+ * @param[in] name The name of the executable
+ */
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s --keyset <name> [options]\n"
+            "  --keyset <name>   Keyset the daemon serves to use\n"
+            "  --socket <path>   Daemon's socket (default: its default)\n"
+            "  --clients <n>     Clients sending requests at once "
+            "(default: %d)\n"
+            "  --requests <n>    Encrypt and decrypt requests per client "
+            "(default: %d)\n"
+            "  --size <n>        Size of each message (default: %zu)\n"
+            "  --json            Print a JSON object per result\n",
+            name, DEFAULT_CLIENTS, DEFAULT_REQUESTS, DEFAULT_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    daemon_bench_options_t opts = { NULL, NULL, DEFAULT_CLIENTS,
+                                    DEFAULT_REQUESTS, DEFAULT_SIZE, 0 };
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--keyset") == 0 && a + 1 < argc)
+            opts.keyset = argv[++a];
+        else if (strcmp(argv[a], "--socket") == 0 && a + 1 < argc)
+            opts.socket_path = argv[++a];
+        else if (strcmp(argv[a], "--clients") == 0 && a + 1 < argc)
+            opts.clients = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--requests") == 0 && a + 1 < argc)
+            opts.requests = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--size") == 0 && a + 1 < argc)
+            opts.size = strtoul(argv[++a], NULL, 10);
+        else if (strcmp(argv[a], "--json") == 0)
+            opts.json = 1;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opts.keyset == NULL || opts.clients < 1 || opts.requests < 1
+        || opts.size < 1 || opts.size > DAEMON_MAX_DATA / 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    client_t *clients = calloc(opts.clients, sizeof(client_t));
+    histogram_t *encrypt_hist = histogram_create();
+    histogram_t *decrypt_hist = histogram_create();
+    int ret = (clients == NULL || encrypt_hist == NULL
+               || decrypt_hist == NULL);
+    for (int c = 0; c < opts.clients && !ret; c++)
+    {
+        clients[c].opts = &opts;
+        clients[c].encrypt_hist = histogram_create();
+        clients[c].decrypt_hist = histogram_create();
+        ret = (clients[c].encrypt_hist == NULL
+               || clients[c].decrypt_hist == NULL);
+    }
+    if (ret)
+        fprintf(stderr, "Out of memory\n");
+
+    int started = 0;
+    uint64_t start = get_time_ns();
+    for (; started < opts.clients && !ret; started++)
+    {
+        if (pthread_create(&clients[started].thread, NULL, run_client,
+                           &clients[started]) != 0)
+        {
+            fprintf(stderr, "Failed to start a client thread\n");
+            ret = 1;
+            break;
+        }
+    }
+    for (int c = 0; c < started; c++)
+    {
+        pthread_join(clients[c].thread, NULL);
+        ret |= clients[c].ret;
+    }
+    double seconds = (get_time_ns() - start) / 1e9;
+
+    if (!ret)
+    {
+        for (int c = 0; c < opts.clients; c++)
+        {
+            merge_histogram(encrypt_hist, clients[c].encrypt_hist);
+            merge_histogram(decrypt_hist, clients[c].decrypt_hist);
+        }
+        if (!opts.json)
+        {
+            printf("%d clients, %zu-byte messages, latency per request in "
+                   "microseconds\n",
+                   opts.clients, opts.size);
+            printf("%-8s %10s %12s %10s %10s %10s %10s %10s\n", "op",
+                   "requests", "requests/s", "mean", "p50", "p99", "p99.9",
+                   "max");
+        }
+        print_result("encrypt", encrypt_hist, seconds, &opts);
+        print_result("decrypt", decrypt_hist, seconds, &opts);
+    }
+
+    for (int c = 0; clients != NULL && c < opts.clients; c++)
+    {
+        histogram_free(clients[c].encrypt_hist);
+        histogram_free(clients[c].decrypt_hist);
+    }
+    free(clients);
+    histogram_free(encrypt_hist);
+    histogram_free(decrypt_hist);
+    return ret;
+}
@@ -0,0 +1,548 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "file_handling.h"
+#include "globals.h"
+#include "keygen.h"
+#include "progress.h"
+#include "thread_functions.h"
+#include "utils.h"
+
+static const size_t KB = 1024;
+static const size_t MB = 1024 * 1024;
+
+/**
+ * @enum TreeProfiles
+ * @brief The kinds of synthetic trees that can be generated
+ */
+typedef enum
+{
+    // Lots of files from 256 B to 8 KB
+    PROFILE_SMALL = 0,
+    // File sizes with a log-normal distribution, median 16 KB
+    PROFILE_LOGNORMAL = 1,
+    // A few files of 64 MB
+    PROFILE_HUGE = 2
+} TreeProfiles;
+
+static const char *PROFILE_NAMES[] = { "small", "lognormal", "huge" };
+static const int PROFILE_DEFAULT_FILES[] = { 10000, 2000, 4 };
+#define NUM_PROFILES (sizeof(PROFILE_NAMES) / sizeof(PROFILE_NAMES[0]))
+
+/**
+ * @struct dir_bench_options_t
+ * @brief Options from the command line
+ */
+typedef struct
+{
+    const char *dir;
+    int profile;
+    int files;
+    int depth;
+    int fanout;
+    uint64_t seed;
+    int threads[16];
+    int num_threads;
+    int keep;
+    int json;
+} dir_bench_options_t;
+
+/**
+ * @struct tree_t
+ * @brief A generated tree
+ */
+typedef struct
+{
+    char **dirs;
+    size_t num_dirs;
+    char **files;
+    size_t num_files;
+    uint64_t total_bytes;
+} tree_t;
+
+/**
+ * @struct run_result_t
+ * @brief The results of running a job on the tree
+ */
+typedef struct
+{
+    double seconds;
+    // Peak resident set size in KB
+    long peak_rss_kb;
+    int exit_status;
+} run_result_t;
+
+/**
+ * @brief Get the next random number, so the same seed always generates the
+ * same tree
+ * @param[in,out] state The state of the generator
+ * @return The next random number
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    // splitmix64
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Get a random number between 0 and 1
+ * @param[in,out] state The state of the generator
+ * @return The random number
+ */
+static double next_uniform(uint64_t *state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Pick the size of the next file for the profile
+ * @param[in] profile The profile, one of TreeProfiles
+ * @param[in,out] state The state of the generator
+ * @return The size of the file
+ */
+static size_t next_file_size(int profile, uint64_t *state)
+{
+    switch (profile)
+    {
+        case PROFILE_SMALL:
+            return 256 + next_random(state) % (8 * KB - 256);
+        case PROFILE_LOGNORMAL:
+        {
+            // Box-Muller for a normal sample
+            double u1 = next_uniform(state), u2 = next_uniform(state);
+            double n = sqrt(-2.0 * log(u1 + 1e-300)) * cos(2 * M_PI * u2);
+            double size = exp(log(16.0 * KB) + 1.5 * n);
+            if (size < 1)
+                size = 1;
+            if (size > 64.0 * MB)
+                size = 64.0 * MB;
+            return (size_t) size;
+        }
+        case PROFILE_HUGE:
+        default:
+            return 64 * MB;
+    }
+}
+
+/**
+ * @brief Add a string to a list
+ * @param[in,out] list The list
+ * @param[in,out] num The number of strings in the list
+ * @param[in] str The string to add, which the list takes ownership of
+ * @return If the string was added
+ */
+static int list_add(char ***list, size_t *num, char *str)
+{
+    char **tmp = realloc(*list, sizeof(char *) * (*num + 1));
+    if (tmp == NULL)
+        return 0;
+    *list = tmp;
+    (*list)[(*num)++] = str;
+    return 1;
+}
+
+/**
+ * @brief Write a file of random data
+ * @param[in] path The file to write
+ * @param[in] size The size of the file
+ * @param[in,out] state The state of the generator
+ * @return If the file was written
+ */
+static int write_random_file(const char *path, size_t size, uint64_t *state)
+{
+    FILE *fout = fopen(path, "wb");
+    if (fout == NULL)
+        return 0;
+
+    uint64_t buffer[8192];
+    size_t written = 0;
+    while (written < size)
+    {
+        for (size_t w = 0; w < sizeof(buffer) / sizeof(buffer[0]); w++)
+            buffer[w] = next_random(state);
+        size_t chunk = size - written < sizeof(buffer) ? size - written
+                                                       : sizeof(buffer);
+        // Decrypting strips trailing zeros, so don't end the file with one
+        if (written + chunk == size)
+            ((unsigned char *) buffer)[chunk - 1] |= 1;
+        fwrite(buffer, 1, chunk, fout);
+        written += chunk;
+    }
+    return fclose(fout) == 0;
+}
+
+/**
+ * @brief Make a directory, and any parents it needs
+ * @param[in] path The directory to make
+ * @return If the directory was made
+ */
+static int make_dir(const char *path)
+{
+    // mkdir_path() only makes the parts of the path followed by a slash
+    size_t len = strlen(path) + 2;
+    char dir[len];
+    snprintf(dir, len, "%s/", path);
+    return mkdir_path(dir);
+}
+
+/**
+ * @brief Generate the synthetic tree
+ * @param[in] opts The options from the command line
+ * @param[out] tree The tree that was generated
+ * @return If the tree was generated
+ */
+static int generate_tree(const dir_bench_options_t *opts, tree_t *tree)
+{
+    memset(tree, 0, sizeof(tree_t));
+    uint64_t state = opts->seed;
+
+    if (!make_dir(opts->dir)
+        || !list_add(&tree->dirs, &tree->num_dirs, strdup(opts->dir)))
+        return 0;
+
+    // Every directory down to the given depth gets `fanout` children
+    size_t level_start = 0;
+    for (int d = 0; d < opts->depth; d++)
+    {
+        size_t level_end = tree->num_dirs;
+        for (size_t p = level_start; p < level_end; p++)
+        {
+            for (int f = 0; f < opts->fanout; f++)
+            {
+                size_t len = strlen(tree->dirs[p]) + 16;
+                char *dir = malloc(len);
+                if (dir == NULL)
+                    return 0;
+                snprintf(dir, len, "%s/d%d", tree->dirs[p], f);
+                if (!make_dir(dir)
+                    || !list_add(&tree->dirs, &tree->num_dirs, dir))
+                    return 0;
+            }
+        }
+        level_start = level_end;
+    }
+
+    for (int f = 0; f < opts->files; f++)
+    {
+        const char *dir = tree->dirs[next_random(&state) % tree->num_dirs];
+        size_t len = strlen(dir) + 24;
+        char *path = malloc(len);
+        if (path == NULL)
+            return 0;
+        snprintf(path, len, "%s/f%d.bin", dir, f);
+
+        size_t size = next_file_size(opts->profile, &state);
+        if (!write_random_file(path, size, &state)
+            || !list_add(&tree->files, &tree->num_files, path))
+        {
+            fprintf(stderr, "Failed to write \'%s\'\n", path);
+            free(path);
+            return 0;
+        }
+        tree->total_bytes += size;
+    }
+    return 1;
+}
+
+/**
+ * @brief Remove the encrypted copies of the files
+ * @param[in] tree The tree
+ */
+static void remove_outputs(const tree_t *tree)
+{
+    for (size_t f = 0; f < tree->num_files; f++)
+    {
+        char *output = get_output_filename(tree->files[f], 1);
+        if (output != NULL)
+            remove(output);
+        free(output);
+    }
+}
+
+/**
+ * @brief Remove the tree from disk and free it
+ * @param[in] tree The tree
+ * @param[in] keep Leave the files on disk
+ */
+static void free_tree(tree_t *tree, int keep)
+{
+    if (!keep)
+        remove_outputs(tree);
+    for (size_t f = 0; f < tree->num_files; f++)
+    {
+        if (!keep)
+            remove(tree->files[f]);
+        free(tree->files[f]);
+    }
+    // Children were added after their parents, so remove them first
+    for (size_t d = tree->num_dirs; d > 0; d--)
+    {
+        if (!keep)
+            rmdir(tree->dirs[d - 1]);
+        free(tree->dirs[d - 1]);
+    }
+    free(tree->files);
+    free(tree->dirs);
+}
+
+/**
+ * @brief Encrypt or decrypt the tree in a child process, so its peak
+ * memory use can be measured on its own
+ * @param[in] dir The root of the tree
+ * @param[in] keys The keys to use
+ * @param[in] num_keys The number of keys
+ * @param[in] threads The number of threads to use
+ * @param[in] encrypting Are we encrypting the tree
+ * @return The results of the run
+ */
+static run_result_t run_job(const char *dir, const char **keys, int num_keys,
+                            int threads, int encrypting)
+{
+    run_result_t result = { 0, 0, -1 };
+    fflush(stdout);
+
+    uint64_t start = get_time_ns();
+    pid_t pid = fork();
+    if (pid < 0)
+        return result;
+    if (pid == 0)
+    {
+        if (encrypting)
+            start_dir_encrypt_threads(dir, keys, num_keys, 0, threads, 0);
+        else
+            start_dir_decrypt_threads(dir, keys, num_keys, 0, threads, 0);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0)
+        return result;
+    result.seconds = (get_time_ns() - start) / 1e9;
+    result.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    // ru_maxrss is in KB on Linux, but bytes on macOS
+#ifdef __APPLE__
+    result.peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+    result.peak_rss_kb = usage.ru_maxrss;
+#endif
+    return result;
+}
+
+/**
+ * @brief Print the results of a run
+ * @param[in] opts The options from the command line
+ * @param[in] tree The tree
+ * @param[in] phase "encrypt" or "decrypt"
+ * @param[in] threads The number of threads used
+ * @param[in] result The results of the run
+ * @param[in] base_rate The files/s with the fewest threads, to work out the
+ * scaling efficiency against
+ * @param[in] base_threads The fewest number of threads
+ */
+static void print_result(const dir_bench_options_t *opts, const tree_t *tree,
+                         const char *phase, int threads,
+                         const run_result_t *result, double base_rate,
+                         int base_threads)
+{
+    double files_per_s = result->seconds > 0
+                             ? tree->num_files / result->seconds
+                             : 0;
+    double mb_per_s = result->seconds > 0
+                          ? tree->total_bytes / (double) MB / result->seconds
+                          : 0;
+    // How close adding threads came to scaling the throughput linearly
+    double efficiency = base_rate > 0 ? (files_per_s / base_rate)
+                                            / ((double) threads / base_threads)
+                                      : 0;
+
+    if (opts->json)
+        printf("{\"profile\":\"%s\",\"phase\":\"%s\",\"threads\":%d,"
+               "\"files\":%zu,\"bytes\":%llu,\"seconds\":%.4f,"
+               "\"files_per_s\":%.1f,\"mb_per_s\":%.2f,\"efficiency\":%.3f,"
+               "\"peak_rss_kb\":%ld,\"ok\":%s}\n",
+               PROFILE_NAMES[opts->profile], phase, threads, tree->num_files,
+               (unsigned long long) tree->total_bytes, result->seconds,
+               files_per_s, mb_per_s, efficiency, result->peak_rss_kb,
+               result->exit_status == 0 ? "true" : "false");
+    else
+        printf("%-8s %7d %8zu %10.1f %9.3f %10.1f %9.2f %10.1f%% %9.1f\n",
+               phase, threads, tree->num_files, tree->total_bytes / (double) MB,
+               result->seconds, files_per_s, mb_per_s, 100 * efficiency,
+               result->peak_rss_kb / 1024.0);
+    fflush(stdout);
+}
+
+/**
+ * @brief Parse a comma separated list of thread counts
+ * @param[in] str The list
+ * @param[out] opts The options to store the thread counts in
+ * @return If the list was valid
+ */
+static int parse_threads(const char *str, dir_bench_options_t *opts)
+{
+    opts->num_threads = 0;
+    const char *p = str;
+    while (*p && opts->num_threads < 16)
+    {
+        char *end = NULL;
+        long t = strtol(p, &end, 10);
+        if (end == p || t < 1)
+            return 0;
+        opts->threads[opts->num_threads++] = (int) t;
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return opts->num_threads > 0;
+}
+
+/**
+ * @brief Print how to use the benchmark
+ * @param[in] name The name of the executable
+ */
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --dir <dir>          Where to generate the tree "
+            "(default: eea_dir_bench)\n"
+            "  --profile <name>     small, lognormal or huge "
+            "(default: small)\n"
+            "  --files <n>          Number of files (default depends on the "
+            "profile)\n"
+            "  --depth <n>          Depth of the tree (default: 2)\n"
+            "  --fanout <n>         Sub-directories per directory "
+            "(default: 4)\n"
+            "  --seed <n>           Seed for generating the tree "
+            "(default: 1)\n"
+            "  --threads <a,b,...>  Thread counts to run with "
+            "(default: 1,2,4,8)\n"
+            "  --keep               Leave the tree on disk afterwards\n"
+            "  --json               Print a JSON object per result\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    dir_bench_options_t opts = { "eea_dir_bench", PROFILE_SMALL, -1, 2, 4, 1,
+                                 { 1, 2, 4, 8 }, 4, 0, 0 };
+    for (int a = 1; a < argc; a++)
+    {
+        int has_value = a + 1 < argc;
+        if (strcmp(argv[a], "--dir") == 0 && has_value)
+            opts.dir = argv[++a];
+        else if (strcmp(argv[a], "--profile") == 0 && has_value)
+        {
+            opts.profile = -1;
+            a++;
+            for (size_t p = 0; p < NUM_PROFILES; p++)
+                if (strcmp(argv[a], PROFILE_NAMES[p]) == 0)
+                    opts.profile = p;
+            if (opts.profile < 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[a], "--files") == 0 && has_value)
+            opts.files = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--depth") == 0 && has_value)
+            opts.depth = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--fanout") == 0 && has_value)
+            opts.fanout = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--seed") == 0 && has_value)
+            opts.seed = strtoull(argv[++a], NULL, 10);
+        else if (strcmp(argv[a], "--threads") == 0 && has_value)
+        {
+            if (!parse_threads(argv[++a], &opts))
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[a], "--keep") == 0)
+            opts.keep = 1;
+        else if (strcmp(argv[a], "--json") == 0)
+            opts.json = 1;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opts.files < 0)
+        opts.files = PROFILE_DEFAULT_FILES[opts.profile];
+    if (opts.files < 1 || opts.depth < 0 || opts.fanout < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (file_exists(opts.dir))
+    {
+        fprintf(stderr, "\'%s\' already exists, remove it or pick another "
+                        "--dir\n",
+                opts.dir);
+        return 1;
+    }
+
+    tree_t tree;
+    if (!generate_tree(&opts, &tree))
+    {
+        fprintf(stderr, "Failed to generate the tree in \'%s\'\n", opts.dir);
+        free_tree(&tree, opts.keep);
+        return 1;
+    }
+
+    // Only the summary is wanted from the jobs
+    output_mode = OUTPUT_QUIET;
+    int num_keys = 3;
+    char **keys = generate_keys(512, num_keys);
+    if (keys == NULL)
+    {
+        free_tree(&tree, opts.keep);
+        return 1;
+    }
+
+    if (!opts.json)
+    {
+        printf("Profile %s: %zu files, %.1f MB, %zu directories, seed %llu\n",
+               PROFILE_NAMES[opts.profile], tree.num_files,
+               tree.total_bytes / (double) MB, tree.num_dirs,
+               (unsigned long long) opts.seed);
+        printf("%-8s %7s %8s %10s %9s %10s %9s %11s %9s\n", "phase",
+               "threads", "files", "MB", "seconds", "files/s", "MB/s",
+               "efficiency", "peak MB");
+    }
+
+    double base_rate[2] = { 0, 0 };
+    for (int t = 0; t < opts.num_threads; t++)
+    {
+        int threads = opts.threads[t];
+        for (int encrypting = 1; encrypting >= 0; encrypting--)
+        {
+            run_result_t result = run_job(opts.dir, (const char **) keys,
+                                          num_keys, threads, encrypting);
+            if (t == 0 && result.seconds > 0)
+                base_rate[encrypting] = tree.num_files / result.seconds;
+            print_result(&opts, &tree, encrypting ? "encrypt" : "decrypt",
+                         threads, &result, base_rate[encrypting],
+                         opts.threads[0]);
+        }
+        // Start the next run from just the plain text again
+        remove_outputs(&tree);
+    }
+
+    free_keys(keys, num_keys, NULL);
+    free_tree(&tree, opts.keep);
+    return 0;
+}
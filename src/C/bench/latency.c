@@ -0,0 +1,343 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "decrypt.h"
+#include "eea.h"
+#include "encrypt.h"
+#include "histogram.h"
+#include "keygen.h"
+#include "utils.h"
+
+static const size_t MESSAGE_SIZES[] = {
+    16, 64, 256, (size_t) 1 << 10, (size_t) 4 << 10, (size_t) 16 << 10,
+    (size_t) 64 << 10
+};
+#define NUM_MESSAGE_SIZES (sizeof(MESSAGE_SIZES) / sizeof(MESSAGE_SIZES[0]))
+
+static const int DEFAULT_CALLS = 10000;
+static const int DEFAULT_BATCH = 64;
+// Calls made before recording, to warm up the caches and allocator
+static const int WARMUP_CALLS = 1000;
+
+/**
+ * @struct latency_options_t
+ * @brief Options from the command line
+ */
+typedef struct
+{
+    size_t key_bits;
+    int num_keys;
+    int calls;
+    int batch;
+    int json;
+} latency_options_t;
+
+/**
+ * @brief Fill a message with text that won't be changed by removing the
+ * padding during decryption
+ * @param[in] size The size of the message
+ * @return The message, NULL if allocating it failed
+ */
+static unsigned char *make_message(size_t size)
+{
+    unsigned char *data = malloc(size);
+    if (data == NULL)
+        return NULL;
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t x = 0; x < size; x++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        // Printable, like the text the text mode is used for
+        data[x] = (unsigned char) (' ' + state % 95);
+    }
+    return data;
+}
+
+/**
+ * @brief Find the overhead of reading the clock, which is included in
+ * every call timed
+ * @return The smallest time between two reads of the clock, in nanoseconds
+ */
+static uint64_t timer_overhead(void)
+{
+    uint64_t min = UINT64_MAX;
+    for (int x = 0; x < 10000; x++)
+    {
+        uint64_t start = get_time_ns();
+        uint64_t elapsed = get_time_ns() - start;
+        if (elapsed < min)
+            min = elapsed;
+    }
+    return min;
+}
+
+/**
+ * @brief Print the latency percentiles of one operation and size
+ * @param[in] op The operation, encrypt or decrypt
+ * @param[in] size The size of the message
+ * @param[in] hist The latencies of the calls, in nanoseconds
+ * @param[in] opts The options from the command line
+ */
+static void print_result(const char *op, size_t size, const histogram_t *hist,
+                         const latency_options_t *opts)
+{
+    uint64_t p50 = histogram_percentile(hist, 50);
+    uint64_t p99 = histogram_percentile(hist, 99);
+    uint64_t p999 = histogram_percentile(hist, 99.9);
+    if (opts->json)
+    {
+        printf("{\"op\":\"%s\",\"key_bits\":%zu,\"keys\":%d,\"bytes\":%zu,"
+               "\"calls\":%" PRIu64 ",\"mean_ns\":%.0f,\"p50_ns\":%" PRIu64
+               ",\"p99_ns\":%" PRIu64 ",\"p999_ns\":%" PRIu64
+               ",\"max_ns\":%" PRIu64 "}\n",
+               op, opts->key_bits, opts->num_keys, size, hist->total,
+               histogram_mean(hist), p50, p99, p999, hist->max);
+    }
+    else
+        printf("%-9s %8zu %8" PRIu64 " %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+               op, size, hist->total, histogram_mean(hist) / 1e3, p50 / 1e3,
+               p99 / 1e3, p999 / 1e3, hist->max / 1e3);
+    fflush(stdout);
+}
+
+/**
+ * @brief Record the time a batch took as the time of each message in it
+ * @param[in] hist The histogram to record in
+ * @param[in] elapsed The time the batch took, in nanoseconds
+ * @param[in] batch The number of messages in the batch
+ */
+static void record_batch(histogram_t *hist, uint64_t elapsed, int batch)
+{
+    for (int m = 0; m < batch; m++)
+        histogram_record(hist, elapsed / batch);
+}
+
+/**
+ * @brief Time encrypt_batch() and decrypt_batch() on batches of a message,
+ * per message, and check they give the same as encrypt()
+ * @param[in] keys The keys
+ * @param[in] message The message
+ * @param[in] size The size of the message
+ * @param[in] cipher_text The cipher text encrypt() gives for the message
+ * @param[in] cipher_text_len The length of the cipher text
+ * @param[in] hist A histogram to record the latencies in
+ * @param[in] opts The options from the command line
+ * @return 0 on success, 1 on failure
+ */
+static int bench_batch(const char **keys, const unsigned char *message,
+                       size_t size, const unsigned char *cipher_text,
+                       size_t cipher_text_len, histogram_t *hist,
+                       const latency_options_t *opts)
+{
+    eea_buffer_t *messages = malloc(opts->batch * sizeof(eea_buffer_t));
+    eea_buffer_t *results = malloc(opts->batch * sizeof(eea_buffer_t));
+    if (messages == NULL || results == NULL)
+    {
+        free(messages);
+        free(results);
+        return 1;
+    }
+    for (int m = 0; m < opts->batch; m++)
+    {
+        messages[m].data = message;
+        messages[m].len = size;
+    }
+
+    int batches = opts->calls / opts->batch;
+    if (batches < 1)
+        batches = 1;
+    int ret = 0;
+    unsigned char *arena = NULL;
+    histogram_reset(hist);
+    for (int c = -WARMUP_CALLS / opts->batch; c < batches && !ret; c++)
+    {
+        free(arena);
+        arena = NULL;
+        uint64_t start = get_time_ns();
+        ret = encrypt_batch(messages, opts->batch, keys, opts->num_keys,
+                            results, &arena);
+        uint64_t elapsed = get_time_ns() - start;
+        if (c >= 0)
+            record_batch(hist, elapsed, opts->batch);
+    }
+    for (int m = 0; m < opts->batch && !ret; m++)
+        ret = (results[m].len != cipher_text_len
+               || memcmp(results[m].data, cipher_text, cipher_text_len) != 0);
+    if (!ret)
+        print_result("enc-batch", size, hist, opts);
+
+    // Decrypt the cipher texts just made
+    unsigned char *encrypted = arena;
+    for (int m = 0; m < opts->batch; m++)
+        messages[m] = results[m];
+    arena = NULL;
+    histogram_reset(hist);
+    for (int c = -WARMUP_CALLS / opts->batch; c < batches && !ret; c++)
+    {
+        free(arena);
+        arena = NULL;
+        uint64_t start = get_time_ns();
+        ret = decrypt_batch(messages, opts->batch, keys, opts->num_keys,
+                            results, &arena);
+        uint64_t elapsed = get_time_ns() - start;
+        if (c >= 0)
+            record_batch(hist, elapsed, opts->batch);
+    }
+    for (int m = 0; m < opts->batch && !ret; m++)
+        ret = (results[m].len != size
+               || memcmp(results[m].data, message, size) != 0);
+    if (!ret)
+        print_result("dec-batch", size, hist, opts);
+    else
+        fprintf(stderr, "Batches of %zu bytes did not match encrypt() and "
+                "decrypt()\n", size);
+
+    free(arena);
+    free(encrypted);
+    free(messages);
+    free(results);
+    return ret;
+}
+
+/**
+ * @brief Time each call of encrypt() and decrypt() on a message
+ * @param[in] keys The keys
+ * @param[in] size The size of the message
+ * @param[in] hist A histogram to record the latencies in
+ * @param[in] opts The options from the command line
+ * @return 0 on success, 1 on failure
+ */
+static int bench_size(const char **keys, size_t size, histogram_t *hist,
+                      const latency_options_t *opts)
+{
+    unsigned char *message = make_message(size);
+    if (message == NULL)
+        return 1;
+
+    // Each call includes getting the keys ready and base64, as they would
+    // be for a real message. Only freeing the result is left out.
+    unsigned char *cipher_text = NULL;
+    size_t cipher_text_len = 0;
+    histogram_reset(hist);
+    for (int c = -WARMUP_CALLS; c < opts->calls; c++)
+    {
+        free(cipher_text);
+        uint64_t start = get_time_ns();
+        cipher_text_len = encrypt(message, size, &cipher_text, keys,
+                                  opts->num_keys);
+        uint64_t elapsed = get_time_ns() - start;
+        if (c >= 0)
+            histogram_record(hist, elapsed);
+    }
+    print_result("encrypt", size, hist, opts);
+
+    int ret = 0;
+    histogram_reset(hist);
+    for (int c = -WARMUP_CALLS; c < opts->calls; c++)
+    {
+        unsigned char *plain_text = NULL;
+        uint64_t start = get_time_ns();
+        size_t plain_text_len = decrypt(cipher_text, cipher_text_len,
+                                        &plain_text, keys, opts->num_keys);
+        uint64_t elapsed = get_time_ns() - start;
+        if (c >= 0)
+            histogram_record(hist, elapsed);
+        if (plain_text_len != size || memcmp(plain_text, message, size) != 0)
+            ret = 1;
+        free(plain_text);
+    }
+    print_result("decrypt", size, hist, opts);
+    if (ret)
+        fprintf(stderr, "Decrypting %zu bytes did not match the message\n",
+                size);
+    else if (opts->batch > 0)
+        ret = bench_batch(keys, message, size, cipher_text, cipher_text_len,
+                          hist, opts);
+
+    free(cipher_text);
+    free(message);
+    return ret;
+}
+
+/**
+ * @brief Print how to use the benchmark
+ * @param[in] name The name of the executable
+ */
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --bits <n>   Size of the keys (default: 512)\n"
+            "  --keys <n>   Number of keys (default: 3)\n"
+            "  --calls <n>  Calls timed per operation and size "
+            "(default: %d)\n"
+            "  --batch <n>  Messages per batch for encrypt_batch() and "
+            "decrypt_batch(),\n"
+            "               0 to skip them (default: %d)\n"
+            "  --json       Print a JSON object per result\n",
+            name, DEFAULT_CALLS, DEFAULT_BATCH);
+}
+
+int main(int argc, char **argv)
+{
+    latency_options_t opts = { 512, 3, DEFAULT_CALLS, DEFAULT_BATCH, 0 };
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--bits") == 0 && a + 1 < argc)
+            opts.key_bits = strtoul(argv[++a], NULL, 10);
+        else if (strcmp(argv[a], "--keys") == 0 && a + 1 < argc)
+            opts.num_keys = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--calls") == 0 && a + 1 < argc)
+            opts.calls = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--batch") == 0 && a + 1 < argc)
+            opts.batch = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--json") == 0)
+            opts.json = 1;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opts.key_bits < 256 || opts.key_bits % 256 != 0 ||
+        opts.num_keys < 1 || opts.calls < 1 || opts.batch < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char **keys = generate_keys(opts.key_bits, opts.num_keys);
+    histogram_t *hist = histogram_create();
+    if (keys == NULL || hist == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        if (keys != NULL)
+            free_keys(keys, opts.num_keys, NULL);
+        histogram_free(hist);
+        return 1;
+    }
+
+    if (!opts.json)
+    {
+        printf("Latency per call in microseconds, %zu-bit keys x %d, "
+               "timer overhead %" PRIu64 " ns\n",
+               opts.key_bits, opts.num_keys, timer_overhead());
+        printf("%-9s %8s %8s %10s %10s %10s %10s %10s\n", "op", "bytes",
+               "calls", "mean", "p50", "p99", "p99.9", "max");
+    }
+
+    int ret = 0;
+    for (size_t s = 0; s < NUM_MESSAGE_SIZES; s++)
+        ret |= bench_size((const char **) keys, MESSAGE_SIZES[s], hist,
+                          &opts);
+
+    histogram_free(hist);
+    free_keys(keys, opts.num_keys, NULL);
+    return ret;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdio.h>
+
+/**
+ * @brief Pack files, and every file in directories, into one archive.
+ *
+ * The files are laid end to end and cut into segments of the same size,
+ * each encrypted on its own, on several threads, and written in order. An
+ * index of each file's path, permissions, offset and size, and of where
+ * each segment is, is encrypted after them. A file can then be read back
+ * by decrypting only the index and the segments it is in.
+ * @param[in] archive The archive to write
+ * @param[in] paths The files and directories to pack. Each file is stored
+ * under its path, without any leading slashes.
+ * @param[in] num_paths The number of paths
+ * @param[in] keys The keys to use for encryption
+ * @param[in] num_keys The number of keys
+ * @param[in] threads The number of threads to encrypt segments on
+ * @return 0 on success, 1 on failure, after printing why. Nothing is left
+ * written on a failure.
+ */
+int pack_archive(const char *archive, char **paths, int num_paths,
+                 const char **keys, int num_keys, int threads);
+
+/**
+ * @brief List the files in an archive, decrypting only its index
+ * @param[in] archive The archive, from pack_archive()
+ * @param[in] keys The keys it was encrypted with
+ * @param[in] num_keys The number of keys
+ * @param[out] out Where to write the size and path of each file, a line
+ * each
+ * @return 0 on success, 1 on failure, after printing why
+ */
+int list_archive(const char *archive, const char **keys, int num_keys,
+                 FILE *out);
+
+/**
+ * @brief Unpack files from an archive, decrypting only the segments they
+ * are in
+ * @param[in] archive The archive, from pack_archive()
+ * @param[in] members The paths of the files to unpack, or of directories
+ * to unpack everything in. NULL for every file.
+ * @param[in] num_members The number of members
+ * @param[in] dir The directory to unpack into, NULL for the current one
+ * @param[in] keys The keys it was encrypted with
+ * @param[in] num_keys The number of keys
+ * @return 0 on success, 1 on failure, after printing why
+ * @note Files stored with a ".." in their path are not unpacked
+ */
+int unpack_archive(const char *archive, char **members, int num_members,
+                   const char *dir, const char **keys, int num_keys);
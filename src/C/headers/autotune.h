@@ -0,0 +1,8 @@
+#pragma once
+
+/**
+ * @brief Time each XOR kernel, chunk size and thread count on this machine,
+ * and save the fastest to the config file, so they are used from then on
+ * @return 0 on success, 1 on failure
+ */
+int autotune(void);
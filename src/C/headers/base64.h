@@ -20,3 +20,27 @@ char *base64_encode(unsigned char *data, size_t size, size_t *rsize);
  * @note Resulting value must be freed if it is not NULL
  */
 unsigned char *base64_decode(unsigned char *data, size_t size, size_t *rsize);
+
+/**
+ * @brief Encode part of a stream in base64, into a buffer
+ * @param[in] data The data to be encoded, a multiple of 3 bytes unless it
+ * is the end of the stream
+ * @param[in] size The size of the data, under 2 GiB
+ * @param[out] encoded Set to the data encoded in base64, null terminated.
+ * Must be at least 4 * ((size + 2) / 3) + 1 bytes.
+ * @return The length of the encoded data
+ */
+size_t base64_encode_block(const unsigned char *data, size_t size,
+                           char *encoded);
+
+/**
+ * @brief Decode part of a stream from base64, into a buffer
+ * @param[in] data The data to be decoded, without any whitespace
+ * @param[in] size The size of the data, a multiple of 4 and under 2 GiB
+ * @param[out] decoded Set to the decoded data. Must be at least
+ * 3 * (size / 4) + 1 bytes.
+ * @return The length of the decoded data, (size_t) -1 if it isn't valid
+ * base64
+ */
+size_t base64_decode_block(const char *data, size_t size,
+                           unsigned char *decoded);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "eea.h"
+
+/**
+ * @brief Encrypt many small messages at once. The keys are checked and
+ * made ready once for the whole batch, and every cipher text is written
+ * into one allocation, so no memory is allocated per message.
+ * @param[in] messages The messages to encrypt, each under 1 GiB
+ * @param[in] count The number of messages
+ * @param[in] keys The keys to use for encryption
+ * @param[in] num_keys The number of keys being used for encryption
+ * @param[out] results Set to each message's cipher text, in base64 and null
+ * terminated, the same as encrypt() gives for it. Points into arena.
+ * @param[out] arena Set to the memory holding every cipher text
+ * @return EEA_OK, or one of EeaErrors
+ * @note The arena must be freed. The XOR rounds always use the blocked
+ * kernel.
+ */
+int encrypt_batch(const eea_buffer_t *messages, size_t count,
+                  const char **keys, int num_keys, eea_buffer_t *results,
+                  unsigned char **arena);
+
+/**
+ * @brief Decrypt many small messages at once, into one allocation
+ * @param[in] messages The cipher texts to decrypt
+ * @param[in] count The number of messages
+ * @param[in] keys The keys to use for decryption
+ * @param[in] num_keys The number of keys being used for decryption
+ * @param[out] results Set to each message's plain text, null terminated.
+ * Points into arena. A message that wasn't encrypted with these keys is set
+ * to NULL, with a length of 0.
+ * @param[out] arena Set to the memory holding every plain text
+ * @return EEA_OK, EEA_ERR_INVALID_DATA if any message wasn't encrypted with
+ * these keys, the rest still being decrypted, or another of EeaErrors
+ * @note The arena must be freed, even after EEA_ERR_INVALID_DATA. The XOR
+ * rounds always use the blocked kernel.
+ */
+int decrypt_batch(const eea_buffer_t *messages, size_t count,
+                  const char **keys, int num_keys, eea_buffer_t *results,
+                  unsigned char **arena);
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Starts the checksums written after the cipher text, on a line of their
+// own. '#' isn't in base64, so decryption stops at it.
+static const char CHECKSUM_MARKER[] = "#crc32c:";
+
+// How much of the cipher text each checksum covers
+#define CHECKSUM_CHUNK ((size_t) 1 << 20)
+// The most a checksum can be given to cover, so a damaged trailer can't ask
+// for a huge buffer
+#define CHECKSUM_MAX_CHUNK ((size_t) 64 << 20)
+
+/**
+ * @struct checksum_t
+ * @brief The checksum of each chunk of cipher text written so far
+ */
+typedef struct
+{
+    // The checksum of the chunk being written, and how much of it there is
+    uint32_t crc;
+    size_t have;
+    uint32_t *crcs;
+    size_t count;
+    size_t capacity;
+} checksum_t;
+
+/**
+ * @brief Update a CRC32C (Castagnoli) with more data. It is computed with
+ * the SSE4.2 crc32 instruction when the CPU has it, or with tables
+ * otherwise.
+ * @param[in] crc The CRC so far, 0 to start
+ * @param[in] data The data
+ * @param[in] len The length of the data
+ * @return The CRC of everything so far
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Start checksumming cipher text
+ * @param[out] sum The checksums
+ */
+void checksum_init(checksum_t *sum);
+
+/**
+ * @brief Checksum the next part of the cipher text
+ * @param[in,out] sum The checksums
+ * @param[in] data The next part
+ * @param[in] len The length of the part
+ * @return 0 on success, 1 if allocating memory failed
+ */
+int checksum_update(checksum_t *sum, const void *data, size_t len);
+
+/**
+ * @brief Finish checksumming, and write the line of checksums that goes
+ * after the cipher text: a new line, CHECKSUM_MARKER, the chunk size, and
+ * the checksum of each chunk, in hex
+ * @param[in,out] sum The checksums
+ * @param[out] len Set to the length of the line
+ * @return The line, NULL if allocating it failed
+ * @note The line must be freed
+ */
+char *checksum_trailer(checksum_t *sum, size_t *len);
+
+/**
+ * @brief Free the checksums
+ * @param[in] sum The checksums
+ */
+void checksum_free(checksum_t *sum);
+
+/**
+ * @brief The most room the line of checksums can take
+ * @param[in] len The length of the cipher text it covers
+ * @return The length of the longest line, with its null terminator
+ */
+size_t checksum_trailer_max(size_t len);
+
+/**
+ * @brief Find the line of checksums at the end of an .eea file
+ * @param[in] data The end of the file, at least the whole last line
+ * @param[in] len The length of the end
+ * @return Where the line starts, after CHECKSUM_MARKER's new line. len if
+ * the last line isn't checksums, or there is no line before it.
+ */
+size_t checksum_line_start(const unsigned char *data, size_t len);
+
+/**
+ * @brief Find where the cipher text ends, before any line of checksums
+ * @param[in] data The contents of an .eea file
+ * @param[in] len The length of the contents
+ * @return The length of the cipher text
+ */
+size_t checksum_body_len(const unsigned char *data, size_t len);
@@ -0,0 +1,23 @@
+#pragma once
+
+/**
+ * @brief Check if an argument is one of the commands, such as enc
+ * @param[in] arg The first argument given to the program
+ * @return If it is a command
+ */
+int is_command(const char *arg);
+
+/**
+ * @brief Run a command given on the command line, without the menus
+ * @param[in] argc The number of arguments, starting with the command
+ * @param[in] argv The arguments, starting with the command
+ * @return The exit code, 0 on success, 1 on failure and 2 for invalid
+ * options
+ */
+int run_command(int argc, char **argv);
+
+/**
+ * @brief Print how to run the program
+ * @param[in] program The name the program was run as
+ */
+void print_usage(const char *program);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdio.h>
+
+/**
+ * @enum ColumnFormats
+ * @brief The formats of record files columns can be encrypted in
+ */
+typedef enum
+{
+    // Comma separated values, with a header naming the columns
+    COLUMN_FORMAT_CSV = 0,
+    // JSON Lines, a JSON object per line, with the columns as its keys
+    COLUMN_FORMAT_JSONL = 1
+} ColumnFormats;
+
+static const char *COLUMN_FORMAT_NAMES[] = { "csv", "jsonl" };
+static const int NUM_COLUMN_FORMATS = sizeof(COLUMN_FORMAT_NAMES)
+                                      / sizeof(char *);
+
+/**
+ * @brief Encrypt or decrypt only some columns of a CSV or JSON Lines file,
+ * leaving the rest of it as it was. The records are read in chunks, which
+ * are rewritten on several threads and written out in order.
+ *
+ * Each value is encrypted on its own, to base64. A CSV value is encrypted
+ * without its quotes, and a JSON value is encrypted as it is written, such
+ * as "text" with its quotes or 12, and replaced by a string of the base64,
+ * so decrypting gives back the same type. Empty CSV values and JSON nulls
+ * are left as they are.
+ * @param[in] in The records to read
+ * @param[out] out Where to write the rewritten records
+ * @param[in] format One of ColumnFormats
+ * @param[in] columns The names of the columns, or JSON keys, to encrypt or
+ * decrypt
+ * @param[in] num_columns The number of columns
+ * @param[in] encrypting 1 to encrypt the columns, 0 to decrypt them
+ * @param[in] keys The keys to use
+ * @param[in] num_keys The number of keys
+ * @param[in] threads The number of threads to rewrite chunks on
+ * @return 0 on success, 1 on failure, after printing why
+ */
+int crypt_columns(FILE *in, FILE *out, ColumnFormats format,
+                  const char **columns, int num_columns, int encrypting,
+                  const char **keys, int num_keys, int threads);
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stddef.h>
+
+// Starts the cipher text of compressed plain text, before the base64. ':'
+// isn't in base64, so no other cipher text can start with it.
+static const char COMPRESSED_PREFIX[] = "zlib:";
+
+// The most plain text compressed into a frame at once
+#define COMPRESS_CHUNK ((size_t) 256 << 10)
+// The length of the header of each frame: its type, the length of the
+// plain text and the length of the data that follows
+#define COMPRESS_FRAME_HEADER 9
+
+/**
+ * @brief Get the longest a frame can be
+ * @param[in] len The length of the plain text it holds
+ * @return The length
+ */
+size_t compress_frame_bound(size_t len);
+
+/**
+ * @brief Compress a chunk of plain text into a frame. If a quick look at a
+ * sample of it says it won't shrink, or it doesn't, it is stored as it is.
+ * @param[in] data The chunk, at most COMPRESS_CHUNK bytes
+ * @param[in] len The length of the chunk
+ * @param[out] frame Set to the frame. Must be at least
+ * compress_frame_bound(len) bytes.
+ * @return The length of the frame
+ */
+size_t compress_frame(const unsigned char *data, size_t len,
+                      unsigned char *frame);
+
+/**
+ * @brief Write the frame that ends the frames. It doesn't end in a padding
+ * byte, so decryption never removes any of the frames with the padding.
+ * @param[out] frame Set to the frame, which is one byte
+ * @return The length of the frame
+ */
+size_t compress_end_frame(unsigned char *frame);
+
+/**
+ * @brief Compress a buffer into frames, ended by the end frame
+ * @param[in] data The plain text
+ * @param[in] len The length of the plain text
+ * @param[out] frames Set to the frames
+ * @param[out] frames_len Set to the length of the frames
+ * @return EEA_OK, or EEA_ERR_NO_MEMORY
+ * @note The frames must be freed
+ */
+int compress_data(const unsigned char *data, size_t len,
+                  unsigned char **frames, size_t *frames_len);
+
+/**
+ * @brief Where a frame reader sends the plain text
+ * @param[in] ctx The output's state
+ * @param[in] data The next part of the plain text
+ * @param[in] len The length of the part
+ * @return 0 on success, 1 on failure
+ */
+typedef int (*frame_output_t)(void *ctx, const unsigned char *data,
+                              size_t len);
+
+/**
+ * @struct frame_reader_t
+ * @brief Decompresses frames as they are given to it, in parts of any size
+ */
+typedef struct
+{
+    frame_output_t output;
+    void *ctx;
+    unsigned char header[COMPRESS_FRAME_HEADER];
+    size_t header_have;
+    unsigned char *data;
+    size_t data_have;
+    unsigned char *plain;
+    int ended;
+} frame_reader_t;
+
+/**
+ * @brief Start reading frames
+ * @param[out] reader The reader
+ * @param[in] output Where to send the plain text
+ * @param[in] ctx The output's state
+ * @return EEA_OK, or EEA_ERR_NO_MEMORY
+ * @note The reader must be freed with frame_reader_free(), even on failure
+ */
+int frame_reader_init(frame_reader_t *reader, frame_output_t output,
+                      void *ctx);
+
+/**
+ * @brief Give the reader the next part of the frames
+ * @param[in,out] reader The reader
+ * @param[in] data The next part
+ * @param[in] len The length of the part
+ * @return EEA_OK, EEA_ERR_INVALID_DATA if they aren't valid frames, or
+ * EEA_ERR_IO if the output failed
+ */
+int frame_reader_feed(frame_reader_t *reader, const unsigned char *data,
+                      size_t len);
+
+/**
+ * @brief Check the frames were ended by the end frame
+ * @param[in] reader The reader
+ * @return EEA_OK, or EEA_ERR_INVALID_DATA if they were cut short
+ */
+int frame_reader_finish(const frame_reader_t *reader);
+
+/**
+ * @brief Free a reader
+ * @param[in] reader The reader
+ */
+void frame_reader_free(frame_reader_t *reader);
+
+/**
+ * @brief Decompress a buffer of frames, from compress_data()
+ * @param[in] frames The frames
+ * @param[in] frames_len The length of the frames
+ * @param[out] data Set to the plain text, null terminated
+ * @param[out] len Set to the length of the plain text
+ * @return EEA_OK, or one of EeaErrors
+ * @note The plain text must be freed
+ */
+int decompress_data(const unsigned char *frames, size_t frames_len,
+                    unsigned char **data, size_t *len);
@@ -2,5 +2,26 @@
 
 /**
  * @brief Load the config file if it exists. Otherwise create the default one.
+ * @param[in] interactive If the keys directory doesn't exist, ask whether to
+ * create it
  */
-void load_config(void);
+void load_config(int interactive);
+
+/**
+ * @struct config_setting_t
+ * @brief A setting to save to the config file
+ */
+typedef struct
+{
+    const char *key;
+    const char *value;
+} config_setting_t;
+
+/**
+ * @brief Save settings to the config file, replacing any lines that already
+ * set them and leaving the rest of the file as it is
+ * @param[in] settings The settings to save
+ * @param[in] num_settings The number of settings
+ * @return 1 on success, 0 on failure
+ */
+int save_config_settings(const config_setting_t *settings, int num_settings);
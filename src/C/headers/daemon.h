@@ -0,0 +1,29 @@
+#pragma once
+
+/**
+ * @struct keyset_t
+ * @brief A set of keys the daemon holds unlocked, and the name requests
+ * select it by
+ */
+typedef struct
+{
+    char *name;
+    char **keys;
+    int num_keys;
+} keyset_t;
+
+/**
+ * @brief Serve encrypt and decrypt requests from local clients over a Unix
+ * socket, until SIGINT or SIGTERM. Each request selects one of the keysets,
+ * which are locked into memory for as long as the daemon runs, so no keys
+ * file is read or decrypted per request.
+ * @param[in] keysets The keysets, which are wiped and freed before
+ * returning
+ * @param[in] num_keysets The number of keysets
+ * @param[in] socket_path The socket to listen on, NULL for
+ * daemon_socket_path()
+ * @param[in] threads The number of worker threads that run the requests
+ * @return 0 once stopped, 1 if the daemon couldn't be started
+ */
+int run_daemon(keyset_t *keysets, int num_keysets, const char *socket_path,
+               int threads);
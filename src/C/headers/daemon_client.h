@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The protocol spoken over the daemon's Unix socket. A connection carries
+// any number of requests, one after the other, each answered before the
+// next is read. All lengths are big endian.
+//
+// Request:  u8 op, u8 keyset name length, u32 data length, the keyset
+//           name, then the data
+// Response: u8 status (one of EeaErrors), u32 data length, then the data
+//           (the cipher text in base64, or the plain text)
+
+/**
+ * @enum DaemonOps
+ * @brief What a request to the daemon asks for
+ */
+typedef enum
+{
+    DAEMON_OP_ENCRYPT = 1,
+    DAEMON_OP_DECRYPT = 2
+} DaemonOps;
+
+#define DAEMON_REQUEST_HEADER_LEN 6
+#define DAEMON_RESPONSE_HEADER_LEN 5
+// The most data a request can carry. Larger requests are refused and the
+// connection is closed.
+static const size_t DAEMON_MAX_DATA = (size_t) 64 << 20;
+
+/**
+ * @brief Store a 32-bit length big endian, as the protocol does
+ * @param[out] buf Where to store it, 4 bytes
+ * @param[in] value The length
+ */
+void daemon_put_u32(unsigned char *buf, uint32_t value);
+
+/**
+ * @brief Load a 32-bit length stored big endian
+ * @param[in] buf The 4 bytes it is stored in
+ * @return The length
+ */
+uint32_t daemon_get_u32(const unsigned char *buf);
+
+/**
+ * @brief Get the socket the daemon listens on by default,
+ *   $XDG_RUNTIME_DIR/eea.sock, or /tmp/eea-<uid>.sock without it
+ * @param[out] path Set to the path of the socket
+ * @param[in] size The size of path
+ * @return 1 on success, 0 if the path doesn't fit
+ */
+int daemon_socket_path(char *path, size_t size);
+
+/**
+ * @brief Read exactly len bytes, retrying after short reads and signals
+ * @param[in] fd The file descriptor to read
+ * @param[out] buf The buffer to read into
+ * @param[in] len The number of bytes to read
+ * @return 1 on success, 0 on an error or the end of the file
+ */
+int daemon_read_full(int fd, void *buf, size_t len);
+
+/**
+ * @brief Write exactly len bytes, retrying after short writes and signals
+ * @param[in] fd The file descriptor to write
+ * @param[in] buf The bytes to write
+ * @param[in] len The number of bytes to write
+ * @return 1 on success, 0 on an error
+ */
+int daemon_write_full(int fd, const void *buf, size_t len);
+
+/**
+ * @brief Connect to the daemon
+ * @param[in] socket_path The daemon's socket, NULL for daemon_socket_path()
+ * @param[out] fd Set to the connection
+ * @return EEA_OK, or EEA_ERR_IO if connecting failed
+ */
+int daemon_connect(const char *socket_path, int *fd);
+
+/**
+ * @brief Send a request to the daemon and wait for its response
+ * @param[in] fd The connection, from daemon_connect()
+ * @param[in] op One of DaemonOps
+ * @param[in] keyset The name of the keyset to use
+ * @param[in] data The data to encrypt or decrypt
+ * @param[in] data_len The length of the data
+ * @param[out] out Set to the result, null terminated
+ * @param[out] out_len Set to the length of the result
+ * @return The daemon's status, EEA_OK or one of EeaErrors. EEA_ERR_IO if
+ * the connection failed, after which it can't be used again.
+ * @note out must be freed
+ */
+int daemon_request(int fd, int op, const char *keyset,
+                   const unsigned char *data, size_t data_len,
+                   unsigned char **out, size_t *out_len);
@@ -12,26 +12,62 @@
 size_t decrypt(unsigned char *data, size_t data_len,
                unsigned char **cipher_text, const char **keys, int num_keys);
 
+/**
+ * @brief Decrypt the given data with the given keys, saying why it failed
+ * @param[in] data The data to decrypt, which isn't changed
+ * @param[in] data_len The size of the data to decrypt
+ * @param[out] plain_text The resulting plain text, null terminated
+ * @param[out] plain_text_len The length of the plain text
+ * @param[in] keys The keys to use for decryption
+ * @param[in] num_keys The number of keys being used for decryption
+ * @return EEA_OK, or one of EeaErrors
+ */
+int decrypt_data(unsigned char *data, size_t data_len,
+                 unsigned char **plain_text, size_t *plain_text_len,
+                 const char **keys, int num_keys);
+
+/**
+ * @brief Decrypt the contents of an .eea file: cipher text, marked with
+ * COMPRESSED_PREFIX if the plain text was compressed, and followed by its
+ * checksums if it has them
+ * @param[in] data The contents, which aren't changed
+ * @param[in] data_len The length of the contents
+ * @param[out] plain_text The resulting plain text, decompressed and null
+ * terminated
+ * @param[out] plain_text_len The length of the plain text
+ * @param[in] keys The keys to use for decryption
+ * @param[in] num_keys The number of keys being used for decryption
+ * @return EEA_OK, or one of EeaErrors
+ */
+int decrypt_contents(const unsigned char *data, size_t data_len,
+                     unsigned char **plain_text, size_t *plain_text_len,
+                     const char **keys, int num_keys);
+
 /**
  * @brief Decrypt the keys prior to using them to a with the
  * password used to encrypt them
  * @param[in] encrypted_string The string of keys encrypted
  * @param[in] encrypted_size The size of the encrypted string of keys
+ * @param[in] password_hash The hash of the password, from hash_password()
  * @param[out] keys_string The string containing all the keys decrypted
  * @note keys_string must be freed
- * @return Length of keys string
+ * @return Length of keys string, 0 on failure
  * @attention This function assumes the password entered is the same as
  * the one used to encrypt the keys. i.e. the keys you get back could be
  * bogus or invalid.
  */
 size_t decrypt_keys(unsigned char *encrypted_string, size_t encrypted_size,
-                    char **keys_string);
+                    const char *password_hash, char **keys_string);
 
 /**
  * @brief Decrypt the given file with the given keys
  * @param[in] filename The file to be decrypted
  * @param[in] keys The keys to be used for decryption
  * @param[in] num_keys The number of keys that are being used
- * @return If the file was decrypted successfully
+ * @param[out] bytes_in The size of the file read in (may be NULL)
+ * @param[out] bytes_out The size of the file written out (may be NULL)
+ * @return EEA_OK if the file was decrypted successfully, or one of
+ * EeaErrors
  */
-int decrypt_file(const char *filename, const char **keys, int num_keys);
+int decrypt_file(const char *filename, const char **keys, int num_keys,
+                 size_t *bytes_in, size_t *bytes_out);
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+// The public API of libeea, the Elite Encryption Algorithm library.
+//
+// Nothing in the library prompts, prints or exits. Every function returns
+// one of EeaErrors, and any memory it returns must be freed with eea_free()
+// or eea_free_keys(). The functions can be called from several threads at
+// once, as long as they don't share an output.
+
+#define EEA_VERSION_MAJOR 2
+#define EEA_VERSION_MINOR 0
+#define EEA_VERSION_PATCH 0
+
+// Only the functions below are exported from libeea.so
+#if defined(__GNUC__)
+#define EEA_API __attribute__((visibility("default")))
+#else
+#define EEA_API
+#endif
+
+/**
+ * @enum EeaErrors
+ * @brief What each function in the library returns
+ */
+typedef enum
+{
+    EEA_OK = 0,
+    // Allocating memory failed
+    EEA_ERR_NO_MEMORY = 1,
+    // A NULL pointer, no keys, or keys that aren't hex of the same length
+    EEA_ERR_INVALID_ARGUMENT = 2,
+    // The cipher text isn't a multiple of the key length, so it wasn't
+    // encrypted with these keys
+    EEA_ERR_INVALID_DATA = 3,
+    // Reading or writing a file failed, see errno
+    EEA_ERR_IO = 4,
+    // Getting random bytes from OpenSSL failed
+    EEA_ERR_RANDOM = 5,
+    // The keys file didn't decrypt to valid keys with the password
+    EEA_ERR_WRONG_PASSWORD = 6,
+    // The daemon has no keyset by the name given
+    EEA_ERR_NO_KEYSET = 7,
+    // Every one of the daemon's workers was busy and its queue was full, so
+    // it turned the request away and closed the connection
+    EEA_ERR_BUSY = 8
+} EeaErrors;
+
+/**
+ * @struct eea_buffer_t
+ * @brief A message in a batch, or the result of one
+ */
+typedef struct
+{
+    const unsigned char *data;
+    size_t len;
+} eea_buffer_t;
+
+/**
+ * @brief Describe an error
+ * @param[in] error One of EeaErrors
+ * @return A description of the error, which must not be freed
+ */
+EEA_API const char *eea_strerror(int error);
+
+/**
+ * @brief Generate a set of random keys
+ * @param[in] bits The size of each key in bits, a multiple of 256
+ * @param[in] num_keys The number of keys to generate
+ * @param[out] keys Set to the keys, as hex strings
+ * @return EEA_OK, or one of EeaErrors
+ * @note The keys must be freed with eea_free_keys()
+ */
+EEA_API int eea_generate_keys(size_t bits, int num_keys, char ***keys);
+
+/**
+ * @brief Free keys returned by the library
+ * @param[in] keys The keys, may be NULL
+ * @param[in] num_keys The number of keys
+ */
+EEA_API void eea_free_keys(char **keys, int num_keys);
+
+/**
+ * @brief Free memory returned by the library
+ * @param[in] ptr The memory, may be NULL
+ */
+EEA_API void eea_free(void *ptr);
+
+/**
+ * @brief Encrypt data
+ * @param[in] data The data to encrypt
+ * @param[in] data_len The size of the data
+ * @param[in] keys The keys to encrypt with
+ * @param[in] num_keys The number of keys
+ * @param[out] cipher_text Set to the cipher text, in base64 and null
+ * terminated
+ * @param[out] cipher_text_len Set to the length of the cipher text
+ * @return EEA_OK, or one of EeaErrors
+ * @note The cipher text must be freed with eea_free()
+ */
+EEA_API int eea_encrypt(const unsigned char *data, size_t data_len,
+                        const char **keys, int num_keys,
+                        unsigned char **cipher_text, size_t *cipher_text_len);
+
+/**
+ * @brief Decrypt data
+ * @param[in] data The cipher text to decrypt, or the contents of an .eea
+ * file, which may be compressed (`eea enc --compress`) and checksummed
+ * @param[in] data_len The size of the cipher text
+ * @param[in] keys The keys it was encrypted with
+ * @param[in] num_keys The number of keys
+ * @param[out] plain_text Set to the plain text, null terminated
+ * @param[out] plain_text_len Set to the length of the plain text
+ * @return EEA_OK, or one of EeaErrors
+ * @note The plain text must be freed with eea_free()
+ */
+EEA_API int eea_decrypt(const unsigned char *data, size_t data_len,
+                        const char **keys, int num_keys,
+                        unsigned char **plain_text, size_t *plain_text_len);
+
+/**
+ * @brief Encrypt many small messages, such as the fields of records, at
+ * once. The keys are checked and made ready once for the whole batch, and
+ * the cipher texts are all written into one allocation, so it is much
+ * faster than calling eea_encrypt() for each message.
+ * @param[in] messages The messages to encrypt, each under 1 GiB
+ * @param[in] count The number of messages
+ * @param[in] keys The keys to encrypt with
+ * @param[in] num_keys The number of keys
+ * @param[out] results Set to the cipher text of each message, in base64 and
+ * null terminated, the same as eea_encrypt() gives for it. Must have room
+ * for count results.
+ * @param[out] arena Set to the memory the results point into
+ * @return EEA_OK, or one of EeaErrors
+ * @note The arena must be freed with eea_free(), which frees every result
+ */
+EEA_API int eea_encrypt_batch(const eea_buffer_t *messages, size_t count,
+                              const char **keys, int num_keys,
+                              eea_buffer_t *results, unsigned char **arena);
+
+/**
+ * @brief Decrypt many small messages at once, into one allocation
+ * @param[in] messages The cipher texts to decrypt
+ * @param[in] count The number of messages
+ * @param[in] keys The keys they were encrypted with
+ * @param[in] num_keys The number of keys
+ * @param[out] results Set to the plain text of each message, null
+ * terminated. A message that wasn't encrypted with these keys is set to
+ * NULL, with a length of 0. Must have room for count results.
+ * @param[out] arena Set to the memory the results point into
+ * @return EEA_OK, EEA_ERR_INVALID_DATA if any of the messages wasn't
+ * encrypted with these keys, or one of EeaErrors
+ * @note The arena must be freed with eea_free(), including after
+ * EEA_ERR_INVALID_DATA, when the other messages are still decrypted
+ */
+EEA_API int eea_decrypt_batch(const eea_buffer_t *messages, size_t count,
+                              const char **keys, int num_keys,
+                              eea_buffer_t *results, unsigned char **arena);
+
+/**
+ * @brief Encrypt a file
+ * @param[in] in_path The file to encrypt
+ * @param[in] out_path Where to write the cipher text, followed by a line of
+ * CRC32C checksums of it if they are turned on with eea_set_checksums()
+ * @param[in] keys The keys to encrypt with
+ * @param[in] num_keys The number of keys
+ * @return EEA_OK, or one of EeaErrors
+ */
+EEA_API int eea_encrypt_file(const char *in_path, const char *out_path,
+                             const char **keys, int num_keys);
+
+/**
+ * @brief Decrypt a file
+ * @param[in] in_path The file to decrypt
+ * @param[in] out_path Where to write the plain text
+ * @param[in] keys The keys it was encrypted with
+ * @param[in] num_keys The number of keys
+ * @return EEA_OK, or one of EeaErrors
+ */
+EEA_API int eea_decrypt_file(const char *in_path, const char *out_path,
+                             const char **keys, int num_keys);
+
+/**
+ * @brief Encrypt a stream, a part at a time, so it takes the same memory
+ * however long it is
+ * @param[in] in The plain text, read until it ends
+ * @param[out] out Where to write the cipher text, the same as eea_encrypt()
+ * gives for the whole stream, followed by a line of CRC32C checksums of it
+ * as eea_encrypt_file() writes, if they are turned on
+ * @param[in] keys The keys to encrypt with
+ * @param[in] num_keys The number of keys
+ * @return EEA_OK, or one of EeaErrors
+ */
+EEA_API int eea_encrypt_stream(FILE *in, FILE *out, const char **keys,
+                               int num_keys);
+
+/**
+ * @brief Decrypt a stream, a part at a time, so it takes the same memory
+ * however long it is
+ * @param[in] in The cipher text, in base64, read until it ends or until its
+ * line of checksums
+ * @param[out] out Where to write the plain text
+ * @param[in] keys The keys it was encrypted with
+ * @param[in] num_keys The number of keys
+ * @return EEA_OK, or one of EeaErrors
+ * @note Some plain text may have been written before EEA_ERR_INVALID_DATA
+ * is returned
+ */
+EEA_API int eea_decrypt_stream(FILE *in, FILE *out, const char **keys,
+                               int num_keys);
+
+/**
+ * @brief Save keys to a keys file, encrypted with a password
+ * @param[in] path The keys file to write
+ * @param[in] keys The keys to save
+ * @param[in] num_keys The number of keys
+ * @param[in] password The password to encrypt the keys with
+ * @return EEA_OK, or one of EeaErrors
+ */
+EEA_API int eea_save_keys(const char *path, const char **keys, int num_keys,
+                          const char *password);
+
+/**
+ * @brief Load keys from a keys file
+ * @param[in] path The keys file to read
+ * @param[in] password The password the keys were saved with
+ * @param[out] keys Set to the keys
+ * @param[out] num_keys Set to the number of keys
+ * @return EEA_OK, or one of EeaErrors
+ * @note The keys must be freed with eea_free_keys()
+ */
+EEA_API int eea_load_keys(const char *path, const char *password, char ***keys,
+                          int *num_keys);
+
+/**
+ * @brief Connect to a running `eea daemon`, which holds its keysets
+ * unlocked, so no keys file is read or decrypted for each request
+ * @param[in] socket_path The daemon's socket, NULL for the default
+ * @param[out] fd Set to the connection, which can be used for any number of
+ * requests, but only by one thread at a time
+ * @return EEA_OK, or EEA_ERR_IO if the daemon isn't running
+ */
+EEA_API int eea_daemon_connect(const char *socket_path, int *fd);
+
+/**
+ * @brief Encrypt data with one of the daemon's keysets
+ * @param[in] fd The connection, from eea_daemon_connect()
+ * @param[in] keyset The name of the keyset, the name of its keys file
+ * without .keys
+ * @param[in] data The data to encrypt, up to 64 MB
+ * @param[in] data_len The size of the data
+ * @param[out] cipher_text Set to the cipher text, in base64 and null
+ * terminated
+ * @param[out] cipher_text_len Set to the length of the cipher text
+ * @return EEA_OK, or one of EeaErrors. After EEA_ERR_IO or EEA_ERR_BUSY
+ * the connection must be closed.
+ * @note The cipher text must be freed with eea_free()
+ */
+EEA_API int eea_daemon_encrypt(int fd, const char *keyset,
+                               const unsigned char *data, size_t data_len,
+                               unsigned char **cipher_text,
+                               size_t *cipher_text_len);
+
+/**
+ * @brief Decrypt data with one of the daemon's keysets
+ * @param[in] fd The connection, from eea_daemon_connect()
+ * @param[in] keyset The name of the keyset it was encrypted with
+ * @param[in] data The cipher text to decrypt, up to 64 MB
+ * @param[in] data_len The size of the cipher text
+ * @param[out] plain_text Set to the plain text, null terminated
+ * @param[out] plain_text_len Set to the length of the plain text
+ * @return EEA_OK, or one of EeaErrors. After EEA_ERR_IO or EEA_ERR_BUSY
+ * the connection must be closed.
+ * @note The plain text must be freed with eea_free()
+ */
+EEA_API int eea_daemon_decrypt(int fd, const char *keyset,
+                               const unsigned char *data, size_t data_len,
+                               unsigned char **plain_text,
+                               size_t *plain_text_len);
+
+/**
+ * @brief Close a connection to the daemon
+ * @param[in] fd The connection, from eea_daemon_connect()
+ */
+EEA_API void eea_daemon_close(int fd);
+
+/**
+ * @brief Choose the kernel for the XOR rounds, as `eea autotune` does for
+ * the executable
+ * @param[in] kernel The name of the kernel, "reference" or "blocked"
+ * @param[in] chunk_size The number of bytes the blocked kernel takes
+ * through every key at a time, 0 for the whole buffer
+ * @return EEA_OK, or EEA_ERR_INVALID_ARGUMENT if there is no such kernel
+ * @note Not thread safe. Call it before using the library from any other
+ * thread.
+ */
+EEA_API int eea_set_kernel(const char *kernel, size_t chunk_size);
+
+/**
+ * @brief Choose if eea_encrypt_file() and eea_encrypt_stream() end the
+ * cipher text in a line of CRC32C checksums, as `eea enc --checksums` does,
+ * so `eea verify` can check it without the keys
+ * @param[in] enabled 1 to write the checksums, 0 not to (the default)
+ * @note Older builds and the other ports can't read files with checksums.
+ * Not thread safe. Call it before using the library from any other thread.
+ */
+EEA_API void eea_set_checksums(int enabled);
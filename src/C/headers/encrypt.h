@@ -4,30 +4,57 @@
  * @brief Encrypt the given data with the given keys
  * @param[in] data The data to encrypt
  * @param[in] data_len The size of the data to encrypt
- * @param[out] cipher_text The resulting cipher text post encryption
+ * @param[out] cipher_text The resulting cipher text post encryption, left
+ * as it was if encryption failed
  * @param[in] keys The keys to use for encryption
  * @param[in] num_keys The number of keys being used for encryption
- * @return Length of cipher text
+ * @return Length of cipher text, 0 if allocating memory failed
  */
 size_t encrypt(unsigned char *data, size_t data_len,
                unsigned char **cipher_text, const char **keys, int num_keys);
 
+/**
+ * @brief Encrypt data as it is saved in an .eea file: the prefix, then the
+ * cipher text encrypt() would give, then a line of CRC32C checksums of both
+ * if checksums is set. The checksums are computed a block at a time as the
+ * cipher text is encoded.
+ * @param[in] data The data to encrypt
+ * @param[in] data_len The size of the data to encrypt
+ * @param[in] prefix Written before the cipher text, "" for none
+ * @param[out] contents Set to what goes in the file, null terminated, left
+ * as it was if encryption failed
+ * @param[in] keys The keys to use for encryption
+ * @param[in] num_keys The number of keys being used for encryption
+ * @return Length of the contents, 0 if allocating memory failed
+ * @note contents must be freed
+ */
+size_t encrypt_for_file(unsigned char *data, size_t data_len,
+                        const char *prefix, unsigned char **contents,
+                        const char **keys, int num_keys);
+
 /**
  * @brief Encrypt the keys prior to saving them to a file with a password
  * @param[in] keys The keys to be encrypted
  * @param[in] num_keys The number of keys being encrypted
+ * @param[in] password_hash The hash of the password, from hash_password()
  * @param[out] encrypted_string The string of keys encrypted
  * @note encrypted_string must be freed
- * @return Length of encrypted key string
+ * @return Length of encrypted key string, 0 on failure
  */
-size_t encrypt_keys(char **keys, int num_keys,
+size_t encrypt_keys(char **keys, int num_keys, const char *password_hash,
                     unsigned char **encrypted_string);
 
 /**
- * @brief Encrypt the given file with the given keys
+ * @brief Encrypt the given file with the given keys. If checksums is set,
+ * the cipher text is followed by a line of CRC32C checksums of it, for
+ * verify_file().
  * @param[in] filename The file to be encrypted
  * @param[in] keys The keys to be used for encryption
  * @param[in] num_keys The number of keys that are being used
- * @return If the file was encrypted successfully
+ * @param[out] bytes_in The size of the file read in (may be NULL)
+ * @param[out] bytes_out The size of the file written out (may be NULL)
+ * @return EEA_OK if the file was encrypted successfully, or one of
+ * EeaErrors
  */
-int encrypt_file(const char *filename, const char **keys, int num_keys);
+int encrypt_file(const char *filename, const char **keys, int num_keys,
+                 size_t *bytes_in, size_t *bytes_out);
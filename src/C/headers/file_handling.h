@@ -9,6 +9,10 @@ static const char SLASH_CH = '\\';
 static const char SLASH_CH = '/';
 #endif
 
+// Added to the name of a file while save_to_file() is writing it, so a
+// half written file never has the name of a finished one
+static const char PARTIAL_FILE_EXTENTION[] = ".eea_part";
+
 /**
  * @enum FILE_TYPE
  * @brief The kind of value returned from get_file_type()
@@ -31,33 +35,6 @@ typedef enum
  */
 char *get_output_filename(const char *filename, int encrypting);
 
-/**
- * @brief Prompt the user for the name of the file they would like to encrypt
- * @param[in] encrypting If this file will be encrypted
- * @return The name of the file to encrypt/decrypt
- * @note Return value must be freed
- */
-char *get_input_filename(int encrypting);
-
-/**
- * @brief Prompt the user for the name of the directory they would
- *   like to encrypt
- * @param[in] encrypting If this directory will be encrypted
- * @return The name of the directory to encrypt/decrypt
- * @note Return value must be freed
- */
-char *get_input_dir_name(int encrypting);
-
-/**
- * @brief Load in the keys for encryption from they key file
- * @param[in] filename The name of the file to load the keys from
- * @param[out] total_keys The number of keys loaded in from the file
- * @param[out] key_len The length of an individual key
- * @return The keys loaded in from the file
- * @note The keys must be freed
- */
-char **load_keys_from_file(const char *filename, int *total_keys, size_t *len);
-
 /**
  * @brief Checks to see if the file exists
  * @param[in] filename File to see if it exists
@@ -113,12 +90,48 @@ char *get_keys_path(const char *filename);
  */
 char *get_dir_contents(char *basePath);
 
+/**
+ * @brief Function called by walk_dir() for every file found
+ * @param[in] path Path to the file that was found
+ * @param[in] ctx The context pointer that was passed to walk_dir()
+ * @return 1 to keep walking, 0 to stop the walk
+ */
+typedef int (*walk_callback_t)(const char *path, void *ctx);
+
+/**
+ * @brief Recursively walk a directory, calling the callback for each file
+ *   as soon as it is found
+ * @param[in] basePath Base path to traverse directory
+ * @param[in] callback Function to call for each file
+ * @param[in] ctx Pointer passed through to the callback
+ * @return 1 if the whole directory was walked, 0 if the walk was stopped
+ *   early by the callback
+ * @note Each entry is handed to the callback as it is read, so a huge
+ *   directory is never held in memory. Files written into the directory
+ *   while it is walked may or may not be found, so a job that writes its
+ *   output next to its input must skip that output itself. Directories
+ *   that can't be read are skipped.
+ */
+int walk_dir(const char *basePath, walk_callback_t callback, void *ctx);
+
+/**
+ * @brief Checks to see if a directory, or any of its sub-directories,
+ *   contains at least one file
+ * @param[in] basePath Base path to traverse directory
+ * @return If a file was found
+ */
+int dir_has_files(const char *basePath);
+
 /**
  * @brief Save the cipher text to a file
  * @param[in] filename The file to save the data to
  * @param[in] data The data to be written to the file
  * @param[in] bytes_to_write The number of bytes to write to the file
  * @return If the save was successful
+ * @note The data is written to a PARTIAL_FILE_EXTENTION file, which is
+ * synced to disk and renamed over the file, and the rename is synced too.
+ * Once this returns the file is on disk whole, so the input it came from
+ * can be removed, and a crash never leaves a cut off file under the name.
  */
 int save_to_file(const char *filename, unsigned char *data,
                  size_t bytes_to_write);
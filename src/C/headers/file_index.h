@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @struct file_index_t
+ * @brief On-disk index of the files encrypted by previous runs of a
+ * directory job, used to skip the files that haven't changed since
+ */
+typedef struct file_index file_index_t;
+
+/**
+ * @struct index_entry_t
+ * @brief The state of a single file when it was last encrypted
+ */
+typedef struct
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;
+    // Fingerprint of the keys the file was encrypted with
+    uint64_t keyset;
+    char *output;
+} index_entry_t;
+
+static const char INDEX_FILE[] = ".eea_index";
+
+/**
+ * @brief Open the index for the given directory, loading the entries saved
+ * by the previous run if there are any
+ * @param[in] dir_name The directory the job is running on
+ * @param[in] use_hash Also compare a hash of each file's contents, so files
+ * that were touched but not changed are still skipped
+ * @param[in] keys The keys the job encrypts with
+ * @param[in] num_keys The number of keys
+ * @return The index, NULL if allocating it failed
+ * @note Return value must be closed with file_index_close()
+ */
+file_index_t *file_index_open(const char *dir_name, int use_hash,
+                              const char **keys, int num_keys);
+
+/**
+ * @brief Check if a file has changed since it was last encrypted
+ * @param[in] index The index
+ * @param[in] path The file to check
+ * @param[out] current The current state of the file, to be passed to
+ * file_index_update() once the file is encrypted
+ * @return 1 if the file is unchanged, its output still exists and was
+ * encrypted with the same keys, 0 if it needs to be encrypted
+ */
+int file_index_unchanged(file_index_t *index, const char *path,
+                         index_entry_t *current);
+
+/**
+ * @brief Record that a file was encrypted
+ * @param[in] index The index
+ * @param[in] current The state of the file from file_index_unchanged()
+ * @param[in] output The file the encrypted data was saved to
+ */
+void file_index_update(file_index_t *index, const index_entry_t *current,
+                       const char *output);
+
+/**
+ * @brief Save and close the index
+ * @param[in] index The index to close
+ * @param[in] save Write the index to disk before closing it
+ * @note Entries for files that were not seen during this run are dropped
+ */
+void file_index_close(file_index_t *index, int save);
@@ -10,6 +10,34 @@ static const int ROUNDS = 5;
 static const char DEFAULT_KEYS_FILE[] = "keys.keys";
 static const char DEFAULT_KEYS_DIR[] = ".";
 extern char *keys_dir;
+// Skip files that haven't changed since the last time a directory was
+// encrypted (set in the config file)
+extern int incremental_index;
+extern int index_content_hash;
+// How the results of directory jobs are reported, one of OutputModes
+// (set in the config file)
+extern int output_mode;
+// Time the stages of each job and print a breakdown at the end
+// (set with --stats or in the config file)
+extern int stats_enabled;
+// Write a timeline of each job to this file, in the Chrome trace format
+// (set with --trace or in the config file)
+extern char *trace_file;
+// The kernel used for the XOR rounds, one of XorKernels, and the number of
+// bytes taken through every key at a time, 0 for all of them
+// (set in the config file, see the autotune command)
+extern int xor_kernel;
+extern size_t chunk_size;
+// Compress the plain text before encrypting it (set with --compress or in
+// the config file). Decryption always undoes it.
+extern int compression;
+// End .eea files in a line of CRC32C checksums of the cipher text, for
+// verify (set with --checksums or in the config file). Off by default, as
+// older builds and the other ports can't read them.
+extern int checksums;
+// The number of threads directory jobs use by default
+// (set in the config file, see the autotune command)
+extern int default_threads;
 static const char EEA_FILE_EXTENTION[] = ".eea";
 // Selection 2 (512-bits) in the menu
 static const int DEFAULT_KEY_SELECTION = 2;
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+
+// Each power of two is split into 2^HISTOGRAM_SUB_BITS buckets, so a value
+// is recorded to within 1/128 (under 1%) of itself. Values below 256 are
+// recorded exactly.
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_BUCKETS ((65 - HISTOGRAM_SUB_BITS) << HISTOGRAM_SUB_BITS)
+
+/**
+ * @struct histogram_t
+ * @brief A log-linear (HDR style) histogram of values, such as latencies
+ * in nanoseconds. Recording a value is constant time, and the histogram
+ * covers every uint64_t with the same relative precision.
+ */
+typedef struct
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} histogram_t;
+
+/**
+ * @brief Create an empty histogram
+ * @return The histogram, NULL if allocating it failed
+ */
+histogram_t *histogram_create(void);
+
+/**
+ * @brief Free a histogram
+ * @param[in] hist The histogram to free, may be NULL
+ */
+void histogram_free(histogram_t *hist);
+
+/**
+ * @brief Empty a histogram
+ * @param[in] hist The histogram
+ */
+void histogram_reset(histogram_t *hist);
+
+/**
+ * @brief Record a value
+ * @param[in] hist The histogram
+ * @param[in] value The value to record
+ * @note Not thread safe. Each thread should have its own histogram, or
+ * hold a lock.
+ */
+void histogram_record(histogram_t *hist, uint64_t value);
+
+/**
+ * @brief Get the value at a percentile
+ * @param[in] hist The histogram
+ * @param[in] percentile The percentile, from 0 to 100, e.g. 99.9
+ * @return The largest value that could have been recorded in the bucket the
+ * percentile falls in, capped at the largest value recorded. 0 if the
+ * histogram is empty.
+ */
+uint64_t histogram_percentile(const histogram_t *hist, double percentile);
+
+/**
+ * @brief Get the mean of the recorded values
+ * @param[in] hist The histogram
+ * @return The mean, 0 if the histogram is empty
+ */
+double histogram_mean(const histogram_t *hist);
@@ -0,0 +1,89 @@
+#pragma once
+
+/**
+ * @struct journal_t
+ * @brief Append-only record of the state of each file in a directory job,
+ * used to resume the job if it is interrupted
+ */
+typedef struct journal journal_t;
+
+/**
+ * @enum JournalState
+ * @brief The state of a file recorded in the journal
+ */
+typedef enum
+{
+    JOURNAL_QUEUED = 'Q',
+    JOURNAL_IN_PROGRESS = 'P',
+    JOURNAL_COMMITTED = 'C'
+} JournalState;
+
+static const char JOURNAL_FILE[] = ".eea_journal";
+
+/**
+ * @brief Get the path to the journal for the given directory
+ * @param[in] dir_name The directory the job is running on
+ * @return Path to the journal
+ * @note Return value must be freed
+ */
+char *get_journal_path(const char *dir_name);
+
+/**
+ * @brief Checks to see if an unfinished job journal exists for the
+ * directory
+ * @param[in] dir_name The directory to check
+ * @param[in] encrypting If the job would be encrypting the directory
+ * @return If a journal for the same kind of job exists
+ */
+int journal_exists(const char *dir_name, int encrypting);
+
+/**
+ * @brief Open the journal for a directory job
+ * @param[in] dir_name The directory the job is running on
+ * @param[in] encrypting If the job is encrypting the directory
+ * @param[in] overwrite Should the files be removed once they are committed
+ * @param[in] resume Load the existing journal and continue where it left
+ * off, rather than starting a new one
+ * @return The journal, NULL if it could not be opened
+ * @note Return value must be closed with journal_close()
+ */
+journal_t *journal_open(const char *dir_name, int encrypting, int overwrite,
+                        int resume);
+
+/**
+ * @brief Checks if a file should be skipped because a previous run of the
+ * job already committed it, or because it is the output of a file the
+ * previous run recorded
+ * @param[in] journal The journal
+ * @param[in] path The file to check
+ * @return 0 if the file should be queued, JOURNAL_COMMITTED if the previous
+ * run committed it, or 1 if it should be skipped for any other reason
+ */
+int journal_should_skip(journal_t *journal, const char *path);
+
+/**
+ * @brief Record the state of a file in the journal
+ * @param[in] journal The journal
+ * @param[in] path The file the state is for
+ * @param[in] state The new state of the file
+ */
+void journal_record(journal_t *journal, const char *path, JournalState state);
+
+/**
+ * @brief Record a file as committed, once its output has been saved
+ * @param[in] journal The journal
+ * @param[in] path The file that was committed
+ * @note Must only be called once the output is on disk, see save_to_file().
+ * The journal is synced to disk in batches. When overwriting, the file is
+ * only removed once the batch it was committed in has been synced, so an
+ * interrupted job never loses a file that is not marked as committed.
+ */
+void journal_commit(journal_t *journal, const char *path);
+
+/**
+ * @brief Sync and close the journal
+ * @param[in] journal The journal to close
+ * @param[in] finished If the job finished without any failures. If so,
+ * the journal is deleted, otherwise it is kept so the job can be resumed.
+ */
+void journal_close(journal_t *journal, int finished);
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * @enum XorKernels
+ * @brief The ways the XOR rounds of encrypt() and decrypt() can be run (set
+ * in the config file)
+ */
+typedef enum
+{
+    // A byte at a time, one key after the other over the whole buffer
+    XOR_KERNEL_REFERENCE = 0,
+    // A block at a time, a word wide, taking each chunk of the buffer
+    // through every key while it is in cache
+    XOR_KERNEL_BLOCKED = 1
+} XorKernels;
+
+static const char *XOR_KERNEL_NAMES[] = { "reference", "blocked" };
+static const int NUM_XOR_KERNELS = sizeof(XOR_KERNEL_NAMES) / sizeof(char *);
+
+/**
+ * @brief Find a kernel by its name
+ * @param[in] name The name of the kernel, as in XOR_KERNEL_NAMES
+ * @return The kernel, one of XorKernels, -1 if there isn't one by that name
+ */
+int xor_kernel_from_name(const char *name);
+
+/**
+ * @brief Encrypt the next part of a stream in place with the blocked kernel
+ * @param[in,out] buf The next part of the padded plain text, a multiple of
+ * key_len long. Set to the cipher text.
+ * @param[in] len The length of the buffer
+ * @param[in,out] tails The last block of each round so far, from
+ * xor_tails_from_keys(). Updated for the next part.
+ * @param[in] num_keys The number of keys
+ * @param[in] key_len The length of each key
+ * @param[in] chunk The number of bytes to take through every key at a time,
+ * rounded down to a multiple of key_len. 0 for the whole buffer.
+ */
+void xor_encrypt_chained(unsigned char *buf, size_t len, unsigned char *tails,
+                         int num_keys, size_t key_len, size_t chunk);
+
+/**
+ * @brief Decrypt the next part of a stream in place with the blocked kernel
+ * @param[in,out] buf The next part of the cipher text, a multiple of key_len
+ * long. Set to the padded plain text.
+ * @param[in] len The length of the buffer
+ * @param[in,out] tails The last block of each round so far, from
+ * xor_tails_from_keys(). Updated for the next part.
+ * @param[in] num_keys The number of keys
+ * @param[in] key_len The length of each key
+ * @param[in] chunk The number of bytes to take through every key at a time,
+ * rounded down to a multiple of key_len. 0 for the whole buffer.
+ */
+void xor_decrypt_chained(unsigned char *buf, size_t len, unsigned char *tails,
+                         int num_keys, size_t key_len, size_t chunk);
+
+/**
+ * @brief Get the state to start a stream with, for xor_encrypt_chained() and
+ * xor_decrypt_chained()
+ * @param[in] keys The keys
+ * @param[in] num_keys The number of keys
+ * @param[in] key_len The length of each key
+ * @return The tails, NULL if allocating them failed
+ * @note The tails must be freed
+ */
+unsigned char *xor_tails_from_keys(const char **keys, int num_keys,
+                                   size_t key_len);
+
+/**
+ * @brief Encrypt a buffer in place with the blocked kernel
+ * @param[in,out] buf The padded plain text, a multiple of key_len long.
+ * Set to the cipher text.
+ * @param[in] len The length of the buffer
+ * @param[in] keys The keys to encrypt with
+ * @param[in] num_keys The number of keys
+ * @param[in] key_len The length of each key
+ * @param[in] chunk The number of bytes to take through every key at a time,
+ * rounded down to a multiple of key_len. 0 for the whole buffer.
+ * @return 0 on success, 1 if allocating memory failed
+ */
+int xor_encrypt_blocked(unsigned char *buf, size_t len, const char **keys,
+                        int num_keys, size_t key_len, size_t chunk);
+
+/**
+ * @brief Decrypt a buffer in place with the blocked kernel
+ * @param[in,out] buf The cipher text, a multiple of key_len long. Set to the
+ * padded plain text.
+ * @param[in] len The length of the buffer
+ * @param[in] keys The keys to decrypt with
+ * @param[in] num_keys The number of keys
+ * @param[in] key_len The length of each key
+ * @param[in] chunk The number of bytes to take through every key at a time,
+ * rounded down to a multiple of key_len. 0 for the whole buffer.
+ * @return 0 on success, 1 if allocating memory failed
+ */
+int xor_decrypt_blocked(unsigned char *buf, size_t len, const char **keys,
+                        int num_keys, size_t key_len, size_t chunk);
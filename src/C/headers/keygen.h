@@ -30,3 +30,12 @@ char *generate_key(size_t hash_size);
  * @return The array of keys
  */
 char **generate_keys(size_t hash_size, int num_keys);
+
+/**
+ * @brief Hash a password into the key that keys files are encrypted with
+ * @param[in] password The password
+ * @return The SHA512 of the password as a hex string, NULL if allocating it
+ * failed
+ * @note Return value must be freed
+ */
+char *hash_password(const char *password);
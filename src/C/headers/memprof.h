@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Allocate memory, recording the allocation against its call site
+ * @param[in] size The number of bytes to allocate
+ * @param[in] file The file of the call site
+ * @param[in] line The line of the call site
+ * @return The memory, NULL if allocating it failed
+ */
+void *memprof_malloc(size_t size, const char *file, int line);
+
+/**
+ * @brief Allocate zeroed memory, recording the allocation against its call
+ * site
+ * @param[in] num The number of elements to allocate
+ * @param[in] size The size of each element
+ * @param[in] file The file of the call site
+ * @param[in] line The line of the call site
+ * @return The memory, NULL if allocating it failed
+ */
+void *memprof_calloc(size_t num, size_t size, const char *file, int line);
+
+/**
+ * @brief Resize memory, recording the new allocation against its call site
+ * @param[in] ptr The memory to resize, may be NULL
+ * @param[in] size The new size in bytes
+ * @param[in] file The file of the call site
+ * @param[in] line The line of the call site
+ * @return The resized memory, NULL if resizing it failed
+ */
+void *memprof_realloc(void *ptr, size_t size, const char *file, int line);
+
+/**
+ * @brief Duplicate a string, recording the allocation against its call site
+ * @param[in] str The string to duplicate
+ * @param[in] file The file of the call site
+ * @param[in] line The line of the call site
+ * @return The copy of the string, NULL if allocating it failed
+ */
+char *memprof_strdup(const char *str, const char *file, int line);
+
+/**
+ * @brief Free memory, removing it from the live heap of the thread that
+ * allocated it
+ * @param[in] ptr The memory to free. Memory that was allocated without
+ * being recorded, such as by getline(), is freed as normal.
+ */
+void memprof_free(void *ptr);
+
+/**
+ * @brief Start a new job, clearing the counts from the last one
+ * @note Does nothing unless built with `make memprof`
+ */
+void memprof_begin_job(void);
+
+/**
+ * @brief Name the calling thread in the profile
+ * @param[in] name The name of the thread. Must be a string literal, or
+ * otherwise outlive the job.
+ */
+void memprof_name_thread(const char *name);
+
+/**
+ * @brief Finish the job and print the allocations and bytes per call site,
+ * and the peak live heap per thread and for the job, as a table or as a
+ * JSON line
+ * @param[in] json Print the profile as a JSON line
+ * @note Does nothing unless built with `make memprof`
+ */
+void memprof_end_job(int json);
+
+// The memprof build force includes this header into every source file, so
+// all of their allocations go through the wrappers above
+#ifdef EEA_MEMPROF
+#define malloc(size) memprof_malloc((size), __FILE__, __LINE__)
+#define calloc(num, size) memprof_calloc((num), (size), __FILE__, __LINE__)
+#define realloc(ptr, size) memprof_realloc((ptr), (size), __FILE__, __LINE__)
+#define strdup(str) memprof_strdup((str), __FILE__, __LINE__)
+#define free(ptr) memprof_free(ptr)
+#endif
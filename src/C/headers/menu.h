@@ -30,7 +30,8 @@ typedef enum
 {
     ENCRYPT_DECRYPT_MENU_FILE = 0,
     ENCRYPT_DECRYPT_MENU_DIR = 1,
-    ENCRYPT_DECRYPT_MENU_TEXT = 2
+    ENCRYPT_DECRYPT_MENU_TEXT = 2,
+    ENCRYPT_DECRYPT_MENU_WATCH = 3
 } EncryptDecryptMenuOptions;
 
 static const char *MAIN_MENU_ITEMS[] = { "1. Manage Keys", "2. Encrypt",
@@ -52,8 +53,9 @@ static const char *MANAGE_KEYS_MENU_ITEMS[] = { "1. Add Keys",
 static const size_t NUM_MANAGE_KEYS_MENU_ITEMS = sizeof(MANAGE_KEYS_MENU_ITEMS)
                                                  / sizeof(char *);
 
-static const char *ENCRYPT_DECRYPT_MENU_ITEMS[] = { "single file", "directory",
-                                                    "text" };
+static const char *ENCRYPT_DECRYPT_MENU_ITEMS[] = {
+    "single file", "directory", "text", "files as they land in a directory"
+};
 static const size_t
     NUM_ENCRYPT_DECRYPT_MENU_ITEMS = sizeof(ENCRYPT_DECRYPT_MENU_ITEMS)
                                      / sizeof(char *);
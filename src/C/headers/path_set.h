@@ -0,0 +1,39 @@
+#pragma once
+
+/**
+ * @struct path_set_t
+ * @brief A set of paths, such as the outputs a directory job has written,
+ * so the walk can tell them apart from the files that were already there
+ * @note Not thread safe. It is only used by the thread walking the
+ * directory.
+ */
+typedef struct path_set path_set_t;
+
+/**
+ * @brief Create an empty set
+ * @return The new set, NULL if allocating it failed
+ * @note Return value must be freed with path_set_free()
+ */
+path_set_t *path_set_create(void);
+
+/**
+ * @brief Add a path to the set
+ * @param[in] set The set
+ * @param[in] path The path, which is copied
+ * @return 1 if the path is in the set, 0 if allocating memory failed
+ */
+int path_set_add(path_set_t *set, const char *path);
+
+/**
+ * @brief Checks if a path is in the set
+ * @param[in] set The set (may be NULL)
+ * @param[in] path The path
+ * @return If the path was added to the set
+ */
+int path_set_contains(const path_set_t *set, const char *path);
+
+/**
+ * @brief Free the set and the paths in it
+ * @param[in] set The set (may be NULL)
+ */
+void path_set_free(path_set_t *set);
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @enum OutputModes
+ * @brief How the results of a directory job are reported (set in the
+ * config file)
+ */
+typedef enum
+{
+    // A progress line with the throughput and ETA, updated in place
+    OUTPUT_PROGRESS = 0,
+    // A line for every file, like single file mode
+    OUTPUT_VERBOSE = 1,
+    // Only the summary of the files that failed
+    OUTPUT_QUIET = 2,
+    // A JSON object per line, for scripts
+    OUTPUT_JSON = 3
+} OutputModes;
+
+/**
+ * @struct progress_t
+ * @brief Counters for the workers of a directory job, and the thread that
+ * reports them
+ */
+typedef struct progress progress_t;
+
+/**
+ * @brief Start reporting the progress of a directory job
+ * @param[in] num_workers The number of threads working on the files
+ * @param[in] encrypting Are we encrypting the files
+ * @param[in] mode How to report the progress, one of OutputModes
+ * @return The progress, NULL if allocating it failed
+ * @note Return value must be stopped with progress_stop()
+ */
+progress_t *progress_start(int num_workers, int encrypting, int mode);
+
+/**
+ * @brief Stop reporting the progress, and print the summary
+ * @param[in] progress The progress to stop
+ * @note The workers must have finished before it is stopped
+ */
+void progress_stop(progress_t *progress);
+
+/**
+ * @brief Give the calling thread its own counters, so updating them
+ * doesn't contend with the other workers
+ * @param[in] progress The progress of the job
+ * @note Must be called by each worker before it reports any files. Files
+ * counted by a thread that didn't call it, such as the one walking the
+ * directory, go to counters of their own.
+ */
+void progress_register_worker(progress_t *progress);
+
+/**
+ * @brief Count a file that was added to the queue
+ * @param[in] progress The progress of the job
+ */
+void progress_file_queued(progress_t *progress);
+
+/**
+ * @brief Mark that all the files have been queued, so the ETA can be
+ * worked out
+ * @param[in] progress The progress of the job
+ */
+void progress_walk_done(progress_t *progress);
+
+/**
+ * @brief Count a file that was encrypted/decrypted
+ * @param[in] progress The progress of the job
+ * @param[in] bytes_in The size of the file
+ * @param[in] bytes_out The size of the output
+ */
+void progress_file_done(progress_t *progress, size_t bytes_in,
+                        size_t bytes_out);
+
+/**
+ * @brief Count a file that failed to be encrypted/decrypted
+ * @param[in] progress The progress of the job
+ * @param[in] path The file
+ */
+void progress_file_failed(progress_t *progress, const char *path);
+
+/**
+ * @brief Count a file that was skipped because it hasn't changed, or
+ * because the job it is resuming already did it
+ * @param[in] progress The progress of the job
+ */
+void progress_file_skipped(progress_t *progress);
+
+/**
+ * @brief Get the number of files that failed so far
+ * @param[in] progress The progress of the job
+ * @return The number of files that failed
+ */
+uint64_t progress_failures(progress_t *progress);
+
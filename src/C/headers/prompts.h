@@ -53,6 +53,13 @@ int prompt_for_ghost_mode_keys(char ***keys, int *num_keys);
  */
 int prompt_for_overwrite(int is_single_file);
 
+/**
+ * @brief Prompt the user if they want to resume an interrupted job
+ * @param[in] dir_name The directory the job was running on
+ * @return Whether or not to resume the job
+ */
+int prompt_for_resume(const char *dir_name);
+
 /**
  * @brief Prompt the user for a password and return the result
  * @param[in] prompt The prompt to display to the user
@@ -68,3 +75,39 @@ char *get_password(const char *prompt);
  * @note The returned password must be freed
  */
 char *get_hashed_password(int set_password);
+
+/**
+ * @brief Prompt the user for the name of the file they would like to encrypt
+ * @param[in] encrypting If this file will be encrypted
+ * @return The name of the file to encrypt/decrypt
+ * @note Return value must be freed
+ */
+char *get_input_filename(int encrypting);
+
+/**
+ * @brief Prompt the user for the name of the directory they would
+ *   like to encrypt
+ * @param[in] encrypting If this directory will be encrypted
+ * @return The name of the directory to encrypt/decrypt
+ * @note Return value must be freed
+ */
+char *get_input_dir_name(int encrypting);
+
+/**
+ * @brief Load in the keys for encryption from they key file, prompting for
+ * its password
+ * @param[in] filename The name of the file to load the keys from
+ * @param[out] total_keys The number of keys loaded in from the file
+ * @param[out] key_len The length of an individual key
+ * @return The keys loaded in from the file
+ * @note The keys must be freed
+ */
+char **load_keys_from_file(const char *filename, int *total_keys, size_t *len);
+
+/**
+ * @brief Load in the users preferred keys from a keys file
+ * @param[out] num_keys The number of keys read in
+ * @return List of keys
+ * @note List of keys must be freed
+ */
+char **load_keys(int *num_keys);
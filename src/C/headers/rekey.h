@@ -0,0 +1,34 @@
+#pragma once
+
+/**
+ * @brief Re-encrypt an .eea file with new keys, streaming the old cipher
+ * text through decryption and straight into encryption, so the plain text
+ * is never written to disk. The new cipher text is written next to the file
+ * and then renamed over it, so the file is either wholly old or wholly new.
+ * @param[in] path The .eea file
+ * @param[in] old_keys The keys the file was encrypted with
+ * @param[in] old_num_keys The number of old keys
+ * @param[in] new_keys The keys to encrypt it with
+ * @param[in] new_num_keys The number of new keys
+ * @param[out] bytes Set to the size of the old file (may be NULL)
+ * @return EEA_OK, or one of EeaErrors. The file is left as it was on an
+ * error.
+ */
+int rekey_file(const char *path, const char **old_keys, int old_num_keys,
+               const char **new_keys, int new_num_keys, size_t *bytes);
+
+/**
+ * @brief Re-encrypt .eea files, and every .eea file in directories, with
+ * new keys, on several threads, printing each failure and a summary
+ * @param[in] paths The files and directories
+ * @param[in] num_paths The number of paths
+ * @param[in] old_keys The keys the files were encrypted with
+ * @param[in] old_num_keys The number of old keys
+ * @param[in] new_keys The keys to encrypt them with
+ * @param[in] new_num_keys The number of new keys
+ * @param[in] threads The number of files to re-encrypt at once
+ * @return 0 if every file was re-encrypted, 1 otherwise
+ */
+int rekey_paths(char **paths, int num_paths, const char **old_keys,
+                int old_num_keys, const char **new_keys, int new_num_keys,
+                int threads);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "globals.h"
+#include "utils.h"
+
+/**
+ * @enum StatStages
+ * @brief The stages of encrypting/decrypting a file that are timed
+ */
+typedef enum
+{
+    STAT_READ = 0,
+    STAT_BASE64_DECODE = 1,
+    STAT_XOR = 2,
+    STAT_REMOVE_PADDING = 3,
+    STAT_BASE64_ENCODE = 4,
+    STAT_WRITE = 5,
+    STAT_COMPRESS = 6,
+    STAT_DECOMPRESS = 7,
+    NUM_STAT_STAGES = 8
+} StatStages;
+
+// If the stages are being timed, for the stats or the trace
+#define STATS_ACTIVE (stats_enabled || trace_file != NULL)
+
+/**
+ * @brief Start timing a stage
+ * @param[in] name Name of the variable to hold the start time
+ * @note When the stats and trace are disabled this is a single branch, so
+ * the stages can be timed in the hot paths
+ */
+#define STATS_START(name) uint64_t name = STATS_ACTIVE ? get_time_ns() : 0
+
+/**
+ * @brief Stop timing a stage, adding it to the calling thread's totals and
+ * the trace
+ * @param[in] stage The stage that was timed, one of StatStages
+ * @param[in] name Name of the variable passed to STATS_START()
+ * @param[in] bytes The number of bytes the stage worked on
+ */
+#define STATS_STOP(stage, name, bytes)                                        \
+    do                                                                        \
+    {                                                                         \
+        if (STATS_ACTIVE)                                                     \
+            stats_stage_done((stage), (name), (bytes));                       \
+    } while (0)
+
+/**
+ * @brief Add the time and bytes for a stage to the calling thread's totals,
+ * and record it in the trace
+ * @param[in] stage The stage, one of StatStages
+ * @param[in] start_ns When the stage started, from get_time_ns()
+ * @param[in] bytes The number of bytes the stage worked on
+ */
+void stats_stage_done(int stage, uint64_t start_ns, uint64_t bytes);
+
+/**
+ * @brief Start a new job, clearing the totals from the last one
+ * @note The calling thread's totals are cleared too. Worker threads
+ * must be started after this is called.
+ */
+void stats_begin_job(void);
+
+/**
+ * @brief Add the calling thread's totals to the job's totals
+ * @note Must be called by each worker thread before it exits
+ */
+void stats_flush_thread(void);
+
+/**
+ * @brief Finish the job and print the breakdown of the time spent in each
+ * stage, as a table or as a JSON line
+ * @param[in] threads The number of threads that worked on the job
+ * @param[in] json Print the breakdown as a JSON line
+ */
+void stats_end_job(int threads, int json);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdio.h>
+
+/**
+ * @brief Encrypt a stream, such as stdin, a part at a time, so it takes the
+ * same memory however long it is
+ * @param[in] in The plain text
+ * @param[out] out Where to write the cipher text, the same as encrypt()
+ * would give for the whole stream. If compression is set, the stream is
+ * compressed into frames first, and the cipher text of them starts with
+ * COMPRESSED_PREFIX. If checksums is set, a line of checksums of the
+ * cipher text follows it, as encrypt_file() writes.
+ * @param[in] keys The keys to use for encryption
+ * @param[in] num_keys The number of keys being used for encryption
+ * @param[out] trailing_padding Set to the number of padding bytes the plain
+ * text ended in, which decryption removes with the padding, 0 when it is
+ * compressed (may be NULL)
+ * @return EEA_OK, or one of EeaErrors
+ * @note The XOR rounds always use the blocked kernel, with chunk_size
+ */
+int encrypt_stream(FILE *in, FILE *out, const char **keys, int num_keys,
+                   size_t *trailing_padding);
+
+/**
+ * @brief Encrypt a stream for several keysets at once, reading it only
+ * once. Each part read is encrypted for every keyset on its own thread
+ * while the next part is read.
+ * @param[in] in The plain text
+ * @param[out] outs Where to write the cipher text for each keyset, the same
+ * as encrypt_stream() would give
+ * @param[in] keys The keys of each keyset
+ * @param[in] num_keys The number of keys in each keyset
+ * @param[in] count The number of keysets
+ * @param[out] trailing_padding Set to the number of padding bytes the plain
+ * text ended in, as with encrypt_stream() (may be NULL)
+ * @return EEA_OK, or one of EeaErrors. If writing any output fails, the
+ * rest are still written.
+ * @note The XOR rounds always use the blocked kernel, with chunk_size
+ */
+int encrypt_stream_fanout(FILE *in, FILE **outs, const char ***keys,
+                          const int *num_keys, int count,
+                          size_t *trailing_padding);
+
+/**
+ * @brief Decrypt a stream of base64 cipher text a part at a time, so it
+ * takes the same memory however long it is
+ * @param[in] in The cipher text, from encrypt() or encrypt_stream()
+ * @param[out] out Where to write the plain text. As with decrypt(), any
+ * padding bytes at the end are removed. Cipher text that starts with
+ * COMPRESSED_PREFIX is decompressed.
+ * @param[in] keys The keys to use for decryption
+ * @param[in] num_keys The number of keys being used for decryption
+ * @return EEA_OK, or one of EeaErrors. Plain text may have been written
+ * before an error is found.
+ * @note The XOR rounds always use the blocked kernel, with chunk_size
+ */
+int decrypt_stream(FILE *in, FILE *out, const char **keys, int num_keys);
+
+/**
+ * @brief Re-encrypt a stream of cipher text with new keys, a part at a
+ * time, so the plain text is never written anywhere
+ * @param[in] in The cipher text, encrypted with the old keys
+ * @param[out] out Where to write the cipher text for the new keys, the same
+ * as decrypting the stream and encrypting the plain text would give
+ * @param[in] old_keys The keys the stream was encrypted with
+ * @param[in] old_num_keys The number of old keys
+ * @param[in] new_keys The keys to encrypt it with
+ * @param[in] new_num_keys The number of new keys
+ * @return EEA_OK, or one of EeaErrors. Some of the output may have been
+ * written before an error is found.
+ * @note The XOR rounds always use the blocked kernel, with chunk_size
+ */
+int rekey_stream(FILE *in, FILE *out, const char **old_keys,
+                 int old_num_keys, const char **new_keys, int new_num_keys);
@@ -1,29 +1,47 @@
 #pragma once
 
 /**
- * @brief Function to spin up threads to encrypt multiple files at once
- * @param[in] files_list The list files to be encrypted
- * @param[in] num_files The number of files to be encrypted
+ * @brief Function to spin up threads to encrypt multiple files at once.
+ * The directory is walked while the threads are encrypting, so the
+ * threads start on the first file as soon as it is found.
+ * @param[in] dir_name The directory of files to be encrypted
  * @param[in] keys The keys to be used for encryption
  * @param[in] num_keys The number of keys
  * @param[in] overwrite Should the files be overwritten
  * @param[in] threads The number of threads to use (default: 1)
- * @note The array of files will be freed
+ * @param[in] resume Skip the files a previous, interrupted, run of the
+ * job already committed to its journal
  */
-void start_dir_encrypt_threads(char **files_list, int num_files,
-                               const char **keys, int num_keys, int overwrite,
-                               int threads);
+void start_dir_encrypt_threads(const char *dir_name, const char **keys,
+                               int num_keys, int overwrite, int threads,
+                               int resume);
 
 /**
- * @brief Function to spin up threads to decrypt multiple files at once
- * @param[in] files_list The list files to be decrypted
- * @param[in] num_files The number of files to be decrypted
+ * @brief Function to spin up threads to decrypt multiple files at once.
+ * The directory is walked while the threads are decrypting, so the
+ * threads start on the first file as soon as it is found.
+ * @param[in] dir_name The directory of files to be decrypted
  * @param[in] keys The keys to be used for decryption
  * @param[in] num_keys The number of keys
  * @param[in] overwrite Should the files be overwritten
  * @param[in] threads The number of threads to use (default: 1)
- * @note The array of files will be freed
+ * @param[in] resume Skip the files a previous, interrupted, run of the
+ * job already committed to its journal
  */
-void start_dir_decrypt_threads(char **files_list, int num_files,
-                               const char **keys, int num_keys, int overwrite,
-                               int threads);
+void start_dir_decrypt_threads(const char *dir_name, const char **keys,
+                               int num_keys, int overwrite, int threads,
+                               int resume);
+
+/**
+ * @brief Function to spin up threads that encrypt or decrypt files as
+ * they land in a directory, until the user stops watching it
+ * @param[in] dir_name The directory to watch
+ * @param[in] keys The keys to be used for encryption/decryption
+ * @param[in] num_keys The number of keys
+ * @param[in] overwrite Should the files be overwritten
+ * @param[in] threads The number of threads to use (default: 1)
+ * @param[in] encrypting Are we encrypting the files
+ */
+void start_dir_watch_threads(const char *dir_name, const char **keys,
+                             int num_keys, int overwrite, int threads,
+                             int encrypting);
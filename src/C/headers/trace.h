@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Start recording the timeline of a new job
+ * @param[in] name The name of the job, shown as the process name
+ */
+void trace_begin_job(const char *name);
+
+/**
+ * @brief Name the calling thread in the timeline
+ * @param[in] name The name of the thread, copied
+ */
+void trace_name_thread(const char *name);
+
+/**
+ * @brief Record a span of time on the calling thread
+ * @param[in] name The name of the span. Must be a string literal, or
+ * otherwise outlive the job.
+ * @param[in] detail Extra detail for the span, such as the file it was for,
+ * copied. May be NULL.
+ * @param[in] start_ns When the span started, from get_time_ns()
+ * @param[in] end_ns When the span ended, from get_time_ns()
+ * @param[in] bytes The number of bytes worked on during the span
+ * @note Each thread records into its own buffer, so this never waits on the
+ * other threads
+ */
+void trace_span(const char *name, const char *detail, uint64_t start_ns,
+                uint64_t end_ns, uint64_t bytes);
+
+/**
+ * @brief Write the timeline of the job to the trace file, and free it
+ * @note Every thread that recorded spans must have finished
+ */
+void trace_end_job(void);
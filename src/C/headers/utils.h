@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
 /**
  * @brief Convert the message digest returned by SHA256 and SHA512 into a
  * hex string
@@ -12,7 +16,8 @@ void message_digest_to_hash(unsigned char *md, char *hash, int digest_length);
 /**
  * @brief Create a randomized hex number and return it as a string
  * @param[in] size The number of randomized bytes to create
- * @return Random hex number as a hex string
+ * @return Random hex number as a hex string, NULL if getting the random
+ * bytes or allocating the string failed
  */
 char *get_random_hexstr(size_t size);
 
@@ -75,14 +80,6 @@ int validate_keys(const char **keys, int num_keys);
  */
 size_t find_key_len(const char *keys_string);
 
-/**
- * @brief Load in the users preferred keys from a keys file
- * @param[out] num_keys The number of keys read in
- * @return List of keys
- * @note List of keys must be freed
- */
-char **load_keys(int *num_keys);
-
 /**
  * @brief Free the list of keys
  * @param[in] keys The list of keys to be freed
@@ -99,3 +96,17 @@ void free_keys(char **keys, int num, const char *print);
  * @return 0 on success, 1 if something went wrong
  */
 int buff_resize(char **buffer, size_t *max, size_t required);
+
+/**
+ * @brief Print a string as a JSON string, with quotes and escapes
+ * @param[in] fout Where to print it
+ * @param[in] str The string to print
+ */
+void print_json_string(FILE *fout, const char *str);
+
+/**
+ * @brief Get the current time from a monotonic clock
+ * @return The current time in nanoseconds
+ * @note Only useful for measuring how long something took
+ */
+uint64_t get_time_ns(void);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * @struct verify_result_t
+ * @brief What checking an .eea file found
+ */
+typedef struct
+{
+    // The size of the file
+    size_t bytes;
+    // If the file ends in a line of checksums, and if that line is damaged
+    int has_checksums;
+    int bad_checksums;
+    // The number of chunks checked, and how many didn't match
+    size_t chunks;
+    size_t damaged;
+    // Where the first chunk that didn't match starts. The damaged bytes
+    // are somewhere in that chunk.
+    size_t first_damaged;
+} verify_result_t;
+
+/**
+ * @brief Check an .eea file against the CRC32C checksums after its cipher
+ * text, a chunk at a time, without decrypting it
+ * @param[in] path The .eea file
+ * @param[out] result Set to what was found
+ * @return EEA_OK if the file could be checked, whether or not it matched,
+ * or one of EeaErrors
+ */
+int verify_file(const char *path, verify_result_t *result);
+
+/**
+ * @brief Check .eea files, and every .eea file in directories, on several
+ * threads, printing each one that is damaged and a summary. No keys are
+ * needed, and nothing is written.
+ * @param[in] paths The files and directories
+ * @param[in] num_paths The number of paths
+ * @param[in] threads The number of files to check at once
+ * @param[in] allow_missing Count files without checksums, encrypted without
+ * them or from before they were added, as unchecked rather than failed
+ * @return 0 if every file matched its checksums, 1 otherwise
+ * @note A file cut short loses its checksums with its end, so a missing
+ * line of checksums can't be told apart from damage. It is only allowed
+ * when asked for.
+ */
+int verify_paths(char **paths, int num_paths, int threads,
+                 int allow_missing);
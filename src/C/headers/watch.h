@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Function called by watch_dir() for every file that lands in the
+ * directory
+ * @param[in] path Path to the file
+ * @param[in] closed_ns When the file was last closed after being written,
+ * from get_time_ns()
+ * @param[in] ctx The context pointer that was passed to watch_dir()
+ * @return 1 to keep watching, 0 to stop
+ */
+typedef int (*watch_callback_t)(const char *path, uint64_t closed_ns,
+                                void *ctx);
+
+/**
+ * @brief Check if watching directories is supported on this platform
+ * @return If watch_dir() is supported
+ */
+int watch_supported(void);
+
+/**
+ * @brief Watch a directory, and its sub-directories, calling the callback
+ *   for each file written to it, until the user enters 'q'
+ * @param[in] dir_name The directory to watch
+ * @param[in] callback Function to call for each file
+ * @param[in] ctx Pointer passed through to the callback
+ * @return 1 if the directory was watched until the user quit, 0 if watching
+ *   it failed or the callback stopped it
+ * @note A file is only handed to the callback once it has been closed and
+ *   not written to again for a short time, so files written in several
+ *   passes are only handled once. While nothing is happening, the watch
+ *   sleeps in the kernel and uses no CPU.
+ */
+int watch_dir(const char *dir_name, watch_callback_t callback, void *ctx);
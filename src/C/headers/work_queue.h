@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * @struct work_queue_t
+ * @brief Bounded, thread safe FIFO queue used to hand work from a
+ * producer (e.g. the directory walker) to the worker threads
+ */
+typedef struct work_queue work_queue_t;
+
+/**
+ * @brief Create a new work queue
+ * @param[in] capacity The maximum number of items the queue can hold before
+ * work_queue_push() blocks
+ * @return The new queue, NULL if allocating it failed
+ * @note Return value must be freed with work_queue_free()
+ */
+work_queue_t *work_queue_create(size_t capacity);
+
+/**
+ * @brief Add an item to the end of the queue, blocking while the queue is
+ * full
+ * @param[in] queue The queue to add the item to
+ * @param[in] item The item to add
+ * @return 1 if the item was added, 0 if the queue has been closed
+ */
+int work_queue_push(work_queue_t *queue, void *item);
+
+/**
+ * @brief Add an item to the end of the queue, if there is room for it
+ * @param[in] queue The queue to add the item to
+ * @param[in] item The item to add
+ * @return 1 if the item was added, 0 if the queue is full or has been
+ * closed
+ */
+int work_queue_try_push(work_queue_t *queue, void *item);
+
+/**
+ * @brief Remove the item at the front of the queue, blocking while the
+ * queue is empty
+ * @param[in] queue The queue to take the item from
+ * @return The item, NULL once the queue is closed and has been drained
+ */
+void *work_queue_pop(work_queue_t *queue);
+
+/**
+ * @brief Close the queue, signaling no more items will be added. Workers
+ * blocked in work_queue_pop() will finish the remaining items and then
+ * get NULL.
+ * @param[in] queue The queue to close
+ */
+void work_queue_close(work_queue_t *queue);
+
+/**
+ * @brief Free the queue
+ * @param[in] queue The queue to free
+ * @note Any items left in the queue are not freed
+ */
+void work_queue_free(work_queue_t *queue);
@@ -4,14 +4,19 @@
 
 #include "app_functions.h"
 #include "decrypt.h"
+#include "eea.h"
 #include "encrypt.h"
 #include "file_handling.h"
 #include "globals.h"
+#include "journal.h"
 #include "keygen.h"
+#include "memprof.h"
 #include "menu.h"
 #include "prompts.h"
+#include "stats.h"
 #include "thread_functions.h"
 #include "utils.h"
+#include "watch.h"
 
 static const char
     *GHOST_ENCRYPT_PRINT = "The data was encrypted with the following keys:";
@@ -36,9 +41,19 @@ static int generate_new_keys(HashType hash_type, int num_keys,
         return 0;
     }
 
+    // We are creating a password
+    char *password_hash = get_hashed_password(1);
+    if (password_hash == NULL)
+    {
+        free_keys(keys, num_keys, NULL);
+        return 0;
+    }
+
     unsigned char *keys_encrypted = NULL;
     size_t encrypted_keys_string_len = encrypt_keys(keys, num_keys,
+                                                    password_hash,
                                                     &keys_encrypted);
+    free(password_hash);
     if (keys_encrypted == NULL)
     {
         fprintf(stderr, "%sError:%s Encrypting keys failed\n",
@@ -448,15 +463,21 @@ static void encrypt_single_file_mode(int ghost_mode)
         return;
     }
 
-    int encryption_success = encrypt_file(filename, (const char **) keys,
-                                          num_keys);
+    stats_begin_job();
+    memprof_begin_job();
+    int error = encrypt_file(filename, (const char **) keys, num_keys, NULL,
+                             NULL);
+    int encryption_success = (error == EEA_OK);
+    stats_end_job(1, 0);
+    memprof_end_job(0);
     if (encryption_success)
         fprintf(stdout, "%sEncryption success:%s %s\n%s",
                 colors[COLOR_SUCCESS], colors[COLOR_RESET], filename,
                 (ghost_mode ? "Encrypted with the following keys:\n" : ""));
     else
-        fprintf(stderr, "%sEncryption failed:%s  %s\n", colors[COLOR_ERROR],
-                colors[COLOR_RESET], filename);
+        fprintf(stderr, "%sEncryption failed:%s  %s (%s)\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], filename,
+                eea_strerror(error));
 
     if (encryption_success && overwrite)
         remove(filename);
@@ -480,18 +501,15 @@ static void encrypt_directory_mode(int ghost_mode)
     if (dir_name == NULL)
         return;
 
-    char *contents = get_dir_contents(dir_name);
-    if (strcmp(contents, "") == 0)
+    if (!dir_has_files(dir_name))
     {
         printf("The directory \'%s\' is empty. There is nothing to do\n",
                dir_name);
-        free(contents);
         free(dir_name);
         return;
     }
-    // Replace the last newline with a null terminator
-    contents[strlen(contents) - 1] = '\0';
 
+    int resume = journal_exists(dir_name, 1) && prompt_for_resume(dir_name);
     int overwrite = prompt_for_overwrite(0); // not single file
     int threads = prompt_for_num_threads();
 
@@ -499,25 +517,12 @@ static void encrypt_directory_mode(int ghost_mode)
     char **keys = keys_prompt(ghost_mode, 1, &num_keys);
     if (keys == NULL)
     {
-        free(contents);
         free(dir_name);
         return;
     }
 
-    int arr_size = 0;
-    char **files_list = split_string(contents, "\n", &arr_size);
-    free(contents);
-    if (files_list == NULL)
-    {
-        free_keys(keys, num_keys, NULL);
-        free(dir_name);
-        fprintf(stderr,
-                "%sError:%s Getting the list of individual files failed.\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET]);
-        return;
-    }
-    start_dir_encrypt_threads(files_list, arr_size, (const char **) keys,
-                              num_keys, overwrite, threads);
+    start_dir_encrypt_threads(dir_name, (const char **) keys, num_keys,
+                              overwrite, threads, resume);
 
     free(dir_name);
     if (ghost_mode)
@@ -550,14 +555,20 @@ static void decrypt_single_file_mode(int ghost_mode)
         return;
     }
 
-    int decryption_success = decrypt_file(filename, (const char **) keys,
-                                          num_keys);
+    stats_begin_job();
+    memprof_begin_job();
+    int error = decrypt_file(filename, (const char **) keys, num_keys, NULL,
+                             NULL);
+    int decryption_success = (error == EEA_OK);
+    stats_end_job(1, 0);
+    memprof_end_job(0);
     if (decryption_success)
         fprintf(stdout, "%sDecryption success:%s %s\n", colors[COLOR_SUCCESS],
                 colors[COLOR_RESET], filename);
     else
-        fprintf(stderr, "%sDecryption failed:%s  %s\n", colors[COLOR_ERROR],
-                colors[COLOR_RESET], filename);
+        fprintf(stderr, "%sDecryption failed:%s  %s (%s)\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], filename,
+                eea_strerror(error));
 
     if (decryption_success && overwrite)
         remove(filename);
@@ -580,18 +591,15 @@ static void decrypt_directory_mode(int ghost_mode)
     if (dir_name == NULL)
         return;
 
-    char *contents = get_dir_contents(dir_name);
-    if (strcmp(contents, "") == 0)
+    if (!dir_has_files(dir_name))
     {
         printf("The directory \'%s\' is empty. There is nothing to do\n",
                dir_name);
-        free(contents);
         free(dir_name);
         return;
     }
-    // Replace the last newline with a null terminator
-    contents[strlen(contents) - 1] = '\0';
 
+    int resume = journal_exists(dir_name, 0) && prompt_for_resume(dir_name);
     int overwrite = prompt_for_overwrite(0); // not single file
 
     int threads = prompt_for_num_threads();
@@ -601,27 +609,61 @@ static void decrypt_directory_mode(int ghost_mode)
     if (keys == NULL)
     {
         free(dir_name);
-        free(contents);
         return;
     }
 
-    int arr_size = 0;
-    char **files_list = split_string(contents, "\n", &arr_size);
-    free(contents);
-    if (files_list == NULL)
+    start_dir_decrypt_threads(dir_name, (const char **) keys, num_keys,
+                              overwrite, threads, resume);
+
+    free(dir_name);
+    free_keys(keys, num_keys, NULL);
+    return;
+}
+
+/**
+ * @brief Watch a directory and encrypt/decrypt files as they land in it,
+ * based on user input
+ * @param[in] ghost_mode Whether we are encrypting/decrypting in ghost mode
+ * @param[in] encrypting Are we encrypting
+ * @note Ghost Mode opts to use new randomly generated keys, rather
+ * than keys from a keys file
+ */
+static void watch_directory_mode(int ghost_mode, int encrypting)
+{
+    if (!watch_supported())
     {
-        free_keys(keys, num_keys, NULL);
-        free(dir_name);
         fprintf(stderr,
-                "%sError:%s Getting the list of individual files failed.\n",
+                "%sError:%s Watching directories is not supported on this "
+                "platform\n",
                 colors[COLOR_ERROR], colors[COLOR_RESET]);
         return;
     }
-    start_dir_decrypt_threads(files_list, arr_size, (const char **) keys,
-                              num_keys, overwrite, threads);
+
+    char *dir_name = get_input_dir_name(encrypting);
+    if (dir_name == NULL)
+        return;
+
+    int overwrite = prompt_for_overwrite(0); // not single file
+    int threads = prompt_for_num_threads();
+
+    int num_keys = 0;
+    char **keys = keys_prompt(ghost_mode, encrypting, &num_keys);
+    if (keys == NULL)
+    {
+        free(dir_name);
+        return;
+    }
+
+    start_dir_watch_threads(dir_name, (const char **) keys, num_keys,
+                            overwrite, threads, encrypting);
 
     free(dir_name);
-    free_keys(keys, num_keys, NULL);
+    if (ghost_mode && encrypting)
+        printf("Your files were encrypted with the following keys:\n");
+
+    const char *print = (ghost_mode && encrypting) ? GHOST_ENCRYPT_PRINT
+                                                   : NULL;
+    free_keys(keys, num_keys, print);
     return;
 }
 
@@ -809,6 +851,9 @@ void do_encryption(void)
             case ENCRYPT_DECRYPT_MENU_TEXT:
                 text_mode(ghost, 1);
                 return;
+            case ENCRYPT_DECRYPT_MENU_WATCH:
+                watch_directory_mode(ghost, 1);
+                return;
             default:
                 printf("Invalid selection\n");
                 break;
@@ -859,6 +904,9 @@ void do_decryption(void)
             case ENCRYPT_DECRYPT_MENU_TEXT:
                 text_mode(ghost, 0);
                 return;
+            case ENCRYPT_DECRYPT_MENU_WATCH:
+                watch_directory_mode(ghost, 0);
+                return;
             default:
                 printf("Invalid selection\n");
                 break;
@@ -0,0 +1,1085 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "base64.h"
+#include "eea.h"
+#include "file_handling.h"
+#include "globals.h"
+#include "kernels.h"
+#include "utils.h"
+#include "work_queue.h"
+
+// Starts every archive
+static const char ARCHIVE_MAGIC[] = "EEAPACK1\n";
+// Starts the index, so decrypting it with the wrong keys is noticed
+static const char INDEX_MAGIC[] = "EEAINDEX";
+// How much of the files laid end to end each segment holds. Reading a file
+// back decrypts every segment it is in.
+static const size_t ARCHIVE_SEGMENT = (size_t) 4 << 20;
+// Ends every archive: a new line, then where the index is, how long it is,
+// and how long it is once decrypted, as 16 hex digits each, then a new line
+#define ARCHIVE_FOOTER_LEN (1 + 3 * 16 + 1)
+
+/**
+ * @struct archive_entry_t
+ * @brief A file in an archive
+ */
+typedef struct
+{
+    // Where the file is read from when packing
+    char *path;
+    // The path it is stored under, the end of path
+    const char *name;
+    uint32_t mode;
+    // Where the file starts in the files laid end to end
+    uint64_t offset;
+    uint64_t size;
+} archive_entry_t;
+
+/**
+ * @struct archive_segment_t
+ * @brief Where a segment's cipher text is in an archive
+ */
+typedef struct
+{
+    uint64_t offset;
+    uint64_t length;
+} archive_segment_t;
+
+/**
+ * @struct archive_index_t
+ * @brief What an archive holds, and where
+ */
+typedef struct
+{
+    uint64_t segment_size;
+    // The length of the files laid end to end
+    uint64_t total;
+    archive_segment_t *segments;
+    size_t num_segments;
+    archive_entry_t *entries;
+    size_t num_entries;
+    size_t capacity;
+} archive_index_t;
+
+/**
+ * @struct segment_job_t
+ * @brief A segment, and what it was encrypted to
+ */
+typedef struct
+{
+    unsigned char *plain;
+    size_t plain_len;
+    unsigned char *cipher;
+    size_t cipher_len;
+    int done;
+} segment_job_t;
+
+/**
+ * @struct packer_t
+ * @brief What the reader, workers and writer packing an archive share
+ */
+typedef struct
+{
+    const char **keys;
+    int num_keys;
+    size_t key_len;
+    // Segments waiting for a worker, and every segment in the order read
+    work_queue_t *todo;
+    work_queue_t *order;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    FILE *out;
+    // Where the next segment is written
+    uint64_t written;
+    // Only the writer adds the segments, until it is joined
+    archive_index_t *index;
+    // The first error, after which nothing more is read or written
+    const char *error;
+} packer_t;
+
+/**
+ * @struct collector_t
+ * @brief What walk_dir() is given to add the files found to an index
+ */
+typedef struct
+{
+    archive_index_t *index;
+    // The archive itself, which is never packed into itself
+    dev_t archive_dev;
+    ino_t archive_ino;
+    int failed;
+} collector_t;
+
+/**
+ * @brief Write a whole number, most significant byte first
+ * @param[out] buf Where to write it
+ * @param[in] value The number
+ * @param[in] bytes The number of bytes to write it in
+ * @return Where the next value goes
+ */
+static unsigned char *put_uint(unsigned char *buf, uint64_t value, int bytes)
+{
+    for (int b = bytes - 1; b >= 0; b--)
+    {
+        buf[b] = value & 0xff;
+        value >>= 8;
+    }
+    return buf + bytes;
+}
+
+/**
+ * @struct index_reader_t
+ * @brief Reads the values of a decrypted index, checking it holds them
+ */
+typedef struct
+{
+    const unsigned char *pos;
+    size_t left;
+    int invalid;
+} index_reader_t;
+
+/**
+ * @brief Read a whole number, most significant byte first
+ * @param[in,out] reader The index being read. Set invalid if it is too
+ * short.
+ * @param[in] bytes The number of bytes it is written in
+ * @return The number, 0 if the index is too short
+ */
+static uint64_t take_uint(index_reader_t *reader, int bytes)
+{
+    if (reader->left < (size_t) bytes)
+    {
+        reader->invalid = 1;
+        return 0;
+    }
+    uint64_t value = 0;
+    for (int b = 0; b < bytes; b++)
+        value = (value << 8) | reader->pos[b];
+    reader->pos += bytes;
+    reader->left -= bytes;
+    return value;
+}
+
+/**
+ * @brief Encrypt a segment, or the index, to base64, the same as encrypt()
+ * would, but always with the blocked kernel
+ * @param[in,out] buf The plain text, with room for key_len bytes more for
+ * the padding. Set to the padded cipher text.
+ * @param[in] len The length of the plain text
+ * @param[in] keys The keys to use for encryption
+ * @param[in] num_keys The number of keys
+ * @param[out] cipher_len Set to the length of the cipher text
+ * @return The cipher text, NULL if there isn't enough memory
+ * @note The returned cipher text must be freed
+ */
+static unsigned char *encrypt_part(unsigned char *buf, size_t len,
+                                   const char **keys, int num_keys,
+                                   size_t *cipher_len)
+{
+    size_t key_len = strlen(keys[0]);
+    size_t padded = (len == 0) ? key_len
+                               : (len + key_len - 1) / key_len * key_len;
+    memset(buf + len, PADDING, padded - len);
+    unsigned char *cipher = malloc(4 * ((padded + 2) / 3) + 1);
+    if (cipher == NULL
+        || xor_encrypt_blocked(buf, padded, keys, num_keys, key_len,
+                               chunk_size))
+    {
+        free(cipher);
+        return NULL;
+    }
+    *cipher_len = base64_encode_block(buf, padded, (char *) cipher);
+    return cipher;
+}
+
+/**
+ * @brief Decrypt a segment, or the index, from encrypt_part()
+ * @param[in] cipher The cipher text
+ * @param[in] cipher_len The length of the cipher text
+ * @param[in] plain_len The length of the plain text, which is all that is
+ * left of it once the padding is removed
+ * @param[in] keys The keys it was encrypted with
+ * @param[in] num_keys The number of keys
+ * @param[out] plain Set to the plain text
+ * @return EEA_OK, or one of EeaErrors
+ * @note The plain text must be freed
+ */
+static int decrypt_part(const unsigned char *cipher, size_t cipher_len,
+                        uint64_t plain_len, const char **keys, int num_keys,
+                        unsigned char **plain)
+{
+    size_t key_len = strlen(keys[0]);
+    if (cipher_len % 4 != 0)
+        return EEA_ERR_INVALID_DATA;
+    unsigned char *raw = malloc(3 * (cipher_len / 4) + 1);
+    if (raw == NULL)
+        return EEA_ERR_NO_MEMORY;
+    size_t len = base64_decode_block((const char *) cipher, cipher_len, raw);
+    // It must be the plain text, padded to a whole number of blocks
+    size_t padded = (plain_len == 0)
+                        ? key_len
+                        : (plain_len + key_len - 1) / key_len * key_len;
+    if (len == (size_t) -1 || plain_len > len || len != padded)
+    {
+        free(raw);
+        return EEA_ERR_INVALID_DATA;
+    }
+    if (xor_decrypt_blocked(raw, len, keys, num_keys, key_len, chunk_size))
+    {
+        free(raw);
+        return EEA_ERR_NO_MEMORY;
+    }
+    *plain = raw;
+    return EEA_OK;
+}
+
+/**
+ * @brief Free what an index holds
+ * @param[in] index The index
+ */
+static void free_index(archive_index_t *index)
+{
+    for (size_t e = 0; e < index->num_entries; e++)
+        free(index->entries[e].path);
+    free(index->entries);
+    free(index->segments);
+}
+
+/**
+ * @brief Write an index out to a buffer, to be encrypted
+ * @param[in] index The index
+ * @param[in] key_len The length of each key, which the buffer has room for
+ * more of, for the padding
+ * @param[out] len Set to the length of the index
+ * @return The buffer, NULL if there isn't enough memory
+ * @note The returned buffer must be freed
+ */
+static unsigned char *serialize_index(const archive_index_t *index,
+                                      size_t key_len, size_t *len)
+{
+    *len = strlen(INDEX_MAGIC) + 4 * 8 + index->num_segments * 2 * 8;
+    for (size_t e = 0; e < index->num_entries; e++)
+        *len += 2 + strlen(index->entries[e].name) + 4 + 2 * 8;
+    unsigned char *buf = malloc(*len + key_len);
+    if (buf == NULL)
+        return NULL;
+
+    unsigned char *pos = buf;
+    memcpy(pos, INDEX_MAGIC, strlen(INDEX_MAGIC));
+    pos += strlen(INDEX_MAGIC);
+    pos = put_uint(pos, index->segment_size, 8);
+    pos = put_uint(pos, index->total, 8);
+    pos = put_uint(pos, index->num_segments, 8);
+    for (size_t s = 0; s < index->num_segments; s++)
+    {
+        pos = put_uint(pos, index->segments[s].offset, 8);
+        pos = put_uint(pos, index->segments[s].length, 8);
+    }
+    pos = put_uint(pos, index->num_entries, 8);
+    for (size_t e = 0; e < index->num_entries; e++)
+    {
+        const archive_entry_t *entry = &index->entries[e];
+        size_t path_len = strlen(entry->name);
+        pos = put_uint(pos, path_len, 2);
+        memcpy(pos, entry->name, path_len);
+        pos += path_len;
+        pos = put_uint(pos, entry->mode, 4);
+        pos = put_uint(pos, entry->offset, 8);
+        pos = put_uint(pos, entry->size, 8);
+    }
+    return buf;
+}
+
+/**
+ * @brief Read an index from a decrypted buffer, checking it makes sense
+ * @param[in] buf The buffer
+ * @param[in] len The length of the buffer
+ * @param[in] index_offset Where the index is in the archive, which every
+ * segment comes before
+ * @param[out] index Set to the index
+ * @return EEA_OK, EEA_ERR_INVALID_DATA if it doesn't make sense, such as
+ * with the wrong keys, or EEA_ERR_NO_MEMORY
+ */
+static int parse_index(const unsigned char *buf, size_t len,
+                       uint64_t index_offset, archive_index_t *index)
+{
+    memset(index, 0, sizeof(*index));
+    if (len < strlen(INDEX_MAGIC)
+        || memcmp(buf, INDEX_MAGIC, strlen(INDEX_MAGIC)) != 0)
+        return EEA_ERR_INVALID_DATA;
+    index_reader_t reader = { buf + strlen(INDEX_MAGIC),
+                              len - strlen(INDEX_MAGIC), 0 };
+
+    index->segment_size = take_uint(&reader, 8);
+    index->total = take_uint(&reader, 8);
+    uint64_t num_segments = take_uint(&reader, 8);
+    // Each segment takes 16 bytes of the index, so this can't overflow
+    if (reader.invalid || index->segment_size == 0
+        || num_segments > reader.left / 16
+        || num_segments
+               != (index->total + index->segment_size - 1)
+                      / index->segment_size)
+        return EEA_ERR_INVALID_DATA;
+    index->segments = malloc((num_segments + 1) * sizeof(archive_segment_t));
+    if (index->segments == NULL)
+        return EEA_ERR_NO_MEMORY;
+    for (; index->num_segments < num_segments; index->num_segments++)
+    {
+        archive_segment_t *segment = &index->segments[index->num_segments];
+        segment->offset = take_uint(&reader, 8);
+        segment->length = take_uint(&reader, 8);
+        if (segment->offset > index_offset
+            || segment->length > index_offset - segment->offset)
+            return EEA_ERR_INVALID_DATA;
+    }
+
+    uint64_t num_entries = take_uint(&reader, 8);
+    // Each entry takes at least 22 bytes of the index
+    if (reader.invalid || num_entries > reader.left / 22)
+        return EEA_ERR_INVALID_DATA;
+    index->entries = calloc(num_entries + 1, sizeof(archive_entry_t));
+    if (index->entries == NULL)
+        return EEA_ERR_NO_MEMORY;
+    for (; index->num_entries < num_entries; index->num_entries++)
+    {
+        archive_entry_t *entry = &index->entries[index->num_entries];
+        size_t path_len = take_uint(&reader, 2);
+        if (reader.invalid || path_len == 0 || path_len > reader.left)
+            return EEA_ERR_INVALID_DATA;
+        entry->path = strndup((const char *) reader.pos, path_len);
+        if (entry->path == NULL)
+            return EEA_ERR_NO_MEMORY;
+        entry->name = entry->path;
+        reader.pos += path_len;
+        reader.left -= path_len;
+        entry->mode = take_uint(&reader, 4);
+        entry->offset = take_uint(&reader, 8);
+        entry->size = take_uint(&reader, 8);
+        if (reader.invalid || strlen(entry->path) != path_len
+            || entry->offset > index->total
+            || entry->size > index->total - entry->offset)
+        {
+            index->num_entries++;
+            return EEA_ERR_INVALID_DATA;
+        }
+    }
+    return EEA_OK;
+}
+
+/**
+ * @brief walk_dir() callback that adds a file to the index
+ * @param[in] path Path to the file that was found
+ * @param[in] args The collector_t with the index to add to
+ * @return 1 to keep walking, 0 if there isn't enough memory
+ */
+static int collect_file(const char *path, void *args)
+{
+    collector_t *collector = (collector_t *) args;
+    archive_index_t *index = collector->index;
+    struct stat path_stat;
+    if (stat(path, &path_stat) != 0 || !S_ISREG(path_stat.st_mode))
+        return 1;
+    if (path_stat.st_dev == collector->archive_dev
+        && path_stat.st_ino == collector->archive_ino)
+        return 1;
+
+    // Files are stored under a relative path, as tar does
+    const char *name = path;
+    while (name[0] == SLASH_CH)
+        name++;
+    while (name[0] == '.' && name[1] == SLASH_CH)
+        name += 2;
+    if (name[0] == '\0' || strlen(name) > UINT16_MAX)
+    {
+        fprintf(stderr, "%sError:%s Can't store \'%s\' under its path\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path);
+        collector->failed = 1;
+        return 1;
+    }
+
+    if (index->num_entries == index->capacity)
+    {
+        size_t capacity = index->capacity ? index->capacity * 2 : 256;
+        archive_entry_t *entries = realloc(index->entries,
+                                           capacity * sizeof(*entries));
+        if (entries == NULL)
+        {
+            collector->failed = 1;
+            return 0;
+        }
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+    archive_entry_t *entry = &index->entries[index->num_entries];
+    entry->path = strdup(path);
+    if (entry->path == NULL)
+    {
+        collector->failed = 1;
+        return 0;
+    }
+    entry->name = entry->path + (name - path);
+    entry->mode = path_stat.st_mode & 07777;
+    entry->offset = index->total;
+    entry->size = path_stat.st_size;
+    index->total += entry->size;
+    index->num_entries++;
+    return 1;
+}
+
+/**
+ * @brief Record the first error packing an archive
+ * @param[in,out] packer What the threads share
+ * @param[in] error Why it failed
+ */
+static void set_pack_error(packer_t *packer, const char *error)
+{
+    pthread_mutex_lock(&packer->lock);
+    if (packer->error == NULL)
+        packer->error = error;
+    pthread_mutex_unlock(&packer->lock);
+}
+
+/**
+ * @brief Function called by pthread_create to encrypt segments
+ * @param[in] args The packer_t the threads share
+ */
+static void *segment_worker(void *args)
+{
+    packer_t *packer = (packer_t *) args;
+    segment_job_t *job = NULL;
+    while ((job = work_queue_pop(packer->todo)) != NULL)
+    {
+        size_t cipher_len = 0;
+        unsigned char *cipher = encrypt_part(job->plain, job->plain_len,
+                                             packer->keys, packer->num_keys,
+                                             &cipher_len);
+        free(job->plain);
+        job->plain = NULL;
+        pthread_mutex_lock(&packer->lock);
+        job->cipher = cipher;
+        job->cipher_len = cipher_len;
+        job->done = 1;
+        pthread_cond_broadcast(&packer->done);
+        pthread_mutex_unlock(&packer->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Function called by pthread_create to write the segments out in
+ * order, as each is encrypted, recording where each went
+ * @param[in] args The packer_t the threads share
+ */
+static void *segment_writer(void *args)
+{
+    packer_t *packer = (packer_t *) args;
+    archive_index_t *index = packer->index;
+    size_t capacity = 0;
+    segment_job_t *job = NULL;
+    while ((job = work_queue_pop(packer->order)) != NULL)
+    {
+        pthread_mutex_lock(&packer->lock);
+        while (!job->done)
+            pthread_cond_wait(&packer->done, &packer->lock);
+        if (packer->error == NULL && job->cipher == NULL)
+            packer->error = "Not enough memory to encrypt a segment";
+        int write = (packer->error == NULL);
+        pthread_mutex_unlock(&packer->lock);
+
+        if (write && index->num_segments == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            archive_segment_t *segments = realloc(
+                index->segments, capacity * sizeof(archive_segment_t));
+            if (segments == NULL)
+            {
+                set_pack_error(packer, "Not enough memory for the index");
+                write = 0;
+            }
+            else
+                index->segments = segments;
+        }
+        if (write
+            && fwrite(job->cipher, 1, job->cipher_len, packer->out)
+                   != job->cipher_len)
+        {
+            set_pack_error(packer, "Writing the archive failed");
+            write = 0;
+        }
+        if (write)
+        {
+            archive_segment_t *segment = &index->segments[index->num_segments];
+            segment->offset = packer->written;
+            segment->length = job->cipher_len;
+            packer->written += job->cipher_len;
+            index->num_segments++;
+        }
+        free(job->plain);
+        free(job->cipher);
+        free(job);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Hand a segment to the workers, and to the writer
+ * @param[in,out] packer What the threads share
+ * @param[in] job The segment, which is freed by the writer
+ * @return 1 on success, 0 if it couldn't be queued, after freeing it
+ */
+static int queue_segment(packer_t *packer, segment_job_t *job)
+{
+    if (!work_queue_push(packer->order, job))
+    {
+        free(job->plain);
+        free(job);
+        return 0;
+    }
+    work_queue_push(packer->todo, job);
+    return 1;
+}
+
+/**
+ * @brief Start a segment to read files into
+ * @param[in] key_len The length of each key, which the segment has room
+ * for more of, for the padding
+ * @return The segment, NULL if there isn't enough memory
+ */
+static segment_job_t *new_segment(size_t key_len)
+{
+    segment_job_t *job = calloc(1, sizeof(segment_job_t));
+    if (job == NULL)
+        return NULL;
+    job->plain = malloc(ARCHIVE_SEGMENT + key_len);
+    if (job->plain == NULL)
+    {
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+/**
+ * @brief Read every file in the index, end to end, into segments, queuing
+ * each as it fills
+ * @param[in,out] packer What the threads share
+ * @param[in] index The files to read
+ * @return 1 on success, 0 on failure, after recording why
+ */
+static int read_members(packer_t *packer, const archive_index_t *index)
+{
+    segment_job_t *job = new_segment(packer->key_len);
+    if (job == NULL)
+    {
+        set_pack_error(packer, "Not enough memory to read the files");
+        return 0;
+    }
+
+    for (size_t e = 0; e < index->num_entries; e++)
+    {
+        pthread_mutex_lock(&packer->lock);
+        int failed = (packer->error != NULL);
+        pthread_mutex_unlock(&packer->lock);
+        if (failed)
+            break;
+
+        const archive_entry_t *entry = &index->entries[e];
+        FILE *in = fopen(entry->path, "rb");
+        if (in == NULL)
+        {
+            fprintf(stderr, "%sError:%s Failed to open \'%s\'\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], entry->path);
+            set_pack_error(packer, "A file couldn't be read");
+            break;
+        }
+        uint64_t left = entry->size;
+        while (left > 0 && job != NULL)
+        {
+            size_t want = ARCHIVE_SEGMENT - job->plain_len;
+            if (want > left)
+                want = left;
+            size_t read = fread(job->plain + job->plain_len, 1, want, in);
+            job->plain_len += read;
+            left -= read;
+            if (read < want)
+                break;
+            if (job->plain_len == ARCHIVE_SEGMENT)
+            {
+                int queued = queue_segment(packer, job);
+                job = queued ? new_segment(packer->key_len) : NULL;
+            }
+        }
+        fclose(in);
+        if (job == NULL)
+        {
+            set_pack_error(packer, "Not enough memory to read the files");
+            return 0;
+        }
+        if (left > 0)
+        {
+            fprintf(stderr, "%sError:%s \'%s\' changed while it was being "
+                    "packed\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], entry->path);
+            set_pack_error(packer, "A file couldn't be read");
+            break;
+        }
+    }
+
+    if (job->plain_len > 0)
+        return queue_segment(packer, job);
+    free(job->plain);
+    free(job);
+    return 1;
+}
+
+/**
+ * @brief Encrypt the index, and write it and the footer after the segments
+ * @param[in] out The archive
+ * @param[in] index The index
+ * @param[in] offset Where the index goes, after the last segment
+ * @param[in] keys The keys to use for encryption
+ * @param[in] num_keys The number of keys
+ * @return 1 on success, 0 on failure
+ */
+static int write_index(FILE *out, const archive_index_t *index,
+                       uint64_t offset, const char **keys, int num_keys)
+{
+    size_t plain_len = 0;
+    unsigned char *plain = serialize_index(index, strlen(keys[0]),
+                                           &plain_len);
+    if (plain == NULL)
+        return 0;
+    size_t cipher_len = 0;
+    unsigned char *cipher = encrypt_part(plain, plain_len, keys, num_keys,
+                                         &cipher_len);
+    free(plain);
+    if (cipher == NULL)
+        return 0;
+
+    char footer[ARCHIVE_FOOTER_LEN + 1];
+    snprintf(footer, sizeof(footer), "\n%016" PRIx64 "%016" PRIx64
+             "%016" PRIx64 "\n",
+             offset, (uint64_t) cipher_len, (uint64_t) plain_len);
+    int ret = (fwrite(cipher, 1, cipher_len, out) == cipher_len
+               && fwrite(footer, 1, ARCHIVE_FOOTER_LEN, out)
+                      == ARCHIVE_FOOTER_LEN);
+    free(cipher);
+    return ret;
+}
+
+int pack_archive(const char *archive, char **paths, int num_paths,
+                 const char **keys, int num_keys, int threads)
+{
+    FILE *out = fopen(archive, "wb");
+    struct stat archive_stat;
+    if (out == NULL || fstat(fileno(out), &archive_stat) != 0)
+    {
+        fprintf(stderr, "%sError:%s Failed to create \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], archive);
+        if (out != NULL)
+            fclose(out);
+        return 1;
+    }
+    if (threads < 1)
+        threads = 1;
+
+    archive_index_t index;
+    memset(&index, 0, sizeof(index));
+    index.segment_size = ARCHIVE_SEGMENT;
+    collector_t collector = { &index, archive_stat.st_dev,
+                              archive_stat.st_ino, 0 };
+    for (int p = 0; p < num_paths && !collector.failed; p++)
+    {
+        int type = get_file_type(paths[p]);
+        if (type == FILE_TYPE_DIR)
+            walk_dir(paths[p], collect_file, &collector);
+        else if (type == FILE_TYPE_REG)
+            collect_file(paths[p], &collector);
+        else
+        {
+            fprintf(stderr, "%sError:%s \'%s\' isn't a file or a directory\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], paths[p]);
+            collector.failed = 1;
+        }
+    }
+
+    packer_t packer;
+    memset(&packer, 0, sizeof(packer));
+    packer.keys = keys;
+    packer.num_keys = num_keys;
+    packer.key_len = strlen(keys[0]);
+    packer.out = out;
+    packer.index = &index;
+    packer.written = strlen(ARCHIVE_MAGIC);
+    uint64_t start = get_time_ns();
+
+    // Enough segments are in flight to keep every thread busy, while the
+    // writer waits for the oldest
+    pthread_t *pool = malloc((threads + 1) * sizeof(pthread_t));
+    packer.todo = work_queue_create(threads * 2);
+    packer.order = work_queue_create(threads * 2);
+    int ret = (collector.failed || pool == NULL || packer.todo == NULL
+               || packer.order == NULL
+               || fwrite(ARCHIVE_MAGIC, 1, strlen(ARCHIVE_MAGIC), out)
+                      != strlen(ARCHIVE_MAGIC));
+    pthread_mutex_init(&packer.lock, NULL);
+    pthread_cond_init(&packer.done, NULL);
+
+    // The writer is pool[0]
+    int started = 0;
+    for (; started < threads + 1 && !ret; started++)
+        if (pthread_create(&pool[started], NULL,
+                           started == 0 ? segment_writer : segment_worker,
+                           &packer)
+            != 0)
+        {
+            set_pack_error(&packer, "Failed to start the threads");
+            break;
+        }
+    if (!ret && packer.error == NULL)
+        read_members(&packer, &index);
+
+    if (packer.todo != NULL)
+        work_queue_close(packer.todo);
+    if (packer.order != NULL)
+        work_queue_close(packer.order);
+    for (int t = 0; t < started; t++)
+        pthread_join(pool[t], NULL);
+
+    if (!ret && packer.error == NULL
+        && !write_index(out, &index, packer.written, keys, num_keys))
+        packer.error = "Writing the index failed";
+    if (fclose(out) != 0 && packer.error == NULL)
+        packer.error = "Writing the archive failed";
+    if (!ret && packer.error != NULL)
+    {
+        fprintf(stderr, "%sError:%s %s\n", colors[COLOR_ERROR],
+                colors[COLOR_RESET], packer.error);
+        ret = 1;
+    }
+    if (ret)
+        remove(archive);
+    else
+    {
+        double seconds = (get_time_ns() - start) / 1e9;
+        printf("Packed %zu files, %.1f MB in %.2f s (%.1f MB/s)\n",
+               index.num_entries, index.total / 1e6, seconds,
+               seconds > 0 ? index.total / 1e6 / seconds : 0);
+    }
+
+    pthread_cond_destroy(&packer.done);
+    pthread_mutex_destroy(&packer.lock);
+    if (packer.todo != NULL)
+        work_queue_free(packer.todo);
+    if (packer.order != NULL)
+        work_queue_free(packer.order);
+    free(pool);
+    free_index(&index);
+    return ret;
+}
+
+/**
+ * @brief Read and decrypt a part of an archive
+ * @param[in] in The archive
+ * @param[in] offset Where the cipher text is
+ * @param[in] length The length of the cipher text
+ * @param[in] plain_len The length it was before it was encrypted
+ * @param[in] keys The keys it was encrypted with
+ * @param[in] num_keys The number of keys
+ * @param[out] plain Set to the plain text
+ * @return EEA_OK, or one of EeaErrors
+ * @note The plain text must be freed
+ */
+static int read_part(FILE *in, uint64_t offset, uint64_t length,
+                     uint64_t plain_len, const char **keys, int num_keys,
+                     unsigned char **plain)
+{
+    unsigned char *cipher = malloc(length + 1);
+    if (cipher == NULL)
+        return EEA_ERR_NO_MEMORY;
+    int ret = EEA_ERR_IO;
+    if (fseek(in, (long) offset, SEEK_SET) == 0
+        && fread(cipher, 1, length, in) == length)
+        ret = decrypt_part(cipher, length, plain_len, keys, num_keys, plain);
+    free(cipher);
+    return ret;
+}
+
+/**
+ * @brief Open an archive and decrypt its index
+ * @param[in] archive The archive
+ * @param[in] keys The keys it was encrypted with
+ * @param[in] num_keys The number of keys
+ * @param[out] index Set to the index
+ * @return The archive, NULL on failure, after printing why
+ * @note The archive must be closed, and the index freed with free_index()
+ */
+static FILE *open_archive(const char *archive, const char **keys,
+                          int num_keys, archive_index_t *index)
+{
+    memset(index, 0, sizeof(*index));
+    FILE *in = fopen(archive, "rb");
+    if (in == NULL)
+    {
+        fprintf(stderr, "%sError:%s Failed to open \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], archive);
+        return NULL;
+    }
+
+    char magic[sizeof(ARCHIVE_MAGIC)];
+    char footer[ARCHIVE_FOOTER_LEN + 1];
+    footer[ARCHIVE_FOOTER_LEN] = '\0';
+    int ret = EEA_ERR_INVALID_DATA;
+    long size = 0;
+    if (fread(magic, 1, strlen(ARCHIVE_MAGIC), in) == strlen(ARCHIVE_MAGIC)
+        && memcmp(magic, ARCHIVE_MAGIC, strlen(ARCHIVE_MAGIC)) == 0
+        && fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) > 0
+        && size >= (long) (strlen(ARCHIVE_MAGIC) + ARCHIVE_FOOTER_LEN)
+        && fseek(in, size - ARCHIVE_FOOTER_LEN, SEEK_SET) == 0
+        && fread(footer, 1, ARCHIVE_FOOTER_LEN, in) == ARCHIVE_FOOTER_LEN
+        && footer[0] == '\n' && footer[ARCHIVE_FOOTER_LEN - 1] == '\n')
+    {
+        // The three numbers, which strtoull can't be told the length of
+        uint64_t values[3];
+        int valid = 1;
+        for (int v = 0; v < 3; v++)
+        {
+            char digits[17];
+            memcpy(digits, footer + 1 + v * 16, 16);
+            digits[16] = '\0';
+            char *end = NULL;
+            values[v] = strtoull(digits, &end, 16);
+            valid &= (end == digits + 16);
+        }
+        uint64_t index_end = (uint64_t) size - ARCHIVE_FOOTER_LEN;
+        unsigned char *plain = NULL;
+        if (valid && values[0] <= index_end
+            && values[1] == index_end - values[0])
+            ret = read_part(in, values[0], values[1], values[2], keys,
+                            num_keys, &plain);
+        if (valid && ret == EEA_OK)
+        {
+            ret = parse_index(plain, values[2], values[0], index);
+            free(plain);
+        }
+    }
+
+    if (ret != EEA_OK)
+    {
+        fprintf(stderr, "%sError:%s Failed to read the index of \'%s\': %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], archive,
+                ret == EEA_ERR_INVALID_DATA
+                    ? "It isn't an archive, or these aren't its keys"
+                    : eea_strerror(ret));
+        free_index(index);
+        fclose(in);
+        return NULL;
+    }
+    return in;
+}
+
+int list_archive(const char *archive, const char **keys, int num_keys,
+                 FILE *out)
+{
+    archive_index_t index;
+    FILE *in = open_archive(archive, keys, num_keys, &index);
+    if (in == NULL)
+        return 1;
+    for (size_t e = 0; e < index.num_entries; e++)
+        fprintf(out, "%12" PRIu64 "  %s\n", index.entries[e].size,
+                index.entries[e].name);
+    fclose(in);
+    free_index(&index);
+    return fflush(out) != 0;
+}
+
+/**
+ * @brief Check if a path stored in an archive stays in the directory it is
+ * unpacked into
+ * @param[in] path The path
+ * @return If it does
+ */
+static int is_safe_path(const char *path)
+{
+    if (path[0] == '/' || path[0] == '\\')
+        return 0;
+    for (const char *part = path; part != NULL;)
+    {
+        if (part[0] == '.' && part[1] == '.'
+            && (part[2] == '\0' || part[2] == '/' || part[2] == '\\'))
+            return 0;
+        const char *next = strpbrk(part, "/\\");
+        part = (next == NULL) ? NULL : next + 1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Check if a file in an archive was asked for
+ * @param[in] path The path of the file
+ * @param[in] member A file or directory asked for
+ * @return If it is that file, or is in that directory
+ */
+static int is_member(const char *path, const char *member)
+{
+    size_t len = strlen(member);
+    while (len > 0 && member[len - 1] == '/')
+        len--;
+    return strncmp(path, member, len) == 0
+           && (path[len] == '\0' || path[len] == '/');
+}
+
+/**
+ * @brief Write a file out of an archive, decrypting the segments it is in
+ * as they are needed
+ * @param[in] in The archive
+ * @param[in] index The archive's index
+ * @param[in] entry The file
+ * @param[in] path Where to write it
+ * @param[in,out] segment The segment decrypted last, kept for the next
+ * file, as files are often smaller than a segment
+ * @param[in,out] cached Which segment that is, SIZE_MAX for none
+ * @param[in] keys The keys the archive was encrypted with
+ * @param[in] num_keys The number of keys
+ * @return EEA_OK, or one of EeaErrors
+ */
+static int unpack_entry(FILE *in, const archive_index_t *index,
+                        const archive_entry_t *entry, const char *path,
+                        unsigned char **segment, size_t *cached,
+                        const char **keys, int num_keys)
+{
+    if (!mkdir_path(path))
+        return EEA_ERR_IO;
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+        return EEA_ERR_IO;
+
+    int ret = EEA_OK;
+    uint64_t pos = entry->offset;
+    uint64_t left = entry->size;
+    while (left > 0 && ret == EEA_OK)
+    {
+        size_t s = pos / index->segment_size;
+        uint64_t start = (uint64_t) s * index->segment_size;
+        uint64_t segment_len = index->total - start;
+        if (segment_len > index->segment_size)
+            segment_len = index->segment_size;
+        if (s != *cached)
+        {
+            free(*segment);
+            *segment = NULL;
+            *cached = SIZE_MAX;
+            ret = read_part(in, index->segments[s].offset,
+                            index->segments[s].length, segment_len, keys,
+                            num_keys, segment);
+            if (ret != EEA_OK)
+                break;
+            *cached = s;
+        }
+        uint64_t len = segment_len - (pos - start);
+        if (len > left)
+            len = left;
+        if (fwrite(*segment + (pos - start), 1, len, out) != len)
+            ret = EEA_ERR_IO;
+        pos += len;
+        left -= len;
+    }
+
+    if (fclose(out) != 0 && ret == EEA_OK)
+        ret = EEA_ERR_IO;
+#ifndef WIN32
+    if (ret == EEA_OK && chmod(path, entry->mode) != 0)
+        ret = EEA_ERR_IO;
+#endif
+    return ret;
+}
+
+int unpack_archive(const char *archive, char **members, int num_members,
+                   const char *dir, const char **keys, int num_keys)
+{
+    archive_index_t index;
+    FILE *in = open_archive(archive, keys, num_keys, &index);
+    if (in == NULL)
+        return 1;
+    unsigned char *found = calloc(num_members + 1, 1);
+    if (found == NULL)
+    {
+        fclose(in);
+        free_index(&index);
+        return 1;
+    }
+
+    int failed = 0;
+    size_t files = 0;
+    uint64_t bytes = 0;
+    unsigned char *segment = NULL;
+    size_t cached = SIZE_MAX;
+    for (size_t e = 0; e < index.num_entries; e++)
+    {
+        const archive_entry_t *entry = &index.entries[e];
+        int wanted = (num_members == 0);
+        for (int m = 0; m < num_members; m++)
+            if (is_member(entry->name, members[m]))
+                wanted = found[m] = 1;
+        if (!wanted)
+            continue;
+        if (!is_safe_path(entry->name))
+        {
+            fprintf(stderr, "%sError:%s Not unpacking \'%s\', which would be "
+                    "outside the directory\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], entry->name);
+            failed = 1;
+            continue;
+        }
+
+        size_t path_len = (dir ? strlen(dir) + 1 : 0) + strlen(entry->name)
+                          + 1;
+        char *path = malloc(path_len);
+        if (path == NULL)
+        {
+            failed = 1;
+            break;
+        }
+        if (dir != NULL)
+            snprintf(path, path_len, "%s%c%s", dir, SLASH_CH, entry->name);
+        else
+            snprintf(path, path_len, "%s", entry->name);
+        int ret = unpack_entry(in, &index, entry, path, &segment, &cached,
+                               keys, num_keys);
+        if (ret != EEA_OK)
+        {
+            fprintf(stderr, "%sError:%s Failed to unpack \'%s\': %s\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], entry->name,
+                    eea_strerror(ret));
+            failed = 1;
+        }
+        else
+        {
+            files++;
+            bytes += entry->size;
+        }
+        free(path);
+    }
+
+    for (int m = 0; m < num_members; m++)
+        if (!found[m])
+        {
+            fprintf(stderr, "%sError:%s \'%s\' isn't in the archive\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], members[m]);
+            failed = 1;
+        }
+    printf("Unpacked %zu files, %.1f MB\n", files, bytes / 1e6);
+
+    free(segment);
+    free(found);
+    fclose(in);
+    free_index(&index);
+    return failed;
+}
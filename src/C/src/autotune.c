@@ -0,0 +1,344 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "autotune.h"
+#include "config.h"
+#include "decrypt.h"
+#include "encrypt.h"
+#include "globals.h"
+#include "kernels.h"
+#include "keygen.h"
+#include "utils.h"
+
+// Tune with the keys that are made by default, 3 x 512-bit
+static const size_t TUNE_KEY_BITS = 512;
+static const size_t TUNE_SIZE = (size_t) 4 << 20;
+static const int TUNE_REPS = 5;
+static const size_t CHUNK_SIZES[] = { 0, (size_t) 16 << 10, (size_t) 64 << 10,
+                                      (size_t) 256 << 10, (size_t) 1 << 20 };
+#define NUM_CHUNK_SIZES (sizeof(CHUNK_SIZES) / sizeof(CHUNK_SIZES[0]))
+// Each thread encrypts and decrypts its own message this many times
+static const size_t THREAD_SIZE = (size_t) 1 << 20;
+static const int THREAD_ROUNDS = 8;
+static const int MAX_THREADS = 64;
+// More threads are only used if they are at least this much faster
+static const double THREAD_GAIN = 1.05;
+
+/**
+ * @struct tune_job_t
+ * @brief A message to encrypt and decrypt, and the keys to use
+ */
+typedef struct
+{
+    const char **keys;
+    unsigned char *message;
+    size_t size;
+    int rounds;
+    int failed;
+} tune_job_t;
+
+/**
+ * @brief Fill a message with printable text, so no padding is removed from
+ * it when it's decrypted
+ * @param[in] size The size of the message
+ * @param[in] seed Changes the text
+ * @return The message, NULL if allocating it failed
+ */
+static unsigned char *make_message(size_t size, uint64_t seed)
+{
+    unsigned char *data = malloc(size);
+    if (data == NULL)
+        return NULL;
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ seed;
+    for (size_t x = 0; x < size; x++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        data[x] = (unsigned char) (' ' + state % 95);
+    }
+    return data;
+}
+
+/**
+ * @brief Encrypt and decrypt a message, checking it comes back the same
+ * @param[in] job The message and keys
+ * @param[out] cipher_text Set to the cipher text if not NULL
+ * @param[out] cipher_text_len Set to the length of the cipher text
+ * @return 0 on success, 1 on failure
+ */
+static int round_trip(const tune_job_t *job, unsigned char **cipher_text,
+                      size_t *cipher_text_len)
+{
+    unsigned char *encrypted = NULL;
+    unsigned char *decrypted = NULL;
+    size_t encrypted_len = encrypt(job->message, job->size, &encrypted,
+                                   job->keys, DEFAULT_NUM_KEYS);
+    if (encrypted == NULL)
+        return 1;
+    size_t decrypted_len = decrypt(encrypted, encrypted_len, &decrypted,
+                                   job->keys, DEFAULT_NUM_KEYS);
+
+    int ret = (decrypted == NULL || decrypted_len != job->size
+               || memcmp(decrypted, job->message, job->size) != 0);
+    free(decrypted);
+    if (cipher_text != NULL && !ret)
+    {
+        *cipher_text = encrypted;
+        *cipher_text_len = encrypted_len;
+    }
+    else
+        free(encrypted);
+    return ret;
+}
+
+/**
+ * @brief Compare two uint64_t values for qsort()
+ */
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Time the current kernel and chunk size
+ * @param[in] job The message and keys
+ * @param[in] expected The cipher text of the reference kernel
+ * @param[in] expected_len The length of the expected cipher text
+ * @return The median MB/s of encrypting and decrypting the message, -1 if
+ * the cipher text didn't match the reference or the round trip failed
+ */
+static double time_kernel(const tune_job_t *job, const unsigned char *expected,
+                          size_t expected_len)
+{
+    unsigned char *cipher_text = NULL;
+    size_t cipher_text_len = 0;
+    if (round_trip(job, &cipher_text, &cipher_text_len))
+        return -1;
+    int matches = (cipher_text_len == expected_len
+                   && memcmp(cipher_text, expected, expected_len) == 0);
+    free(cipher_text);
+    if (!matches)
+        return -1;
+
+    uint64_t times[TUNE_REPS];
+    for (int r = 0; r < TUNE_REPS; r++)
+    {
+        uint64_t start = get_time_ns();
+        if (round_trip(job, NULL, NULL))
+            return -1;
+        times[r] = get_time_ns() - start;
+    }
+    qsort(times, TUNE_REPS, sizeof(times[0]), compare_u64);
+    return job->size / (times[TUNE_REPS / 2] / 1e3);
+}
+
+/**
+ * @brief Function called by pthread_create to run a thread's round trips
+ * @param[in] args A tune_job_t struct for the thread
+ */
+static void *tune_thread(void *args)
+{
+    tune_job_t *job = (tune_job_t *) args;
+    for (int r = 0; r < job->rounds && !job->failed; r++)
+        job->failed = round_trip(job, NULL, NULL);
+    return NULL;
+}
+
+/**
+ * @brief Time a number of threads encrypting and decrypting at once
+ * @param[in] keys The keys
+ * @param[in] threads The number of threads
+ * @return The total MB/s of all of the threads, -1 on failure
+ */
+static double time_threads(const char **keys, int threads)
+{
+    pthread_t pool[MAX_THREADS];
+    tune_job_t jobs[MAX_THREADS];
+    memset(jobs, 0, sizeof(jobs));
+
+    int ret = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        jobs[t].keys = keys;
+        jobs[t].size = THREAD_SIZE;
+        jobs[t].rounds = THREAD_ROUNDS;
+        jobs[t].message = make_message(THREAD_SIZE, t + 1);
+        if (jobs[t].message == NULL)
+            ret = 1;
+    }
+
+    int started = 0;
+    uint64_t start = get_time_ns();
+    for (; started < threads && !ret; started++)
+        if (pthread_create(&pool[started], NULL, tune_thread, &jobs[started])
+            != 0)
+        {
+            ret = 1;
+            break;
+        }
+    for (int t = 0; t < started; t++)
+    {
+        pthread_join(pool[t], NULL);
+        ret |= jobs[t].failed;
+    }
+    uint64_t elapsed = get_time_ns() - start;
+
+    for (int t = 0; t < threads; t++)
+        free(jobs[t].message);
+    if (ret)
+        return -1;
+    return (double) threads * THREAD_ROUNDS * THREAD_SIZE / (elapsed / 1e3);
+}
+
+/**
+ * @brief Find the fastest kernel and chunk size, and set them
+ * @param[in] keys The keys
+ * @return 0 on success, 1 on failure
+ */
+static int tune_kernel(const char **keys)
+{
+    tune_job_t job = { keys, make_message(TUNE_SIZE, 0), TUNE_SIZE, 1, 0 };
+    if (job.message == NULL)
+        return 1;
+
+    // Every kernel must give the same cipher text as the reference
+    unsigned char *expected = NULL;
+    size_t expected_len = 0;
+    xor_kernel = XOR_KERNEL_REFERENCE;
+    chunk_size = 0;
+    if (round_trip(&job, &expected, &expected_len))
+    {
+        free(job.message);
+        return 1;
+    }
+
+    printf("Timing the kernels on %zu MB with %d x %zu-bit keys "
+           "(encrypt + decrypt)\n",
+           TUNE_SIZE >> 20, DEFAULT_NUM_KEYS, TUNE_KEY_BITS);
+    printf("%-10s %8s %10s\n", "kernel", "chunk", "MB/s");
+
+    int best_kernel = XOR_KERNEL_REFERENCE;
+    size_t best_chunk = 0;
+    double best = 0;
+    for (int k = 0; k < NUM_XOR_KERNELS; k++)
+    {
+        // Only the blocked kernel works through the buffer in chunks
+        size_t num_chunks = (k == XOR_KERNEL_BLOCKED) ? NUM_CHUNK_SIZES : 1;
+        for (size_t c = 0; c < num_chunks; c++)
+        {
+            xor_kernel = k;
+            chunk_size = CHUNK_SIZES[c];
+            double mbs = time_kernel(&job, expected, expected_len);
+
+            char chunk[32] = "whole";
+            if (chunk_size != 0)
+                snprintf(chunk, sizeof(chunk), "%zuK", chunk_size >> 10);
+            if (mbs < 0)
+            {
+                printf("%-10s %8s %10s\n", XOR_KERNEL_NAMES[k], chunk,
+                       "failed");
+                continue;
+            }
+            printf("%-10s %8s %10.1f\n", XOR_KERNEL_NAMES[k], chunk, mbs);
+            fflush(stdout);
+            if (mbs > best)
+            {
+                best = mbs;
+                best_kernel = k;
+                best_chunk = chunk_size;
+            }
+        }
+    }
+
+    xor_kernel = best_kernel;
+    chunk_size = best_chunk;
+    free(expected);
+    free(job.message);
+    return best > 0 ? 0 : 1;
+}
+
+/**
+ * @brief Find the fewest threads that get the most throughput, and set them
+ * as the default
+ * @param[in] keys The keys
+ * @return 0 on success, 1 on failure
+ */
+static int tune_threads(const char **keys)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        cpus = 1;
+    if (cpus > MAX_THREADS)
+        cpus = MAX_THREADS;
+
+    printf("\nTiming the threads on %zu MB each\n", THREAD_SIZE >> 20);
+    printf("%-10s %8s %10s\n", "threads", "", "MB/s");
+
+    int best_threads = 1;
+    double best = 0;
+    for (int t = 1; t <= cpus; t = (t * 2 > cpus && t < cpus) ? cpus : t * 2)
+    {
+        double mbs = time_threads(keys, t);
+        if (mbs < 0)
+        {
+            printf("%-10d %8s %10s\n", t, "", "failed");
+            continue;
+        }
+        printf("%-10d %8s %10.1f\n", t, "", mbs);
+        fflush(stdout);
+        if (mbs > best * THREAD_GAIN)
+        {
+            best = mbs;
+            best_threads = t;
+        }
+    }
+
+    default_threads = best_threads;
+    return best > 0 ? 0 : 1;
+}
+
+int autotune(void)
+{
+    char **keys = generate_keys(TUNE_KEY_BITS, DEFAULT_NUM_KEYS);
+    if (keys == NULL)
+    {
+        fprintf(stderr, "%sError:%s Failed to generate the keys\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 1;
+    }
+
+    int ret = tune_kernel((const char **) keys);
+    if (!ret)
+        ret = tune_threads((const char **) keys);
+    free_keys(keys, DEFAULT_NUM_KEYS, NULL);
+    if (ret)
+    {
+        fprintf(stderr, "%sError:%s Timing the kernels failed\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 1;
+    }
+
+    char chunk[32];
+    char threads[16];
+    snprintf(chunk, sizeof(chunk), "%zu", chunk_size);
+    snprintf(threads, sizeof(threads), "%d", default_threads);
+    config_setting_t settings[] = { { "kernel", XOR_KERNEL_NAMES[xor_kernel] },
+                                    { "chunkSize", chunk },
+                                    { "threads", threads } };
+    if (!save_config_settings(settings, 3))
+        return 1;
+
+    printf("\n%sSaved to the config:%s kernel: %s, chunkSize: %s, "
+           "threads: %s\n",
+           colors[COLOR_SUCCESS], colors[COLOR_RESET],
+           XOR_KERNEL_NAMES[xor_kernel], chunk, threads);
+    return 0;
+}
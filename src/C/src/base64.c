@@ -6,6 +6,12 @@
 
 #include "base64.h"
 
+// EVP_EncodeBlock() and EVP_DecodeBlock() take the size as an int, so
+// buffers over 2 GiB are done in chunks. Multiples of 3 bytes in, and
+// 4 characters out, keep each chunk on a base64 boundary.
+static const size_t ENCODE_CHUNK = (size_t) 3 << 28;
+static const size_t DECODE_CHUNK = (size_t) 4 << 28;
+
 /**
  * @brief Calculates the length of a encoded base64 string
  * @param[in] size The current size of the data to be encoded
@@ -27,7 +33,15 @@ char *base64_encode(unsigned char *data, size_t size, size_t *rsize)
         return NULL;
     }
 
-    *rsize = EVP_EncodeBlock((unsigned char *) encoded, data, (int) size);
+    size_t in = 0, out = 0;
+    while (in < size)
+    {
+        size_t chunk = (size - in) < ENCODE_CHUNK ? (size - in) : ENCODE_CHUNK;
+        out += EVP_EncodeBlock((unsigned char *) encoded + out, data + in,
+                               (int) chunk);
+        in += chunk;
+    }
+    *rsize = out;
 
     if (!*rsize)
     {
@@ -68,7 +82,15 @@ unsigned char *base64_decode(unsigned char *data, size_t size, size_t *rsize)
         return NULL;
     }
 
-    int ret = EVP_DecodeBlock(decoded, data, (int) size);
+    int ret = 0;
+    size_t in = 0, out = 0;
+    while (in < size && ret != -1)
+    {
+        size_t chunk = (size - in) < DECODE_CHUNK ? (size - in) : DECODE_CHUNK;
+        ret = EVP_DecodeBlock(decoded + out, data + in, (int) chunk);
+        in += chunk;
+        out += (ret > 0) ? ret : 0;
+    }
 
     // Decode failed
     if (ret == -1)
@@ -80,3 +102,30 @@ unsigned char *base64_decode(unsigned char *data, size_t size, size_t *rsize)
 
     return decoded;
 }
+
+size_t base64_encode_block(const unsigned char *data, size_t size,
+                           char *encoded)
+{
+    return EVP_EncodeBlock((unsigned char *) encoded, data, (int) size);
+}
+
+size_t base64_decode_block(const char *data, size_t size,
+                           unsigned char *decoded)
+{
+    if (size % 4 != 0)
+        return (size_t) -1;
+
+    // Only the last two characters can be padding, and only the last if the
+    // one before it isn't
+    size_t padding = 0;
+    while (padding < 2 && padding < size && data[size - padding - 1] == '=')
+        padding++;
+    if (memchr(data, '=', size - padding) != NULL)
+        return (size_t) -1;
+
+    int ret = EVP_DecodeBlock(decoded, (const unsigned char *) data,
+                              (int) size);
+    if (ret == -1)
+        return (size_t) -1;
+    return ret - padding;
+}
@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64.h"
+#include "batch.h"
+#include "decrypt.h"
+#include "eea.h"
+#include "globals.h"
+#include "kernels.h"
+
+// The largest message a batch can hold, so its base64 fits in an int for
+// base64_encode_block() and base64_decode_block()
+static const size_t BATCH_MAX_MESSAGE = (size_t) 1 << 30;
+
+/**
+ * @brief Get the length of a message once padded to whole blocks
+ * @param[in] len The length of the message
+ * @param[in] key_len The length of each key
+ * @return The padded length, at least one block
+ */
+static size_t padded_len(size_t len, size_t key_len)
+{
+    if (len <= key_len)
+        return key_len;
+    return ((len + key_len - 1) / key_len) * key_len;
+}
+
+/**
+ * @brief Add the room a message needs to the size of the arena
+ * @param[in,out] arena_len The size of the arena so far
+ * @param[in] len The room the message needs
+ * @return 1 on success, 0 if the arena would be too big
+ */
+static int add_to_arena(size_t *arena_len, size_t len)
+{
+    if (len > SIZE_MAX - *arena_len)
+        return 0;
+    *arena_len += len;
+    return 1;
+}
+
+int encrypt_batch(const eea_buffer_t *messages, size_t count,
+                  const char **keys, int num_keys, eea_buffer_t *results,
+                  unsigned char **arena)
+{
+    size_t key_len = strlen(keys[0]);
+
+    // Size the arena and the buffer the rounds are run in up front, so
+    // nothing is allocated per message
+    size_t arena_len = 0;
+    size_t max_padded = 0;
+    for (size_t m = 0; m < count; m++)
+    {
+        if (messages[m].len >= BATCH_MAX_MESSAGE)
+            return EEA_ERR_INVALID_ARGUMENT;
+        size_t padded = padded_len(messages[m].len, key_len);
+        if (!add_to_arena(&arena_len, 4 * ((padded + 2) / 3) + 1))
+            return EEA_ERR_NO_MEMORY;
+        if (padded > max_padded)
+            max_padded = padded;
+    }
+
+    size_t tails_len = num_keys * key_len;
+    unsigned char *out = malloc(arena_len > 0 ? arena_len : 1);
+    unsigned char *work = malloc(max_padded + tails_len);
+    unsigned char *first_tails = xor_tails_from_keys(keys, num_keys, key_len);
+    if (out == NULL || work == NULL || first_tails == NULL)
+    {
+        free(out);
+        free(work);
+        free(first_tails);
+        return EEA_ERR_NO_MEMORY;
+    }
+
+    unsigned char *tails = work + max_padded;
+    size_t offset = 0;
+    for (size_t m = 0; m < count; m++)
+    {
+        size_t len = messages[m].len;
+        size_t padded = padded_len(len, key_len);
+        if (len > 0)
+            memcpy(work, messages[m].data, len);
+        memset(work + len, PADDING, padded - len);
+
+        // Every message starts its rounds from the keys
+        memcpy(tails, first_tails, tails_len);
+        xor_encrypt_chained(work, padded, tails, num_keys, key_len, 0);
+
+        char *encoded = (char *) out + offset;
+        size_t encoded_len = base64_encode_block(work, padded, encoded);
+        results[m].data = (unsigned char *) encoded;
+        results[m].len = encoded_len;
+        offset += encoded_len + 1;
+    }
+
+    free(work);
+    free(first_tails);
+    *arena = out;
+    return EEA_OK;
+}
+
+int decrypt_batch(const eea_buffer_t *messages, size_t count,
+                  const char **keys, int num_keys, eea_buffer_t *results,
+                  unsigned char **arena)
+{
+    size_t key_len = strlen(keys[0]);
+
+    // A message never decodes to more than its own length, so each is
+    // decoded and decrypted in place in its room in the arena
+    size_t arena_len = 0;
+    for (size_t m = 0; m < count; m++)
+    {
+        if (messages[m].len >= BATCH_MAX_MESSAGE)
+            return EEA_ERR_INVALID_ARGUMENT;
+        if (!add_to_arena(&arena_len, messages[m].len + 1))
+            return EEA_ERR_NO_MEMORY;
+    }
+
+    size_t tails_len = num_keys * key_len;
+    unsigned char *out = malloc(arena_len > 0 ? arena_len : 1);
+    unsigned char *tails = malloc(tails_len);
+    unsigned char *first_tails = xor_tails_from_keys(keys, num_keys, key_len);
+    if (out == NULL || tails == NULL || first_tails == NULL)
+    {
+        free(out);
+        free(tails);
+        free(first_tails);
+        return EEA_ERR_NO_MEMORY;
+    }
+
+    int ret = EEA_OK;
+    size_t offset = 0;
+    for (size_t m = 0; m < count && ret != EEA_ERR_NO_MEMORY; m++)
+    {
+        const eea_buffer_t *message = &messages[m];
+        unsigned char *plain_text = out + offset;
+        offset += message->len + 1;
+        results[m].data = NULL;
+        results[m].len = 0;
+
+        size_t raw_len = base64_decode_block((const char *) message->data,
+                                             message->len, plain_text);
+        size_t plain_text_len = 0;
+        if (raw_len == (size_t) -1)
+        {
+            // Not plain base64, such as with new lines in it. decrypt()
+            // accepts more, so leave it to that.
+            unsigned char *decrypted = NULL;
+            int error = decrypt_data((unsigned char *) message->data,
+                                     message->len, &decrypted,
+                                     &plain_text_len, keys, num_keys);
+            if (error != EEA_OK)
+            {
+                ret = error;
+                continue;
+            }
+            memcpy(plain_text, decrypted, plain_text_len);
+            free(decrypted);
+        }
+        else if (raw_len == 0 || raw_len % key_len != 0)
+        {
+            ret = EEA_ERR_INVALID_DATA;
+            continue;
+        }
+        else
+        {
+            memcpy(tails, first_tails, tails_len);
+            xor_decrypt_chained(plain_text, raw_len, tails, num_keys, key_len,
+                                0);
+            plain_text_len = raw_len;
+            while (plain_text_len > 0
+                   && plain_text[plain_text_len - 1] == PADDING)
+                plain_text_len--;
+        }
+        plain_text[plain_text_len] = '\0';
+        results[m].data = plain_text;
+        results[m].len = plain_text_len;
+    }
+
+    free(tails);
+    free(first_tails);
+    if (ret == EEA_ERR_NO_MEMORY)
+    {
+        free(out);
+        return ret;
+    }
+    *arena = out;
+    return ret;
+}
@@ -0,0 +1,203 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HAVE_SSE42_CRC 1
+#endif
+
+#include "checksum.h"
+
+// The CRC32C polynomial, reversed
+static const uint32_t CRC32C_POLY = 0x82f63b78;
+
+// Tables to checksum 8 bytes at a time without the instruction
+static uint32_t crc_tables[8][256];
+static int have_sse42 = 0;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Fill the tables, and see if the CPU has the crc32 instruction
+ */
+static void crc_init(void)
+{
+    for (int b = 0; b < 256; b++)
+    {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+        crc_tables[0][b] = crc;
+    }
+    for (int b = 0; b < 256; b++)
+        for (int t = 1; t < 8; t++)
+            crc_tables[t][b] = (crc_tables[t - 1][b] >> 8)
+                               ^ crc_tables[0][crc_tables[t - 1][b] & 0xff];
+#ifdef HAVE_SSE42_CRC
+    have_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+/**
+ * @brief Update a CRC32C with the tables, 8 bytes at a time
+ * @param[in] crc The CRC so far, before its final inversion
+ * @param[in] data The data
+ * @param[in] len The length of the data
+ * @return The CRC, before its final inversion
+ */
+static uint32_t crc32c_tables(uint32_t crc, const unsigned char *data,
+                              size_t len)
+{
+    for (; len >= 8; data += 8, len -= 8)
+    {
+        uint32_t low = crc ^ ((uint32_t) data[0] | (uint32_t) data[1] << 8
+                              | (uint32_t) data[2] << 16
+                              | (uint32_t) data[3] << 24);
+        crc = crc_tables[7][low & 0xff] ^ crc_tables[6][(low >> 8) & 0xff]
+              ^ crc_tables[5][(low >> 16) & 0xff] ^ crc_tables[4][low >> 24]
+              ^ crc_tables[3][data[4]] ^ crc_tables[2][data[5]]
+              ^ crc_tables[1][data[6]] ^ crc_tables[0][data[7]];
+    }
+    for (; len > 0; data++, len--)
+        crc = (crc >> 8) ^ crc_tables[0][(crc ^ *data) & 0xff];
+    return crc;
+}
+
+#ifdef HAVE_SSE42_CRC
+/**
+ * @brief Update a CRC32C with the SSE4.2 crc32 instruction, 8 bytes at a
+ * time
+ * @param[in] crc The CRC so far, before its final inversion
+ * @param[in] data The data
+ * @param[in] len The length of the data
+ * @return The CRC, before its final inversion
+ */
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const unsigned char *data, size_t len)
+{
+    uint64_t crc64 = crc;
+    for (; len >= 8; data += 8, len -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t) crc64;
+    for (; len > 0; data++, len--)
+        crc = _mm_crc32_u8(crc, *data);
+    return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&crc_once, crc_init);
+    crc = ~crc;
+#ifdef HAVE_SSE42_CRC
+    if (have_sse42)
+        return ~crc32c_sse42(crc, data, len);
+#endif
+    return ~crc32c_tables(crc, data, len);
+}
+
+void checksum_init(checksum_t *sum)
+{
+    memset(sum, 0, sizeof(*sum));
+}
+
+/**
+ * @brief Keep the checksum of the chunk that was just finished
+ * @param[in,out] sum The checksums
+ * @return 0 on success, 1 if allocating memory failed
+ */
+static int checksum_push(checksum_t *sum)
+{
+    if (sum->count == sum->capacity)
+    {
+        size_t capacity = sum->capacity ? sum->capacity * 2 : 64;
+        uint32_t *tmp = realloc(sum->crcs, capacity * sizeof(uint32_t));
+        if (tmp == NULL)
+            return 1;
+        sum->crcs = tmp;
+        sum->capacity = capacity;
+    }
+    sum->crcs[sum->count++] = sum->crc;
+    sum->crc = 0;
+    sum->have = 0;
+    return 0;
+}
+
+int checksum_update(checksum_t *sum, const void *data, size_t len)
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+    while (len > 0)
+    {
+        size_t take = CHECKSUM_CHUNK - sum->have;
+        if (take > len)
+            take = len;
+        sum->crc = crc32c(sum->crc, bytes, take);
+        sum->have += take;
+        bytes += take;
+        len -= take;
+        if (sum->have == CHECKSUM_CHUNK && checksum_push(sum))
+            return 1;
+    }
+    return 0;
+}
+
+char *checksum_trailer(checksum_t *sum, size_t *len)
+{
+    if (sum->have > 0 && checksum_push(sum))
+        return NULL;
+
+    size_t max_len = checksum_trailer_max(sum->count * CHECKSUM_CHUNK);
+    char *trailer = malloc(max_len);
+    if (trailer == NULL)
+        return NULL;
+    size_t used = snprintf(trailer, max_len, "\n%s%zu:", CHECKSUM_MARKER,
+                           CHECKSUM_CHUNK);
+    for (size_t c = 0; c < sum->count; c++)
+        used += snprintf(trailer + used, max_len - used, "%08x",
+                         (unsigned int) sum->crcs[c]);
+    used += snprintf(trailer + used, max_len - used, "\n");
+    *len = used;
+    return trailer;
+}
+
+void checksum_free(checksum_t *sum)
+{
+    free(sum->crcs);
+}
+
+size_t checksum_trailer_max(size_t len)
+{
+    // A new line, the marker, the chunk size and its ':', 8 hex digits for
+    // each chunk, and a new line
+    size_t count = (len + CHECKSUM_CHUNK - 1) / CHECKSUM_CHUNK;
+    return 1 + strlen(CHECKSUM_MARKER) + 21 + count * 8 + 2;
+}
+
+size_t checksum_line_start(const unsigned char *data, size_t len)
+{
+    // The line of checksums is the last line, and ends in a new line
+    if (len < 2 || data[len - 1] != '\n')
+        return len;
+    size_t start = len - 1;
+    while (start > 0 && data[start - 1] != '\n')
+        start--;
+    size_t marker_len = strlen(CHECKSUM_MARKER);
+    if (start == 0 || len - start < marker_len
+        || memcmp(data + start, CHECKSUM_MARKER, marker_len) != 0)
+        return len;
+    return start;
+}
+
+size_t checksum_body_len(const unsigned char *data, size_t len)
+{
+    size_t start = checksum_line_start(data, len);
+    if (start == len)
+        return len;
+    // Without the new line before the checksums
+    return start - 1;
+}
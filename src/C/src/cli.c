@@ -0,0 +1,1109 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "archive.h"
+#include "autotune.h"
+#include "cli.h"
+#include "columns.h"
+#include "config.h"
+#include "daemon.h"
+#include "decrypt.h"
+#include "eea.h"
+#include "encrypt.h"
+#include "file_handling.h"
+#include "globals.h"
+#include "menu.h"
+#include "prompts.h"
+#include "rekey.h"
+#include "stream.h"
+#include "verify.h"
+
+/**
+ * @enum Commands
+ * @brief The commands that can be given on the command line
+ */
+typedef enum
+{
+    COMMAND_ENCRYPT = 0,
+    COMMAND_DECRYPT = 1,
+    COMMAND_KEYGEN = 2,
+    COMMAND_AUTOTUNE = 3,
+    COMMAND_DAEMON = 4,
+    COMMAND_REKEY = 5,
+    COMMAND_PACK = 6,
+    COMMAND_LIST = 7,
+    COMMAND_UNPACK = 8,
+    COMMAND_VERIFY = 9
+} Commands;
+
+static const char *COMMAND_NAMES[] = { "enc", "dec", "keygen",
+                                       "autotune", "daemon", "rekey",
+                                       "pack", "list", "unpack",
+                                       "verify" };
+static const int NUM_COMMANDS = sizeof(COMMAND_NAMES) / sizeof(char *);
+
+// The environment variable the password can be given in
+static const char PASSWORD_ENV[] = "EEA_PASSWORD";
+// The most keys files, and so keysets, the daemon or enc can be given
+#define MAX_KEYS_FILES 64
+
+/**
+ * @struct command_args_t
+ * @brief The options given to a command
+ */
+typedef struct
+{
+    Commands command;
+    const char *keys_files[MAX_KEYS_FILES];
+    int num_keys_files;
+    int password_fd;
+    int num_keys;
+    long key_bits;
+    const char *socket_path;
+    long threads;
+    const char *columns;
+    const char *format;
+    const char *output;
+    const char *directory;
+    int compress;
+    int checksums;
+    int allow_missing;
+    char **files;
+    int num_files;
+} command_args_t;
+
+/**
+ * @brief Find a command by its name
+ * @param[in] name The name of the command, as in COMMAND_NAMES
+ * @return The command, one of Commands, -1 if there isn't one by that name
+ */
+static int find_command(const char *name)
+{
+    for (int c = 0; c < NUM_COMMANDS; c++)
+        if (strcmp(name, COMMAND_NAMES[c]) == 0)
+            return c;
+    return -1;
+}
+
+/**
+ * @brief Parse a whole, positive number given for an option
+ * @param[in] option The option, for the error message
+ * @param[in] value The value given
+ * @param[out] number Set to the number
+ * @return 1 if it is valid, 0 otherwise
+ */
+static int parse_number(const char *option, const char *value, long *number)
+{
+    char *end = NULL;
+    *number = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || *number < 0)
+    {
+        fprintf(stderr, "%sError:%s Invalid value for %s: \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], option, value);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Parse the options given to a command
+ * @param[in] argc The number of arguments, starting with the command
+ * @param[in] argv The arguments, starting with the command
+ * @param[out] args Set to the options
+ * @return 1 if they are valid, 0 otherwise
+ */
+static int parse_command_args(int argc, char **argv, command_args_t *args)
+{
+    memset(args, 0, sizeof(*args));
+    args->command = find_command(argv[0]);
+    args->password_fd = -1;
+    args->num_keys = DEFAULT_NUM_KEYS;
+    args->key_bits = KEY_BIT_SIZES[DEFAULT_KEY_SELECTION - 1];
+    args->files = &argv[1];
+
+    int options_done = 0;
+    for (int a = 1; a < argc; a++)
+    {
+        const char *arg = argv[a];
+        int has_value = (a + 1 < argc);
+        long number = 0;
+        if (options_done || arg[0] != '-' || strcmp(arg, "-") == 0)
+            args->files[args->num_files++] = argv[a];
+        else if (strcmp(arg, "--") == 0)
+            options_done = 1;
+        else if ((strcmp(arg, "-k") == 0 || strcmp(arg, "--keys") == 0)
+                 && has_value && args->num_keys_files < MAX_KEYS_FILES)
+            args->keys_files[args->num_keys_files++] = argv[++a];
+        else if (strcmp(arg, "--password-fd") == 0 && has_value)
+        {
+            if (!parse_number(arg, argv[++a], &number))
+                return 0;
+            args->password_fd = (int) number;
+        }
+        else if ((strcmp(arg, "-n") == 0 || strcmp(arg, "--num-keys") == 0)
+                 && has_value && args->command == COMMAND_KEYGEN)
+        {
+            if (!parse_number(arg, argv[++a], &number))
+                return 0;
+            args->num_keys = (int) number;
+        }
+        else if ((strcmp(arg, "-b") == 0 || strcmp(arg, "--bits") == 0)
+                 && has_value && args->command == COMMAND_KEYGEN)
+        {
+            if (!parse_number(arg, argv[++a], &args->key_bits))
+                return 0;
+        }
+        else if (strcmp(arg, "--socket") == 0 && has_value
+                 && args->command == COMMAND_DAEMON)
+            args->socket_path = argv[++a];
+        else if ((strcmp(arg, "-t") == 0 || strcmp(arg, "--threads") == 0)
+                 && has_value && args->command != COMMAND_KEYGEN
+                 && args->command != COMMAND_AUTOTUNE)
+        {
+            if (!parse_number(arg, argv[++a], &args->threads))
+                return 0;
+        }
+        else if ((strcmp(arg, "-c") == 0 || strcmp(arg, "--columns") == 0)
+                 && has_value
+                 && (args->command == COMMAND_ENCRYPT
+                     || args->command == COMMAND_DECRYPT))
+            args->columns = argv[++a];
+        else if (strcmp(arg, "--format") == 0 && has_value
+                 && (args->command == COMMAND_ENCRYPT
+                     || args->command == COMMAND_DECRYPT))
+            args->format = argv[++a];
+        else if ((strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0)
+                 && has_value
+                 && (args->command == COMMAND_ENCRYPT
+                     || args->command == COMMAND_PACK))
+            args->output = argv[++a];
+        else if ((strcmp(arg, "-z") == 0 || strcmp(arg, "--compress") == 0)
+                 && args->command == COMMAND_ENCRYPT)
+            args->compress = 1;
+        else if (strcmp(arg, "--checksums") == 0
+                 && (args->command == COMMAND_ENCRYPT
+                     || args->command == COMMAND_REKEY))
+            args->checksums = 1;
+        else if (strcmp(arg, "--allow-missing") == 0
+                 && args->command == COMMAND_VERIFY)
+            args->allow_missing = 1;
+        else if ((strcmp(arg, "-C") == 0 || strcmp(arg, "--directory") == 0)
+                 && has_value && args->command == COMMAND_UNPACK)
+            args->directory = argv[++a];
+        else
+        {
+            fprintf(stderr, "%sError:%s Unknown option for %s: \'%s\'\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], argv[0], arg);
+            return 0;
+        }
+    }
+
+    if (args->command != COMMAND_AUTOTUNE && args->command != COMMAND_VERIFY
+        && args->num_keys_files == 0)
+    {
+        fprintf(stderr, "%sError:%s %s needs a keys file, given with -k\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], argv[0]);
+        return 0;
+    }
+    if (args->command == COMMAND_REKEY && args->num_keys_files != 2)
+    {
+        fprintf(stderr, "%sError:%s %s needs the old keys file, then the new "
+                "one, each given with -k\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], argv[0]);
+        return 0;
+    }
+    if (args->command != COMMAND_DAEMON && args->command != COMMAND_REKEY
+        && args->command != COMMAND_ENCRYPT && args->num_keys_files > 1)
+    {
+        fprintf(stderr, "%sError:%s %s only takes one keys file\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], argv[0]);
+        return 0;
+    }
+    if (args->command != COMMAND_ENCRYPT && args->command != COMMAND_DECRYPT
+        && args->command != COMMAND_REKEY && args->command != COMMAND_PACK
+        && args->command != COMMAND_LIST && args->command != COMMAND_UNPACK
+        && args->command != COMMAND_VERIFY && args->num_files > 0)
+    {
+        fprintf(stderr, "%sError:%s %s doesn't take any files\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], argv[0]);
+        return 0;
+    }
+    if (args->columns == NULL && args->format != NULL)
+    {
+        fprintf(stderr, "%sError:%s --format is only used with --columns\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 0;
+    }
+    if (args->columns != NULL && args->compress)
+    {
+        fprintf(stderr, "%sError:%s --compress isn't used with --columns\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 0;
+    }
+    if (args->columns != NULL && args->checksums)
+    {
+        fprintf(stderr, "%sError:%s --checksums isn't used with --columns\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 0;
+    }
+    if (args->columns != NULL && args->num_keys_files > 1)
+    {
+        fprintf(stderr, "%sError:%s --columns takes one keys file\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 0;
+    }
+    if (args->command == COMMAND_PACK
+        && (args->output == NULL || args->num_files == 0))
+    {
+        fprintf(stderr, "%sError:%s pack needs the archive to write, given "
+                "with -o, and the files\nto pack\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 0;
+    }
+    if (args->command == COMMAND_VERIFY
+        && (args->num_keys_files > 0 || args->num_files == 0))
+    {
+        fprintf(stderr, "%sError:%s verify needs the files or directories to "
+                "check, and no keys file\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 0;
+    }
+    if ((args->command == COMMAND_LIST && args->num_files != 1)
+        || (args->command == COMMAND_UNPACK && args->num_files == 0))
+    {
+        fprintf(stderr, "%sError:%s %s needs an archive\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], argv[0]);
+        return 0;
+    }
+    if (args->command == COMMAND_ENCRYPT && args->output != NULL
+        && args->num_keys_files < 2)
+    {
+        fprintf(stderr, "%sError:%s --output is only used with several keys "
+                "files\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 0;
+    }
+    if (args->columns != NULL && args->num_files > 1)
+    {
+        fprintf(stderr, "%sError:%s --columns takes one file at a time\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Read a password from a file descriptor, up to a new line
+ * @param[in] fd The file descriptor
+ * @return The password, NULL if reading it failed
+ * @note Only the password and its new line are read, so the rest of the
+ * file descriptor can still be used, such as for the data on stdin
+ * @note The returned password must be freed
+ */
+static char *read_password_fd(int fd)
+{
+    size_t password_max_len = 64;
+    size_t len = 0;
+    char *password = malloc(password_max_len);
+    if (password == NULL)
+        return NULL;
+
+    char c;
+    ssize_t ret;
+    while ((ret = read(fd, &c, 1)) == 1 && c != '\n')
+    {
+        if (len + 1 == password_max_len)
+        {
+            char *tmp = realloc(password, password_max_len *= 2);
+            if (tmp == NULL)
+            {
+                free(password);
+                return NULL;
+            }
+            password = tmp;
+        }
+        password[len++] = c;
+    }
+    if (ret < 0)
+    {
+        free(password);
+        return NULL;
+    }
+
+    if (len > 0 && password[len - 1] == '\r')
+        len--;
+    password[len] = '\0';
+    return password;
+}
+
+/**
+ * @brief Get the password for the keys file, without prompting unless
+ * there is no other way and stdin is a terminal
+ * @param[in] args The options given to the command
+ * @param[in] can_prompt If stdin isn't being used for data
+ * @param[in] set_password If the password is being created, so a prompted
+ * one is asked for twice
+ * @return The password, NULL on failure
+ * @note The returned password must be freed
+ */
+static char *get_command_password(const command_args_t *args, int can_prompt,
+                                  int set_password)
+{
+    if (args->password_fd >= 0)
+    {
+        char *password = read_password_fd(args->password_fd);
+        if (password == NULL)
+            fprintf(stderr,
+                    "%sError:%s Failed to read the password from file "
+                    "descriptor %d\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET],
+                    args->password_fd);
+        return password;
+    }
+
+    const char *env = getenv(PASSWORD_ENV);
+    if (env != NULL)
+        return strdup(env);
+
+    if (!can_prompt || !isatty(STDIN_FILENO))
+    {
+        fprintf(stderr,
+                "%sError:%s No password. Give it with --password-fd <fd> or "
+                "in %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], PASSWORD_ENV);
+        return NULL;
+    }
+
+    char *password = get_password(set_password
+                                      ? "Enter a password for the keys file: "
+                                      : "Password: ");
+    if (password == NULL || !set_password)
+        return password;
+
+    char *retyped = get_password("Re-type password: ");
+    if (retyped == NULL || strcmp(password, retyped) != 0)
+    {
+        fprintf(stderr, "%sError:%s Passwords don't match.\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        free(password);
+        password = NULL;
+    }
+    free(retyped);
+    return password;
+}
+
+/**
+ * @brief Find a keys file, either at the path given or in the keys
+ * directory
+ * @param[in] name The path or name of the keys file
+ * @param[in] must_exist If the keys file is being read, rather than created
+ * @return The path of the keys file, NULL on failure
+ * @note The returned path must be freed
+ */
+static char *find_keys_file(const char *name, int must_exist)
+{
+    // A bare name is in the keys directory, as in the menu
+    char *path = NULL;
+    if (file_exists(name) || keys_dir == NULL || strchr(name, '/') != NULL)
+        path = strdup(name);
+    else
+        path = get_keys_path(name);
+    if (path == NULL)
+        return NULL;
+
+    if (must_exist && !file_exists(path))
+    {
+        fprintf(stderr, "%sError:%s The keys file \'%s\' doesn't exist\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], name);
+        free(path);
+        return NULL;
+    }
+    if (!must_exist && file_exists(path))
+    {
+        fprintf(stderr, "%sError:%s The keys file \'%s\' already exists\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path);
+        free(path);
+        return NULL;
+    }
+    return path;
+}
+
+/**
+ * @brief Find a keys file, get its password and load the keys from it
+ * @param[in] args The options given to the command
+ * @param[in] file The path or name of the keys file
+ * @param[in] can_prompt If stdin isn't being used for data
+ * @param[out] keys Set to the keys
+ * @param[out] num_keys Set to the number of keys
+ * @return 1 on success, 0 on failure, after printing why
+ * @note The keys must be freed with eea_free_keys()
+ */
+static int load_command_keys(const command_args_t *args, const char *file,
+                             int can_prompt, char ***keys, int *num_keys)
+{
+    char *path = find_keys_file(file, 1);
+    if (path == NULL)
+        return 0;
+    char *password = get_command_password(args, can_prompt, 0);
+    if (password == NULL)
+    {
+        free(path);
+        return 0;
+    }
+
+    int ret = eea_load_keys(path, password, keys, num_keys);
+    free(password);
+    if (ret != EEA_OK)
+        fprintf(stderr, "%sError:%s Failed to load the keys from \'%s\': %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path,
+                eea_strerror(ret));
+    free(path);
+    return ret == EEA_OK;
+}
+
+/**
+ * @brief Get the name of a keyset, which is the name of its keys file
+ * without the directory or .keys
+ * @param[in] file The keys file, as given with -k
+ * @return The name, NULL if there isn't enough memory
+ * @note The returned name must be freed
+ */
+static char *get_keyset_name(const char *file)
+{
+    const char *base = strrchr(file, '/');
+    base = (base == NULL) ? file : base + 1;
+    size_t name_len = strlen(base);
+    if (is_of_filetype(base, ".keys"))
+        name_len -= strlen(".keys");
+    return strndup(base, name_len);
+}
+
+/**
+ * @brief Check if the password will be asked for, rather than given
+ * @param[in] args The options given to the command
+ * @return If it will be asked for
+ */
+static int will_prompt(const command_args_t *args)
+{
+    return args->password_fd < 0 && getenv(PASSWORD_ENV) == NULL;
+}
+
+/**
+ * @brief Generate keys and save them to a new keys file
+ * @param[in] args The options given to the command
+ * @return The exit code
+ */
+static int run_keygen(const command_args_t *args)
+{
+    if (!is_of_filetype(args->keys_files[0], ".keys"))
+    {
+        fprintf(stderr, "%sError:%s The keys file should end in .keys\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 1;
+    }
+    char *path = find_keys_file(args->keys_files[0], 0);
+    if (path == NULL)
+        return 1;
+
+    char **keys = NULL;
+    int ret = eea_generate_keys(args->key_bits, args->num_keys, &keys);
+    if (ret != EEA_OK)
+    {
+        fprintf(stderr, "%sError:%s Generating keys failed: %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], eea_strerror(ret));
+        free(path);
+        return 1;
+    }
+
+    char *password = get_command_password(args, 1, 1);
+    if (password != NULL)
+    {
+        ret = eea_save_keys(path, (const char **) keys, args->num_keys,
+                            password);
+        if (ret != EEA_OK)
+            fprintf(stderr, "%sError:%s Saving keys to \'%s\' failed: %s\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], path,
+                    eea_strerror(ret));
+        free(password);
+    }
+
+    eea_free_keys(keys, args->num_keys);
+    free(path);
+    return (password == NULL || ret != EEA_OK);
+}
+
+/**
+ * @brief Encrypt or decrypt the columns given with --columns in a CSV or
+ * JSON Lines file, or stdin, to stdout
+ * @param[in] args The options given to the command
+ * @param[in] keys The keys
+ * @param[in] num_keys The number of keys
+ * @return The exit code
+ */
+static int run_columns(const command_args_t *args, const char **keys,
+                       int num_keys)
+{
+    const char *file = (args->num_files == 1 && strcmp(args->files[0], "-"))
+                           ? args->files[0]
+                           : NULL;
+    int format = COLUMN_FORMAT_CSV;
+    if (args->format != NULL)
+    {
+        for (format = 0; format < NUM_COLUMN_FORMATS; format++)
+            if (strcmp(args->format, COLUMN_FORMAT_NAMES[format]) == 0)
+                break;
+        if (format == NUM_COLUMN_FORMATS)
+        {
+            fprintf(stderr, "%sError:%s Unknown format \'%s\', use csv or "
+                    "jsonl\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], args->format);
+            return 1;
+        }
+    }
+    else if (file != NULL
+             && (is_of_filetype(file, ".jsonl")
+                 || is_of_filetype(file, ".ndjson")))
+        format = COLUMN_FORMAT_JSONL;
+
+    // Split the comma separated names
+    char *list = strdup(args->columns);
+    const char **columns = calloc(strlen(args->columns) / 2 + 1,
+                                  sizeof(char *));
+    if (list == NULL || columns == NULL)
+    {
+        free(list);
+        free(columns);
+        return 1;
+    }
+    int num_columns = 0;
+    for (char *name = strtok(list, ","); name != NULL;
+         name = strtok(NULL, ","))
+        columns[num_columns++] = name;
+
+    FILE *in = stdin;
+    if (file != NULL)
+        in = fopen(file, "rb");
+    int ret = 1;
+    if (num_columns == 0)
+        fprintf(stderr, "%sError:%s No columns were given\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+    else if (in == NULL)
+        fprintf(stderr, "%sError:%s Failed to open \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], file);
+    else
+    {
+#ifdef WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        long threads = (args->threads > 0) ? args->threads : default_threads;
+        ret = crypt_columns(in, stdout, format, columns, num_columns,
+                            args->command == COMMAND_ENCRYPT, keys, num_keys,
+                            (int) threads);
+    }
+    if (in != NULL && in != stdin)
+        fclose(in);
+    free(columns);
+    free(list);
+    return ret;
+}
+
+/**
+ * @brief Warn that the plain text ended in zero bytes, which the format
+ * can't tell from the padding
+ * @param[in] padding The number of zero bytes it ended in
+ */
+static void warn_trailing_padding(size_t padding)
+{
+    if (padding > 0)
+        fprintf(stderr,
+                "%sWARNING%s the input ended in %zu zero bytes, which "
+                "will be removed\nwith the padding when it is decrypted. "
+                "Compress it first, e.g. with xz, to\nkeep them.\n",
+                colors[COLOR_WARNING], colors[COLOR_RESET], padding);
+}
+
+/**
+ * @brief Encrypt a file, or stdin, for several keysets, reading it once,
+ * to <file>.<keyset>.eea for each
+ * @param[in] file The file, NULL for stdin
+ * @param[in] prefix What to name the files written for stdin after
+ * @param[in] names The name of each keyset
+ * @param[in] keys The keys of each keyset
+ * @param[in] num_keys The number of keys in each keyset
+ * @param[in] count The number of keysets
+ * @return 0 on success, 1 on failure, after printing why. Nothing is left
+ * written on a failure.
+ */
+static int fanout_file(const char *file, const char *prefix, char **names,
+                       char ***keys, const int *num_keys, int count)
+{
+    FILE *in = (file == NULL) ? stdin : fopen(file, "rb");
+    if (in == NULL)
+    {
+        fprintf(stderr, "%sError:%s Failed to open \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], file);
+        return 1;
+    }
+#ifdef WIN32
+    if (file == NULL)
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+
+    const char *base = (file == NULL) ? prefix : file;
+    char *paths[MAX_KEYS_FILES];
+    FILE *outs[MAX_KEYS_FILES];
+    int ret = EEA_OK;
+    int opened = 0;
+    for (; opened < count; opened++)
+    {
+        size_t len = strlen(base) + strlen(names[opened])
+                     + sizeof(EEA_FILE_EXTENTION) + 1;
+        paths[opened] = malloc(len);
+        if (paths[opened] == NULL)
+        {
+            ret = EEA_ERR_NO_MEMORY;
+            break;
+        }
+        snprintf(paths[opened], len, "%s.%s%s", base, names[opened],
+                 EEA_FILE_EXTENTION);
+        outs[opened] = fopen(paths[opened], "wb");
+        if (outs[opened] == NULL)
+        {
+            ret = EEA_ERR_IO;
+            free(paths[opened]);
+            break;
+        }
+    }
+
+    size_t padding = 0;
+    if (ret == EEA_OK)
+        ret = encrypt_stream_fanout(in, outs, (const char ***) keys,
+                                    num_keys, count, &padding);
+    for (int o = 0; o < opened; o++)
+        if (fclose(outs[o]) != 0 && ret == EEA_OK)
+            ret = EEA_ERR_IO;
+    for (int o = 0; o < opened; o++)
+    {
+        if (ret != EEA_OK)
+            remove(paths[o]);
+        free(paths[o]);
+    }
+    if (in != stdin)
+        fclose(in);
+
+    if (ret == EEA_OK)
+        warn_trailing_padding(padding);
+    else
+        fprintf(stderr, "%sError:%s Failed to encrypt \'%s\': %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET],
+                (file == NULL) ? "stdin" : file, eea_strerror(ret));
+    return ret != EEA_OK;
+}
+
+/**
+ * @brief Encrypt stdin, or each file given, for every keys file given,
+ * reading each only once
+ * @param[in] args The options given to the command
+ * @return The exit code
+ */
+static int run_fanout(const command_args_t *args)
+{
+    int streaming = (args->num_files == 0
+                     || (args->num_files == 1
+                         && strcmp(args->files[0], "-") == 0));
+    if (streaming && args->output == NULL)
+    {
+        fprintf(stderr, "%sError:%s Encrypting stdin for several keys files "
+                "needs --output,\nto name the files written\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 1;
+    }
+
+    int count = args->num_keys_files;
+    char *names[MAX_KEYS_FILES];
+    char **keys[MAX_KEYS_FILES];
+    int num_keys[MAX_KEYS_FILES];
+    int loaded = 0;
+    for (; loaded < count; loaded++)
+    {
+        // Each output is named after its keys file, without .keys
+        const char *file = args->keys_files[loaded];
+        names[loaded] = get_keyset_name(file);
+        if (names[loaded] == NULL)
+            break;
+        int duplicate = 0;
+        for (int s = 0; s < loaded; s++)
+            duplicate |= (strcmp(names[s], names[loaded]) == 0);
+        if (duplicate)
+        {
+            fprintf(stderr,
+                    "%sError:%s There is already a keyset called \'%s\'\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], names[loaded]);
+            free(names[loaded]);
+            break;
+        }
+
+        if (!streaming && will_prompt(args))
+            printf("Unlocking the keyset \'%s\'\n", names[loaded]);
+        if (!load_command_keys(args, file, !streaming, &keys[loaded],
+                               &num_keys[loaded]))
+        {
+            free(names[loaded]);
+            break;
+        }
+    }
+
+    int failed = (loaded < count);
+    if (!failed && streaming)
+        failed = fanout_file(NULL, args->output, names, keys, num_keys,
+                             count);
+    for (int f = 0; f < args->num_files && !streaming && loaded == count;
+         f++)
+        failed |= fanout_file(args->files[f], NULL, names, keys, num_keys,
+                              count);
+
+    for (int s = 0; s < loaded; s++)
+    {
+        eea_free_keys(keys[s], num_keys[s]);
+        free(names[s]);
+    }
+    return failed;
+}
+
+/**
+ * @brief Encrypt or decrypt stdin to stdout, or each file given
+ * @param[in] args The options given to the command
+ * @return The exit code
+ */
+static int run_crypt(const command_args_t *args)
+{
+    if (args->num_keys_files > 1)
+        return run_fanout(args);
+
+    int encrypting = (args->command == COMMAND_ENCRYPT);
+    int streaming = (args->num_files == 0
+                     || (args->num_files == 1
+                         && strcmp(args->files[0], "-") == 0));
+
+    char **keys = NULL;
+    int num_keys = 0;
+    if (!load_command_keys(args, args->keys_files[0], !streaming, &keys,
+                           &num_keys))
+        return 1;
+    int ret = EEA_OK;
+
+    int failed = 0;
+    if (args->columns != NULL)
+        failed = run_columns(args, (const char **) keys, num_keys);
+    else if (streaming)
+    {
+#ifdef WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        size_t padding = 0;
+        ret = encrypting
+                  ? encrypt_stream(stdin, stdout, (const char **) keys,
+                                   num_keys, &padding)
+                  : decrypt_stream(stdin, stdout, (const char **) keys,
+                                   num_keys);
+        if (ret == EEA_OK)
+            warn_trailing_padding(padding);
+        if (ret != EEA_OK)
+        {
+            fprintf(stderr, "%sError:%s %s failed: %s\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET],
+                    encrypting ? "Encryption" : "Decryption",
+                    eea_strerror(ret));
+            failed = 1;
+        }
+    }
+
+    for (int f = 0; f < args->num_files && !streaming && args->columns == NULL;
+         f++)
+    {
+        const char *file = args->files[f];
+        if (!encrypting && !is_of_filetype(file, EEA_FILE_EXTENTION))
+        {
+            fprintf(stderr, "%sError:%s \'%s\' isn't a %s file\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], file,
+                    EEA_FILE_EXTENTION);
+            failed = 1;
+            continue;
+        }
+        ret = encrypting
+                  ? encrypt_file(file, (const char **) keys, num_keys, NULL,
+                                 NULL)
+                  : decrypt_file(file, (const char **) keys, num_keys, NULL,
+                                 NULL);
+        if (ret != EEA_OK)
+        {
+            fprintf(stderr, "%sError:%s Failed to %s \'%s\': %s\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET],
+                    encrypting ? "encrypt" : "decrypt", file,
+                    eea_strerror(ret));
+            failed = 1;
+        }
+    }
+
+    eea_free_keys(keys, num_keys);
+    return failed;
+}
+
+/**
+ * @brief Unlock each keys file given, and serve requests for them over a
+ * Unix socket until stopped
+ * @param[in] args The options given to the command
+ * @return The exit code
+ */
+static int run_daemon_command(const command_args_t *args)
+{
+    keyset_t *keysets = calloc(args->num_keys_files, sizeof(keyset_t));
+    if (keysets == NULL)
+        return 1;
+
+    int loaded = 0;
+    for (; loaded < args->num_keys_files; loaded++)
+    {
+        // Requests select a keyset by the name of its file, without .keys
+        const char *file = args->keys_files[loaded];
+        keyset_t *keyset = &keysets[loaded];
+        keyset->name = get_keyset_name(file);
+        if (keyset->name == NULL)
+            break;
+        size_t name_len = strlen(keyset->name);
+        int duplicate = 0;
+        for (int s = 0; s < loaded; s++)
+            duplicate |= (strcmp(keysets[s].name, keyset->name) == 0);
+        if (duplicate || name_len > UINT8_MAX)
+        {
+            fprintf(stderr,
+                    "%sError:%s There is already a keyset called \'%s\', or "
+                    "the name is too long\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], keyset->name);
+            free(keyset->name);
+            break;
+        }
+
+        if (will_prompt(args))
+            printf("Unlocking the keyset \'%s\'\n", keyset->name);
+        if (!load_command_keys(args, file, 1, &keyset->keys,
+                               &keyset->num_keys))
+        {
+            free(keyset->name);
+            break;
+        }
+    }
+
+    if (loaded < args->num_keys_files)
+    {
+        for (int s = 0; s < loaded; s++)
+        {
+            eea_free_keys(keysets[s].keys, keysets[s].num_keys);
+            free(keysets[s].name);
+        }
+        free(keysets);
+        return 1;
+    }
+
+    long threads = args->threads;
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int ret = run_daemon(keysets, loaded, args->socket_path,
+                         threads > 0 ? (int) threads : 1);
+    free(keysets);
+    return ret;
+}
+
+/**
+ * @brief Re-encrypt .eea files, directories of them, or stdin to stdout,
+ * from the first keys file given to the second
+ * @param[in] args The options given to the command
+ * @return The exit code
+ */
+static int run_rekey(const command_args_t *args)
+{
+    int streaming = (args->num_files == 0
+                     || (args->num_files == 1
+                         && strcmp(args->files[0], "-") == 0));
+
+    // The passwords are read in the same order as the keys files
+    char **old_keys = NULL, **new_keys = NULL;
+    int old_num_keys = 0, new_num_keys = 0;
+    if (!streaming && will_prompt(args))
+        printf("Unlocking the old keys, \'%s\'\n", args->keys_files[0]);
+    if (!load_command_keys(args, args->keys_files[0], !streaming, &old_keys,
+                           &old_num_keys))
+        return 1;
+    if (!streaming && will_prompt(args))
+        printf("Unlocking the new keys, \'%s\'\n", args->keys_files[1]);
+    if (!load_command_keys(args, args->keys_files[1], !streaming, &new_keys,
+                           &new_num_keys))
+    {
+        eea_free_keys(old_keys, old_num_keys);
+        return 1;
+    }
+
+    int failed = 0;
+    if (streaming)
+    {
+#ifdef WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        int ret = rekey_stream(stdin, stdout, (const char **) old_keys,
+                               old_num_keys, (const char **) new_keys,
+                               new_num_keys);
+        if (ret != EEA_OK)
+        {
+            fprintf(stderr, "%sError:%s Re-encrypting failed: %s\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET],
+                    eea_strerror(ret));
+            failed = 1;
+        }
+    }
+    else
+    {
+        long threads = (args->threads > 0) ? args->threads : default_threads;
+        failed = rekey_paths(args->files, args->num_files,
+                             (const char **) old_keys, old_num_keys,
+                             (const char **) new_keys, new_num_keys,
+                             (int) threads);
+    }
+
+    eea_free_keys(old_keys, old_num_keys);
+    eea_free_keys(new_keys, new_num_keys);
+    return failed;
+}
+
+/**
+ * @brief Pack files into an archive, list what is in one, or unpack files
+ * from one
+ * @param[in] args The options given to the command
+ * @return The exit code
+ */
+static int run_archive(const command_args_t *args)
+{
+    char **keys = NULL;
+    int num_keys = 0;
+    if (!load_command_keys(args, args->keys_files[0], 1, &keys, &num_keys))
+        return 1;
+
+    int failed = 0;
+    if (args->command == COMMAND_PACK)
+    {
+        long threads = (args->threads > 0) ? args->threads : default_threads;
+        failed = pack_archive(args->output, args->files, args->num_files,
+                              (const char **) keys, num_keys, (int) threads);
+    }
+    else if (args->command == COMMAND_LIST)
+        failed = list_archive(args->files[0], (const char **) keys, num_keys,
+                              stdout);
+    else
+        failed = unpack_archive(args->files[0], &args->files[1],
+                                args->num_files - 1, args->directory,
+                                (const char **) keys, num_keys);
+
+    eea_free_keys(keys, num_keys);
+    return failed;
+}
+
+int is_command(const char *arg)
+{
+    return find_command(arg) >= 0;
+}
+
+int run_command(int argc, char **argv)
+{
+    command_args_t args;
+    if (!parse_command_args(argc, argv, &args))
+        return 2;
+
+    if (args.command == COMMAND_AUTOTUNE)
+        return autotune();
+
+    load_config(0);
+    if (args.compress)
+        compression = 1;
+    if (args.checksums)
+        checksums = 1;
+    int ret = 0;
+    if (args.command == COMMAND_KEYGEN)
+        ret = run_keygen(&args);
+    else if (args.command == COMMAND_DAEMON)
+        ret = run_daemon_command(&args);
+    else if (args.command == COMMAND_REKEY)
+        ret = run_rekey(&args);
+    else if (args.command == COMMAND_VERIFY)
+    {
+        long threads = (args.threads > 0) ? args.threads : default_threads;
+        ret = verify_paths(args.files, args.num_files, (int) threads,
+                           args.allow_missing);
+    }
+    else if (args.command == COMMAND_PACK || args.command == COMMAND_LIST
+             || args.command == COMMAND_UNPACK)
+        ret = run_archive(&args);
+    else
+        ret = run_crypt(&args);
+    free(keys_dir);
+    free(trace_file);
+    return ret;
+}
+
+void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [--stats] [--trace <file>]\n"
+            "       %s enc -k <keys file> [--password-fd <fd>] [--compress]\n"
+            "              [--checksums] [file...]\n"
+            "       %s dec -k <keys file> [--password-fd <fd>] [file...]\n"
+            "       %s enc -k <keys file> -k <keys file>... "
+            "[--password-fd <fd>]\n"
+            "              [--compress] [--checksums] [-o <name>] "
+            "[file...]\n"
+            "       %s enc|dec -k <keys file> --columns <name,...> "
+            "[--format csv|jsonl]\n"
+            "              [--threads <n>] [file]\n"
+            "       %s keygen -k <keys file> [--password-fd <fd>] "
+            "[-n <keys>] [-b <bits>]\n"
+            "       %s daemon -k <keys file> [-k <keys file>...] "
+            "[--password-fd <fd>]\n"
+            "              [--socket <path>] [--threads <n>]\n"
+            "       %s rekey -k <old keys file> -k <new keys file> "
+            "[--password-fd <fd>]\n"
+            "              [--threads <n>] [--checksums] "
+            "[file or directory...]\n"
+            "       %s pack -k <keys file> -o <archive> [--threads <n>] "
+            "<file or directory>...\n"
+            "       %s list -k <keys file> <archive>\n"
+            "       %s unpack -k <keys file> [-C <directory>] <archive> "
+            "[file or directory...]\n"
+            "       %s verify [--threads <n>] [--allow-missing] "
+            "<file or directory>...\n"
+            "       %s autotune\n\n"
+            "Without any files, or with '-', enc and dec read stdin and "
+            "write stdout.\n"
+            "With several keys files, enc writes <file>.<keys file>.eea for "
+            "each, reading\nthe file once, or <name>.<keys file>.eea for "
+            "stdin.\n"
+            "With --columns, only those columns of a CSV or JSON Lines file "
+            "are encrypted\nor decrypted, and it is written to stdout.\n"
+            "With --compress, enc compresses the data with zlib first; dec "
+            "notices this\nitself.\n"
+            "With --checksums, enc and rekey end each .eea file in CRC32C "
+            "checksums, for\nverify. Older builds and the other ports can't "
+            "read them.\n"
+            "The password is read from --password-fd, or %s, and is only "
+            "asked for\nif neither is given and stdin is a terminal.\n",
+            program, program, program, program, program, program, program,
+            program, program, program, program, program, program,
+            PASSWORD_ENV);
+}
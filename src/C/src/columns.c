@@ -0,0 +1,908 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "columns.h"
+#include "eea.h"
+#include "globals.h"
+#include "work_queue.h"
+
+// About how much of the input each chunk holds. A chunk is always whole
+// records, so it grows to fit a record longer than this.
+static const size_t COLUMN_CHUNK = (size_t) 1 << 20;
+
+/**
+ * @struct span_t
+ * @brief Where a value being replaced is in a chunk
+ */
+typedef struct
+{
+    size_t start;
+    size_t end;
+} span_t;
+
+/**
+ * @struct column_values_t
+ * @brief The values of the selected columns in a chunk, in order
+ */
+typedef struct
+{
+    span_t *spans;
+    eea_buffer_t *messages;
+    size_t count;
+    size_t capacity;
+    // Values that had to be unescaped, as long as the chunk so it never
+    // moves
+    unsigned char *scratch;
+    size_t scratch_len;
+} column_values_t;
+
+/**
+ * @struct column_job_t
+ * @brief A chunk of records, and what it was rewritten to
+ */
+typedef struct
+{
+    unsigned char *in;
+    size_t in_len;
+    unsigned char *out;
+    size_t out_len;
+    int done;
+    // Why rewriting the chunk failed, NULL if it didn't
+    const char *error;
+} column_job_t;
+
+/**
+ * @struct columns_t
+ * @brief What the reader, workers and writer share
+ */
+typedef struct
+{
+    ColumnFormats format;
+    int encrypting;
+    const char **keys;
+    int num_keys;
+    // CSV: whether each column in the header is selected
+    unsigned char *selected;
+    size_t num_fields;
+    // JSON Lines: the keys selected
+    const char **names;
+    int num_names;
+    // Chunks waiting for a worker, and every chunk in the order read
+    work_queue_t *todo;
+    work_queue_t *order;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    FILE *out;
+    // The first error, after which nothing more is read or written
+    const char *error;
+} columns_t;
+
+/**
+ * @brief Find the end of the last whole record in a buffer
+ * @param[in] format One of ColumnFormats
+ * @param[in] buf The buffer, which starts at the start of a record
+ * @param[in] len The length of the buffer
+ * @return The length of the whole records, 0 if there are none
+ */
+static size_t find_records_end(ColumnFormats format, const unsigned char *buf,
+                               size_t len)
+{
+    if (format == COLUMN_FORMAT_JSONL)
+    {
+        // A JSON string can't hold a raw new line, so every one ends a line
+        for (size_t x = len; x > 0; x--)
+            if (buf[x - 1] == '\n')
+                return x;
+        return 0;
+    }
+
+    // A quoted CSV value can hold new lines
+    size_t end = 0;
+    int quoted = 0;
+    for (size_t x = 0; x < len; x++)
+    {
+        if (buf[x] == '"')
+            quoted = !quoted;
+        else if (buf[x] == '\n' && !quoted)
+            end = x + 1;
+    }
+    return end;
+}
+
+/**
+ * @brief Find the end of the first record in a buffer
+ * @param[in] buf The buffer, which starts at the start of a CSV record
+ * @param[in] len The length of the buffer
+ * @return The length of the first record, with its new line, 0 if the
+ * buffer doesn't hold a whole record
+ */
+static size_t find_first_record_end(const unsigned char *buf, size_t len)
+{
+    int quoted = 0;
+    for (size_t x = 0; x < len; x++)
+    {
+        if (buf[x] == '"')
+            quoted = !quoted;
+        else if (buf[x] == '\n' && !quoted)
+            return x + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Find the next CSV value in a record
+ * @param[in] buf The chunk
+ * @param[in] len The length of the chunk
+ * @param[in] pos Where the value starts
+ * @param[out] end Set to where the value ends, without its comma or new line
+ * @param[out] end_of_record Set if the value was the last in its record
+ * @return Where the next value starts
+ */
+static size_t scan_csv_value(const unsigned char *buf, size_t len, size_t pos,
+                             size_t *end, int *end_of_record)
+{
+    int quoted = 0;
+    size_t x = pos;
+    for (; x < len; x++)
+    {
+        if (buf[x] == '"')
+            quoted = !quoted;
+        else if (!quoted && (buf[x] == ',' || buf[x] == '\n'))
+            break;
+    }
+
+    *end = x;
+    *end_of_record = (x == len || buf[x] == '\n');
+    if (x < len && buf[x] == '\n' && x > pos && buf[x - 1] == '\r')
+        (*end)--;
+    return (x < len) ? x + 1 : x;
+}
+
+/**
+ * @brief Remove the quotes from a CSV value, and undo doubled quotes
+ * @param[in] value The value, as written
+ * @param[in] len The length of the value
+ * @param[out] unquoted Set to the value without its quotes, at most len
+ * bytes
+ * @return The length of the unquoted value
+ */
+static size_t unquote_csv_value(const unsigned char *value, size_t len,
+                                unsigned char *unquoted)
+{
+    size_t out = 0;
+    for (size_t x = 1; x < len; x++)
+    {
+        if (value[x] == '"')
+        {
+            // Anything after the closing quote is ignored
+            if (x + 1 >= len || value[x + 1] != '"')
+                break;
+            x++;
+        }
+        unquoted[out++] = value[x];
+    }
+    return out;
+}
+
+/**
+ * @brief Add a value to be encrypted or decrypted
+ * @param[in,out] values The values of the chunk
+ * @param[in] start Where the text the result replaces starts
+ * @param[in] end Where the text the result replaces ends
+ * @param[in] data The value to encrypt or decrypt
+ * @param[in] len The length of the value
+ * @return 1 on success, 0 if allocating memory failed
+ */
+static int add_value(column_values_t *values, size_t start, size_t end,
+                     const unsigned char *data, size_t len)
+{
+    if (values->count == values->capacity)
+    {
+        size_t capacity = values->capacity ? values->capacity * 2 : 256;
+        span_t *spans = realloc(values->spans, capacity * sizeof(span_t));
+        if (spans == NULL)
+            return 0;
+        values->spans = spans;
+        eea_buffer_t *messages = realloc(values->messages,
+                                         capacity * sizeof(eea_buffer_t));
+        if (messages == NULL)
+            return 0;
+        values->messages = messages;
+        values->capacity = capacity;
+    }
+    values->spans[values->count].start = start;
+    values->spans[values->count].end = end;
+    values->messages[values->count].data = data;
+    values->messages[values->count].len = len;
+    values->count++;
+    return 1;
+}
+
+/**
+ * @brief Find the values of the selected columns in a chunk of CSV
+ * @param[in] c What the threads share
+ * @param[in] job The chunk
+ * @param[out] values Set to the values
+ * @return NULL on success, otherwise why it failed
+ */
+static const char *find_csv_values(const columns_t *c, const column_job_t *job,
+                                   column_values_t *values)
+{
+    const unsigned char *in = job->in;
+    size_t pos = 0;
+    while (pos < job->in_len)
+    {
+        int end_of_record = 0;
+        for (size_t field = 0; !end_of_record; field++)
+        {
+            size_t start = pos;
+            size_t end = 0;
+            pos = scan_csv_value(in, job->in_len, start, &end,
+                                 &end_of_record);
+            if (field >= c->num_fields || !c->selected[field] || end == start)
+                continue;
+
+            const unsigned char *data = &in[start];
+            size_t len = end - start;
+            if (in[start] == '"')
+            {
+                data = &values->scratch[values->scratch_len];
+                len = unquote_csv_value(&in[start], end - start,
+                                        &values->scratch[values->scratch_len]);
+                values->scratch_len += len;
+                if (len == 0)
+                    continue;
+            }
+            if (!add_value(values, start, end, data, len))
+                return "Out of memory";
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Skip the spaces between JSON tokens
+ * @param[in] buf The chunk
+ * @param[in] pos Where to start
+ * @param[in] end Where the line ends
+ * @return The position of the next token, or end
+ */
+static size_t skip_json_space(const unsigned char *buf, size_t pos, size_t end)
+{
+    while (pos < end
+           && (buf[pos] == ' ' || buf[pos] == '\t' || buf[pos] == '\r'
+               || buf[pos] == '\n'))
+        pos++;
+    return pos;
+}
+
+/**
+ * @brief Skip a JSON string
+ * @param[in] buf The chunk
+ * @param[in] pos Where the string's opening quote is
+ * @param[in] end Where the line ends
+ * @return The position after its closing quote, (size_t) -1 if it isn't
+ * closed
+ */
+static size_t skip_json_string(const unsigned char *buf, size_t pos,
+                               size_t end)
+{
+    for (pos++; pos < end; pos++)
+    {
+        if (buf[pos] == '\\')
+            pos++;
+        else if (buf[pos] == '"')
+            return pos + 1;
+    }
+    return (size_t) -1;
+}
+
+/**
+ * @brief Skip a JSON value of any type
+ * @param[in] buf The chunk
+ * @param[in] pos Where the value starts
+ * @param[in] end Where the line ends
+ * @return The position after the value, (size_t) -1 if it isn't valid
+ */
+static size_t skip_json_value(const unsigned char *buf, size_t pos, size_t end)
+{
+    if (pos >= end)
+        return (size_t) -1;
+    if (buf[pos] == '"')
+        return skip_json_string(buf, pos, end);
+
+    if (buf[pos] == '{' || buf[pos] == '[')
+    {
+        int depth = 0;
+        while (pos < end)
+        {
+            if (buf[pos] == '"')
+            {
+                pos = skip_json_string(buf, pos, end);
+                if (pos == (size_t) -1)
+                    return pos;
+                continue;
+            }
+            if (buf[pos] == '{' || buf[pos] == '[')
+                depth++;
+            else if ((buf[pos] == '}' || buf[pos] == ']') && --depth == 0)
+                return pos + 1;
+            pos++;
+        }
+        return (size_t) -1;
+    }
+
+    // A number, true, false or null
+    size_t start = pos;
+    while (pos < end && buf[pos] != ',' && buf[pos] != '}' && buf[pos] != ']'
+           && buf[pos] != ' ' && buf[pos] != '\t' && buf[pos] != '\r'
+           && buf[pos] != '\n')
+        pos++;
+    return (pos > start) ? pos : (size_t) -1;
+}
+
+/**
+ * @brief Check if a JSON key is one of the selected ones
+ * @param[in] c What the threads share
+ * @param[in] key The key, without its quotes, as written
+ * @param[in] len The length of the key
+ * @return If it is selected
+ */
+static int is_selected_key(const columns_t *c, const unsigned char *key,
+                           size_t len)
+{
+    for (int n = 0; n < c->num_names; n++)
+        if (strlen(c->names[n]) == len && memcmp(c->names[n], key, len) == 0)
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief Find the values of the selected keys in a line of JSON Lines
+ * @param[in] c What the threads share
+ * @param[in] job The chunk
+ * @param[in] pos Where the line starts
+ * @param[in] end Where the line ends
+ * @param[out] values Set to the values
+ * @return NULL on success, otherwise why it failed
+ */
+static const char *find_json_line_values(const columns_t *c,
+                                         const column_job_t *job, size_t pos,
+                                         size_t end, column_values_t *values)
+{
+    static const char NOT_AN_OBJECT[] = "A line isn't a JSON object";
+    const unsigned char *in = job->in;
+    pos = skip_json_space(in, pos, end);
+    if (pos == end)
+        return NULL;
+    if (in[pos] != '{')
+        return NOT_AN_OBJECT;
+
+    pos = skip_json_space(in, pos + 1, end);
+    while (pos < end && in[pos] != '}')
+    {
+        if (in[pos] != '"')
+            return NOT_AN_OBJECT;
+        size_t key = pos + 1;
+        pos = skip_json_string(in, pos, end);
+        if (pos == (size_t) -1)
+            return NOT_AN_OBJECT;
+        size_t key_len = pos - 1 - key;
+
+        pos = skip_json_space(in, pos, end);
+        if (pos == end || in[pos] != ':')
+            return NOT_AN_OBJECT;
+        size_t start = skip_json_space(in, pos + 1, end);
+        pos = skip_json_value(in, start, end);
+        if (pos == (size_t) -1)
+            return NOT_AN_OBJECT;
+
+        int is_null = (pos - start == 4 && memcmp(&in[start], "null", 4) == 0);
+        if (is_selected_key(c, &in[key], key_len) && !is_null)
+        {
+            // A value is encrypted as it is written, and decrypted from the
+            // string of base64 it was replaced with
+            const unsigned char *data = &in[start];
+            size_t len = pos - start;
+            if (!c->encrypting)
+            {
+                if (in[start] != '"')
+                    return "A value to decrypt isn't a string";
+                data = &values->scratch[values->scratch_len];
+                len = 0;
+                // Base64 only needs unescaping if its / were written as \/
+                for (size_t x = start + 1; x < pos - 1; x++)
+                    if (in[x] != '\\')
+                        values->scratch[values->scratch_len + len++] = in[x];
+                values->scratch_len += len;
+            }
+            if (!add_value(values, start, pos, data, len))
+                return "Out of memory";
+        }
+
+        pos = skip_json_space(in, pos, end);
+        if (pos < end && in[pos] == ',')
+            pos = skip_json_space(in, pos + 1, end);
+        else if (pos == end || in[pos] != '}')
+            return NOT_AN_OBJECT;
+    }
+    return (pos < end) ? NULL : NOT_AN_OBJECT;
+}
+
+/**
+ * @brief Find the values of the selected keys in a chunk of JSON Lines
+ * @param[in] c What the threads share
+ * @param[in] job The chunk
+ * @param[out] values Set to the values
+ * @return NULL on success, otherwise why it failed
+ */
+static const char *find_jsonl_values(const columns_t *c,
+                                     const column_job_t *job,
+                                     column_values_t *values)
+{
+    size_t pos = 0;
+    while (pos < job->in_len)
+    {
+        const unsigned char *line_end = memchr(&job->in[pos], '\n',
+                                               job->in_len - pos);
+        size_t end = (line_end != NULL) ? (size_t) (line_end - job->in)
+                                        : job->in_len;
+        const char *error = find_json_line_values(c, job, pos, end, values);
+        if (error != NULL)
+            return error;
+        pos = end + 1;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check if a decrypted CSV value must be quoted
+ * @param[in] value The value
+ * @return If it holds a comma, quote or new line
+ */
+static int needs_quotes(const eea_buffer_t *value)
+{
+    for (size_t x = 0; x < value->len; x++)
+        if (value->data[x] == ',' || value->data[x] == '"'
+            || value->data[x] == '\n' || value->data[x] == '\r')
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief Write a chunk with its values replaced by their results
+ * @param[in] c What the threads share
+ * @param[in,out] job The chunk. Its output is set.
+ * @param[in] values Where the values were
+ * @param[in] results What to replace each value with
+ * @return NULL on success, otherwise why it failed
+ */
+static const char *replace_values(const columns_t *c, column_job_t *job,
+                                  const column_values_t *values,
+                                  const eea_buffer_t *results)
+{
+    // At worst, every result is quoted with each byte escaped
+    size_t out_len = job->in_len;
+    for (size_t v = 0; v < values->count; v++)
+        out_len += 2 * results[v].len + 2;
+    job->out = malloc(out_len > 0 ? out_len : 1);
+    if (job->out == NULL)
+        return "Out of memory";
+
+    unsigned char *out = job->out;
+    size_t copied = 0;
+    for (size_t v = 0; v < values->count; v++)
+    {
+        const span_t *span = &values->spans[v];
+        memcpy(out, &job->in[copied], span->start - copied);
+        out += span->start - copied;
+        copied = span->end;
+
+        const eea_buffer_t *result = &results[v];
+        int quote = (c->encrypting && c->format == COLUMN_FORMAT_JSONL)
+                    || (!c->encrypting && c->format == COLUMN_FORMAT_CSV
+                        && needs_quotes(result));
+        if (quote)
+            *out++ = '"';
+        for (size_t x = 0; x < result->len; x++)
+        {
+            if (quote && result->data[x] == '"')
+                *out++ = '"';
+            *out++ = result->data[x];
+        }
+        if (quote)
+            *out++ = '"';
+    }
+    memcpy(out, &job->in[copied], job->in_len - copied);
+    out += job->in_len - copied;
+    job->out_len = out - job->out;
+    return NULL;
+}
+
+/**
+ * @brief Encrypt or decrypt the selected values in a chunk, as one batch
+ * @param[in] c What the threads share
+ * @param[in,out] job The chunk. Its output is set.
+ * @return NULL on success, otherwise why it failed
+ */
+static const char *rewrite_chunk(const columns_t *c, column_job_t *job)
+{
+    column_values_t values;
+    memset(&values, 0, sizeof(values));
+    values.scratch = malloc(job->in_len > 0 ? job->in_len : 1);
+    if (values.scratch == NULL)
+        return "Out of memory";
+
+    const char *error = (c->format == COLUMN_FORMAT_CSV)
+                            ? find_csv_values(c, job, &values)
+                            : find_jsonl_values(c, job, &values);
+
+    eea_buffer_t *results = NULL;
+    unsigned char *arena = NULL;
+    if (error == NULL && values.count > 0)
+    {
+        results = malloc(values.count * sizeof(eea_buffer_t));
+        int ret = EEA_ERR_NO_MEMORY;
+        if (results != NULL)
+            ret = c->encrypting
+                      ? encrypt_batch(values.messages, values.count, c->keys,
+                                      c->num_keys, results, &arena)
+                      : decrypt_batch(values.messages, values.count, c->keys,
+                                      c->num_keys, results, &arena);
+        if (ret == EEA_ERR_INVALID_DATA)
+            error = "A value couldn't be decrypted with these keys";
+        else if (ret != EEA_OK)
+            error = eea_strerror(ret);
+    }
+    if (error == NULL)
+        error = replace_values(c, job, &values, results);
+
+    free(arena);
+    free(results);
+    free(values.spans);
+    free(values.messages);
+    free(values.scratch);
+    return error;
+}
+
+/**
+ * @brief Function called by pthread_create to rewrite chunks
+ * @param[in] args The columns_t the threads share
+ */
+static void *column_worker(void *args)
+{
+    columns_t *c = (columns_t *) args;
+    column_job_t *job = NULL;
+    while ((job = work_queue_pop(c->todo)) != NULL)
+    {
+        const char *error = rewrite_chunk(c, job);
+        pthread_mutex_lock(&c->lock);
+        job->error = error;
+        job->done = 1;
+        pthread_cond_broadcast(&c->done);
+        pthread_mutex_unlock(&c->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Function called by pthread_create to write the chunks out in the
+ * order they were read, as each is rewritten
+ * @param[in] args The columns_t the threads share
+ */
+static void *column_writer(void *args)
+{
+    columns_t *c = (columns_t *) args;
+    column_job_t *job = NULL;
+    while ((job = work_queue_pop(c->order)) != NULL)
+    {
+        pthread_mutex_lock(&c->lock);
+        while (!job->done)
+            pthread_cond_wait(&c->done, &c->lock);
+        if (c->error == NULL && job->error != NULL)
+            c->error = job->error;
+        int write = (c->error == NULL);
+        pthread_mutex_unlock(&c->lock);
+
+        if (write && fwrite(job->out, 1, job->out_len, c->out) != job->out_len)
+        {
+            pthread_mutex_lock(&c->lock);
+            c->error = "Writing the output failed";
+            pthread_mutex_unlock(&c->lock);
+        }
+        free(job->in);
+        free(job->out);
+        free(job);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Read more of the input onto the end of a buffer
+ * @param[in] in The input
+ * @param[in,out] buf The buffer, grown to fit
+ * @param[in,out] len The length of the data in the buffer
+ * @param[in,out] capacity The size of the buffer
+ * @param[out] eof Set once the input has ended
+ * @return 1 on success, 0 on failure
+ */
+static int read_more(FILE *in, unsigned char **buf, size_t *len,
+                     size_t *capacity, int *eof)
+{
+    if (*capacity - *len < COLUMN_CHUNK)
+    {
+        size_t grown = *capacity ? *capacity * 2 : COLUMN_CHUNK * 2;
+        while (grown - *len < COLUMN_CHUNK)
+            grown *= 2;
+        unsigned char *tmp = realloc(*buf, grown);
+        if (tmp == NULL)
+            return 0;
+        *buf = tmp;
+        *capacity = grown;
+    }
+    size_t read = fread(*buf + *len, 1, COLUMN_CHUNK, in);
+    *len += read;
+    if (read < COLUMN_CHUNK)
+    {
+        if (ferror(in))
+            return 0;
+        *eof = 1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Read the CSV header, write it out as it is, and find the columns
+ * selected in it
+ * @param[in,out] c What the threads share. Set to the columns selected.
+ * @param[in] in The input
+ * @param[in,out] buf The buffer the input is read into
+ * @param[in,out] len The length of the data in the buffer, without the
+ * header once it returns
+ * @param[in,out] capacity The size of the buffer
+ * @param[out] eof Set once the input has ended
+ * @return 1 on success, 0 on failure, after printing why
+ */
+static int read_csv_header(columns_t *c, FILE *in, unsigned char **buf,
+                           size_t *len, size_t *capacity, int *eof)
+{
+    size_t header_len = 0;
+    while (header_len == 0 && !(*eof && *len == 0))
+    {
+        if (!*eof && !read_more(in, buf, len, capacity, eof))
+        {
+            fprintf(stderr, "%sError:%s Failed to read the input\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET]);
+            return 0;
+        }
+        header_len = find_first_record_end(*buf, *len);
+        if (*eof && header_len == 0)
+            header_len = *len;
+    }
+    // Empty input is left empty
+    if (header_len == 0)
+        return 1;
+
+    // Count the columns, then select them by name
+    size_t num_fields = 0;
+    int end_of_record = 0;
+    for (size_t pos = 0, end = 0; !end_of_record; num_fields++)
+        pos = scan_csv_value(*buf, header_len, pos, &end, &end_of_record);
+    c->num_fields = num_fields;
+    c->selected = calloc(num_fields, 1);
+    unsigned char *found = calloc(c->num_names, 1);
+    unsigned char *name = malloc(header_len + 1);
+    if (c->selected == NULL || found == NULL || name == NULL)
+    {
+        free(found);
+        free(name);
+        return 0;
+    }
+
+    end_of_record = 0;
+    size_t pos = 0;
+    for (size_t field = 0; !end_of_record; field++)
+    {
+        size_t start = pos;
+        size_t end = 0;
+        pos = scan_csv_value(*buf, header_len, start, &end, &end_of_record);
+        size_t name_len = end - start;
+        if (name_len > 0 && (*buf)[start] == '"')
+            name_len = unquote_csv_value(&(*buf)[start], end - start, name);
+        else
+            memcpy(name, &(*buf)[start], name_len);
+        for (int n = 0; n < c->num_names; n++)
+            if (strlen(c->names[n]) == name_len
+                && memcmp(c->names[n], name, name_len) == 0)
+                c->selected[field] = found[n] = 1;
+    }
+    free(name);
+
+    int missing = -1;
+    for (int n = c->num_names - 1; n >= 0; n--)
+        if (!found[n])
+            missing = n;
+    free(found);
+    if (missing >= 0)
+    {
+        fprintf(stderr, "%sError:%s There is no column called \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], c->names[missing]);
+        return 0;
+    }
+
+    if (fwrite(*buf, 1, header_len, c->out) != header_len)
+    {
+        fprintf(stderr, "%sError:%s Failed to write the output\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return 0;
+    }
+    *len -= header_len;
+    memmove(*buf, *buf + header_len, *len);
+    return 1;
+}
+
+/**
+ * @brief Read the input a chunk of whole records at a time, and queue each
+ * chunk to be rewritten and written out
+ * @param[in,out] c What the threads share
+ * @param[in] in The input
+ * @param[in] buf The buffer the input is being read into, which is freed
+ * @param[in] len The length of the data in the buffer
+ * @param[in] capacity The size of the buffer
+ * @param[in] eof If the input has already ended
+ * @return 1 on success, 0 if reading failed
+ */
+static int queue_chunks(columns_t *c, FILE *in, unsigned char *buf,
+                        size_t len, size_t capacity, int eof)
+{
+    int ret = 1;
+    while (ret && (!eof || len > 0))
+    {
+        pthread_mutex_lock(&c->lock);
+        int failed = (c->error != NULL);
+        pthread_mutex_unlock(&c->lock);
+        if (failed)
+            break;
+
+        if (!eof && !read_more(in, &buf, &len, &capacity, &eof))
+        {
+            ret = 0;
+            break;
+        }
+        size_t records_len = eof ? len : find_records_end(c->format, buf, len);
+        if (records_len == 0)
+            continue;
+
+        // The chunk takes the buffer, and what is left of the last record
+        // starts the next one
+        column_job_t *job = calloc(1, sizeof(column_job_t));
+        size_t rest = len - records_len;
+        size_t next_capacity = (rest + COLUMN_CHUNK) * 2;
+        unsigned char *next = malloc(next_capacity);
+        if (job == NULL || next == NULL)
+        {
+            free(job);
+            free(next);
+            ret = 0;
+            break;
+        }
+        memcpy(next, buf + records_len, rest);
+        job->in = buf;
+        job->in_len = records_len;
+        buf = next;
+        len = rest;
+        capacity = next_capacity;
+
+        if (!work_queue_push(c->order, job))
+        {
+            free(job->in);
+            free(job);
+            ret = 0;
+            break;
+        }
+        work_queue_push(c->todo, job);
+    }
+    free(buf);
+    return ret;
+}
+
+int crypt_columns(FILE *in, FILE *out, ColumnFormats format,
+                  const char **columns, int num_columns, int encrypting,
+                  const char **keys, int num_keys, int threads)
+{
+    columns_t c;
+    memset(&c, 0, sizeof(c));
+    c.format = format;
+    c.encrypting = encrypting;
+    c.keys = keys;
+    c.num_keys = num_keys;
+    c.names = columns;
+    c.num_names = num_columns;
+    c.out = out;
+    if (threads < 1)
+        threads = 1;
+
+    unsigned char *buf = NULL;
+    size_t len = 0;
+    size_t capacity = 0;
+    int eof = 0;
+    if (format == COLUMN_FORMAT_CSV
+        && !read_csv_header(&c, in, &buf, &len, &capacity, &eof))
+    {
+        free(c.selected);
+        free(buf);
+        return 1;
+    }
+
+    // Enough chunks are in flight to keep every thread busy, while the
+    // writer waits for the oldest
+    pthread_t *pool = malloc((threads + 1) * sizeof(pthread_t));
+    c.todo = work_queue_create(threads * 2);
+    c.order = work_queue_create(threads * 2);
+    int ret = (pool == NULL || c.todo == NULL || c.order == NULL);
+    if (!ret)
+    {
+        pthread_mutex_init(&c.lock, NULL);
+        pthread_cond_init(&c.done, NULL);
+    }
+
+    // The writer is pool[0]
+    int started = 0;
+    for (; started < threads + 1 && !ret; started++)
+        if (pthread_create(&pool[started], NULL,
+                           started == 0 ? column_writer : column_worker, &c)
+            != 0)
+        {
+            ret = 1;
+            break;
+        }
+
+    if (!ret && !queue_chunks(&c, in, buf, len, capacity, eof))
+    {
+        pthread_mutex_lock(&c.lock);
+        if (c.error == NULL)
+            c.error = "Failed to read the input";
+        pthread_mutex_unlock(&c.lock);
+    }
+    else if (ret)
+        free(buf);
+
+    if (c.todo != NULL)
+        work_queue_close(c.todo);
+    if (c.order != NULL)
+        work_queue_close(c.order);
+    for (int t = 0; t < started; t++)
+        pthread_join(pool[t], NULL);
+
+    if (ret)
+        fprintf(stderr, "%sError:%s Failed to start the threads\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+    else if (c.error != NULL)
+    {
+        fprintf(stderr, "%sError:%s %s\n", colors[COLOR_ERROR],
+                colors[COLOR_RESET], c.error);
+        ret = 1;
+    }
+    else if (fflush(out) != 0)
+    {
+        fprintf(stderr, "%sError:%s Failed to write the output\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        ret = 1;
+    }
+
+    if (pool != NULL && c.todo != NULL && c.order != NULL)
+    {
+        pthread_mutex_destroy(&c.lock);
+        pthread_cond_destroy(&c.done);
+    }
+    if (c.todo != NULL)
+        work_queue_free(c.todo);
+    if (c.order != NULL)
+        work_queue_free(c.order);
+    free(pool);
+    free(c.selected);
+    return ret;
+}
@@ -0,0 +1,292 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "compress.h"
+#include "eea.h"
+
+/**
+ * @enum FrameTypes
+ * @brief What a frame holds, its first byte
+ */
+typedef enum
+{
+    // The plain text as it is
+    FRAME_STORED = 1,
+    // The plain text compressed with zlib
+    FRAME_DEFLATE = 2,
+    // Nothing, the frames have ended
+    FRAME_END = 0xff
+} FrameTypes;
+
+// The most bytes sampled to judge whether a chunk will compress
+static const size_t ENTROPY_SAMPLES = 4096;
+
+/**
+ * @brief Guess if a chunk will compress from a sample of its bytes
+ * @param[in] data The chunk
+ * @param[in] len The length of the chunk
+ * @return 0 if it looks random, such as data that is already compressed,
+ * 1 otherwise
+ */
+static int looks_compressible(const unsigned char *data, size_t len)
+{
+    // The collision entropy of the sample, which is never more than its
+    // entropy, is over 7.5 bits a byte when the sum of the squared counts
+    // is under samples^2 / 2^7.5, about samples^2 / 181
+    uint64_t counts[256] = { 0 };
+    uint64_t samples = 0;
+    size_t step = len / ENTROPY_SAMPLES + 1;
+    for (size_t x = 0; x < len; x += step, samples++)
+        counts[data[x]]++;
+    uint64_t sum = 0;
+    for (int c = 0; c < 256; c++)
+        sum += counts[c] * counts[c];
+    return sum * 181 >= samples * samples;
+}
+
+/**
+ * @brief Write the header of a frame
+ * @param[out] frame The frame
+ * @param[in] type One of FrameTypes
+ * @param[in] plain_len The length of the plain text it holds
+ * @param[in] data_len The length of the data after the header
+ */
+static void put_frame_header(unsigned char *frame, int type, size_t plain_len,
+                             size_t data_len)
+{
+    frame[0] = type;
+    for (int b = 0; b < 4; b++)
+    {
+        frame[1 + b] = (plain_len >> (24 - 8 * b)) & 0xff;
+        frame[5 + b] = (data_len >> (24 - 8 * b)) & 0xff;
+    }
+}
+
+size_t compress_frame_bound(size_t len)
+{
+    return COMPRESS_FRAME_HEADER + compressBound(len);
+}
+
+size_t compress_frame(const unsigned char *data, size_t len,
+                      unsigned char *frame)
+{
+    if (len > 0 && looks_compressible(data, len))
+    {
+        // The fastest level, so it costs less than the bytes it saves
+        uLongf data_len = compressBound(len);
+        if (compress2(frame + COMPRESS_FRAME_HEADER, &data_len, data, len, 1)
+                == Z_OK
+            && data_len < len)
+        {
+            put_frame_header(frame, FRAME_DEFLATE, len, data_len);
+            return COMPRESS_FRAME_HEADER + data_len;
+        }
+    }
+    put_frame_header(frame, FRAME_STORED, len, len);
+    memcpy(frame + COMPRESS_FRAME_HEADER, data, len);
+    return COMPRESS_FRAME_HEADER + len;
+}
+
+size_t compress_end_frame(unsigned char *frame)
+{
+    frame[0] = FRAME_END;
+    return 1;
+}
+
+int compress_data(const unsigned char *data, size_t len,
+                  unsigned char **frames, size_t *frames_len)
+{
+    size_t chunks = (len + COMPRESS_CHUNK - 1) / COMPRESS_CHUNK;
+    size_t bound = chunks * compress_frame_bound(COMPRESS_CHUNK) + 1;
+    if (chunks == 1)
+        bound = compress_frame_bound(len) + 1;
+    unsigned char *out = malloc(bound);
+    if (out == NULL)
+        return EEA_ERR_NO_MEMORY;
+
+    size_t out_len = 0;
+    for (size_t pos = 0; pos < len; pos += COMPRESS_CHUNK)
+    {
+        size_t chunk = (len - pos < COMPRESS_CHUNK) ? len - pos
+                                                    : COMPRESS_CHUNK;
+        out_len += compress_frame(data + pos, chunk, out + out_len);
+    }
+    out_len += compress_end_frame(out + out_len);
+
+    // Give back what the frames didn't need
+    unsigned char *tmp = realloc(out, out_len);
+    *frames = (tmp != NULL) ? tmp : out;
+    *frames_len = out_len;
+    return EEA_OK;
+}
+
+int frame_reader_init(frame_reader_t *reader, frame_output_t output,
+                      void *ctx)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->output = output;
+    reader->ctx = ctx;
+    reader->data = malloc(compressBound(COMPRESS_CHUNK));
+    reader->plain = malloc(COMPRESS_CHUNK);
+    if (reader->data == NULL || reader->plain == NULL)
+        return EEA_ERR_NO_MEMORY;
+    return EEA_OK;
+}
+
+/**
+ * @brief Read a length from a frame header
+ * @param[in] buf Where the length is
+ * @return The length
+ */
+static size_t get_frame_len(const unsigned char *buf)
+{
+    return ((size_t) buf[0] << 24) | ((size_t) buf[1] << 16)
+           | ((size_t) buf[2] << 8) | buf[3];
+}
+
+int frame_reader_feed(frame_reader_t *reader, const unsigned char *data,
+                      size_t len)
+{
+    while (len > 0)
+    {
+        if (reader->ended)
+            return EEA_ERR_INVALID_DATA;
+
+        // The header, which is only the type for the end frame
+        if (reader->header_have == 0 && data[0] == FRAME_END)
+        {
+            reader->ended = 1;
+            data++;
+            len--;
+            continue;
+        }
+        if (reader->header_have < COMPRESS_FRAME_HEADER)
+        {
+            size_t take = COMPRESS_FRAME_HEADER - reader->header_have;
+            if (take > len)
+                take = len;
+            memcpy(reader->header + reader->header_have, data, take);
+            reader->header_have += take;
+            data += take;
+            len -= take;
+            if (reader->header_have < COMPRESS_FRAME_HEADER)
+                break;
+        }
+
+        int type = reader->header[0];
+        size_t plain_len = get_frame_len(reader->header + 1);
+        size_t data_len = get_frame_len(reader->header + 5);
+        if ((type != FRAME_STORED && type != FRAME_DEFLATE)
+            || plain_len > COMPRESS_CHUNK
+            || data_len > compressBound(COMPRESS_CHUNK)
+            || (type == FRAME_STORED && data_len != plain_len))
+            return EEA_ERR_INVALID_DATA;
+
+        // The data, which is gathered until it is whole
+        size_t take = data_len - reader->data_have;
+        if (take > len)
+            take = len;
+        memcpy(reader->data + reader->data_have, data, take);
+        reader->data_have += take;
+        data += take;
+        len -= take;
+        if (reader->data_have < data_len)
+            break;
+
+        const unsigned char *plain = reader->data;
+        if (type == FRAME_DEFLATE)
+        {
+            uLongf got = plain_len;
+            if (uncompress(reader->plain, &got, reader->data, data_len) != Z_OK
+                || got != plain_len)
+                return EEA_ERR_INVALID_DATA;
+            plain = reader->plain;
+        }
+        if (plain_len > 0 && reader->output(reader->ctx, plain, plain_len))
+            return EEA_ERR_IO;
+        reader->header_have = 0;
+        reader->data_have = 0;
+    }
+    return EEA_OK;
+}
+
+int frame_reader_finish(const frame_reader_t *reader)
+{
+    return reader->ended ? EEA_OK : EEA_ERR_INVALID_DATA;
+}
+
+void frame_reader_free(frame_reader_t *reader)
+{
+    free(reader->data);
+    free(reader->plain);
+}
+
+/**
+ * @struct growing_buffer_t
+ * @brief Plain text being gathered into memory
+ */
+typedef struct
+{
+    unsigned char *data;
+    size_t len;
+    size_t capacity;
+} growing_buffer_t;
+
+/**
+ * @brief A frame output that adds the plain text to a growing_buffer_t
+ * @param[in] ctx The growing_buffer_t
+ * @param[in] data The next part of the plain text
+ * @param[in] len The length of the part
+ * @return 0 on success, 1 if there isn't enough memory
+ */
+static int buffer_output(void *ctx, const unsigned char *data, size_t len)
+{
+    growing_buffer_t *buf = (growing_buffer_t *) ctx;
+    if (buf->capacity - buf->len < len + 1)
+    {
+        size_t capacity = buf->capacity ? buf->capacity : COMPRESS_CHUNK;
+        while (capacity - buf->len < len + 1)
+            capacity *= 2;
+        unsigned char *tmp = realloc(buf->data, capacity);
+        if (tmp == NULL)
+            return 1;
+        buf->data = tmp;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return 0;
+}
+
+int decompress_data(const unsigned char *frames, size_t frames_len,
+                    unsigned char **data, size_t *len)
+{
+    // Most of what is worth compressing shrinks by a few times
+    growing_buffer_t buf = { NULL, 0, 0 };
+    buf.capacity = frames_len * 4 + 1;
+    buf.data = malloc(buf.capacity);
+    if (buf.data == NULL)
+        return EEA_ERR_NO_MEMORY;
+
+    frame_reader_t reader;
+    int ret = frame_reader_init(&reader, buffer_output, &buf);
+    if (ret == EEA_OK)
+        ret = frame_reader_feed(&reader, frames, frames_len);
+    // The output only fails to grow
+    if (ret == EEA_ERR_IO)
+        ret = EEA_ERR_NO_MEMORY;
+    if (ret == EEA_OK)
+        ret = frame_reader_finish(&reader);
+    frame_reader_free(&reader);
+    if (ret != EEA_OK)
+    {
+        free(buf.data);
+        return ret;
+    }
+    buf.data[buf.len] = '\0';
+    *data = buf.data;
+    *len = buf.len;
+    return EEA_OK;
+}
@@ -16,6 +16,8 @@
 #include "config.h"
 #include "file_handling.h"
 #include "globals.h"
+#include "kernels.h"
+#include "progress.h"
 #include "utils.h"
 
 static char CONFIG_FILE[] = "eea.conf";
@@ -30,7 +32,39 @@ static void write_default_config(const char *path)
         "# Elite Encryption Algorithm (EEA) config file\n\n"
         "# The directory to search for your '.keys' files in.\n"
         "# NOTE: The default is the same directory as the EEA executable\n"
-        "# keysDir: ~/.eeaKeys\n";
+        "# keysDir: ~/.eeaKeys\n\n"
+        "# Keep an index of the files in a directory when encrypting it,\n"
+        "# without overwriting, so files that haven't changed since the\n"
+        "# last run are skipped.\n"
+        "# incrementalIndex: false\n\n"
+        "# Also compare a hash of each file's contents, so files that were\n"
+        "# only touched are still skipped. (Requires incrementalIndex)\n"
+        "# indexContentHash: false\n\n"
+        "# How the results of directory jobs are reported:\n"
+        "#   progress - a progress line with the throughput and ETA\n"
+        "#   verbose  - a line for every file\n"
+        "#   quiet    - only the files that failed\n"
+        "#   json     - JSON lines, for scripts\n"
+        "# output: progress\n\n"
+        "# Time each stage of encrypting/decrypting files, and print a\n"
+        "# breakdown at the end of each job. (Same as running with --stats)\n"
+        "# stats: false\n\n"
+        "# Write a timeline of what each thread was doing during each\n"
+        "# directory job to this file. Open it in https://ui.perfetto.dev\n"
+        "# (Same as running with --trace <file>)\n"
+        "# trace: eea_trace.json\n\n"
+        "# End each .eea file in CRC32C checksums, so 'eea verify' can check\n"
+        "# it without the keys. Older builds and the other ports can't read\n"
+        "# them. (Same as running with --checksums)\n"
+        "# checksums: false\n\n"
+        "# The kernel used for the XOR rounds (reference or blocked), the\n"
+        "# number of bytes the blocked kernel takes through every key at a\n"
+        "# time (0 for the whole file), and the default number of threads\n"
+        "# for directory jobs. Run 'eea autotune' to find the fastest on\n"
+        "# this machine and save them here.\n"
+        "# kernel: reference\n"
+        "# chunkSize: 0\n"
+        "# threads: 1\n";
     if (!save_to_file(path, (unsigned char *) cfg, strlen(cfg)))
     {
         fprintf(stderr, "%sError:%s, Failed to open default config\n",
@@ -78,6 +112,26 @@ static char *exe_path(size_t *path_len)
     return path;
 }
 
+/**
+ * @brief Return the full path to the config file, next to the executable
+ * @return Path to the config file, NULL if it couldn't be found
+ * @note Return value must be freed
+ */
+static char *config_path(void)
+{
+    size_t len = 0;
+    char *cfg = exe_path(&len);
+    if (cfg == NULL)
+        return NULL;
+    if (len + sizeof(CONFIG_FILE) > PATH_MAX)
+    {
+        free(cfg);
+        return NULL;
+    }
+    strcat(cfg, CONFIG_FILE);
+    return cfg;
+}
+
 /**
  * @brief Get the absolute path to the users home directory
  * @return Path to users home directory
@@ -116,6 +170,50 @@ static char *fix_slashes(char *path)
     return path;
 }
 
+/**
+ * @brief Check if a config value is set to true
+ * @param[in] value The value from the config file
+ * @return If the value is true
+ */
+static int is_true(const char *value)
+{
+    return (strcmp(value, "true") == 0 || strcmp(value, "yes") == 0
+            || strcmp(value, "1") == 0);
+}
+
+/**
+ * @brief Set how the results of directory jobs are reported
+ * @param[in] value The value from the config file
+ */
+static void set_output_mode(const char *value)
+{
+    if (strcmp(value, "progress") == 0)
+        output_mode = OUTPUT_PROGRESS;
+    else if (strcmp(value, "verbose") == 0)
+        output_mode = OUTPUT_VERBOSE;
+    else if (strcmp(value, "quiet") == 0)
+        output_mode = OUTPUT_QUIET;
+    else if (strcmp(value, "json") == 0)
+        output_mode = OUTPUT_JSON;
+    else
+        fprintf(stderr, "%sWarning:%s Unknown output \'%s\' in the config\n",
+                colors[COLOR_WARNING], colors[COLOR_RESET], value);
+}
+
+/**
+ * @brief Set the kernel used for the XOR rounds
+ * @param[in] value The value from the config file
+ */
+static void set_xor_kernel(const char *value)
+{
+    int kernel = xor_kernel_from_name(value);
+    if (kernel < 0)
+        fprintf(stderr, "%sWarning:%s Unknown kernel \'%s\' in the config\n",
+                colors[COLOR_WARNING], colors[COLOR_RESET], value);
+    else
+        xor_kernel = kernel;
+}
+
 /**
  * @brief Parse the config file and set the requisite variables
  * @param[in] cfg Path to the config file
@@ -178,6 +276,33 @@ static void parse_cfg(const char *cfg)
                 keys_dir = fix_slashes(keys_dir);
             }
         }
+        else if (strcmp(key, "incrementalIndex") == 0)
+            incremental_index = is_true(trim(value));
+        else if (strcmp(key, "indexContentHash") == 0)
+            index_content_hash = is_true(trim(value));
+        else if (strcmp(key, "output") == 0)
+            set_output_mode(trim(value));
+        else if (strcmp(key, "stats") == 0)
+            stats_enabled = is_true(trim(value));
+        else if (strcmp(key, "trace") == 0)
+        {
+            free(trace_file);
+            trace_file = strdup(trim(value));
+        }
+        else if (strcmp(key, "kernel") == 0)
+            set_xor_kernel(trim(value));
+        else if (strcmp(key, "compress") == 0)
+            compression = is_true(trim(value));
+        else if (strcmp(key, "checksums") == 0)
+            checksums = is_true(trim(value));
+        else if (strcmp(key, "chunkSize") == 0)
+            chunk_size = strtoull(trim(value), NULL, 10);
+        else if (strcmp(key, "threads") == 0)
+        {
+            int threads = strtol(trim(value), NULL, 10);
+            if (threads > 0)
+                default_threads = threads;
+        }
     }
     free(line);
     fclose(config);
@@ -207,13 +332,11 @@ int confirm_key_dir(const char *path)
     return ret;
 }
 
-void load_config(void)
+void load_config(int interactive)
 {
-    size_t len = 0;
-    char *cfg = exe_path(&len);
-    if (cfg == NULL || len + sizeof(CONFIG_FILE) > PATH_MAX)
+    char *cfg = config_path();
+    if (cfg == NULL)
         return;
-    strcat(cfg, CONFIG_FILE);
 
     if (!file_exists(cfg))
     {
@@ -225,7 +348,8 @@ void load_config(void)
     if (keys_dir == NULL)
         goto load_config_end;
 
-    if (!file_exists(keys_dir))
+    // Commands can't stop to ask, so they leave a missing keys directory
+    if (!file_exists(keys_dir) && interactive)
     {
         if (!confirm_key_dir(keys_dir))
         {
@@ -252,3 +376,104 @@ load_config_end:
     free(cfg);
     return;
 }
+
+/**
+ * @brief Find which setting a line of the config file sets
+ * @param[in] line The line, which doesn't need to be null terminated
+ * @param[in] line_len The length of the line
+ * @param[in] settings The settings being saved
+ * @param[in] num_settings The number of settings
+ * @return The index of the setting, -1 if the line doesn't set any of them
+ */
+static int find_setting(const char *line, size_t line_len,
+                        const config_setting_t *settings, int num_settings)
+{
+    for (int s = 0; s < num_settings; s++)
+    {
+        size_t key_len = strlen(settings[s].key);
+        if (line_len > key_len && strncmp(line, settings[s].key, key_len) == 0
+            && line[key_len] == ':')
+            return s;
+    }
+    return -1;
+}
+
+int save_config_settings(const config_setting_t *settings, int num_settings)
+{
+    char *cfg = config_path();
+    if (cfg == NULL)
+        return 0;
+    if (!file_exists(cfg))
+        write_default_config(cfg);
+
+    unsigned char *old = NULL;
+    size_t old_len = read_in_file(cfg, &old);
+    if (old_len == (size_t) -1)
+    {
+        fprintf(stderr, "%sError:%s Failed to read the config \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], cfg);
+        free(cfg);
+        return 0;
+    }
+
+    // Write the new config next to the old one, then replace it, so it is
+    // never left half written
+    char tmp[PATH_MAX + 5];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cfg);
+    FILE *fout = fopen(tmp, "wb");
+    if (fout == NULL)
+    {
+        fprintf(stderr, "%sError:%s Failed to open the file \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], tmp);
+        free(old);
+        free(cfg);
+        return 0;
+    }
+
+    int saved[num_settings];
+    memset(saved, 0, sizeof(saved));
+    const char *line = (const char *) old;
+    const char *end = line + old_len;
+    while (line < end)
+    {
+        const char *eol = memchr(line, '\n', end - line);
+        size_t line_len = (eol != NULL) ? (size_t) (eol - line) + 1
+                                        : (size_t) (end - line);
+        int s = find_setting(line, line_len, settings, num_settings);
+        if (s < 0)
+            fwrite(line, 1, line_len, fout);
+        else if (!saved[s])
+        {
+            // Replace the first line that sets it, and drop any others
+            fprintf(fout, "%s: %s\n", settings[s].key, settings[s].value);
+            saved[s] = 1;
+        }
+        line += line_len;
+    }
+
+    int header = 0;
+    for (int s = 0; s < num_settings; s++)
+    {
+        if (saved[s])
+            continue;
+        if (!header)
+        {
+            if (old_len > 0 && old[old_len - 1] != '\n')
+                fputc('\n', fout);
+            fprintf(fout, "\n# Found by 'eea autotune'\n");
+            header = 1;
+        }
+        fprintf(fout, "%s: %s\n", settings[s].key, settings[s].value);
+    }
+
+    int success = (fclose(fout) == 0 && rename(tmp, cfg) == 0);
+    if (!success)
+    {
+        fprintf(stderr, "%sError:%s Failed to save the config \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], cfg);
+        remove(tmp);
+    }
+    free(old);
+    free(cfg);
+    return success;
+}
@@ -0,0 +1,519 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+#include "daemon.h"
+#include "daemon_client.h"
+#include "globals.h"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+/**
+ * @brief Wipe a keyset's keys from memory, and free it
+ * @param[in] keyset The keyset
+ */
+static void wipe_keyset(keyset_t *keyset)
+{
+    for (int k = 0; k < keyset->num_keys; k++)
+    {
+        size_t len = strlen(keyset->keys[k]) + 1;
+        OPENSSL_cleanse(keyset->keys[k], len);
+#ifndef WIN32
+        munlock(keyset->keys[k], len);
+#endif
+        free(keyset->keys[k]);
+    }
+    free(keyset->keys);
+    free(keyset->name);
+    keyset->keys = NULL;
+    keyset->num_keys = 0;
+}
+
+#ifndef WIN32
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include "decrypt.h"
+#include "eea.h"
+#include "encrypt.h"
+#include "work_queue.h"
+
+static const int DAEMON_BACKLOG = 64;
+// A client that stops part way through a request for this long is dropped,
+// so it can't hold on to a worker
+static const int DAEMON_TIMEOUT_S = 5;
+
+/**
+ * @struct daemon_t
+ * @brief The state shared by the daemon's threads
+ */
+typedef struct
+{
+    keyset_t *keysets;
+    int num_keysets;
+    // Connections with a request waiting, for the workers
+    work_queue_t *queue;
+    // The workers hand connections back through this pipe, to wait for
+    // their next request
+    int return_fds[2];
+} daemon_t;
+
+// Written to by the signal handler to stop the daemon
+static int stop_fds[2] = { -1, -1 };
+
+/**
+ * @brief Signal handler for SIGINT and SIGTERM, which wakes up the daemon's
+ * poll() to stop it
+ * @param[in] sig The signal
+ */
+static void handle_stop(int sig)
+{
+    char c = (char) sig;
+    ssize_t ret = write(stop_fds[1], &c, 1);
+    (void) ret;
+}
+
+/**
+ * @brief Lock the keys into memory, so they are never swapped to disk, and
+ * keep them out of core dumps
+ * @param[in] keysets The keysets
+ * @param[in] num_keysets The number of keysets
+ * @return 1 if every key was locked, 0 otherwise
+ */
+static int lock_keysets(keyset_t *keysets, int num_keysets)
+{
+    struct rlimit no_core = { 0, 0 };
+    setrlimit(RLIMIT_CORE, &no_core);
+#ifdef __linux__
+    prctl(PR_SET_DUMPABLE, 0);
+#endif
+
+    int locked = 1;
+    for (int s = 0; s < num_keysets; s++)
+        for (int k = 0; k < keysets[s].num_keys; k++)
+            if (mlock(keysets[s].keys[k], strlen(keysets[s].keys[k]) + 1)
+                != 0)
+                locked = 0;
+    return locked;
+}
+
+/**
+ * @brief Find a keyset by its name
+ * @param[in] d The daemon
+ * @param[in] name The name of the keyset
+ * @return The keyset, NULL if there isn't one by that name
+ */
+static const keyset_t *find_keyset(const daemon_t *d, const char *name)
+{
+    for (int s = 0; s < d->num_keysets; s++)
+        if (strcmp(d->keysets[s].name, name) == 0)
+            return &d->keysets[s];
+    return NULL;
+}
+
+/**
+ * @brief Check the client connecting is the same user as the daemon
+ * @param[in] fd The connection
+ * @return If the client may use the daemon
+ */
+static int peer_is_owner(int fd)
+{
+#if defined(__linux__)
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+        return 0;
+    return cred.uid == getuid();
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)     \
+    || defined(__NetBSD__)
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0)
+        return 0;
+    return uid == getuid();
+#else
+    // The socket is only accessible to its owner anyway
+    return 1;
+#endif
+}
+
+/**
+ * @brief Send the response to a request
+ * @param[in] fd The connection
+ * @param[in] status EEA_OK, or one of EeaErrors
+ * @param[in] data The result, NULL if there isn't one
+ * @param[in] data_len The length of the result
+ * @return 1 on success, 0 if the connection failed
+ */
+static int send_response(int fd, int status, const unsigned char *data,
+                         size_t data_len)
+{
+    unsigned char header[DAEMON_RESPONSE_HEADER_LEN];
+    header[0] = (unsigned char) status;
+    daemon_put_u32(&header[1], (uint32_t) data_len);
+    return daemon_write_full(fd, header, sizeof(header))
+           && daemon_write_full(fd, data, data_len);
+}
+
+/**
+ * @brief Read a request from a connection, run it and send the response
+ * @param[in] d The daemon
+ * @param[in] fd The connection
+ * @return 1 if the connection can be used for another request, 0 if it
+ * should be closed
+ */
+static int serve_request(const daemon_t *d, int fd)
+{
+    unsigned char header[DAEMON_REQUEST_HEADER_LEN];
+    if (!daemon_read_full(fd, header, sizeof(header)))
+        return 0;
+    int op = header[0];
+    size_t name_len = header[1];
+    size_t data_len = daemon_get_u32(&header[2]);
+
+    // The rest of the request can't be skipped, so the connection is closed
+    if (data_len > DAEMON_MAX_DATA)
+    {
+        send_response(fd, EEA_ERR_INVALID_ARGUMENT, NULL, 0);
+        return 0;
+    }
+    char name[UINT8_MAX + 1];
+    if (!daemon_read_full(fd, name, name_len))
+        return 0;
+    name[name_len] = '\0';
+    unsigned char *data = malloc(data_len + 1);
+    if (data == NULL)
+    {
+        send_response(fd, EEA_ERR_NO_MEMORY, NULL, 0);
+        return 0;
+    }
+    if (!daemon_read_full(fd, data, data_len))
+    {
+        free(data);
+        return 0;
+    }
+
+    unsigned char *result = NULL;
+    size_t result_len = 0;
+    int status = EEA_OK;
+    const keyset_t *keyset = find_keyset(d, name);
+    if (keyset == NULL)
+        status = EEA_ERR_NO_KEYSET;
+    else if (op == DAEMON_OP_ENCRYPT)
+    {
+        result_len = encrypt(data, data_len, &result,
+                             (const char **) keyset->keys, keyset->num_keys);
+        if (result == NULL)
+            status = EEA_ERR_NO_MEMORY;
+    }
+    else if (op == DAEMON_OP_DECRYPT)
+        status = decrypt_data(data, data_len, &result, &result_len,
+                              (const char **) keyset->keys,
+                              keyset->num_keys);
+    else
+        status = EEA_ERR_INVALID_ARGUMENT;
+    free(data);
+
+    int ret = send_response(fd, status, result,
+                            (status == EEA_OK) ? result_len : 0);
+    free(result);
+    return ret;
+}
+
+/**
+ * @brief Function called by pthread_create to serve the requests of the
+ * connections in the queue, one request at a time
+ * @param[in] args The daemon_t
+ */
+static void *daemon_worker(void *args)
+{
+    daemon_t *d = (daemon_t *) args;
+    void *item = NULL;
+    while ((item = work_queue_pop(d->queue)) != NULL)
+    {
+        // The queue can't hold NULL, so the fds are stored one higher
+        int fd = (int) (intptr_t) item - 1;
+        if (!serve_request(d, fd)
+            || !daemon_write_full(d->return_fds[1], &fd, sizeof(fd)))
+            close(fd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Create the socket and listen on it, replacing a socket left
+ * behind by a daemon that didn't stop cleanly
+ * @param[in] path The path of the socket
+ * @return The socket, -1 on failure
+ */
+static int listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%sError:%s The socket path \'%s\' is too long\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    struct stat st;
+    if (lstat(path, &st) == 0)
+    {
+        int probe = -1;
+        if (!S_ISSOCK(st.st_mode) || daemon_connect(path, &probe) == EEA_OK)
+        {
+            fprintf(stderr,
+                    "%sError:%s \'%s\' is in use, is the daemon already "
+                    "running?\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], path);
+            if (probe >= 0)
+                close(probe);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+        return -1;
+    // Only the user running the daemon can connect to it
+    mode_t old_mask = umask(0177);
+    int bound = bind(sock, (struct sockaddr *) &addr, sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(sock, DAEMON_BACKLOG) != 0)
+    {
+        fprintf(stderr, "%sError:%s Failed to listen on \'%s\': %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path,
+                strerror(errno));
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/**
+ * @brief Accept a connection, and add it to those waiting for a request
+ * @param[in] sock The listening socket
+ * @param[in,out] fds The file descriptors being polled
+ * @param[in,out] num_fds The number of file descriptors being polled
+ * @param[in,out] max_fds The number there is room for
+ * @return 1 on success, 0 if allocating memory failed
+ */
+static int accept_client(int sock, struct pollfd **fds, size_t *num_fds,
+                         size_t *max_fds)
+{
+    int fd = accept(sock, NULL, NULL);
+    if (fd < 0)
+        return 1;
+    if (!peer_is_owner(fd))
+    {
+        close(fd);
+        return 1;
+    }
+
+    struct timeval timeout = { DAEMON_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    if (*num_fds == *max_fds)
+    {
+        struct pollfd *tmp = realloc(*fds, *max_fds * 2 * sizeof(**fds));
+        if (tmp == NULL)
+        {
+            close(fd);
+            return 0;
+        }
+        *fds = tmp;
+        *max_fds *= 2;
+    }
+    (*fds)[*num_fds].fd = fd;
+    (*fds)[*num_fds].events = POLLIN;
+    (*fds)[(*num_fds)++].revents = 0;
+    return 1;
+}
+
+int run_daemon(keyset_t *keysets, int num_keysets, const char *socket_path,
+               int threads)
+{
+    char default_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+    if (socket_path == NULL)
+    {
+        if (!daemon_socket_path(default_path, sizeof(default_path)))
+            return 1;
+        socket_path = default_path;
+    }
+
+    daemon_t d = { keysets, num_keysets, NULL, { -1, -1 } };
+    int ret = 1;
+    int sock = -1;
+    pthread_t *pool = NULL;
+    int started = 0;
+    // The listening socket, the stop pipe and the return pipe come first
+    size_t num_fds = 3, max_fds = 64;
+    struct pollfd *fds = malloc(max_fds * sizeof(*fds));
+
+    if (!lock_keysets(keysets, num_keysets))
+        fprintf(stderr,
+                "%sWARNING%s Failed to lock the keys into memory, so they "
+                "could be swapped to\ndisk. Raise the limit with "
+                "`ulimit -l`.\n",
+                colors[COLOR_WARNING], colors[COLOR_RESET]);
+
+    d.queue = work_queue_create(threads * 4);
+    pool = malloc(threads * sizeof(pthread_t));
+    if (fds == NULL || d.queue == NULL || pool == NULL || pipe(stop_fds) != 0
+        || pipe(d.return_fds) != 0)
+        goto run_daemon_end;
+    sock = listen_on(socket_path);
+    if (sock < 0)
+        goto run_daemon_end;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    // A client that goes away mid-response is an error, not a reason to
+    // stop
+    signal(SIGPIPE, SIG_IGN);
+
+    for (; started < threads; started++)
+        if (pthread_create(&pool[started], NULL, daemon_worker, &d) != 0)
+            break;
+    if (started == 0)
+        goto run_daemon_end;
+
+    printf("Listening on %s with %d keyset%s and %d threads\n", socket_path,
+           num_keysets, num_keysets == 1 ? "" : "s", started);
+    fflush(stdout);
+
+    fds[0] = (struct pollfd) { sock, POLLIN, 0 };
+    fds[1] = (struct pollfd) { stop_fds[0], POLLIN, 0 };
+    fds[2] = (struct pollfd) { d.return_fds[0], POLLIN, 0 };
+    while (1)
+    {
+        if (poll(fds, num_fds, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+
+        // Connections with a request waiting go to the workers, and are
+        // polled again once it has been answered. When the queue is full
+        // the client is turned away rather than waiting on it here, which
+        // would stop every other connection being accepted and served.
+        for (size_t x = 3; x < num_fds;)
+        {
+            if (fds[x].revents == 0)
+            {
+                x++;
+                continue;
+            }
+            if (!work_queue_try_push(d.queue,
+                                     (void *) (intptr_t) (fds[x].fd + 1)))
+            {
+                send_response(fds[x].fd, EEA_ERR_BUSY, NULL, 0);
+                close(fds[x].fd);
+            }
+            fds[x] = fds[--num_fds];
+        }
+        if (fds[2].revents)
+        {
+            int returned[64];
+            ssize_t len = read(d.return_fds[0], returned, sizeof(returned));
+            for (ssize_t r = 0; r < len / (ssize_t) sizeof(int); r++)
+            {
+                if (num_fds == max_fds)
+                {
+                    struct pollfd *tmp = realloc(fds, max_fds * 2
+                                                          * sizeof(*fds));
+                    if (tmp == NULL)
+                    {
+                        close(returned[r]);
+                        continue;
+                    }
+                    fds = tmp;
+                    max_fds *= 2;
+                }
+                fds[num_fds++] = (struct pollfd) { returned[r], POLLIN, 0 };
+            }
+        }
+        if (fds[0].revents && !accept_client(sock, &fds, &num_fds, &max_fds))
+            break;
+    }
+    printf("Stopping\n");
+    ret = 0;
+
+run_daemon_end:
+    if (sock >= 0)
+    {
+        close(sock);
+        unlink(socket_path);
+    }
+    if (d.queue != NULL)
+    {
+        work_queue_close(d.queue);
+        for (int t = 0; t < started; t++)
+            pthread_join(pool[t], NULL);
+        work_queue_free(d.queue);
+    }
+    if (fds != NULL)
+        for (size_t x = 3; x < num_fds; x++)
+            close(fds[x].fd);
+    // Connections the workers handed back after the loop stopped
+    int returned = -1;
+    if (d.return_fds[0] >= 0)
+    {
+        close(d.return_fds[1]);
+        while (daemon_read_full(d.return_fds[0], &returned, sizeof(returned)))
+            close(returned);
+        close(d.return_fds[0]);
+    }
+    if (stop_fds[0] >= 0)
+    {
+        close(stop_fds[0]);
+        close(stop_fds[1]);
+        stop_fds[0] = stop_fds[1] = -1;
+    }
+    free(fds);
+    free(pool);
+    for (int s = 0; s < num_keysets; s++)
+        wipe_keyset(&keysets[s]);
+    return ret;
+}
+
+#else
+
+int run_daemon(keyset_t *keysets, int num_keysets, const char *socket_path,
+               int threads)
+{
+    fprintf(stderr,
+            "%sError:%s The daemon is only supported on Linux and macOS\n",
+            colors[COLOR_ERROR], colors[COLOR_RESET]);
+    for (int s = 0; s < num_keysets; s++)
+        wipe_keyset(&keysets[s]);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,205 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "daemon_client.h"
+#include "eea.h"
+
+void daemon_put_u32(unsigned char *buf, uint32_t value)
+{
+    buf[0] = value >> 24;
+    buf[1] = value >> 16;
+    buf[2] = value >> 8;
+    buf[3] = value;
+}
+
+uint32_t daemon_get_u32(const unsigned char *buf)
+{
+    return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16)
+           | ((uint32_t) buf[2] << 8) | buf[3];
+}
+
+#ifndef WIN32
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int daemon_socket_path(char *path, size_t size)
+{
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    int len = 0;
+    if (runtime_dir != NULL && runtime_dir[0] != '\0')
+        len = snprintf(path, size, "%s/eea.sock", runtime_dir);
+    else
+        len = snprintf(path, size, "/tmp/eea-%u.sock", (unsigned) getuid());
+    return (len > 0 && (size_t) len < size);
+}
+
+int daemon_read_full(int fd, void *buf, size_t len)
+{
+    unsigned char *p = buf;
+    while (len > 0)
+    {
+        ssize_t got = read(fd, p, len);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 0;
+        p += got;
+        len -= got;
+    }
+    return 1;
+}
+
+int daemon_write_full(int fd, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    while (len > 0)
+    {
+        ssize_t put = write(fd, p, len);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put <= 0)
+            return 0;
+        p += put;
+        len -= put;
+    }
+    return 1;
+}
+
+/**
+ * @brief Send all of a buffer over a socket, without SIGPIPE if the daemon
+ * has closed the connection
+ * @param[in] fd The socket
+ * @param[in] buf The buffer
+ * @param[in] len The length of the buffer
+ * @return 1 if it was all sent, 0 otherwise
+ */
+static int send_full(int fd, const void *buf, size_t len)
+{
+#ifdef MSG_NOSIGNAL
+    const unsigned char *p = buf;
+    while (len > 0)
+    {
+        ssize_t put = send(fd, p, len, MSG_NOSIGNAL);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put <= 0)
+            return 0;
+        p += put;
+        len -= put;
+    }
+    return 1;
+#else
+    // SO_NOSIGPIPE was set on the socket when it was connected
+    return daemon_write_full(fd, buf, len);
+#endif
+}
+
+int daemon_connect(const char *socket_path, int *fd)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path == NULL)
+    {
+        if (!daemon_socket_path(addr.sun_path, sizeof(addr.sun_path)))
+            return EEA_ERR_INVALID_ARGUMENT;
+    }
+    else if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return EEA_ERR_INVALID_ARGUMENT;
+    else
+        strcpy(addr.sun_path, socket_path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+        return EEA_ERR_IO;
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+    {
+        close(sock);
+        return EEA_ERR_IO;
+    }
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    *fd = sock;
+    return EEA_OK;
+}
+
+int daemon_request(int fd, int op, const char *keyset,
+                   const unsigned char *data, size_t data_len,
+                   unsigned char **out, size_t *out_len)
+{
+    size_t keyset_len = strlen(keyset);
+    if (keyset_len > UINT8_MAX || data_len > DAEMON_MAX_DATA)
+        return EEA_ERR_INVALID_ARGUMENT;
+
+    unsigned char header[DAEMON_REQUEST_HEADER_LEN];
+    header[0] = (unsigned char) op;
+    header[1] = (unsigned char) keyset_len;
+    daemon_put_u32(&header[2], (uint32_t) data_len);
+    int sent = (send_full(fd, header, sizeof(header))
+                && send_full(fd, keyset, keyset_len)
+                && send_full(fd, data, data_len));
+
+    // A busy daemon answers and closes the connection without reading the
+    // request, so the answer is read even if sending the request failed
+    unsigned char response[DAEMON_RESPONSE_HEADER_LEN];
+    if (!daemon_read_full(fd, response, sizeof(response)))
+        return EEA_ERR_IO;
+    if (!sent)
+        return (response[0] != EEA_OK) ? response[0] : EEA_ERR_IO;
+    size_t len = daemon_get_u32(&response[1]);
+    unsigned char *result = malloc(len + 1);
+    if (result == NULL)
+        return EEA_ERR_NO_MEMORY;
+    if (!daemon_read_full(fd, result, len))
+    {
+        free(result);
+        return EEA_ERR_IO;
+    }
+    result[len] = '\0';
+
+    if (response[0] != EEA_OK)
+    {
+        free(result);
+        return response[0];
+    }
+    *out = result;
+    *out_len = len;
+    return EEA_OK;
+}
+
+#else
+
+int daemon_socket_path(char *path, size_t size)
+{
+    return 0;
+}
+
+int daemon_read_full(int fd, void *buf, size_t len)
+{
+    return 0;
+}
+
+int daemon_write_full(int fd, const void *buf, size_t len)
+{
+    return 0;
+}
+
+int daemon_connect(const char *socket_path, int *fd)
+{
+    return EEA_ERR_IO;
+}
+
+int daemon_request(int fd, int op, const char *keyset,
+                   const unsigned char *data, size_t data_len,
+                   unsigned char **out, size_t *out_len)
+{
+    return EEA_ERR_IO;
+}
+
+#endif
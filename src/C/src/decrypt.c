@@ -3,10 +3,14 @@
 #include <string.h>
 
 #include "base64.h"
+#include "checksum.h"
+#include "compress.h"
 #include "decrypt.h"
+#include "eea.h"
 #include "file_handling.h"
 #include "globals.h"
-#include "prompts.h"
+#include "kernels.h"
+#include "stats.h"
 #include "utils.h"
 
 /**
@@ -31,22 +35,17 @@ static void get_prev_block(unsigned char *data, size_t start,
  * @param[out] being_decrypted The resulting value of decryption
  * @param[in] key_block The key block that will to decrypt the data
  * @param[in] key_len The length of the keys to use for decryption
+ * @return 0 on success, 1 if allocating memory failed
  */
-static void decrypt_multi_block(unsigned char *data, size_t data_len,
-                                unsigned char **being_decrypted,
-                                unsigned char *key_block, size_t key_len)
+static int decrypt_multi_block(unsigned char *data, size_t data_len,
+                               unsigned char **being_decrypted,
+                               unsigned char *key_block, size_t key_len)
 {
     // Allocate memory and set a temporary variables to handle
     // data being modified in the function
     unsigned char *temp = malloc(data_len + 1);
     if (temp == NULL)
-    {
-        fprintf(stderr,
-                "%sError:%s Unable to allocate memory for "
-                "decryption.\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET]);
-        exit(EXIT_FAILURE);
-    }
+        return 1;
     memcpy(temp, *being_decrypted, data_len);
 
     size_t start = data_len - (key_len * 2);
@@ -75,6 +74,7 @@ static void decrypt_multi_block(unsigned char *data, size_t data_len,
     // our temporary variable
     memcpy(*being_decrypted, temp, data_len);
     free(temp);
+    return 0;
 }
 
 /**
@@ -89,7 +89,7 @@ static size_t remove_padding(unsigned char **plain_text, size_t plain_text_len)
     size_t plain_text_size = plain_text_len;
 
     unsigned char *temp = *plain_text;
-    while (temp[plain_text_size - 1] == PADDING)
+    while (plain_text_size > 0 && temp[plain_text_size - 1] == PADDING)
         plain_text_size--;
 
     unsigned char *tmp = realloc(*plain_text, (plain_text_size + 1));
@@ -99,96 +99,127 @@ static size_t remove_padding(unsigned char **plain_text, size_t plain_text_len)
     return plain_text_size;
 }
 
-size_t decrypt(unsigned char *data, size_t data_len,
-               unsigned char **plain_text, const char **keys, int num_keys)
+/**
+ * @brief Run the XOR rounds a byte at a time, one key after the other
+ * @param[in] raw_data The cipher text, after base64. Changed between rounds.
+ * @param[in] data_size The size of the cipher text
+ * @param[out] temp Set to the plain text, with the padding
+ * @param[in] keys The keys to use for decryption
+ * @param[in] num_keys The number of keys being used for decryption
+ * @param[in] key_len The length of each key
+ * @return 0 on success, 1 if allocating memory failed
+ */
+static int xor_reference(unsigned char *raw_data, size_t data_size,
+                         unsigned char *temp, const char **keys, int num_keys,
+                         size_t key_len)
+{
+    unsigned char *key_block = malloc(key_len + 1);
+    if (key_block == NULL)
+        return 1;
+
+    for (int k = num_keys - 1; k >= 0; k--)
+    {
+        // Set the data to decrypt to the result from the previous
+        // round of decryption
+        if (k != (num_keys - 1))
+            memcpy(raw_data, temp, data_size);
+
+        // Check to see if we have more than one block to decrypt
+        if (data_size >= (key_len * 2)
+            && decrypt_multi_block(raw_data, data_size, &temp, key_block,
+                                   key_len))
+        {
+            free(key_block);
+            return 1;
+        }
+
+        // We are at the last block, so the previous block is the key
+        memcpy(key_block, keys[k], key_len);
+        for (int x = (key_len - 1); x >= 0; x--)
+            temp[x] = key_block[x] ^ raw_data[x];
+    }
+    free(key_block);
+    return 0;
+}
+
+int decrypt_data(unsigned char *data, size_t data_len,
+                 unsigned char **plain_text, size_t *plain_text_len,
+                 const char **keys, int num_keys)
 {
     size_t key_len = strlen(keys[0]);
 
     // Try and decode the data
     size_t data_size = 0;
-    int decoded = 1; // Assume decode will succeed
+    STATS_START(decode_start);
     unsigned char *raw_data = base64_decode(data, data_len, &data_size);
-    // Data were not encoded in base64. Revert to original data
+    STATS_STOP(STAT_BASE64_DECODE, decode_start, data_len);
+    // Data were not encoded in base64. Revert to a copy of the original
+    // data, as the rounds change it.
     if (raw_data == NULL)
     {
-        raw_data = data;
+        raw_data = malloc(data_len + 1);
+        if (raw_data == NULL)
+            return EEA_ERR_NO_MEMORY;
+        memcpy(raw_data, data, data_len);
         data_size = data_len;
-        decoded = 0;
     }
 
     // Check if data and keys are valid
-    if (data_size % key_len != 0)
+    if (data_size == 0 || data_size % key_len != 0)
     {
-        fprintf(stderr, "%sError:%s Invalid data and or keys provided\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET]);
-        if (decoded)
-        {
-            free(raw_data);
-            raw_data = NULL;
-        }
-        return 0;
+        free(raw_data);
+        return EEA_ERR_INVALID_DATA;
     }
 
     // Allocate memory for the plain text
     unsigned char *temp = malloc(data_size + 1);
     if (temp == NULL)
     {
-        if (decoded)
-        {
-            free(raw_data);
-            raw_data = NULL;
-        }
-        return 0;
+        free(raw_data);
+        return EEA_ERR_NO_MEMORY;
     }
 
-    unsigned char *key_block = malloc(key_len + 1);
-    if (key_block == NULL)
+    STATS_START(xor_start);
+    int failed = 0;
+    if (xor_kernel == XOR_KERNEL_BLOCKED)
     {
-        if (decoded)
-        {
-            free(raw_data);
-            raw_data = NULL;
-        }
-        free(temp);
-        return 0;
+        memcpy(temp, raw_data, data_size);
+        failed = xor_decrypt_blocked(temp, data_size, keys, num_keys, key_len,
+                                     chunk_size);
     }
-
-    for (int k = num_keys - 1; k >= 0; k--)
+    else
+        failed = xor_reference(raw_data, data_size, temp, keys, num_keys,
+                               key_len);
+    STATS_STOP(STAT_XOR, xor_start, (uint64_t) data_size * num_keys);
+    free(raw_data);
+    if (failed)
     {
-        // Set the data to decrypt to the result from the previous
-        // round of decryption
-        if (k != (num_keys - 1))
-            memcpy(raw_data, temp, data_size);
-
-        // Check to see if we have more than one block to decrypt
-        if (data_size >= (key_len * 2))
-            decrypt_multi_block(raw_data, data_size, &temp, key_block,
-                                key_len);
-
-        // We are at the last block, so the previous block is the key
-        memcpy(key_block, keys[k], key_len);
-        for (int x = (key_len - 1); x >= 0; x--)
-            temp[x] = key_block[x] ^ raw_data[x];
-    }
-    if (decoded)
-    {
-        free(raw_data);
-        raw_data = NULL;
+        free(temp);
+        return EEA_ERR_NO_MEMORY;
     }
-    free(key_block);
+    STATS_START(padding_start);
     size_t plain_text_size = remove_padding(&temp, data_size);
+    STATS_STOP(STAT_REMOVE_PADDING, padding_start, data_size);
+    temp[plain_text_size] = '\0';
     *plain_text = temp;
-    return plain_text_size;
+    *plain_text_len = plain_text_size;
+    return EEA_OK;
 }
 
-size_t decrypt_keys(unsigned char *encrypted_string, size_t encrypted_size,
-                    char **keys_string)
+size_t decrypt(unsigned char *data, size_t data_len,
+               unsigned char **plain_text, const char **keys, int num_keys)
 {
-    // We are not setting the password
-    char *password_hash = get_hashed_password(0);
-    if (password_hash == NULL)
+    size_t plain_text_len = 0;
+    if (decrypt_data(data, data_len, plain_text, &plain_text_len, keys,
+                     num_keys)
+        != EEA_OK)
         return 0;
+    return plain_text_len;
+}
 
+size_t decrypt_keys(unsigned char *encrypted_string, size_t encrypted_size,
+                    const char *password_hash, char **keys_string)
+{
     unsigned char *decrypted_keys = calloc(encrypted_size + 1, sizeof(char));
     if (decrypted_keys == NULL)
         return 0;
@@ -197,52 +228,94 @@ size_t decrypt_keys(unsigned char *encrypted_string, size_t encrypted_size,
     for (int x = 0; x < ROUNDS; x++)
     {
         unsigned char *unchanged = decrypted_keys;
+        decrypted_keys = NULL;
         decrypted_keys_len = decrypt(unchanged, decrypted_keys_len,
-                                     &decrypted_keys,
-                                     (const char **) &password_hash, 1);
-        if (unchanged != NULL)
-            free(unchanged);
-        if (decrypted_keys_len == 0)
-        {
-            printf("An error occured during decryption. Aborting...\n");
-            free(password_hash);
+                                     &decrypted_keys, &password_hash, 1);
+        free(unchanged);
+        if (decrypted_keys == NULL)
             return 0;
-        }
     }
 
-    // Remove the salt
-    *keys_string = strdup(strchr((char *) decrypted_keys, '\n') + 1);
-    decrypted_keys_len = strlen(*keys_string);
-
+    // Remove the salt. Without it, the password was wrong.
+    char *keys_start = strchr((char *) decrypted_keys, '\n');
+    if (keys_start == NULL)
+    {
+        free(decrypted_keys);
+        return 0;
+    }
+    *keys_string = strdup(keys_start + 1);
     free(decrypted_keys);
-    free(password_hash);
-    return decrypted_keys_len;
+    if (*keys_string == NULL)
+        return 0;
+    return strlen(*keys_string);
 }
 
-int decrypt_file(const char *filename, const char **keys, int num_keys)
+int decrypt_contents(const unsigned char *data, size_t data_len,
+                     unsigned char **plain_text, size_t *plain_text_len,
+                     const char **keys, int num_keys)
+{
+    // Compressed plain text is marked before the cipher text, and the
+    // checksums come after it
+    size_t body_len = checksum_body_len(data, data_len);
+    size_t prefix_len = strlen(COMPRESSED_PREFIX);
+    int compressed = (body_len >= prefix_len
+                      && memcmp(data, COMPRESSED_PREFIX, prefix_len) == 0);
+    if (!compressed)
+        prefix_len = 0;
+
+    // decrypt_data() only reads the data
+    unsigned char *decrypted = NULL;
+    size_t decrypted_len = 0;
+    int ret = decrypt_data((unsigned char *) data + prefix_len,
+                           body_len - prefix_len, &decrypted, &decrypted_len,
+                           keys, num_keys);
+    if (ret != EEA_OK)
+        return ret;
+
+    if (compressed)
+    {
+        unsigned char *frames = decrypted;
+        STATS_START(decompress_start);
+        ret = decompress_data(frames, decrypted_len, &decrypted,
+                              &decrypted_len);
+        STATS_STOP(STAT_DECOMPRESS, decompress_start, decrypted_len);
+        free(frames);
+        if (ret != EEA_OK)
+            return ret;
+    }
+    *plain_text = decrypted;
+    *plain_text_len = decrypted_len;
+    return EEA_OK;
+}
+
+int decrypt_file(const char *filename, const char **keys, int num_keys,
+                 size_t *bytes_in, size_t *bytes_out)
 {
-    int success = 1;
-    unsigned char *plain_text = NULL;
     unsigned char *cipher_text = NULL;
     size_t file_size = read_in_file(filename, &cipher_text);
     if (file_size == -1)
-        return 0;
+        return EEA_ERR_IO;
 
-    size_t plain_text_size = decrypt(cipher_text, file_size, &plain_text, keys,
-                                     num_keys);
-    if (plain_text == NULL)
-        return 0;
+    unsigned char *plain_text = NULL;
+    size_t plain_text_size = 0;
+    int ret = decrypt_contents(cipher_text, file_size, &plain_text,
+                               &plain_text_size, keys, num_keys);
+    free(cipher_text);
+    if (ret != EEA_OK)
+        return ret;
 
     char *output_file = get_output_filename(filename, 0);
-    if (!save_to_file(output_file, plain_text, plain_text_size))
-    {
-        fprintf(stderr, "%sError:%s Saving data to the file failed\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET]);
-        success = 0;
-    }
+    if (output_file == NULL)
+        ret = EEA_ERR_NO_MEMORY;
+    else if (!save_to_file(output_file, plain_text, plain_text_size))
+        ret = EEA_ERR_IO;
+
+    if (ret == EEA_OK && bytes_in != NULL)
+        *bytes_in = file_size;
+    if (ret == EEA_OK && bytes_out != NULL)
+        *bytes_out = plain_text_size;
 
-    free(cipher_text);
     free(plain_text);
     free(output_file);
-    return success;
+    return ret;
 }
@@ -0,0 +1,367 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/rand.h>
+
+#include "batch.h"
+#include "daemon_client.h"
+#include "decrypt.h"
+#include "eea.h"
+#include "encrypt.h"
+#include "file_handling.h"
+#include "globals.h"
+#include "kernels.h"
+#include "keygen.h"
+#include "stream.h"
+#include "utils.h"
+
+static const char *ERROR_STRINGS[] = {
+    "Success",
+    "Out of memory",
+    "Invalid argument",
+    "The data wasn't encrypted with these keys",
+    "Reading or writing a file failed",
+    "Getting random bytes failed",
+    "Wrong password, or not a keys file",
+    "No keyset by that name",
+    "The daemon is busy, try again"
+};
+static const int NUM_ERROR_STRINGS = sizeof(ERROR_STRINGS) / sizeof(char *);
+
+/**
+ * @brief Check the keys can be used for encryption and decryption
+ * @param[in] keys The keys
+ * @param[in] num_keys The number of keys
+ * @return If they are all hex of the same, valid length
+ */
+static int check_keys(const char **keys, int num_keys)
+{
+    if (keys == NULL || num_keys < 1)
+        return 0;
+    for (int k = 0; k < num_keys; k++)
+        if (keys[k] == NULL)
+            return 0;
+    return validate_keys(keys, num_keys);
+}
+
+/**
+ * @brief Work out why something that needed random bytes failed
+ * @return EEA_ERR_RANDOM if OpenSSL couldn't get them, otherwise
+ * EEA_ERR_NO_MEMORY
+ */
+static int random_error(void)
+{
+    return (RAND_status() == 1) ? EEA_ERR_NO_MEMORY : EEA_ERR_RANDOM;
+}
+
+/**
+ * @brief Split the decrypted contents of a keys file into keys
+ * @param[in] keys_string The keys, one per line
+ * @param[in] keys_string_len The length of keys_string
+ * @param[out] keys Set to the keys
+ * @param[out] num_keys Set to the number of keys
+ * @return EEA_OK, or one of EeaErrors
+ */
+static int split_keys(const char *keys_string, size_t keys_string_len,
+                      char ***keys, int *num_keys)
+{
+    size_t key_len = find_key_len(keys_string);
+    if (key_len == (size_t) -1 || keys_string_len < key_len)
+        return EEA_ERR_WRONG_PASSWORD;
+
+    int count = keys_string_len / key_len;
+    char **split = calloc(count, sizeof(char *));
+    if (split == NULL)
+        return EEA_ERR_NO_MEMORY;
+
+    size_t index = 0;
+    for (int k = 0; k < count; k++)
+    {
+        split[k] = malloc(key_len + 1);
+        if (split[k] == NULL)
+        {
+            free_keys(split, count, NULL);
+            return EEA_ERR_NO_MEMORY;
+        }
+        strncpy(split[k], &keys_string[index], key_len);
+        split[k][key_len] = '\0';
+        index += key_len + 1;
+    }
+
+    if (!validate_keys((const char **) split, count))
+    {
+        free_keys(split, count, NULL);
+        return EEA_ERR_WRONG_PASSWORD;
+    }
+    *keys = split;
+    *num_keys = count;
+    return EEA_OK;
+}
+
+const char *eea_strerror(int error)
+{
+    if (error < 0 || error >= NUM_ERROR_STRINGS)
+        return "Unknown error";
+    return ERROR_STRINGS[error];
+}
+
+int eea_generate_keys(size_t bits, int num_keys, char ***keys)
+{
+    if (keys == NULL || num_keys < 1 || bits < MIN_KEY_BITS
+        || bits % MIN_KEY_BITS != 0)
+        return EEA_ERR_INVALID_ARGUMENT;
+
+    char **generated = generate_keys(bits, num_keys);
+    if (generated == NULL)
+        return random_error();
+    *keys = generated;
+    return EEA_OK;
+}
+
+void eea_free_keys(char **keys, int num_keys)
+{
+    if (keys != NULL)
+        free_keys(keys, num_keys, NULL);
+}
+
+void eea_free(void *ptr)
+{
+    free(ptr);
+}
+
+int eea_encrypt(const unsigned char *data, size_t data_len, const char **keys,
+                int num_keys, unsigned char **cipher_text,
+                size_t *cipher_text_len)
+{
+    if ((data == NULL && data_len > 0) || cipher_text == NULL
+        || cipher_text_len == NULL || !check_keys(keys, num_keys))
+        return EEA_ERR_INVALID_ARGUMENT;
+
+    // encrypt() only reads the data
+    unsigned char *result = NULL;
+    size_t result_len = encrypt((unsigned char *) data, data_len, &result,
+                                keys, num_keys);
+    if (result == NULL)
+        return EEA_ERR_NO_MEMORY;
+    result[result_len] = '\0';
+    *cipher_text = result;
+    *cipher_text_len = result_len;
+    return EEA_OK;
+}
+
+int eea_decrypt(const unsigned char *data, size_t data_len, const char **keys,
+                int num_keys, unsigned char **plain_text,
+                size_t *plain_text_len)
+{
+    if (data == NULL || plain_text == NULL || plain_text_len == NULL
+        || !check_keys(keys, num_keys))
+        return EEA_ERR_INVALID_ARGUMENT;
+
+    return decrypt_contents(data, data_len, plain_text, plain_text_len, keys,
+                            num_keys);
+}
+
+/**
+ * @brief Check the arguments of eea_encrypt_batch() and eea_decrypt_batch()
+ * @param[in] messages The messages
+ * @param[in] count The number of messages
+ * @param[in] keys The keys
+ * @param[in] num_keys The number of keys
+ * @param[in] results Where the results go
+ * @param[in] arena Where the arena goes
+ * @return If they can be used
+ */
+static int check_batch(const eea_buffer_t *messages, size_t count,
+                       const char **keys, int num_keys,
+                       const eea_buffer_t *results, unsigned char **arena)
+{
+    if ((count > 0 && (messages == NULL || results == NULL)) || arena == NULL
+        || !check_keys(keys, num_keys))
+        return 0;
+    for (size_t m = 0; m < count; m++)
+        if (messages[m].data == NULL && messages[m].len > 0)
+            return 0;
+    return 1;
+}
+
+int eea_encrypt_batch(const eea_buffer_t *messages, size_t count,
+                      const char **keys, int num_keys, eea_buffer_t *results,
+                      unsigned char **arena)
+{
+    if (!check_batch(messages, count, keys, num_keys, results, arena))
+        return EEA_ERR_INVALID_ARGUMENT;
+    return encrypt_batch(messages, count, keys, num_keys, results, arena);
+}
+
+int eea_decrypt_batch(const eea_buffer_t *messages, size_t count,
+                      const char **keys, int num_keys, eea_buffer_t *results,
+                      unsigned char **arena)
+{
+    if (!check_batch(messages, count, keys, num_keys, results, arena))
+        return EEA_ERR_INVALID_ARGUMENT;
+    return decrypt_batch(messages, count, keys, num_keys, results, arena);
+}
+
+int eea_encrypt_file(const char *in_path, const char *out_path,
+                     const char **keys, int num_keys)
+{
+    if (in_path == NULL || out_path == NULL || !check_keys(keys, num_keys))
+        return EEA_ERR_INVALID_ARGUMENT;
+
+    unsigned char *data = NULL;
+    size_t data_len = read_in_file(in_path, &data);
+    if (data_len == (size_t) -1)
+        return EEA_ERR_IO;
+
+    unsigned char *cipher_text = NULL;
+    size_t cipher_text_len = encrypt_for_file(data, data_len, "",
+                                              &cipher_text, keys, num_keys);
+    free(data);
+    int ret = (cipher_text == NULL) ? EEA_ERR_NO_MEMORY : EEA_OK;
+    if (ret == EEA_OK && !save_to_file(out_path, cipher_text, cipher_text_len))
+        ret = EEA_ERR_IO;
+    free(cipher_text);
+    return ret;
+}
+
+int eea_decrypt_file(const char *in_path, const char *out_path,
+                     const char **keys, int num_keys)
+{
+    if (in_path == NULL || out_path == NULL || !check_keys(keys, num_keys))
+        return EEA_ERR_INVALID_ARGUMENT;
+
+    unsigned char *data = NULL;
+    size_t data_len = read_in_file(in_path, &data);
+    if (data_len == (size_t) -1)
+        return EEA_ERR_IO;
+
+    unsigned char *plain_text = NULL;
+    size_t plain_text_len = 0;
+    int ret = eea_decrypt(data, data_len, keys, num_keys, &plain_text,
+                          &plain_text_len);
+    free(data);
+    if (ret == EEA_OK && !save_to_file(out_path, plain_text, plain_text_len))
+        ret = EEA_ERR_IO;
+    free(plain_text);
+    return ret;
+}
+
+int eea_encrypt_stream(FILE *in, FILE *out, const char **keys, int num_keys)
+{
+    if (in == NULL || out == NULL || !check_keys(keys, num_keys))
+        return EEA_ERR_INVALID_ARGUMENT;
+    return encrypt_stream(in, out, keys, num_keys, NULL);
+}
+
+int eea_decrypt_stream(FILE *in, FILE *out, const char **keys, int num_keys)
+{
+    if (in == NULL || out == NULL || !check_keys(keys, num_keys))
+        return EEA_ERR_INVALID_ARGUMENT;
+    return decrypt_stream(in, out, keys, num_keys);
+}
+
+int eea_save_keys(const char *path, const char **keys, int num_keys,
+                  const char *password)
+{
+    if (path == NULL || password == NULL || !check_keys(keys, num_keys))
+        return EEA_ERR_INVALID_ARGUMENT;
+
+    char *password_hash = hash_password(password);
+    if (password_hash == NULL)
+        return EEA_ERR_NO_MEMORY;
+
+    unsigned char *encrypted = NULL;
+    size_t encrypted_len = encrypt_keys((char **) keys, num_keys,
+                                        password_hash, &encrypted);
+    free(password_hash);
+    if (encrypted == NULL)
+        return random_error();
+
+    int ret = EEA_OK;
+    if (!save_to_file(path, encrypted, encrypted_len))
+        ret = EEA_ERR_IO;
+    free(encrypted);
+    return ret;
+}
+
+int eea_load_keys(const char *path, const char *password, char ***keys,
+                  int *num_keys)
+{
+    if (path == NULL || password == NULL || keys == NULL || num_keys == NULL)
+        return EEA_ERR_INVALID_ARGUMENT;
+
+    unsigned char *encrypted = NULL;
+    size_t encrypted_len = read_in_file(path, &encrypted);
+    if (encrypted_len == (size_t) -1)
+        return EEA_ERR_IO;
+
+    char *password_hash = hash_password(password);
+    if (password_hash == NULL)
+    {
+        free(encrypted);
+        return EEA_ERR_NO_MEMORY;
+    }
+
+    char *keys_string = NULL;
+    size_t keys_string_len = decrypt_keys(encrypted, encrypted_len,
+                                          password_hash, &keys_string);
+    free(password_hash);
+    free(encrypted);
+    if (keys_string == NULL)
+        return EEA_ERR_WRONG_PASSWORD;
+
+    int ret = split_keys(keys_string, keys_string_len, keys, num_keys);
+    free(keys_string);
+    return ret;
+}
+
+int eea_daemon_connect(const char *socket_path, int *fd)
+{
+    if (fd == NULL)
+        return EEA_ERR_INVALID_ARGUMENT;
+    return daemon_connect(socket_path, fd);
+}
+
+int eea_daemon_encrypt(int fd, const char *keyset, const unsigned char *data,
+                       size_t data_len, unsigned char **cipher_text,
+                       size_t *cipher_text_len)
+{
+    if (keyset == NULL || (data == NULL && data_len > 0)
+        || cipher_text == NULL || cipher_text_len == NULL)
+        return EEA_ERR_INVALID_ARGUMENT;
+    return daemon_request(fd, DAEMON_OP_ENCRYPT, keyset, data, data_len,
+                          cipher_text, cipher_text_len);
+}
+
+int eea_daemon_decrypt(int fd, const char *keyset, const unsigned char *data,
+                       size_t data_len, unsigned char **plain_text,
+                       size_t *plain_text_len)
+{
+    if (keyset == NULL || data == NULL || plain_text == NULL
+        || plain_text_len == NULL)
+        return EEA_ERR_INVALID_ARGUMENT;
+    return daemon_request(fd, DAEMON_OP_DECRYPT, keyset, data, data_len,
+                          plain_text, plain_text_len);
+}
+
+void eea_daemon_close(int fd)
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+int eea_set_kernel(const char *kernel, size_t chunk)
+{
+    int found = (kernel != NULL) ? xor_kernel_from_name(kernel) : -1;
+    if (found < 0)
+        return EEA_ERR_INVALID_ARGUMENT;
+    xor_kernel = found;
+    chunk_size = chunk;
+    return EEA_OK;
+}
+
+void eea_set_checksums(int enabled)
+{
+    checksums = (enabled != 0);
+}
@@ -5,12 +5,21 @@
 #include <openssl/sha.h>
 
 #include "base64.h"
+#include "checksum.h"
+#include "compress.h"
+#include "eea.h"
 #include "encrypt.h"
 #include "file_handling.h"
 #include "globals.h"
-#include "prompts.h"
+#include "kernels.h"
+#include "stats.h"
 #include "utils.h"
 
+// How much of the cipher text is encoded before it is checksummed, small
+// enough to still be in cache, and a multiple of 3 so only the last block
+// is padded
+static const size_t ENCODE_BLOCK = (size_t) 48 << 10;
+
 /**
  * @brief Return the size of how big the resulting cipher text will be
  * @param[in] data_len The size data that will be encrypted
@@ -28,17 +37,20 @@ static size_t get_cipher_text_len(size_t data_len, size_t key_len)
     return cipher_text_len;
 }
 
-size_t encrypt(unsigned char *data, size_t data_len,
-               unsigned char **cipher_text, const char **keys, int num_keys)
+/**
+ * @brief Run the XOR rounds a byte at a time, one key after the other
+ * @param[in] data The data to encrypt
+ * @param[in] data_len The size of the data to encrypt
+ * @param[out] temp Set to the cipher text, before base64
+ * @param[in] cipher_text_len The size of the cipher text
+ * @param[in] keys The keys to use for encryption
+ * @param[in] num_keys The number of keys being used for encryption
+ * @param[in] key_len The length of each key
+ */
+static void xor_reference(unsigned char *data, size_t data_len,
+                          unsigned char *temp, size_t cipher_text_len,
+                          const char **keys, int num_keys, size_t key_len)
 {
-    size_t key_len = strlen(keys[0]);
-    size_t cipher_text_len = get_cipher_text_len(data_len, key_len);
-
-    // Allocate memory for the cipher text
-    unsigned char *temp = malloc(cipher_text_len + 1);
-    if (temp == NULL)
-        return 0;
-
     unsigned char prev_block[key_len];
     unsigned char key_block[key_len];
     // Iterate through each key
@@ -46,7 +58,7 @@ size_t encrypt(unsigned char *data, size_t data_len,
     {
         // Set the key_block equal to the current key
         memcpy(key_block, keys[k], key_len);
-        for (int x = 0; x < cipher_text_len; x++)
+        for (size_t x = 0; x < cipher_text_len; x++)
         {
             // If the current index in the data to be encrypted is beyond
             // the length of the key use the previous block as the new key
@@ -71,30 +83,138 @@ size_t encrypt(unsigned char *data, size_t data_len,
             prev_block[x % key_len] = key_block[x % key_len] ^ byte;
         }
     }
+}
+
+/**
+ * @brief Run the XOR rounds with the chosen kernel
+ * @param[in] data The data to encrypt
+ * @param[in] data_len The size of the data to encrypt
+ * @param[out] cipher_text_len Set to the size of the cipher text
+ * @param[in] keys The keys to use for encryption
+ * @param[in] num_keys The number of keys being used for encryption
+ * @return The cipher text, before base64, NULL if allocating memory failed
+ * @note The returned buffer must be freed
+ */
+static unsigned char *xor_rounds(unsigned char *data, size_t data_len,
+                                 size_t *cipher_text_len, const char **keys,
+                                 int num_keys)
+{
+    size_t key_len = strlen(keys[0]);
+    *cipher_text_len = get_cipher_text_len(data_len, key_len);
+
+    // Allocate memory for the cipher text
+    unsigned char *temp = malloc(*cipher_text_len + 1);
+    if (temp == NULL)
+        return NULL;
+
+    STATS_START(xor_start);
+    if (xor_kernel == XOR_KERNEL_BLOCKED)
+    {
+        memcpy(temp, data, data_len);
+        memset(temp + data_len, PADDING, *cipher_text_len - data_len);
+        if (xor_encrypt_blocked(temp, *cipher_text_len, keys, num_keys,
+                                key_len, chunk_size))
+        {
+            free(temp);
+            return NULL;
+        }
+    }
+    else
+        xor_reference(data, data_len, temp, *cipher_text_len, keys, num_keys,
+                      key_len);
+    STATS_STOP(STAT_XOR, xor_start, (uint64_t) *cipher_text_len * num_keys);
+    return temp;
+}
+
+size_t encrypt(unsigned char *data, size_t data_len,
+               unsigned char **cipher_text, const char **keys, int num_keys)
+{
+    size_t cipher_text_len = 0;
+    unsigned char *temp = xor_rounds(data, data_len, &cipher_text_len, keys,
+                                     num_keys);
+    if (temp == NULL)
+        return 0;
+
     size_t encode_len = 0;
-    int success = 1; // Assume encode success
+    STATS_START(encode_start);
     unsigned char *tmp = (unsigned char *) base64_encode(temp, cipher_text_len,
                                                          &encode_len);
+    STATS_STOP(STAT_BASE64_ENCODE, encode_start, cipher_text_len);
+    free(temp);
+    // The raw XOR output isn't cipher text anything can read back
     if (tmp == NULL)
-    {
-        tmp = temp;
-        encode_len = cipher_text_len;
-        success = 0;
-    }
+        return 0;
     *cipher_text = tmp;
-    if (success)
-        free(temp);
     return encode_len;
 }
 
-size_t encrypt_keys(char **keys, int num_keys,
-                    unsigned char **encrypted_string)
+size_t encrypt_for_file(unsigned char *data, size_t data_len,
+                        const char *prefix, unsigned char **contents,
+                        const char **keys, int num_keys)
 {
-    // We are creating a password
-    char *password_hash = get_hashed_password(1);
-    if (password_hash == NULL)
+    size_t cipher_text_len = 0;
+    unsigned char *temp = xor_rounds(data, data_len, &cipher_text_len, keys,
+                                     num_keys);
+    if (temp == NULL)
+        return 0;
+
+    // Room for everything up front, with the null terminator, so nothing is
+    // moved or reallocated
+    size_t prefix_len = strlen(prefix);
+    size_t body_len = prefix_len + 4 * ((cipher_text_len + 2) / 3);
+    size_t max_len = body_len + 1;
+    if (checksums)
+        max_len = body_len + checksum_trailer_max(body_len);
+    unsigned char *out = malloc(max_len);
+    if (out == NULL)
+    {
+        free(temp);
+        return 0;
+    }
+    memcpy(out, prefix, prefix_len + 1);
+
+    // Encode a block at a time, checksumming each block while it is still
+    // in cache. The checksums are timed with the encoding.
+    checksum_t sum;
+    checksum_init(&sum);
+    int failed = checksums && checksum_update(&sum, out, prefix_len);
+    size_t used = prefix_len;
+    STATS_START(encode_start);
+    for (size_t x = 0; x < cipher_text_len && !failed; x += ENCODE_BLOCK)
+    {
+        size_t take = cipher_text_len - x;
+        if (take > ENCODE_BLOCK)
+            take = ENCODE_BLOCK;
+        size_t len = base64_encode_block(temp + x, take, (char *) out + used);
+        failed = checksums && checksum_update(&sum, out + used, len);
+        used += len;
+    }
+    STATS_STOP(STAT_BASE64_ENCODE, encode_start, cipher_text_len);
+    free(temp);
+
+    if (checksums && !failed)
+    {
+        size_t trailer_len = 0;
+        char *trailer = checksum_trailer(&sum, &trailer_len);
+        failed = (trailer == NULL);
+        if (!failed)
+            memcpy(out + used, trailer, trailer_len + 1);
+        used += trailer_len;
+        free(trailer);
+    }
+    checksum_free(&sum);
+    if (failed)
+    {
+        free(out);
         return 0;
+    }
+    *contents = out;
+    return used;
+}
 
+size_t encrypt_keys(char **keys, int num_keys, const char *password_hash,
+                    unsigned char **encrypted_string)
+{
     size_t key_size = strlen(keys[0]);
 
     // Add salt to harden the encryption since we are only using
@@ -102,14 +222,12 @@ size_t encrypt_keys(char **keys, int num_keys,
     char *salt = get_random_hexstr(key_size / 2);
     if (salt == NULL)
     {
-        free(password_hash);
         return 0;
     }
 
     char *keys_string = keys_to_string((const char **) keys, num_keys);
     if (keys_string == NULL)
     {
-        free(password_hash);
         free(salt);
         return 0;
     }
@@ -118,7 +236,6 @@ size_t encrypt_keys(char **keys, int num_keys,
     unsigned char *encrypted_keys = malloc(encrypted_keys_len);
     if (encrypted_keys == NULL)
     {
-        free(password_hash);
         free(salt);
         free(keys_string);
         return 0;
@@ -133,41 +250,60 @@ size_t encrypt_keys(char **keys, int num_keys,
     for (int x = 0; x < ROUNDS; x++)
     {
         unsigned char *unchanged = encrypted_keys;
+        encrypted_keys = NULL;
         encrypted_keys_len = encrypt(unchanged, encrypted_keys_len,
-                                     &encrypted_keys,
-                                     (const char **) &password_hash, 1);
+                                     &encrypted_keys, &password_hash, 1);
         free(unchanged);
+        if (encrypted_keys == NULL)
+            return 0;
     }
     *encrypted_string = encrypted_keys;
-    free(password_hash);
     return encrypted_keys_len;
 }
 
-int encrypt_file(const char *filename, const char **keys, int num_keys)
+int encrypt_file(const char *filename, const char **keys, int num_keys,
+                 size_t *bytes_in, size_t *bytes_out)
 {
-    int success = 1;
     unsigned char *data = NULL;
     size_t file_size = read_in_file(filename, &data);
     if (file_size == -1)
-        return 0;
+        return EEA_ERR_IO;
 
+    size_t data_len = file_size;
+    if (compression)
+    {
+        unsigned char *frames = NULL;
+        STATS_START(compress_start);
+        int compressed = compress_data(data, file_size, &frames, &data_len);
+        STATS_STOP(STAT_COMPRESS, compress_start, file_size);
+        free(data);
+        if (compressed != EEA_OK)
+            return compressed;
+        data = frames;
+    }
+
+    // Mark the cipher text, so decryption knows to decompress it
+    const char *prefix = compression ? COMPRESSED_PREFIX : "";
     unsigned char *cipher_text = NULL;
-    size_t cipher_text_size = encrypt(data, file_size, &cipher_text, keys,
-                                      num_keys);
+    size_t cipher_text_size = encrypt_for_file(data, data_len, prefix,
+                                               &cipher_text, keys, num_keys);
+    free(data);
     if (cipher_text == NULL)
-        return 0;
+        return EEA_ERR_NO_MEMORY;
 
+    int ret = EEA_OK;
     char *output_file = get_output_filename(filename, 1);
+    if (output_file == NULL)
+        ret = EEA_ERR_NO_MEMORY;
+    else if (!save_to_file(output_file, cipher_text, cipher_text_size))
+        ret = EEA_ERR_IO;
 
-    if (!save_to_file(output_file, cipher_text, cipher_text_size))
-    {
-        fprintf(stderr, "%sError:%s Saving data to the file failed\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET]);
-        success = 0;
-    }
+    if (ret == EEA_OK && bytes_in != NULL)
+        *bytes_in = file_size;
+    if (ret == EEA_OK && bytes_out != NULL)
+        *bytes_out = cipher_text_size;
 
-    free(data);
     free(cipher_text);
     free(output_file);
-    return success;
+    return ret;
 }
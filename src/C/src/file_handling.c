@@ -1,5 +1,6 @@
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,6 +10,7 @@
 #include <unistd.h>
 
 #ifdef WIN32
+#include <io.h>
 #include <windows.h>
 #endif
 
@@ -16,6 +18,7 @@
 #include "decrypt.h"
 #include "file_handling.h"
 #include "globals.h"
+#include "stats.h"
 #include "utils.h"
 
 char *get_output_filename(const char *filename, int encrypting)
@@ -46,145 +49,6 @@ char *get_output_filename(const char *filename, int encrypting)
     return output_filename;
 }
 
-char *get_input_filename(int encrypting)
-{
-    char *input_filename = NULL;
-
-    printf("Enter the name of the file you would like to %s: ",
-           (encrypting) ? "encrypt" : "decrypt");
-    char *line = NULL;
-    size_t line_len = 0;
-    line_len = getline(&line, &line_len, stdin);
-    // Replace new line with null terminator
-    line[line_len - 1] = '\0';
-    line_len--;
-    if (!file_exists(line))
-    {
-        fprintf(stderr, "%sError:%s The file, \'%s\', does not exist\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET], line);
-        free(line);
-        return NULL;
-    }
-
-    if (!encrypting)
-    {
-        if (!is_of_filetype(line, EEA_FILE_EXTENTION))
-        {
-            fprintf(stderr,
-                    "%sError:%s The file needs to be a \'%s\' file "
-                    "in order to be decrypted\n",
-                    colors[COLOR_ERROR], colors[COLOR_RESET],
-                    EEA_FILE_EXTENTION);
-            free(line);
-            return NULL;
-        }
-    }
-
-    input_filename = strdup(line);
-    free(line);
-
-    return input_filename;
-}
-
-char *get_input_dir_name(int encrypting)
-{
-    char *input_dir = NULL;
-
-    printf("Enter the name of the directory you would like to %s: ",
-           (encrypting) ? "encrypt" : "decrypt");
-    char *line = NULL;
-    size_t line_len = 0;
-    line_len = getline(&line, &line_len, stdin);
-    // Replace new line with null terminator
-    line[line_len - 1] = '\0';
-    line_len--;
-
-    FILE_TYPE f_type = get_file_type(line);
-    if (f_type != FILE_TYPE_DIR)
-    {
-        fprintf(stderr, "%sError:%s The \'%s\', is not a directory\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET], line);
-        free(line);
-        return NULL;
-    }
-
-    input_dir = strdup(line);
-    free(line);
-    return input_dir;
-}
-
-char **load_keys_from_file(const char *filename, int *total_keys, size_t *len)
-{
-    if (filename == NULL)
-        return NULL;
-
-    // Make sure the file exists and it is a keys file
-    if (!file_exists(filename) || !is_of_filetype(filename, ".keys"))
-        return NULL;
-
-    unsigned char *encrypted_keys_string = NULL;
-    size_t file_size = read_in_file(filename, &encrypted_keys_string);
-    if (encrypted_keys_string == NULL)
-        return NULL;
-
-    char *keys_string = NULL;
-    size_t key_string_len = decrypt_keys(encrypted_keys_string, file_size,
-                                         &keys_string);
-    free(encrypted_keys_string);
-    if (keys_string == NULL)
-        return NULL;
-
-    size_t key_len = find_key_len(keys_string);
-    if (key_string_len < key_len)
-    {
-        fprintf(stderr,
-                "%sError:%s Failed to decrypt your keys.\n"
-                "Make sure the keys in this file are valid "
-                "and you entered the correct password\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET]);
-        free(keys_string);
-        return NULL;
-    }
-
-    int num_keys = (key_string_len / key_len);
-    size_t index = 0;
-    char **keys = malloc(sizeof(char *) * num_keys);
-    if (keys == NULL)
-        return NULL;
-
-    for (int k = 0; k < num_keys; k++)
-    {
-        char *key = malloc(key_len + 1);
-        if (key == NULL)
-        {
-            fprintf(stderr,
-                    "%sError:%s Mallocing memory for keys failed. "
-                    "Aborting...",
-                    colors[COLOR_ERROR], colors[COLOR_RESET]);
-            free(keys_string);
-            free_keys(keys, num_keys, NULL);
-            return NULL;
-        }
-        strncpy(key, &keys_string[index], key_len);
-        key[key_len] = '\0';
-        keys[k] = key;
-        index += key_len + 1;
-    }
-    free(keys_string);
-    *len = key_len;
-    *total_keys = num_keys;
-    if (!validate_keys((const char **) keys, num_keys))
-    {
-        fprintf(stderr,
-                "%sError:%s Invalid keys detected\n"
-                "Make sure you entered your password correctly\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET]);
-        free_keys(keys, num_keys, NULL);
-        return NULL;
-    }
-    return keys;
-}
-
 int file_exists(const char *filename)
 {
     return (access(filename, F_OK) == 0);
@@ -380,33 +244,133 @@ char *get_dir_contents(char *basePath)
     return files_list;
 }
 
+int walk_dir(const char *basePath, walk_callback_t callback, void *ctx)
+{
+    DIR *dir = opendir(basePath);
+    // Skip directories we are unable to read
+    if (!dir)
+        return 1;
+
+    int keep_walking = 1;
+    struct dirent *dp;
+    while (keep_walking && (dp = readdir(dir)) != NULL)
+    {
+        if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
+            continue;
+
+        size_t path_len = (strlen(basePath) + strlen(dp->d_name) + 2);
+        char path[path_len];
+        snprintf(path, path_len, "%s/%s", basePath, dp->d_name);
+
+        struct stat path_stat;
+        if (stat(path, &path_stat) == 0 && S_ISDIR(path_stat.st_mode))
+            keep_walking = walk_dir(path, callback, ctx);
+        else
+            keep_walking = callback(path, ctx);
+    }
+    closedir(dir);
+    return keep_walking;
+}
+
+/**
+ * @brief walk_dir() callback that stops the walk at the first file found
+ * @param[in] path Path to the file that was found
+ * @param[out] ctx Pointer to an int that is set once a file is found
+ * @return 0 to stop the walk
+ */
+static int found_file(const char *path, void *ctx)
+{
+    (void) path;
+    *(int *) ctx = 1;
+    return 0;
+}
+
+int dir_has_files(const char *basePath)
+{
+    int found = 0;
+    walk_dir(basePath, found_file, &found);
+    return found;
+}
+
+/**
+ * @brief Sync the directory a file is in, so a new name in it is on disk
+ * @param[in] filename The file
+ * @return If the directory was synced
+ */
+static int sync_parent_dir(const char *filename)
+{
+#ifdef WIN32
+    // Renames are written through on Windows
+    (void) filename;
+    return 1;
+#else
+    const char *slash = strrchr(filename, SLASH_CH);
+    // The root directory keeps its slash
+    size_t dir_len = (slash == NULL || slash == filename)
+                         ? 1
+                         : (size_t) (slash - filename);
+    char dir[dir_len + 1];
+    if (slash == NULL)
+        dir[0] = '.';
+    else
+        memcpy(dir, filename, dir_len);
+    dir[dir_len] = '\0';
+
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    int synced = (fsync(fd) == 0);
+    close(fd);
+    return synced;
+#endif
+}
+
 int save_to_file(const char *filename, unsigned char *data,
                  size_t bytes_to_write)
 {
     if (filename == NULL)
         return 0;
-    FILE *fout = fopen(filename, "wb");
+
+    size_t tmp_len = strlen(filename) + sizeof(PARTIAL_FILE_EXTENTION);
+    char tmp_path[tmp_len];
+    snprintf(tmp_path, tmp_len, "%s%s", filename, PARTIAL_FILE_EXTENTION);
+    FILE *fout = fopen(tmp_path, "wb");
     if (fout == NULL)
-    {
-        fprintf(stderr, "%sError:%s Failed to open the file \'%s\'\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET], filename);
         return 0;
-    }
 
-    fwrite(data, sizeof(data[0]), bytes_to_write, fout);
-    fclose(fout);
-    return 1;
+    STATS_START(write_start);
+    size_t written = fwrite(data, sizeof(data[0]), bytes_to_write, fout);
+    int success = (written == bytes_to_write && fflush(fout) == 0);
+#ifdef WIN32
+    if (success)
+        success = (_commit(_fileno(fout)) == 0);
+#else
+    if (success)
+        success = (fsync(fileno(fout)) == 0);
+#endif
+    if (fclose(fout) != 0)
+        success = 0;
+
+#ifdef WIN32
+    // rename() won't replace an existing file on Windows
+    if (success)
+        remove(filename);
+#endif
+    if (success)
+        success = (rename(tmp_path, filename) == 0
+                   && sync_parent_dir(filename));
+    STATS_STOP(STAT_WRITE, write_start, bytes_to_write);
+    if (!success)
+        remove(tmp_path);
+    return success;
 }
 
 size_t read_in_file(const char *filename, unsigned char **buffer)
 {
+    STATS_START(read_start);
     FILE *fin = fopen(filename, "rb");
     if (fin == NULL)
-    {
-        fprintf(stderr, "%sError:%s Failed to open the file \'%s\'\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET], filename);
         return -1;
-    }
 
     fseek(fin, 0, SEEK_END);
     size_t file_size = ftell(fin);
@@ -421,6 +385,7 @@ size_t read_in_file(const char *filename, unsigned char **buffer)
 
     size_t read_bytes = fread(*buffer, sizeof(unsigned char), file_size, fin);
     fclose(fin);
+    STATS_STOP(STAT_READ, read_start, read_bytes);
 
     return read_bytes;
 }
@@ -0,0 +1,390 @@
+#include <inttypes.h>
+#include <openssl/evp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "file_handling.h"
+#include "file_index.h"
+
+// v1 entries have no keyset, so an index from before it was added is
+// dropped and every file is encrypted once more
+static const char INDEX_HEADER[] = "# eea index v2\n";
+static const size_t HASH_BUFFER_SIZE = 64 * 1024;
+
+struct file_index
+{
+    char *path;
+    int use_hash;
+    // Fingerprint of the keys this run encrypts with
+    uint64_t keyset;
+    // Entries saved by the previous run, sorted by device and inode
+    index_entry_t *entries;
+    unsigned char *seen;
+    size_t num_entries;
+    // Entries for the files encrypted during this run
+    index_entry_t *updated;
+    size_t num_updated;
+    size_t max_updated;
+    pthread_mutex_t mutex;
+};
+
+/**
+ * @brief Compare function for sorting and searching the entries by
+ * device and inode
+ */
+static int compare_entries(const void *a, const void *b)
+{
+    const index_entry_t *x = a, *y = b;
+    if (x->dev != y->dev)
+        return x->dev < y->dev ? -1 : 1;
+    if (x->ino != y->ino)
+        return x->ino < y->ino ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Get the modified time of the file in nanoseconds
+ * @param[in] st The stat of the file
+ * @return The modified time in nanoseconds
+ */
+static int64_t get_mtime_ns(const struct stat *st)
+{
+#if defined(__APPLE__)
+    return (int64_t) st->st_mtimespec.tv_sec * 1000000000
+           + st->st_mtimespec.tv_nsec;
+#elif defined(WIN32)
+    return (int64_t) st->st_mtime * 1000000000;
+#else
+    return (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Mix the next 8 bytes into the hash
+ * @param[in] h The current hash
+ * @param[in] v The next 8 bytes
+ * @return The new hash
+ */
+static uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+    h ^= v * 0x9E3779B97F4A7C15ULL;
+    h = (h << 31) | (h >> 33);
+    return h * 0xC2B2AE3D27D4EB4FULL;
+}
+
+/**
+ * @brief Quickly hash the contents of a file. This is only used to tell
+ * if a file has changed, it is not a cryptographic hash.
+ * @param[in] path The file to hash
+ * @param[out] hash The hash of the file
+ * @return If the file was hashed
+ */
+static int hash_file(const char *path, uint64_t *hash)
+{
+    FILE *fin = fopen(path, "rb");
+    if (fin == NULL)
+        return 0;
+
+    unsigned char *buffer = malloc(HASH_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        fclose(fin);
+        return 0;
+    }
+
+    uint64_t h = 0xCBF29CE484222325ULL;
+    size_t total = 0, nread;
+    while ((nread = fread(buffer, 1, HASH_BUFFER_SIZE, fin)) > 0)
+    {
+        size_t x = 0;
+        for (; x + sizeof(uint64_t) <= nread; x += sizeof(uint64_t))
+        {
+            uint64_t v;
+            memcpy(&v, &buffer[x], sizeof(v));
+            h = hash_mix(h, v);
+        }
+        // Only the last read can have bytes left over
+        if (x < nread)
+        {
+            uint64_t v = 0;
+            memcpy(&v, &buffer[x], nread - x);
+            h = hash_mix(h, v);
+        }
+        total += nread;
+    }
+    free(buffer);
+    fclose(fin);
+
+    *hash = hash_mix(h, total);
+    return 1;
+}
+
+/**
+ * @brief Fingerprint a set of keys, so an output can be matched to the
+ * keys it was encrypted with. Only 64 bits of a SHA-256 are kept, which
+ * tells nothing useful about the keys.
+ * @param[in] keys The keys
+ * @param[in] num_keys The number of keys
+ * @return The fingerprint, 0 if it could not be computed
+ */
+static uint64_t keyset_fingerprint(const char **keys, int num_keys)
+{
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (ctx == NULL)
+        return 0;
+
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int md_len = 0;
+    int hashed = EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+    for (int k = 0; hashed && k < num_keys; k++)
+        hashed = (EVP_DigestUpdate(ctx, keys[k], strlen(keys[k]))
+                  && EVP_DigestUpdate(ctx, "\n", 1));
+    if (hashed)
+        hashed = EVP_DigestFinal_ex(ctx, md, &md_len);
+    EVP_MD_CTX_free(ctx);
+
+    uint64_t fingerprint = 0;
+    if (hashed && md_len >= sizeof(fingerprint))
+        memcpy(&fingerprint, md, sizeof(fingerprint));
+    return fingerprint;
+}
+
+/**
+ * @brief Read in the entries saved by the previous run
+ * @param[in] index The index to load the entries into
+ */
+static void load_entries(file_index_t *index)
+{
+    FILE *fin = fopen(index->path, "r");
+    if (fin == NULL)
+        return;
+
+    size_t max = 0;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t nread = getline(&line, &len, fin);
+    if (nread == -1 || strcmp(line, INDEX_HEADER) != 0)
+        nread = -1;
+    while (nread != -1 && (nread = getline(&line, &len, fin)) != -1)
+    {
+        if (line[0] == '#' || line[nread - 1] != '\n')
+            continue;
+        line[nread - 1] = '\0';
+
+        index_entry_t entry;
+        int offset = 0;
+        if (sscanf(line, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNd64
+                         " %" SCNx64 " %" SCNx64 " %n",
+                   &entry.dev, &entry.ino, &entry.size, &entry.mtime_ns,
+                   &entry.hash, &entry.keyset, &offset)
+                != 6
+            || offset == 0)
+            continue;
+
+        if (index->num_entries == max)
+        {
+            size_t new_max = max ? max * 2 : 64;
+            index_entry_t *tmp = realloc(index->entries,
+                                         sizeof(index_entry_t) * new_max);
+            if (tmp == NULL)
+                break;
+            index->entries = tmp;
+            max = new_max;
+        }
+        entry.output = strdup(line + offset);
+        if (entry.output == NULL)
+            break;
+        index->entries[index->num_entries++] = entry;
+    }
+    free(line);
+    fclose(fin);
+
+    qsort(index->entries, index->num_entries, sizeof(index_entry_t),
+          compare_entries);
+    index->seen = calloc(index->num_entries + 1, sizeof(unsigned char));
+}
+
+file_index_t *file_index_open(const char *dir_name, int use_hash,
+                              const char **keys, int num_keys)
+{
+    file_index_t *index = calloc(1, sizeof(file_index_t));
+    if (index == NULL)
+        return NULL;
+
+    size_t path_len = strlen(dir_name) + sizeof(INDEX_FILE) + 1;
+    index->path = malloc(path_len);
+    if (index->path == NULL)
+    {
+        free(index);
+        return NULL;
+    }
+    snprintf(index->path, path_len, "%s/%s", dir_name, INDEX_FILE);
+    index->use_hash = use_hash;
+    index->keyset = keyset_fingerprint(keys, num_keys);
+
+    load_entries(index);
+    if (index->seen == NULL)
+        index->num_entries = 0;
+
+    pthread_mutex_init(&index->mutex, NULL);
+    return index;
+}
+
+int file_index_unchanged(file_index_t *index, const char *path,
+                         index_entry_t *current)
+{
+    memset(current, 0, sizeof(index_entry_t));
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+
+    current->dev = (uint64_t) st.st_dev;
+    current->ino = (uint64_t) st.st_ino;
+    current->size = (uint64_t) st.st_size;
+    current->mtime_ns = get_mtime_ns(&st);
+    current->keyset = index->keyset;
+
+    // Files hard linked together share an entry, so its time is read and
+    // written with the mutex held
+    index_entry_t *prev = NULL;
+    int64_t prev_mtime_ns = 0;
+    if (index->num_entries > 0)
+        prev = bsearch(current, index->entries, index->num_entries,
+                       sizeof(index_entry_t), compare_entries);
+    if (prev != NULL)
+    {
+        pthread_mutex_lock(&index->mutex);
+        prev_mtime_ns = prev->mtime_ns;
+        pthread_mutex_unlock(&index->mutex);
+    }
+    if (prev == NULL || prev->size != current->size
+        || prev->keyset != current->keyset || current->keyset == 0
+        || !file_exists(prev->output))
+    {
+        if (index->use_hash)
+            hash_file(path, &current->hash);
+        return 0;
+    }
+
+    if (index->use_hash)
+    {
+        // Only read the file in if the size and time don't already tell
+        // us it's unchanged
+        if (prev_mtime_ns == current->mtime_ns)
+            current->hash = prev->hash;
+        else if (!hash_file(path, &current->hash))
+            return 0;
+        if (current->hash != prev->hash)
+            return 0;
+    }
+    else if (prev_mtime_ns != current->mtime_ns)
+        return 0;
+
+    pthread_mutex_lock(&index->mutex);
+    index->seen[prev - index->entries] = 1;
+    // A touched file keeps its entry, but with the new time, so it
+    // doesn't need to be hashed again next time
+    prev->mtime_ns = current->mtime_ns;
+    pthread_mutex_unlock(&index->mutex);
+    return 1;
+}
+
+void file_index_update(file_index_t *index, const index_entry_t *current,
+                       const char *output)
+{
+    char *saved_output = strdup(output);
+    if (saved_output == NULL)
+        return;
+
+    pthread_mutex_lock(&index->mutex);
+    if (index->num_updated == index->max_updated)
+    {
+        size_t new_max = index->max_updated ? index->max_updated * 2 : 64;
+        index_entry_t *tmp = realloc(index->updated,
+                                     sizeof(index_entry_t) * new_max);
+        if (tmp == NULL)
+        {
+            pthread_mutex_unlock(&index->mutex);
+            free(saved_output);
+            return;
+        }
+        index->updated = tmp;
+        index->max_updated = new_max;
+    }
+    index_entry_t *entry = &index->updated[index->num_updated++];
+    *entry = *current;
+    entry->output = saved_output;
+    pthread_mutex_unlock(&index->mutex);
+}
+
+/**
+ * @brief Write a single entry to the index file
+ * @param[in] fout The index file
+ * @param[in] entry The entry to write
+ */
+static void write_entry(FILE *fout, const index_entry_t *entry)
+{
+    fprintf(fout,
+            "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64 " %016" PRIx64
+            " %016" PRIx64 " %s\n",
+            entry->dev, entry->ino, entry->size, entry->mtime_ns, entry->hash,
+            entry->keyset, entry->output);
+}
+
+/**
+ * @brief Write the index to disk, replacing the previous one
+ * @param[in] index The index to save
+ * @return If the index was saved
+ */
+static int save_index(file_index_t *index)
+{
+    size_t tmp_len = strlen(index->path) + 5;
+    char tmp_path[tmp_len];
+    snprintf(tmp_path, tmp_len, "%s.tmp", index->path);
+
+    FILE *fout = fopen(tmp_path, "w");
+    if (fout == NULL)
+        return 0;
+
+    fputs(INDEX_HEADER, fout);
+    for (size_t e = 0; e < index->num_entries; e++)
+        if (index->seen[e])
+            write_entry(fout, &index->entries[e]);
+    for (size_t e = 0; e < index->num_updated; e++)
+        write_entry(fout, &index->updated[e]);
+
+    int success = (fclose(fout) == 0);
+#ifdef WIN32
+    // rename() won't replace an existing file on Windows
+    if (success)
+        remove(index->path);
+#endif
+    if (success)
+        success = (rename(tmp_path, index->path) == 0);
+    if (!success)
+        remove(tmp_path);
+    return success;
+}
+
+void file_index_close(file_index_t *index, int save)
+{
+    if (index == NULL)
+        return;
+
+    if (save)
+        save_index(index);
+
+    for (size_t e = 0; e < index->num_entries; e++)
+        free(index->entries[e].output);
+    for (size_t e = 0; e < index->num_updated; e++)
+        free(index->updated[e].output);
+    free(index->entries);
+    free(index->seen);
+    free(index->updated);
+    free(index->path);
+    pthread_mutex_destroy(&index->mutex);
+    free(index);
+}
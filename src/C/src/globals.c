@@ -1,2 +1,13 @@
 #include "globals.h"
+char *keys_dir = NULL;
+int incremental_index = 0;
+int index_content_hash = 0;
+int output_mode = 0;
+int stats_enabled = 0;
+char *trace_file = NULL;
+int xor_kernel = 0;
+size_t chunk_size = 0;
+int compression = 0;
+int checksums = 0;
+int default_threads = 1;
 char *colors[] = { "\x1B[0m", "\x1B[32m", "\x1B[33m", "\x1B[31m" };
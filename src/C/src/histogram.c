@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+
+#define SUB_COUNT ((uint64_t) 1 << HISTOGRAM_SUB_BITS)
+
+/**
+ * @brief Get the bucket a value is recorded in
+ * @param[in] value The value
+ * @return The index of the bucket
+ */
+static int bucket_index(uint64_t value)
+{
+    // Values that fit in the first two sets of sub buckets are exact
+    if (value < (SUB_COUNT << 1))
+        return (int) value;
+
+    // Otherwise keep the top HISTOGRAM_SUB_BITS + 1 bits of the value
+    int shift = (63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS;
+    return (int) (((uint64_t) (shift + 1) << HISTOGRAM_SUB_BITS) +
+                  ((value >> shift) - SUB_COUNT));
+}
+
+/**
+ * @brief Get the largest value that is recorded in a bucket
+ * @param[in] index The index of the bucket
+ * @return The largest value in the bucket
+ */
+static uint64_t bucket_highest(int index)
+{
+    if ((uint64_t) index < (SUB_COUNT << 1))
+        return index;
+
+    int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = (index & (SUB_COUNT - 1)) + SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+histogram_t *histogram_create(void)
+{
+    histogram_t *hist = malloc(sizeof(histogram_t));
+    if (hist != NULL)
+        histogram_reset(hist);
+    return hist;
+}
+
+void histogram_free(histogram_t *hist)
+{
+    free(hist);
+}
+
+void histogram_reset(histogram_t *hist)
+{
+    memset(hist, 0, sizeof(histogram_t));
+    hist->min = UINT64_MAX;
+}
+
+void histogram_record(histogram_t *hist, uint64_t value)
+{
+    hist->counts[bucket_index(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+uint64_t histogram_percentile(const histogram_t *hist, double percentile)
+{
+    if (hist->total == 0)
+        return 0;
+    if (percentile >= 100)
+        return hist->max;
+
+    // The number of values at or below the percentile, at least one
+    uint64_t target = (uint64_t) (percentile / 100 * hist->total + 0.5);
+    if (target < 1)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+    {
+        seen += hist->counts[b];
+        if (seen >= target)
+        {
+            uint64_t value = bucket_highest(b);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+double histogram_mean(const histogram_t *hist)
+{
+    return hist->total ? hist->sum / hist->total : 0;
+}
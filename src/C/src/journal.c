@@ -0,0 +1,348 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "file_handling.h"
+#include "globals.h"
+#include "journal.h"
+
+// Sync the journal after this many commits, or this many seconds,
+// whichever comes first
+static const size_t JOURNAL_SYNC_BATCH = 64;
+static const time_t JOURNAL_SYNC_SECONDS = 1;
+
+static const char JOURNAL_HEADER_ENCRYPT[] = "# eea journal: encrypt\n";
+static const char JOURNAL_HEADER_DECRYPT[] = "# eea journal: decrypt\n";
+
+struct journal
+{
+    FILE *file;
+    char *path;
+    int encrypting;
+    int overwrite;
+    int resumed;
+    // Sorted lists of the files committed by a previous run of the job,
+    // and of every file it recorded, whatever state it got to
+    char **committed;
+    size_t num_committed;
+    char **recorded;
+    size_t num_recorded;
+    // Files waiting on the next sync before they can be removed
+    char **pending_removal;
+    size_t num_pending;
+    size_t max_pending;
+    size_t unsynced;
+    time_t last_sync;
+    pthread_mutex_t mutex;
+};
+
+/**
+ * @brief Compare function for sorting and searching the committed files
+ */
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+char *get_journal_path(const char *dir_name)
+{
+    size_t path_len = strlen(dir_name) + sizeof(JOURNAL_FILE) + 1;
+    char *path = malloc(path_len);
+    if (path == NULL)
+        return NULL;
+
+    // Built the same way walk_dir() builds paths, so the walk can
+    // recognise the journal and skip it
+    snprintf(path, path_len, "%s/%s", dir_name, JOURNAL_FILE);
+    return path;
+}
+
+int journal_exists(const char *dir_name, int encrypting)
+{
+    char *path = get_journal_path(dir_name);
+    if (path == NULL)
+        return 0;
+
+    FILE *fin = fopen(path, "r");
+    free(path);
+    if (fin == NULL)
+        return 0;
+
+    const char *header = encrypting ? JOURNAL_HEADER_ENCRYPT
+                                    : JOURNAL_HEADER_DECRYPT;
+    char line[sizeof(JOURNAL_HEADER_ENCRYPT) + 1] = { 0 };
+    int same_job = (fgets(line, sizeof(line), fin) != NULL
+                    && strcmp(line, header) == 0);
+    fclose(fin);
+    return same_job;
+}
+
+/**
+ * @brief Add a path to a list of paths, growing it as needed
+ * @param[in,out] list The list
+ * @param[in,out] count The number of paths in the list
+ * @param[in,out] max The number of paths there is room for
+ * @param[in] path The path to add
+ * @return If the path was added
+ */
+static int add_path(char ***list, size_t *count, size_t *max,
+                    const char *path)
+{
+    if (*count == *max)
+    {
+        size_t new_max = *max ? *max * 2 : 64;
+        char **tmp = realloc(*list, sizeof(char *) * new_max);
+        if (tmp == NULL)
+            return 0;
+        *list = tmp;
+        *max = new_max;
+    }
+    char *copy = strdup(path);
+    if (copy == NULL)
+        return 0;
+    (*list)[(*count)++] = copy;
+    return 1;
+}
+
+/**
+ * @brief Read in the files recorded, and the files committed, by a
+ * previous run of the job
+ * @param[in] journal The journal to load the files into
+ * @return If the journal was loaded
+ */
+static int load_committed(journal_t *journal)
+{
+    FILE *fin = fopen(journal->path, "r");
+    if (fin == NULL)
+        return 0;
+
+    size_t max_committed = 0, max_recorded = 0;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t nread;
+    int loaded = 1;
+    while (loaded && (nread = getline(&line, &len, fin)) != -1)
+    {
+        // A record without a new line was cut off when the job was
+        // interrupted, so it can't be trusted
+        if (nread < 3 || line[nread - 1] != '\n' || line[1] != ' ')
+            continue;
+        line[nread - 1] = '\0';
+
+        if (line[0] == JOURNAL_COMMITTED)
+            loaded = add_path(&journal->committed, &journal->num_committed,
+                              &max_committed, line + 2);
+        else if (line[0] == JOURNAL_QUEUED
+                 || line[0] == JOURNAL_IN_PROGRESS)
+            loaded = add_path(&journal->recorded, &journal->num_recorded,
+                              &max_recorded, line + 2);
+    }
+    free(line);
+    fclose(fin);
+    if (!loaded)
+        return 0;
+
+    qsort(journal->committed, journal->num_committed, sizeof(char *),
+          compare_paths);
+    qsort(journal->recorded, journal->num_recorded, sizeof(char *),
+          compare_paths);
+    return 1;
+}
+
+journal_t *journal_open(const char *dir_name, int encrypting, int overwrite,
+                        int resume)
+{
+    journal_t *journal = calloc(1, sizeof(journal_t));
+    if (journal == NULL)
+        return NULL;
+
+    journal->path = get_journal_path(dir_name);
+    if (journal->path == NULL)
+    {
+        free(journal);
+        return NULL;
+    }
+    journal->encrypting = encrypting;
+    journal->overwrite = overwrite;
+
+    if (resume && !load_committed(journal))
+        resume = 0;
+    journal->resumed = resume;
+
+    journal->file = fopen(journal->path, resume ? "a" : "w");
+    if (journal->file == NULL)
+    {
+        journal_close(journal, 0);
+        return NULL;
+    }
+    if (!resume)
+        fputs(encrypting ? JOURNAL_HEADER_ENCRYPT : JOURNAL_HEADER_DECRYPT,
+              journal->file);
+
+    journal->last_sync = time(NULL);
+    pthread_mutex_init(&journal->mutex, NULL);
+    return journal;
+}
+
+/**
+ * @brief Check if a path is in a sorted list of paths
+ * @param[in] list The list
+ * @param[in] count The number of paths in the list
+ * @param[in] path The path to look for
+ * @return If the path is in the list
+ */
+static int has_path(char **list, size_t count, const char *path)
+{
+    if (count == 0)
+        return 0;
+    return bsearch(&path, list, count, sizeof(char *), compare_paths)
+           != NULL;
+}
+
+int journal_should_skip(journal_t *journal, const char *path)
+{
+    if (journal == NULL)
+        return 0;
+
+    if (strcmp(path, journal->path) == 0)
+        return 1;
+
+    if (has_path(journal->committed, journal->num_committed, path))
+    {
+        // The job was interrupted after the file was committed, and its
+        // commit synced, but before it was removed
+        if (journal->overwrite)
+            remove(path);
+        return JOURNAL_COMMITTED;
+    }
+
+    // Don't encrypt the output of the interrupted run a second time. An
+    // output is only saved under its name once it is whole, so one whose
+    // input wasn't committed is replaced when the input is encrypted again.
+    if (journal->resumed && journal->encrypting
+        && is_of_filetype(path, EEA_FILE_EXTENTION))
+    {
+        char *input = get_output_filename(path, 0);
+        int is_output = (input != NULL
+                         && (has_path(journal->committed,
+                                      journal->num_committed, input)
+                             || has_path(journal->recorded,
+                                         journal->num_recorded, input)));
+        free(input);
+        return is_output;
+    }
+    return 0;
+}
+
+/**
+ * @brief Flush the journal to disk and remove the files that were waiting
+ * on it
+ * @param[in] journal The journal to sync
+ * @note Must be called with the journal's mutex held
+ */
+static void journal_sync(journal_t *journal)
+{
+    fflush(journal->file);
+#ifdef WIN32
+    _commit(_fileno(journal->file));
+#else
+    fsync(fileno(journal->file));
+#endif
+
+    for (size_t p = 0; p < journal->num_pending; p++)
+    {
+        remove(journal->pending_removal[p]);
+        free(journal->pending_removal[p]);
+    }
+    journal->num_pending = 0;
+    journal->unsynced = 0;
+    journal->last_sync = time(NULL);
+}
+
+void journal_record(journal_t *journal, const char *path, JournalState state)
+{
+    if (journal == NULL)
+        return;
+
+    pthread_mutex_lock(&journal->mutex);
+    fprintf(journal->file, "%c %s\n", (char) state, path);
+    pthread_mutex_unlock(&journal->mutex);
+}
+
+void journal_commit(journal_t *journal, const char *path)
+{
+    if (journal == NULL)
+        return;
+
+    pthread_mutex_lock(&journal->mutex);
+    fprintf(journal->file, "%c %s\n", (char) JOURNAL_COMMITTED, path);
+    journal->unsynced++;
+
+    if (journal->overwrite)
+    {
+        if (journal->num_pending == journal->max_pending)
+        {
+            size_t new_max = journal->max_pending ? journal->max_pending * 2
+                                                  : JOURNAL_SYNC_BATCH;
+            char **tmp = realloc(journal->pending_removal,
+                                 sizeof(char *) * new_max);
+            if (tmp != NULL)
+            {
+                journal->pending_removal = tmp;
+                journal->max_pending = new_max;
+            }
+        }
+
+        char *pending = NULL;
+        if (journal->num_pending < journal->max_pending)
+            pending = strdup(path);
+        if (pending != NULL)
+            journal->pending_removal[journal->num_pending++] = pending;
+        else
+        {
+            // No room to wait on the next sync, so sync right away
+            journal_sync(journal);
+            remove(path);
+        }
+    }
+
+    if (journal->unsynced >= JOURNAL_SYNC_BATCH
+        || time(NULL) - journal->last_sync >= JOURNAL_SYNC_SECONDS)
+        journal_sync(journal);
+    pthread_mutex_unlock(&journal->mutex);
+}
+
+void journal_close(journal_t *journal, int finished)
+{
+    if (journal == NULL)
+        return;
+
+    if (journal->file != NULL)
+    {
+        pthread_mutex_lock(&journal->mutex);
+        journal_sync(journal);
+        pthread_mutex_unlock(&journal->mutex);
+        pthread_mutex_destroy(&journal->mutex);
+        fclose(journal->file);
+        if (finished)
+            remove(journal->path);
+    }
+
+    for (size_t c = 0; c < journal->num_committed; c++)
+        free(journal->committed[c]);
+    free(journal->committed);
+    for (size_t r = 0; r < journal->num_recorded; r++)
+        free(journal->recorded[r]);
+    free(journal->recorded);
+    free(journal->pending_removal);
+    free(journal->path);
+    free(journal);
+}
@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernels.h"
+
+/**
+ * @brief XOR one block into another, a word at a time
+ * @param[in,out] dst The block to XOR into
+ * @param[in] src The block to XOR with, which must not overlap dst
+ * @param[in] len The length of the blocks
+ */
+static void xor_block(unsigned char *restrict dst,
+                      const unsigned char *restrict src, size_t len)
+{
+    size_t x = 0;
+    for (; x + sizeof(uint64_t) <= len; x += sizeof(uint64_t))
+    {
+        uint64_t a, b;
+        memcpy(&a, dst + x, sizeof(a));
+        memcpy(&b, src + x, sizeof(b));
+        a ^= b;
+        memcpy(dst + x, &a, sizeof(a));
+    }
+    for (; x < len; x++)
+        dst[x] ^= src[x];
+}
+
+/**
+ * @brief Get the size of the chunks to take through the keys
+ * @param[in] chunk The size asked for, 0 for the whole buffer
+ * @param[in] len The length of the buffer
+ * @param[in] key_len The length of each key
+ * @return The size of the chunks, a multiple of key_len
+ */
+static size_t chunk_len(size_t chunk, size_t len, size_t key_len)
+{
+    if (chunk == 0 || chunk >= len)
+        return len;
+    chunk -= chunk % key_len;
+    return chunk < key_len ? key_len : chunk;
+}
+
+int xor_kernel_from_name(const char *name)
+{
+    for (int k = 0; k < NUM_XOR_KERNELS; k++)
+        if (strcmp(name, XOR_KERNEL_NAMES[k]) == 0)
+            return k;
+    return -1;
+}
+
+void xor_encrypt_chained(unsigned char *buf, size_t len, unsigned char *tails,
+                         int num_keys, size_t key_len, size_t chunk)
+{
+    // Each block is XORed with the block before it, as it was after the
+    // same round. The block before each chunk is kept in the tails.
+    chunk = chunk_len(chunk, len, key_len);
+    for (size_t start = 0; start < len; start += chunk)
+    {
+        size_t end = (len - start > chunk) ? start + chunk : len;
+        for (int k = 0; k < num_keys; k++)
+        {
+            unsigned char *tail = tails + k * key_len;
+            xor_block(buf + start, tail, key_len);
+            for (size_t b = start + key_len; b < end; b += key_len)
+                xor_block(buf + b, buf + b - key_len, key_len);
+            memcpy(tail, buf + end - key_len, key_len);
+        }
+    }
+}
+
+void xor_decrypt_chained(unsigned char *buf, size_t len, unsigned char *tails,
+                         int num_keys, size_t key_len, size_t chunk)
+{
+    // Each block is XORed with the block before it, as it was before the
+    // same round, so the blocks are done from last to first. The block
+    // before each chunk is kept in the tails.
+    unsigned char saved[key_len];
+    chunk = chunk_len(chunk, len, key_len);
+    for (size_t start = 0; start < len; start += chunk)
+    {
+        size_t end = (len - start > chunk) ? start + chunk : len;
+        for (int k = num_keys - 1; k >= 0; k--)
+        {
+            unsigned char *tail = tails + k * key_len;
+            memcpy(saved, buf + end - key_len, key_len);
+            for (size_t b = end - key_len; b > start; b -= key_len)
+                xor_block(buf + b, buf + b - key_len, key_len);
+            xor_block(buf + start, tail, key_len);
+            memcpy(tail, saved, key_len);
+        }
+    }
+}
+
+unsigned char *xor_tails_from_keys(const char **keys, int num_keys,
+                                   size_t key_len)
+{
+    // The first block is XORed with the key
+    unsigned char *tails = malloc(num_keys * key_len);
+    if (tails == NULL)
+        return NULL;
+    for (int k = 0; k < num_keys; k++)
+        memcpy(tails + k * key_len, keys[k], key_len);
+    return tails;
+}
+
+int xor_encrypt_blocked(unsigned char *buf, size_t len, const char **keys,
+                        int num_keys, size_t key_len, size_t chunk)
+{
+    unsigned char *tails = xor_tails_from_keys(keys, num_keys, key_len);
+    if (tails == NULL)
+        return 1;
+    xor_encrypt_chained(buf, len, tails, num_keys, key_len, chunk);
+    free(tails);
+    return 0;
+}
+
+int xor_decrypt_blocked(unsigned char *buf, size_t len, const char **keys,
+                        int num_keys, size_t key_len, size_t chunk)
+{
+    unsigned char *tails = xor_tails_from_keys(keys, num_keys, key_len);
+    if (tails == NULL)
+        return 1;
+    xor_decrypt_chained(buf, len, tails, num_keys, key_len, chunk);
+    free(tails);
+    return 0;
+}
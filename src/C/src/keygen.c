@@ -100,7 +100,7 @@ char **generate_keys(size_t hash_size, int num_keys)
         if (keys[x] == NULL)
         {
             for (int i = x - 1; i >= 0; i--)
-                free(keys[x]);
+                free(keys[i]);
             free(keys);
             return NULL;
         }
@@ -108,3 +108,15 @@ char **generate_keys(size_t hash_size, int num_keys)
 
     return keys;
 }
+
+char *hash_password(const char *password)
+{
+    char *password_hash = malloc((SHA512_DIGEST_LENGTH * 2) + 1);
+    if (password_hash == NULL)
+        return NULL;
+
+    unsigned char md[SHA512_DIGEST_LENGTH];
+    SHA512((const unsigned char *) password, strlen(password), md);
+    message_digest_to_hash(md, password_hash, SHA512_DIGEST_LENGTH);
+    return password_hash;
+}
@@ -3,13 +3,33 @@
 #include <string.h>
 
 #include "app_functions.h"
+#include "cli.h"
 #include "config.h"
+#include "globals.h"
 #include "menu.h"
 
-char *keys_dir = NULL;
 int main(int argc, char **argv)
 {
-    load_config();
+    if (argc >= 2 && is_command(argv[1]))
+        return run_command(argc - 1, &argv[1]);
+
+    load_config(1);
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--stats") == 0)
+            stats_enabled = 1;
+        else if (strcmp(argv[a], "--trace") == 0 && a + 1 < argc)
+        {
+            free(trace_file);
+            trace_file = strdup(argv[++a]);
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
     while (1)
     {
         print_main_menu();
@@ -26,6 +46,7 @@ int main(int argc, char **argv)
             free(line);
             if (keys_dir != NULL)
                 free(keys_dir);
+            free(trace_file);
             return 0;
         }
 
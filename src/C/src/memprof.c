@@ -0,0 +1,494 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "memprof.h"
+#include "utils.h"
+
+// This file needs the real allocator
+#undef malloc
+#undef calloc
+#undef realloc
+#undef strdup
+#undef free
+
+#ifdef EEA_MEMPROF
+static const int MEMPROF_ENABLED = 1;
+#else
+static const int MEMPROF_ENABLED = 0;
+#endif
+
+// Enough for every allocation in the sources, with room to spare
+#define MAX_SITES 512
+#define NUM_SHARDS 64
+#define BUCKETS_PER_SHARD 1024
+
+/**
+ * @struct site_t
+ * @brief The allocations made from a single call site during the job
+ */
+typedef struct
+{
+    const char *file;
+    int line;
+    uint64_t allocs;
+    uint64_t bytes;
+} site_t;
+
+/**
+ * @struct thread_rec_t
+ * @brief The allocations made by a single thread during the job. Records
+ * are never freed, and only reused once nothing they allocated is live.
+ */
+typedef struct thread_rec
+{
+    const char *name;
+    int id;
+    // The job the record is for, and the thread that it belongs to
+    atomic_uint job;
+    const void *thread;
+    // Bytes allocated by the thread that haven't been freed yet, by any
+    // thread
+    atomic_int_fast64_t live;
+    // Only written by the thread itself
+    int64_t peak;
+    uint64_t allocs;
+    uint64_t bytes;
+    struct thread_rec *next;
+} thread_rec_t;
+
+/**
+ * @struct alloc_entry_t
+ * @brief A live allocation
+ */
+typedef struct alloc_entry
+{
+    void *ptr;
+    size_t size;
+    thread_rec_t *owner;
+    struct alloc_entry *next;
+} alloc_entry_t;
+
+/**
+ * @struct alloc_shard_t
+ * @brief A slice of the live allocations. They are split up by address so
+ * threads rarely wait on each other.
+ */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    alloc_entry_t *buckets[BUCKETS_PER_SHARD];
+} alloc_shard_t;
+
+static site_t sites[MAX_SITES];
+static int dropped_sites = 0;
+static pthread_mutex_t sites_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static alloc_shard_t shards[NUM_SHARDS];
+static pthread_once_t shards_once = PTHREAD_ONCE_INIT;
+
+static thread_rec_t *threads = NULL;
+static int next_id = 1;
+static atomic_uint job_id = 1;
+static uint64_t job_start_ns = 0;
+static pthread_mutex_t threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_int_fast64_t heap_live = 0;
+static atomic_int_fast64_t heap_peak = 0;
+
+static _Thread_local thread_rec_t *local_rec = NULL;
+// Its address is unique to each running thread
+static _Thread_local char thread_token;
+
+/**
+ * @brief Set up the locks of the shards
+ */
+static void init_shards(void)
+{
+    for (int s = 0; s < NUM_SHARDS; s++)
+        pthread_mutex_init(&shards[s].mutex, NULL);
+}
+
+/**
+ * @brief Get the bucket an allocation is in
+ * @param[in] ptr The allocation
+ * @param[out] shard The shard the bucket is in
+ * @return The head of the bucket
+ */
+static alloc_entry_t **get_bucket(const void *ptr, alloc_shard_t **shard)
+{
+    // Allocations are at least 16 byte aligned, so skip the bits that
+    // are always zero
+    uintptr_t hash = ((uintptr_t) ptr >> 4) * 0x9E3779B97F4A7C15ULL;
+    *shard = &shards[(hash >> 58) % NUM_SHARDS];
+    return &(*shard)->buckets[(hash >> 32) % BUCKETS_PER_SHARD];
+}
+
+/**
+ * @brief Get the calling thread's record for the current job, registering
+ * the thread if this is its first allocation of the job
+ * @return The record, NULL if allocating it failed
+ */
+static thread_rec_t *get_thread_rec(void)
+{
+    // The record may have been reused by another thread since this thread
+    // last used it
+    if (local_rec != NULL && local_rec->thread == &thread_token &&
+        atomic_load(&local_rec->job) == job_id)
+        return local_rec;
+
+    pthread_mutex_lock(&threads_mutex);
+    // Reuse the record of a thread from an older job, once nothing it
+    // allocated is still live
+    thread_rec_t *rec = threads;
+    while (rec != NULL &&
+           (atomic_load(&rec->job) == job_id || atomic_load(&rec->live)))
+        rec = rec->next;
+    if (rec == NULL)
+    {
+        rec = calloc(1, sizeof(thread_rec_t));
+        if (rec == NULL)
+        {
+            pthread_mutex_unlock(&threads_mutex);
+            return NULL;
+        }
+        rec->next = threads;
+        threads = rec;
+    }
+    rec->name = NULL;
+    rec->id = next_id++;
+    rec->thread = &thread_token;
+    atomic_store(&rec->job, job_id);
+    rec->peak = 0;
+    rec->allocs = 0;
+    rec->bytes = 0;
+    pthread_mutex_unlock(&threads_mutex);
+
+    // The thread's record from the last job keeps the bytes it had live,
+    // so they are freed against it
+    local_rec = rec;
+    return rec;
+}
+
+/**
+ * @brief Add an allocation to the counts of its call site
+ * @param[in] file The file of the call site
+ * @param[in] line The line of the call site
+ * @param[in] size The size of the allocation
+ */
+static void count_site(const char *file, int line, size_t size)
+{
+    size_t hash = (size_t) line * 31;
+    for (const char *c = file; *c != '\0'; c++)
+        hash = hash * 31 + (unsigned char) *c;
+
+    pthread_mutex_lock(&sites_mutex);
+    for (int probe = 0; probe < MAX_SITES; probe++)
+    {
+        site_t *site = &sites[(hash + probe) % MAX_SITES];
+        if (site->file == NULL)
+        {
+            site->file = file;
+            site->line = line;
+        }
+        else if (site->line != line || strcmp(site->file, file) != 0)
+            continue;
+
+        site->allocs++;
+        site->bytes += size;
+        pthread_mutex_unlock(&sites_mutex);
+        return;
+    }
+    dropped_sites = 1;
+    pthread_mutex_unlock(&sites_mutex);
+}
+
+/**
+ * @brief Add an allocation's entry to its bucket
+ * @param[in] entry The entry of the allocation
+ */
+static void attach(alloc_entry_t *entry)
+{
+    alloc_shard_t *shard = NULL;
+    alloc_entry_t **bucket = get_bucket(entry->ptr, &shard);
+    pthread_mutex_lock(&shard->mutex);
+    entry->next = *bucket;
+    *bucket = entry;
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+/**
+ * @brief Remove an allocation's entry from its bucket
+ * @param[in] ptr The allocation
+ * @return The entry of the allocation, NULL if it isn't tracked
+ */
+static alloc_entry_t *detach(const void *ptr)
+{
+    alloc_shard_t *shard = NULL;
+    alloc_entry_t **bucket = get_bucket(ptr, &shard);
+
+    pthread_mutex_lock(&shard->mutex);
+    alloc_entry_t *entry = *bucket, *prev = NULL;
+    while (entry != NULL && entry->ptr != ptr)
+    {
+        prev = entry;
+        entry = entry->next;
+    }
+    if (entry != NULL)
+    {
+        if (prev == NULL)
+            *bucket = entry->next;
+        else
+            prev->next = entry->next;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return entry;
+}
+
+/**
+ * @brief Remove a detached allocation from the live heap
+ * @param[in] entry The entry of the allocation, may be NULL
+ */
+static void release(alloc_entry_t *entry)
+{
+    if (entry == NULL)
+        return;
+    atomic_fetch_sub(&entry->owner->live, (int_fast64_t) entry->size);
+    atomic_fetch_sub(&heap_live, (int_fast64_t) entry->size);
+    free(entry);
+}
+
+/**
+ * @brief Add an allocation to the live heap, and the counts of its call
+ * site and thread
+ * @param[in] ptr The allocation
+ * @param[in] size The size of the allocation
+ * @param[in] file The file of the call site
+ * @param[in] line The line of the call site
+ */
+static void track(void *ptr, size_t size, const char *file, int line)
+{
+    count_site(file, line, size);
+    thread_rec_t *rec = get_thread_rec();
+    alloc_entry_t *entry = malloc(sizeof(alloc_entry_t));
+    if (rec == NULL || entry == NULL)
+    {
+        free(entry);
+        return;
+    }
+    entry->ptr = ptr;
+    entry->size = size;
+    entry->owner = rec;
+
+    // The address may have been freed by code that wasn't wrapped, such
+    // as a getline() that grew the buffer, so drop anything stale first
+    release(detach(ptr));
+    attach(entry);
+
+    rec->allocs++;
+    rec->bytes += size;
+    int64_t live = atomic_fetch_add(&rec->live, (int_fast64_t) size) +
+                   (int64_t) size;
+    if (live > rec->peak)
+        rec->peak = live;
+
+    int_fast64_t heap = atomic_fetch_add(&heap_live, (int_fast64_t) size) +
+                        (int_fast64_t) size;
+    int_fast64_t peak = atomic_load(&heap_peak);
+    while (heap > peak &&
+           !atomic_compare_exchange_weak(&heap_peak, &peak, heap))
+        ;
+}
+
+void *memprof_malloc(size_t size, const char *file, int line)
+{
+    pthread_once(&shards_once, init_shards);
+    void *ptr = malloc(size);
+    if (ptr != NULL)
+        track(ptr, size, file, line);
+    return ptr;
+}
+
+void *memprof_calloc(size_t num, size_t size, const char *file, int line)
+{
+    pthread_once(&shards_once, init_shards);
+    void *ptr = calloc(num, size);
+    if (ptr != NULL)
+        track(ptr, num * size, file, line);
+    return ptr;
+}
+
+void *memprof_realloc(void *ptr, size_t size, const char *file, int line)
+{
+    pthread_once(&shards_once, init_shards);
+    // The old memory can't be looked up once it has been resized
+    alloc_entry_t *entry = ptr != NULL ? detach(ptr) : NULL;
+    void *tmp = realloc(ptr, size);
+    if (tmp == NULL && size != 0)
+    {
+        if (entry != NULL)
+            attach(entry);
+        return NULL;
+    }
+
+    release(entry);
+    if (tmp != NULL)
+        track(tmp, size, file, line);
+    return tmp;
+}
+
+char *memprof_strdup(const char *str, const char *file, int line)
+{
+    pthread_once(&shards_once, init_shards);
+    char *copy = strdup(str);
+    if (copy != NULL)
+        track(copy, strlen(copy) + 1, file, line);
+    return copy;
+}
+
+void memprof_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    pthread_once(&shards_once, init_shards);
+    release(detach(ptr));
+    free(ptr);
+}
+
+void memprof_begin_job(void)
+{
+    if (!MEMPROF_ENABLED)
+        return;
+
+    pthread_mutex_lock(&sites_mutex);
+    for (int s = 0; s < MAX_SITES; s++)
+        sites[s].allocs = sites[s].bytes = 0;
+    pthread_mutex_unlock(&sites_mutex);
+
+    pthread_mutex_lock(&threads_mutex);
+    job_id++;
+    next_id = 1;
+    job_start_ns = get_time_ns();
+    atomic_store(&heap_peak, atomic_load(&heap_live));
+    pthread_mutex_unlock(&threads_mutex);
+    memprof_name_thread("main");
+}
+
+void memprof_name_thread(const char *name)
+{
+    if (!MEMPROF_ENABLED)
+        return;
+
+    thread_rec_t *rec = get_thread_rec();
+    if (rec != NULL)
+        rec->name = name;
+}
+
+/**
+ * @brief Find the record of a thread in the current job
+ * @param[in] id The id of the thread, in the order the threads started
+ * @return The record, NULL if there isn't one
+ * @note threads_mutex must be held
+ */
+static const thread_rec_t *find_thread_rec(int id)
+{
+    for (thread_rec_t *rec = threads; rec != NULL; rec = rec->next)
+        if (atomic_load(&rec->job) == job_id && rec->id == id)
+            return rec;
+    return NULL;
+}
+
+/**
+ * @brief Compare function for sorting the call sites by bytes, largest
+ * first
+ */
+static int compare_sites(const void *a, const void *b)
+{
+    const site_t *x = a, *y = b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+void memprof_end_job(int json)
+{
+    if (!MEMPROF_ENABLED)
+        return;
+
+    pthread_mutex_lock(&sites_mutex);
+    site_t used[MAX_SITES];
+    int num_used = 0;
+    uint64_t allocs = 0, bytes = 0;
+    for (int s = 0; s < MAX_SITES; s++)
+    {
+        if (sites[s].allocs == 0)
+            continue;
+        used[num_used++] = sites[s];
+        allocs += sites[s].allocs;
+        bytes += sites[s].bytes;
+    }
+    pthread_mutex_unlock(&sites_mutex);
+    qsort(used, num_used, sizeof(site_t), compare_sites);
+
+    pthread_mutex_lock(&threads_mutex);
+    double wall_s = (get_time_ns() - job_start_ns) / 1e9;
+    int64_t peak = atomic_load(&heap_peak);
+    if (json)
+    {
+        printf("{\"event\":\"memprof\",\"wall_s\":%.6f,\"allocs\":%" PRIu64
+               ",\"bytes\":%" PRIu64 ",\"peak_live_bytes\":%" PRId64
+               ",\"threads\":[",
+               wall_s, allocs, bytes, peak);
+        for (int id = 1; id < next_id; id++)
+        {
+            const thread_rec_t *rec = find_thread_rec(id);
+            if (rec == NULL)
+                continue;
+            printf("%s{\"thread\":%d,\"name\":", id > 1 ? "," : "",
+                   rec->id);
+            print_json_string(stdout, rec->name ? rec->name : "thread");
+            printf(",\"allocs\":%" PRIu64 ",\"bytes\":%" PRIu64
+                   ",\"peak_live_bytes\":%" PRId64 "}",
+                   rec->allocs, rec->bytes, rec->peak);
+        }
+        printf("],\"sites\":[");
+        for (int s = 0; s < num_used; s++)
+        {
+            printf("%s{\"file\":", s ? "," : "");
+            print_json_string(stdout, used[s].file);
+            printf(",\"line\":%d,\"allocs\":%" PRIu64 ",\"bytes\":%" PRIu64
+                   "}",
+                   used[s].line, used[s].allocs, used[s].bytes);
+        }
+        printf("]}\n");
+        pthread_mutex_unlock(&threads_mutex);
+        return;
+    }
+
+    printf("\nMemory profile (%.3f s wall): %" PRIu64 " allocation(s), "
+           "%.2f MB allocated, %.2f MB peak live heap\n",
+           wall_s, allocs, bytes / 1e6, peak / 1e6);
+    printf("%-4s %-12s %12s %14s %14s\n", "id", "thread", "allocs", "bytes",
+           "peak live");
+    for (int id = 1; id < next_id; id++)
+    {
+        const thread_rec_t *rec = find_thread_rec(id);
+        if (rec != NULL)
+            printf("%-4d %-12s %12" PRIu64 " %14" PRIu64 " %14" PRId64 "\n",
+                   rec->id, rec->name ? rec->name : "thread", rec->allocs,
+                   rec->bytes, rec->peak);
+    }
+    pthread_mutex_unlock(&threads_mutex);
+
+    printf("%-32s %12s %14s\n", "call site", "allocs", "bytes");
+    for (int s = 0; s < num_used; s++)
+    {
+        char site[256];
+        snprintf(site, sizeof(site), "%s:%d", used[s].file, used[s].line);
+        printf("%-32s %12" PRIu64 " %14" PRIu64 "\n", site, used[s].allocs,
+               used[s].bytes);
+    }
+    if (dropped_sites)
+        printf("Some call sites were left out, raise MAX_SITES to see "
+               "them all.\n");
+}
@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "path_set.h"
+
+// The table is grown once it is this full, in percent
+static const size_t MAX_LOAD = 70;
+
+struct path_set
+{
+    // Open addressing, an empty slot is NULL
+    char **slots;
+    size_t capacity;
+    size_t count;
+};
+
+/**
+ * @brief Hash a path with FNV-1a
+ * @param[in] path The path
+ * @return The hash
+ */
+static uint64_t hash_path(const char *path)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (; *path != '\0'; path++)
+    {
+        h ^= (unsigned char) *path;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief Find the slot a path is in, or the empty slot it would go in
+ * @param[in] slots The table
+ * @param[in] capacity The size of the table, a power of 2
+ * @param[in] path The path
+ * @return The index of the slot
+ */
+static size_t find_slot(char **slots, size_t capacity, const char *path)
+{
+    size_t s = hash_path(path) & (capacity - 1);
+    while (slots[s] != NULL && strcmp(slots[s], path) != 0)
+        s = (s + 1) & (capacity - 1);
+    return s;
+}
+
+path_set_t *path_set_create(void)
+{
+    path_set_t *set = calloc(1, sizeof(path_set_t));
+    if (set == NULL)
+        return NULL;
+
+    set->capacity = 256;
+    set->slots = calloc(set->capacity, sizeof(char *));
+    if (set->slots == NULL)
+    {
+        free(set);
+        return NULL;
+    }
+    return set;
+}
+
+/**
+ * @brief Double the size of the table
+ * @param[in,out] set The set
+ * @return 1 on success, 0 if allocating memory failed
+ */
+static int grow(path_set_t *set)
+{
+    size_t capacity = set->capacity * 2;
+    char **slots = calloc(capacity, sizeof(char *));
+    if (slots == NULL)
+        return 0;
+    for (size_t s = 0; s < set->capacity; s++)
+        if (set->slots[s] != NULL)
+            slots[find_slot(slots, capacity, set->slots[s])] = set->slots[s];
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+    return 1;
+}
+
+int path_set_add(path_set_t *set, const char *path)
+{
+    if ((set->count + 1) * 100 > set->capacity * MAX_LOAD && !grow(set))
+        return 0;
+
+    size_t s = find_slot(set->slots, set->capacity, path);
+    if (set->slots[s] != NULL)
+        return 1;
+    set->slots[s] = strdup(path);
+    if (set->slots[s] == NULL)
+        return 0;
+    set->count++;
+    return 1;
+}
+
+int path_set_contains(const path_set_t *set, const char *path)
+{
+    if (set == NULL)
+        return 0;
+    return set->slots[find_slot(set->slots, set->capacity, path)] != NULL;
+}
+
+void path_set_free(path_set_t *set)
+{
+    if (set == NULL)
+        return;
+    for (size_t s = 0; s < set->capacity; s++)
+        free(set->slots[s]);
+    free(set->slots);
+    free(set);
+}
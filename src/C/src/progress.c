@@ -0,0 +1,414 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "progress.h"
+#include "utils.h"
+
+#define CACHE_LINE 64
+
+// How many of the failed files to list in the summary
+static const size_t MAX_FAILURES_LISTED = 20;
+static const uint64_t PROGRESS_INTERVAL_NS = 250 * 1000000ULL;
+static const uint64_t JSON_INTERVAL_NS = 1000 * 1000000ULL;
+
+/**
+ * @struct worker_counters_t
+ * @brief The counters for a single worker. Each worker's counters sit on
+ * their own cache line, and are only written by that worker, so updating
+ * them never has to wait on the other workers. The thread queueing the
+ * files has counters of its own too.
+ */
+typedef struct
+{
+    _Alignas(CACHE_LINE) atomic_uint_fast64_t files;
+    atomic_uint_fast64_t bytes_in;
+    atomic_uint_fast64_t bytes_out;
+    atomic_uint_fast64_t failures;
+    atomic_uint_fast64_t skipped;
+} worker_counters_t;
+
+/**
+ * @struct progress_totals_t
+ * @brief The counters of all the workers added up
+ */
+typedef struct
+{
+    uint64_t files;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t failures;
+    uint64_t skipped;
+    uint64_t queued;
+} progress_totals_t;
+
+struct progress
+{
+    // Which job this is, so a thread's counters are never looked up for a
+    // job that has ended, even if this one has the same address
+    uint64_t job;
+    int mode;
+    int encrypting;
+    uint64_t start_ns;
+    // Filled in while the job runs
+    atomic_uint_fast64_t queued;
+    atomic_int walk_done;
+    atomic_int next_worker;
+    int num_workers;
+    worker_counters_t *workers;
+    // For the files counted by threads that aren't workers, such as the
+    // one walking the directory
+    worker_counters_t *producer;
+    void *workers_alloc;
+    // The files that failed, the reporter is the only one to print them
+    char **failed;
+    size_t num_failed;
+    size_t max_failed;
+    size_t failed_reported;
+    // The reporter thread
+    pthread_t reporter;
+    int reporter_started;
+    int stopping;
+    int line_drawn;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+// Jobs are numbered from 1, so 0 is never the job of a registered thread
+static atomic_uint_fast64_t next_job = 1;
+static _Thread_local uint64_t local_job = 0;
+static _Thread_local worker_counters_t *local_counters = NULL;
+
+/**
+ * @brief Get the counters for the calling thread
+ * @param[in] progress The progress of the job
+ * @return The worker's counters, or the producer's if the calling thread
+ * didn't register as a worker of this job
+ */
+static worker_counters_t *get_counters(progress_t *progress)
+{
+    if (local_job != progress->job)
+        return progress->producer;
+    return local_counters;
+}
+
+/**
+ * @brief Add up the counters of all the workers
+ * @param[in] progress The progress of the job
+ * @param[out] totals The totals
+ */
+static void get_totals(progress_t *progress, progress_totals_t *totals)
+{
+    memset(totals, 0, sizeof(progress_totals_t));
+    // The producer's counters are the ones after the workers'
+    for (int w = 0; w <= progress->num_workers; w++)
+    {
+        worker_counters_t *c = &progress->workers[w];
+        totals->files += atomic_load_explicit(&c->files,
+                                              memory_order_relaxed);
+        totals->bytes_in += atomic_load_explicit(&c->bytes_in,
+                                                 memory_order_relaxed);
+        totals->bytes_out += atomic_load_explicit(&c->bytes_out,
+                                                  memory_order_relaxed);
+        totals->failures += atomic_load_explicit(&c->failures,
+                                                 memory_order_relaxed);
+        totals->skipped += atomic_load_explicit(&c->skipped,
+                                                memory_order_relaxed);
+    }
+    totals->queued = atomic_load_explicit(&progress->queued,
+                                          memory_order_relaxed);
+}
+
+/**
+ * @brief Print the files that failed since the last report as JSON lines
+ * @param[in] progress The progress of the job
+ */
+static void report_json_failures(progress_t *progress)
+{
+    pthread_mutex_lock(&progress->mutex);
+    for (; progress->failed_reported < progress->num_failed;
+         progress->failed_reported++)
+    {
+        printf("{\"event\":\"failed\",\"path\":");
+        print_json_string(stdout, progress->failed[progress->failed_reported]);
+        printf("}\n");
+    }
+    pthread_mutex_unlock(&progress->mutex);
+}
+
+/**
+ * @brief Print the current progress
+ * @param[in] progress The progress of the job
+ */
+static void report(progress_t *progress)
+{
+    progress_totals_t totals;
+    get_totals(progress, &totals);
+
+    double elapsed = (get_time_ns() - progress->start_ns) / 1e9;
+    uint64_t done = totals.files + totals.failures + totals.skipped;
+    double files_per_s = elapsed > 0 ? totals.files / elapsed : 0;
+    double bytes_per_s = elapsed > 0 ? totals.bytes_in / elapsed : 0;
+
+    // The number of files left is only known once the walk is done
+    int walk_done = atomic_load_explicit(&progress->walk_done,
+                                         memory_order_relaxed);
+    double eta = -1;
+    if (walk_done && files_per_s > 0)
+        eta = (totals.queued - done) / files_per_s;
+
+    if (progress->mode == OUTPUT_JSON)
+    {
+        report_json_failures(progress);
+        printf("{\"event\":\"progress\",\"elapsed_s\":%.3f,\"files\":%" PRIu64
+               ",\"queued\":%" PRIu64 ",\"walk_done\":%s,\"bytes_in\":%" PRIu64
+               ",\"bytes_out\":%" PRIu64 ",\"failures\":%" PRIu64
+               ",\"skipped\":%" PRIu64
+               ",\"files_per_s\":%.1f,\"bytes_per_s\":%.0f,",
+               elapsed, totals.files, totals.queued,
+               walk_done ? "true" : "false", totals.bytes_in, totals.bytes_out,
+               totals.failures, totals.skipped, files_per_s, bytes_per_s);
+        if (eta >= 0)
+            printf("\"eta_s\":%.1f}\n", eta);
+        else
+            printf("\"eta_s\":null}\n");
+        fflush(stdout);
+        return;
+    }
+
+    char eta_str[32] = "--";
+    if (eta >= 0)
+        snprintf(eta_str, sizeof(eta_str), "%d:%02d", (int) eta / 60,
+                 (int) eta % 60);
+
+    printf("\r%" PRIu64 "/%" PRIu64 "%s files  %.1f MiB/s  %.0f files/s  "
+           "ETA %s",
+           done, totals.queued, walk_done ? "" : "+", bytes_per_s / 1048576,
+           files_per_s, eta_str);
+    if (totals.failures > 0)
+        printf("  %s%" PRIu64 " failed%s", colors[COLOR_ERROR],
+               totals.failures, colors[COLOR_RESET]);
+    // Clear whatever is left of the last line
+    printf("\x1B[K");
+    fflush(stdout);
+    progress->line_drawn = 1;
+}
+
+/**
+ * @brief Function called by pthread_create to start the reporter thread
+ * @param[in] args The progress_t for the job
+ */
+static void *reporter_thread(void *args)
+{
+    progress_t *progress = (progress_t *) args;
+    uint64_t interval = progress->mode == OUTPUT_JSON ? JSON_INTERVAL_NS
+                                                      : PROGRESS_INTERVAL_NS;
+
+    pthread_mutex_lock(&progress->mutex);
+    while (!progress->stopping)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t nsec = deadline.tv_nsec + interval;
+        deadline.tv_sec += nsec / 1000000000;
+        deadline.tv_nsec = nsec % 1000000000;
+        pthread_cond_timedwait(&progress->cond, &progress->mutex, &deadline);
+        if (progress->stopping)
+            break;
+
+        pthread_mutex_unlock(&progress->mutex);
+        report(progress);
+        pthread_mutex_lock(&progress->mutex);
+    }
+    pthread_mutex_unlock(&progress->mutex);
+    return NULL;
+}
+
+progress_t *progress_start(int num_workers, int encrypting, int mode)
+{
+    progress_t *progress = calloc(1, sizeof(progress_t));
+    if (progress == NULL)
+        return NULL;
+
+    if (num_workers < 1)
+        num_workers = 1;
+    // calloc() doesn't guarantee cache line alignment, so line it up
+    // by hand. The producer's counters go after the workers'.
+    progress->workers_alloc = calloc(num_workers + 2,
+                                     sizeof(worker_counters_t));
+    if (progress->workers_alloc == NULL)
+    {
+        free(progress);
+        return NULL;
+    }
+    uintptr_t addr = (uintptr_t) progress->workers_alloc;
+    addr = (addr + CACHE_LINE - 1) & ~(uintptr_t) (CACHE_LINE - 1);
+    progress->workers = (worker_counters_t *) addr;
+    progress->producer = &progress->workers[num_workers];
+    progress->num_workers = num_workers;
+    progress->job = atomic_fetch_add_explicit(&next_job, 1,
+                                              memory_order_relaxed);
+    progress->mode = mode;
+    progress->encrypting = encrypting;
+    progress->start_ns = get_time_ns();
+    pthread_mutex_init(&progress->mutex, NULL);
+    pthread_cond_init(&progress->cond, NULL);
+
+    // Redrawing the progress line only makes sense on a terminal
+    int reporting = (mode == OUTPUT_JSON)
+                    || (mode == OUTPUT_PROGRESS && isatty(fileno(stdout)));
+    if (reporting)
+        progress->reporter_started = (pthread_create(&progress->reporter, NULL,
+                                                     reporter_thread, progress)
+                                      == 0);
+    return progress;
+}
+
+void progress_register_worker(progress_t *progress)
+{
+    int w = atomic_fetch_add_explicit(&progress->next_worker, 1,
+                                      memory_order_relaxed);
+    // The counters are atomic, so sharing them still counts correctly if
+    // more workers turn up than were planned for
+    local_counters = &progress->workers[w % progress->num_workers];
+    local_job = progress->job;
+}
+
+void progress_file_queued(progress_t *progress)
+{
+    atomic_fetch_add_explicit(&progress->queued, 1, memory_order_relaxed);
+}
+
+void progress_walk_done(progress_t *progress)
+{
+    atomic_store_explicit(&progress->walk_done, 1, memory_order_relaxed);
+}
+
+void progress_file_done(progress_t *progress, size_t bytes_in,
+                        size_t bytes_out)
+{
+    worker_counters_t *c = get_counters(progress);
+    atomic_fetch_add_explicit(&c->files, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->bytes_in, bytes_in, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->bytes_out, bytes_out, memory_order_relaxed);
+}
+
+void progress_file_failed(progress_t *progress, const char *path)
+{
+    worker_counters_t *c = get_counters(progress);
+    atomic_fetch_add_explicit(&c->failures, 1, memory_order_relaxed);
+
+    // Failures should be rare, so the lock won't be contended
+    char *failed = strdup(path);
+    if (failed == NULL)
+        return;
+    pthread_mutex_lock(&progress->mutex);
+    if (progress->num_failed == progress->max_failed)
+    {
+        size_t new_max = progress->max_failed ? progress->max_failed * 2 : 16;
+        char **tmp = realloc(progress->failed, sizeof(char *) * new_max);
+        if (tmp == NULL)
+        {
+            pthread_mutex_unlock(&progress->mutex);
+            free(failed);
+            return;
+        }
+        progress->failed = tmp;
+        progress->max_failed = new_max;
+    }
+    progress->failed[progress->num_failed++] = failed;
+    pthread_mutex_unlock(&progress->mutex);
+}
+
+void progress_file_skipped(progress_t *progress)
+{
+    worker_counters_t *c = get_counters(progress);
+    atomic_fetch_add_explicit(&c->skipped, 1, memory_order_relaxed);
+}
+
+uint64_t progress_failures(progress_t *progress)
+{
+    progress_totals_t totals;
+    get_totals(progress, &totals);
+    return totals.failures;
+}
+
+/**
+ * @brief Print the summary of the job
+ * @param[in] progress The progress of the job
+ */
+static void print_summary(progress_t *progress)
+{
+    progress_totals_t totals;
+    get_totals(progress, &totals);
+    double elapsed = (get_time_ns() - progress->start_ns) / 1e9;
+
+    if (progress->mode == OUTPUT_JSON)
+    {
+        report_json_failures(progress);
+        printf("{\"event\":\"summary\",\"elapsed_s\":%.3f,\"files\":%" PRIu64
+               ",\"bytes_in\":%" PRIu64 ",\"bytes_out\":%" PRIu64
+               ",\"failures\":%" PRIu64 ",\"skipped\":%" PRIu64 "}\n",
+               elapsed, totals.files, totals.bytes_in, totals.bytes_out,
+               totals.failures, totals.skipped);
+        fflush(stdout);
+        return;
+    }
+
+    if (progress->line_drawn)
+        printf("\r\x1B[K");
+
+    if (progress->mode != OUTPUT_QUIET)
+    {
+        printf("%s %" PRIu64 " file(s), %.1f MiB in %.2f s (%.1f MiB/s)\n",
+               progress->encrypting ? "Encrypted" : "Decrypted", totals.files,
+               totals.bytes_in / 1048576.0, elapsed,
+               elapsed > 0 ? totals.bytes_in / 1048576.0 / elapsed : 0);
+        if (totals.skipped > 0)
+            printf("Skipped %" PRIu64 " unchanged, already done or partly "
+                   "saved file(s)\n",
+                   totals.skipped);
+    }
+
+    // The failures were already printed as they happened in verbose mode
+    if (totals.failures == 0 || progress->mode == OUTPUT_VERBOSE)
+        return;
+    fprintf(stderr, "%s%" PRIu64 " file(s) failed:%s\n", colors[COLOR_ERROR],
+            totals.failures, colors[COLOR_RESET]);
+    for (size_t f = 0; f < progress->num_failed && f < MAX_FAILURES_LISTED;
+         f++)
+        fprintf(stderr, "  %s\n", progress->failed[f]);
+    if (progress->num_failed > MAX_FAILURES_LISTED)
+        fprintf(stderr, "  ...and %zu more\n",
+                progress->num_failed - MAX_FAILURES_LISTED);
+}
+
+void progress_stop(progress_t *progress)
+{
+    if (progress == NULL)
+        return;
+
+    if (progress->reporter_started)
+    {
+        pthread_mutex_lock(&progress->mutex);
+        progress->stopping = 1;
+        pthread_cond_signal(&progress->cond);
+        pthread_mutex_unlock(&progress->mutex);
+        pthread_join(progress->reporter, NULL);
+    }
+    print_summary(progress);
+
+    for (size_t f = 0; f < progress->num_failed; f++)
+        free(progress->failed[f]);
+    free(progress->failed);
+    free(progress->workers_alloc);
+    pthread_mutex_destroy(&progress->mutex);
+    pthread_cond_destroy(&progress->cond);
+    free(progress);
+}
@@ -4,10 +4,10 @@
 #include <termios.h>
 #include <unistd.h>
 
-#include <openssl/sha.h>
-
+#include "eea.h"
 #include "file_handling.h"
 #include "globals.h"
+#include "keygen.h"
 #include "prompts.h"
 #include "utils.h"
 
@@ -154,7 +154,8 @@ int prompt_key_size(void)
 
 int prompt_for_num_threads(void)
 {
-    printf("Enter the number of threads to use (default: 1): ");
+    printf("Enter the number of threads to use (default: %d): ",
+           default_threads);
     char *line = NULL;
     size_t line_len = 0;
     line_len = getline(&line, &line_len, stdin);
@@ -165,7 +166,7 @@ int prompt_for_num_threads(void)
     int is_negative = 0;
 
     if (strcmp(line, "") == 0)
-        num_threads = 1;
+        num_threads = default_threads;
     else
     {
         num_threads = strtol(line, NULL, 10);
@@ -307,6 +308,25 @@ int prompt_for_overwrite(int is_single_file)
     return overwrite;
 }
 
+int prompt_for_resume(const char *dir_name)
+{
+    printf("An unfinished job was found for \'%s\'.\n"
+           "Resume it? (y/n) (default: y): ",
+           dir_name);
+    char *line = NULL;
+    size_t line_len = 0;
+    line_len = getline(&line, &line_len, stdin);
+    // Replace new line with null terminator
+    line[line_len - 1] = '\0';
+
+    int resume = 1;
+    if (strcmp(line, "N") == 0 || strcmp(line, "n") == 0)
+        resume = 0;
+
+    free(line);
+    return resume;
+}
+
 /**
  * @see https://stackoverflow.com/a/1786733
  */
@@ -357,16 +377,11 @@ char *get_password(const char *prompt)
 char *get_hashed_password(int set_password)
 {
     char *password1 = NULL;
-    char *password_hash = malloc((SHA512_DIGEST_LENGTH * 2) + 1);
-    if (password_hash == NULL)
-        return NULL;
-
     if (set_password)
     {
         password1 = get_password("Enter a password for the keys file: ");
         if (password1 == NULL)
         {
-            free(password_hash);
             fprintf(stderr, "%sError:%s Password is NULL.\n",
                     colors[COLOR_ERROR], colors[COLOR_RESET]);
             return NULL;
@@ -374,7 +389,6 @@ char *get_hashed_password(int set_password)
         char *password2 = get_password("Re-type password: ");
         if (password2 == NULL)
         {
-            free(password_hash);
             free(password1);
             fprintf(stderr, "%sError:%s Password is NULL.\n",
                     colors[COLOR_ERROR], colors[COLOR_RESET]);
@@ -385,7 +399,6 @@ char *get_hashed_password(int set_password)
         {
             free(password1);
             free(password2);
-            free(password_hash);
             fprintf(stderr, "%sError:%s Passwords don't match.\n",
                     colors[COLOR_ERROR], colors[COLOR_RESET]);
             return NULL;
@@ -394,7 +407,6 @@ char *get_hashed_password(int set_password)
         {
             free(password1);
             free(password2);
-            free(password_hash);
             fprintf(stderr, "%sError:%s Passwords don't match.\n",
                     colors[COLOR_ERROR], colors[COLOR_RESET]);
             return NULL;
@@ -406,20 +418,191 @@ char *get_hashed_password(int set_password)
         password1 = get_password("Password: ");
         if (password1 == NULL)
         {
-            free(password_hash);
             fprintf(stderr, "%sError:%s Password is NULL.\n",
                     colors[COLOR_ERROR], colors[COLOR_RESET]);
             return NULL;
         }
     }
 
-    unsigned char md[SHA512_DIGEST_LENGTH];
-    SHA512((const unsigned char *) password1, strlen(password1), md);
-    message_digest_to_hash(md, password_hash, SHA512_DIGEST_LENGTH);
-
+    char *password_hash = hash_password(password1);
     free(password1);
-    if (password_hash == NULL)
+    return password_hash;
+}
+
+char *get_input_filename(int encrypting)
+{
+    char *input_filename = NULL;
+
+    printf("Enter the name of the file you would like to %s: ",
+           (encrypting) ? "encrypt" : "decrypt");
+    char *line = NULL;
+    size_t line_len = 0;
+    line_len = getline(&line, &line_len, stdin);
+    // Replace new line with null terminator
+    line[line_len - 1] = '\0';
+    line_len--;
+    if (!file_exists(line))
+    {
+        fprintf(stderr, "%sError:%s The file, \'%s\', does not exist\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], line);
+        free(line);
         return NULL;
+    }
 
-    return password_hash;
+    if (!encrypting)
+    {
+        if (!is_of_filetype(line, EEA_FILE_EXTENTION))
+        {
+            fprintf(stderr,
+                    "%sError:%s The file needs to be a \'%s\' file "
+                    "in order to be decrypted\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET],
+                    EEA_FILE_EXTENTION);
+            free(line);
+            return NULL;
+        }
+    }
+
+    input_filename = strdup(line);
+    free(line);
+
+    return input_filename;
+}
+
+char *get_input_dir_name(int encrypting)
+{
+    char *input_dir = NULL;
+
+    printf("Enter the name of the directory you would like to %s: ",
+           (encrypting) ? "encrypt" : "decrypt");
+    char *line = NULL;
+    size_t line_len = 0;
+    line_len = getline(&line, &line_len, stdin);
+    // Replace new line with null terminator
+    line[line_len - 1] = '\0';
+    line_len--;
+
+    FILE_TYPE f_type = get_file_type(line);
+    if (f_type != FILE_TYPE_DIR)
+    {
+        fprintf(stderr, "%sError:%s The \'%s\', is not a directory\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], line);
+        free(line);
+        return NULL;
+    }
+
+    input_dir = strdup(line);
+    free(line);
+    return input_dir;
+}
+
+char **load_keys_from_file(const char *filename, int *total_keys, size_t *len)
+{
+    if (filename == NULL)
+        return NULL;
+
+    // Make sure the file exists and it is a keys file
+    if (!file_exists(filename) || !is_of_filetype(filename, ".keys"))
+        return NULL;
+
+    // We are not setting the password
+    char *password = get_password("Password: ");
+    if (password == NULL)
+    {
+        fprintf(stderr, "%sError:%s Password is NULL.\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return NULL;
+    }
+
+    char **keys = NULL;
+    int num_keys = 0;
+    int error = eea_load_keys(filename, password, &keys, &num_keys);
+    free(password);
+    if (error == EEA_ERR_WRONG_PASSWORD)
+    {
+        fprintf(stderr,
+                "%sError:%s Failed to decrypt your keys.\n"
+                "Make sure the keys in this file are valid "
+                "and you entered the correct password\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return NULL;
+    }
+    if (error != EEA_OK)
+    {
+        fprintf(stderr, "%sError:%s Loading the keys from \'%s\' failed: %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], filename,
+                eea_strerror(error));
+        return NULL;
+    }
+
+    *len = strlen(keys[0]);
+    *total_keys = num_keys;
+    return keys;
+}
+
+char **load_keys(int *num_keys)
+{
+    if (!keys_file_exists())
+    {
+        printf("You don't have any keys files\n");
+        return NULL;
+    }
+    do
+    {
+        size_t num_key_files = 0;
+        char **keys_files_list = get_all_keys_files(&num_key_files);
+        if (keys_files_list == NULL)
+            return NULL;
+
+        printf("Select which keys file would you like to use:\n");
+        for (size_t f = 0; f < num_key_files; f++)
+            printf("%zu: %s\n", (f + 1), keys_files_list[f]);
+        if (num_key_files > 1)
+            printf("(1-%zu) or 'q' to quit: ", num_key_files);
+        else
+            printf("(1) or 'q' to quit: ");
+
+        char *line = NULL;
+        size_t line_len = 0;
+        line_len = getline(&line, &line_len, stdin);
+        // Replace new line with null terminator
+        line[line_len - 1] = '\0';
+
+        if (strcmp(line, "q") == 0 || strcmp(line, "Q") == 0)
+        {
+            free(line);
+            for (size_t f = 0; f < num_key_files; f++)
+                free(keys_files_list[f]);
+            free(keys_files_list);
+            return NULL;
+        }
+
+        int selection = 0;
+        if (strcmp(line, "") == 0)
+            selection = 1;
+        else
+            selection = strtol(line, NULL, 10);
+
+        free(line);
+        if (selection <= 0 || selection > num_key_files)
+        {
+            printf("Invalid selection.\n");
+            continue;
+        }
+
+        char **keys_decrypted = NULL;
+        size_t key_len = 0;
+        char *key_file = get_keys_path(keys_files_list[selection - 1]);
+        keys_decrypted = load_keys_from_file(key_file, num_keys, &key_len);
+        if (key_file != NULL)
+            free(key_file);
+
+        for (size_t f = 0; f < num_key_files; f++)
+            free(keys_files_list[f]);
+        free(keys_files_list);
+
+        return keys_decrypted;
+
+    } while (keys_file_exists());
+    return NULL;
 }
@@ -0,0 +1,225 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include "eea.h"
+#include "file_handling.h"
+#include "globals.h"
+#include "path_set.h"
+#include "rekey.h"
+#include "stream.h"
+#include "utils.h"
+#include "work_queue.h"
+
+// Written next to a file while it is being re-encrypted
+static const char REKEY_TMP_EXTENTION[] = ".rekey";
+
+/**
+ * @struct rekey_job_t
+ * @brief What the threads re-encrypting files share
+ */
+typedef struct
+{
+    const char **old_keys;
+    int old_num_keys;
+    const char **new_keys;
+    int new_num_keys;
+    work_queue_t *queue;
+    // The files queued so far. Each is renamed into place once it is
+    // re-encrypted, so the walk can find it again.
+    path_set_t *queued;
+    pthread_mutex_t lock;
+    size_t files;
+    size_t failed;
+    size_t bytes;
+} rekey_job_t;
+
+int rekey_file(const char *path, const char **old_keys, int old_num_keys,
+               const char **new_keys, int new_num_keys, size_t *bytes)
+{
+    struct stat path_stat;
+    if (stat(path, &path_stat) != 0)
+        return EEA_ERR_IO;
+    if (bytes != NULL)
+        *bytes = path_stat.st_size;
+
+    size_t tmp_len = strlen(path) + sizeof(REKEY_TMP_EXTENTION);
+    char *tmp_path = malloc(tmp_len);
+    if (tmp_path == NULL)
+        return EEA_ERR_NO_MEMORY;
+    snprintf(tmp_path, tmp_len, "%s%s", path, REKEY_TMP_EXTENTION);
+
+    FILE *in = fopen(path, "rb");
+    FILE *out = fopen(tmp_path, "wb");
+    int ret = (in == NULL || out == NULL) ? EEA_ERR_IO : EEA_OK;
+    if (ret == EEA_OK)
+        ret = rekey_stream(in, out, old_keys, old_num_keys, new_keys,
+                           new_num_keys);
+#ifndef WIN32
+    // Keep who can read the file, and make sure the new cipher text is on
+    // disk before it replaces the old
+    if (ret == EEA_OK
+        && (fchmod(fileno(out), path_stat.st_mode & 07777) != 0
+            || fsync(fileno(out)) != 0))
+        ret = EEA_ERR_IO;
+#endif
+    if (in != NULL)
+        fclose(in);
+    if (out != NULL && fclose(out) != 0 && ret == EEA_OK)
+        ret = EEA_ERR_IO;
+
+#ifdef WIN32
+    // rename() won't replace an existing file on Windows
+    if (ret == EEA_OK && remove(path) != 0)
+        ret = EEA_ERR_IO;
+#endif
+    if (ret == EEA_OK && rename(tmp_path, path) != 0)
+        ret = EEA_ERR_IO;
+    if (ret != EEA_OK && out != NULL)
+        remove(tmp_path);
+    free(tmp_path);
+    return ret;
+}
+
+/**
+ * @brief Re-encrypt a file, recording how it went
+ * @param[in,out] job What the threads share
+ * @param[in] path The file
+ */
+static void rekey_one(rekey_job_t *job, const char *path)
+{
+    size_t bytes = 0;
+    int ret = rekey_file(path, job->old_keys, job->old_num_keys,
+                         job->new_keys, job->new_num_keys, &bytes);
+    if (ret != EEA_OK)
+        fprintf(stderr, "%sError:%s Failed to re-encrypt \'%s\': %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path,
+                eea_strerror(ret));
+
+    pthread_mutex_lock(&job->lock);
+    job->files++;
+    if (ret != EEA_OK)
+        job->failed++;
+    else
+        job->bytes += bytes;
+    pthread_mutex_unlock(&job->lock);
+}
+
+/**
+ * @brief Function called by pthread_create to re-encrypt queued files
+ * @param[in] args The rekey_job_t the threads share
+ */
+static void *rekey_thread(void *args)
+{
+    rekey_job_t *job = (rekey_job_t *) args;
+    char *path = NULL;
+    while ((path = work_queue_pop(job->queue)) != NULL)
+    {
+        rekey_one(job, path);
+        free(path);
+    }
+    return NULL;
+}
+
+/**
+ * @brief walk_dir() callback that queues each .eea file found
+ * @param[in] path Path to the file that was found
+ * @param[in] args The rekey_job_t with the queue to add to
+ * @return 1 to keep walking, 0 if the file could not be queued
+ */
+static int queue_rekey_file(const char *path, void *args)
+{
+    rekey_job_t *job = (rekey_job_t *) args;
+    if (!is_of_filetype(path, EEA_FILE_EXTENTION)
+        || path_set_contains(job->queued, path))
+        return 1;
+    if (!path_set_add(job->queued, path))
+        return 0;
+
+    char *copy = strdup(path);
+    if (copy == NULL || !work_queue_push(job->queue, copy))
+    {
+        free(copy);
+        return 0;
+    }
+    return 1;
+}
+
+int rekey_paths(char **paths, int num_paths, const char **old_keys,
+                int old_num_keys, const char **new_keys, int new_num_keys,
+                int threads)
+{
+    rekey_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.old_keys = old_keys;
+    job.old_num_keys = old_num_keys;
+    job.new_keys = new_keys;
+    job.new_num_keys = new_num_keys;
+    if (threads < 1)
+        threads = 1;
+
+    pthread_t *pool = malloc(threads * sizeof(pthread_t));
+    job.queue = work_queue_create(threads * 4);
+    job.queued = path_set_create();
+    if (pool == NULL || job.queue == NULL || job.queued == NULL)
+    {
+        free(pool);
+        if (job.queue != NULL)
+            work_queue_free(job.queue);
+        path_set_free(job.queued);
+        return 1;
+    }
+    pthread_mutex_init(&job.lock, NULL);
+
+    int started = 0;
+    for (; started < threads; started++)
+        if (pthread_create(&pool[started], NULL, rekey_thread, &job) != 0)
+            break;
+
+    int queued = (started > 0);
+    uint64_t start = get_time_ns();
+    for (int p = 0; p < num_paths && queued; p++)
+    {
+        int type = get_file_type(paths[p]);
+        if (type == FILE_TYPE_DIR)
+            queued = walk_dir(paths[p], queue_rekey_file, &job);
+        else if (type == FILE_TYPE_REG
+                 && is_of_filetype(paths[p], EEA_FILE_EXTENTION))
+            queued = queue_rekey_file(paths[p], &job);
+        else
+        {
+            fprintf(stderr, "%sError:%s \'%s\' isn't a %s file or a "
+                    "directory\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], paths[p],
+                    EEA_FILE_EXTENTION);
+            pthread_mutex_lock(&job.lock);
+            job.files++;
+            job.failed++;
+            pthread_mutex_unlock(&job.lock);
+        }
+    }
+
+    work_queue_close(job.queue);
+    for (int t = 0; t < started; t++)
+        pthread_join(pool[t], NULL);
+    double seconds = (get_time_ns() - start) / 1e9;
+
+    if (!queued)
+        fprintf(stderr, "%sError:%s Failed to queue every file\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+    printf("Re-encrypted %zu of %zu files, %.1f MB in %.2f s (%.1f MB/s)\n",
+           job.files - job.failed, job.files, job.bytes / 1e6, seconds,
+           seconds > 0 ? job.bytes / 1e6 / seconds : 0);
+
+    int ret = (!queued || job.failed > 0);
+    pthread_mutex_destroy(&job.lock);
+    work_queue_free(job.queue);
+    path_set_free(job.queued);
+    free(pool);
+    return ret;
+}
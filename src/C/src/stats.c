@@ -0,0 +1,123 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stats.h"
+#include "trace.h"
+#include "utils.h"
+
+/**
+ * @struct stage_stats_t
+ * @brief The totals for a single stage
+ */
+typedef struct
+{
+    uint64_t ns;
+    uint64_t bytes;
+    uint64_t calls;
+} stage_stats_t;
+
+static const char *STAGE_NAMES[] = {
+    "read",          "base64_decode", "xor",      "remove_padding",
+    "base64_encode", "write",         "compress", "decompress"
+};
+
+// Each thread adds up its own stages, so timing them needs no locking
+static _Thread_local stage_stats_t thread_stats[NUM_STAT_STAGES];
+
+static stage_stats_t job_stats[NUM_STAT_STAGES];
+static uint64_t job_start_ns = 0;
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void stats_stage_done(int stage, uint64_t start_ns, uint64_t bytes)
+{
+    uint64_t end_ns = get_time_ns();
+    if (stats_enabled)
+    {
+        thread_stats[stage].ns += end_ns - start_ns;
+        thread_stats[stage].bytes += bytes;
+        thread_stats[stage].calls++;
+    }
+    trace_span(STAGE_NAMES[stage], NULL, start_ns, end_ns, bytes);
+}
+
+void stats_begin_job(void)
+{
+    if (!stats_enabled)
+        return;
+
+    pthread_mutex_lock(&job_mutex);
+    memset(job_stats, 0, sizeof(job_stats));
+    job_start_ns = get_time_ns();
+    pthread_mutex_unlock(&job_mutex);
+    memset(thread_stats, 0, sizeof(thread_stats));
+}
+
+void stats_flush_thread(void)
+{
+    if (!stats_enabled)
+        return;
+
+    pthread_mutex_lock(&job_mutex);
+    for (int s = 0; s < NUM_STAT_STAGES; s++)
+    {
+        job_stats[s].ns += thread_stats[s].ns;
+        job_stats[s].bytes += thread_stats[s].bytes;
+        job_stats[s].calls += thread_stats[s].calls;
+    }
+    pthread_mutex_unlock(&job_mutex);
+    memset(thread_stats, 0, sizeof(thread_stats));
+}
+
+void stats_end_job(int threads, int json)
+{
+    if (!stats_enabled)
+        return;
+
+    stats_flush_thread();
+    if (threads < 1)
+        threads = 1;
+
+    pthread_mutex_lock(&job_mutex);
+    uint64_t wall_ns = get_time_ns() - job_start_ns;
+    // The stages run on every thread at once, so compare them to the
+    // total time the threads had
+    double thread_ns = (double) wall_ns * threads;
+
+    if (json)
+    {
+        printf("{\"event\":\"stats\",\"wall_s\":%.6f,\"threads\":%d,"
+               "\"stages\":[",
+               wall_ns / 1e9, threads);
+        for (int s = 0; s < NUM_STAT_STAGES; s++)
+        {
+            const stage_stats_t *st = &job_stats[s];
+            printf("%s{\"stage\":\"%s\",\"time_s\":%.6f,\"bytes\":%" PRIu64
+                   ",\"calls\":%" PRIu64 ",\"gb_per_s\":%.3f,\"share\":%.4f}",
+                   s ? "," : "", STAGE_NAMES[s], st->ns / 1e9, st->bytes,
+                   st->calls, st->ns ? (double) st->bytes / st->ns : 0,
+                   thread_ns > 0 ? st->ns / thread_ns : 0);
+        }
+        printf("]}\n");
+        pthread_mutex_unlock(&job_mutex);
+        return;
+    }
+
+    printf("\nStage breakdown (%.3f s wall, %d thread(s)):\n", wall_ns / 1e9,
+           threads);
+    printf("%-16s %10s %14s %10s %8s\n", "stage", "time (s)", "bytes", "GB/s",
+           "share");
+    for (int s = 0; s < NUM_STAT_STAGES; s++)
+    {
+        const stage_stats_t *st = &job_stats[s];
+        if (st->calls == 0)
+            continue;
+        // Bytes per nanosecond is the same as gigabytes per second
+        printf("%-16s %10.4f %14" PRIu64 " %10.3f %7.1f%%\n", STAGE_NAMES[s],
+               st->ns / 1e9, st->bytes,
+               st->ns ? (double) st->bytes / st->ns : 0,
+               thread_ns > 0 ? 100.0 * st->ns / thread_ns : 0);
+    }
+    pthread_mutex_unlock(&job_mutex);
+}
@@ -0,0 +1,803 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64.h"
+#include "checksum.h"
+#include "compress.h"
+#include "eea.h"
+#include "globals.h"
+#include "kernels.h"
+#include "stream.h"
+
+// About how much of a stream is read, run through the keys and written at
+// a time. Each part is a whole number of blocks and of base64 groups.
+static const size_t STREAM_PART = (size_t) 64 << 10;
+// How much is read at a time when one stream is encrypted for several
+// keysets, large enough that the threads rarely wait for each other
+static const size_t FANOUT_PART = (size_t) 1 << 20;
+
+/**
+ * @brief Get the size of the parts a stream is encrypted in
+ * @param[in] key_len The length of each key
+ * @return A multiple of both key_len and 3, close to STREAM_PART
+ */
+static size_t get_part_len(size_t key_len)
+{
+    size_t group = key_len * 3;
+    size_t groups = STREAM_PART / group;
+    return (groups > 0 ? groups : 1) * group;
+}
+
+/**
+ * @brief Read until a buffer is full or the stream ends
+ * @param[in] in The stream to read
+ * @param[out] buf The buffer to read into
+ * @param[in] len The size of the buffer
+ * @param[out] eof Set if the stream ended
+ * @return The number of bytes read, (size_t) -1 on a read error
+ */
+static size_t read_part(FILE *in, unsigned char *buf, size_t len, int *eof)
+{
+    size_t read = fread(buf, 1, len, in);
+    if (read < len && ferror(in))
+        return (size_t) -1;
+    *eof = (read < len);
+    return read;
+}
+
+/**
+ * @brief Where decrypt_to_sink() sends the plain text
+ * @param[in] ctx The sink's state
+ * @param[in] data The next part of the plain text
+ * @param[in] len The length of the part
+ * @return 0 on success, 1 on failure
+ */
+typedef int (*stream_sink_t)(void *ctx, const unsigned char *data,
+                             size_t len);
+
+/**
+ * @struct stream_encoder_t
+ * @brief Encrypts plain text as it is written to it, a part at a time
+ */
+typedef struct
+{
+    FILE *out;
+    int num_keys;
+    size_t key_len;
+    size_t part_len;
+    unsigned char *buf;
+    size_t have;
+    char *encoded;
+    unsigned char *tails;
+    size_t total;
+    // The number of padding bytes the plain text ends in so far
+    size_t padding;
+    // If the cipher text ends in checksums, and the checksums of what has
+    // been written
+    int checksummed;
+    checksum_t sum;
+} stream_encoder_t;
+
+/**
+ * @brief Send decrypted blocks to a sink, holding back any padding at the
+ * end, as the stream may end after it
+ * @param[in] sink Where to send the plain text
+ * @param[in] ctx The sink's state
+ * @param[in] data The decrypted blocks
+ * @param[in] len The length of the blocks
+ * @param[in,out] held The number of padding bytes held back so far
+ * @return 0 on success, 1 if the sink failed
+ */
+static int send_unpadded(stream_sink_t sink, void *ctx,
+                         const unsigned char *data, size_t len, size_t *held)
+{
+    size_t end = len;
+    while (end > 0 && data[end - 1] == PADDING)
+        end--;
+    if (end == 0)
+    {
+        *held += len;
+        return 0;
+    }
+
+    // More data came, so what was held back wasn't the padding
+    unsigned char zeros[256];
+    memset(zeros, PADDING, sizeof(zeros));
+    while (*held > 0)
+    {
+        size_t send = (*held < sizeof(zeros)) ? *held : sizeof(zeros);
+        if (sink(ctx, zeros, send))
+            return 1;
+        *held -= send;
+    }
+    if (sink(ctx, data, end))
+        return 1;
+    *held = len - end;
+    return 0;
+}
+
+/**
+ * @brief A sink that writes the plain text to a stream
+ * @param[in] ctx The FILE to write to
+ * @param[in] data The next part of the plain text
+ * @param[in] len The length of the part
+ * @return 0 on success, 1 if writing failed
+ */
+static int file_sink(void *ctx, const unsigned char *data, size_t len)
+{
+    return fwrite(data, 1, len, (FILE *) ctx) != len;
+}
+
+/**
+ * @brief Remove whitespace, such as a trailing new line, from base64 text,
+ * and stop at the line of checksums after it
+ * @param[in,out] text The text
+ * @param[in] len The length of the text
+ * @param[out] ended Set if the checksums were found, so the cipher text has
+ * ended
+ * @return The length of the text without whitespace, up to the checksums
+ */
+static size_t strip_whitespace(unsigned char *text, size_t len, int *ended)
+{
+    size_t kept = 0;
+    for (size_t x = 0; x < len; x++)
+    {
+        if (text[x] == CHECKSUM_MARKER[0])
+        {
+            *ended = 1;
+            break;
+        }
+        if (text[x] != '\n' && text[x] != '\r' && text[x] != ' '
+            && text[x] != '\t')
+            text[kept++] = text[x];
+    }
+    return kept;
+}
+
+/**
+ * @brief Count the padding bytes a stream ends in so far
+ * @param[in] data The next part of the stream
+ * @param[in] len The length of the part
+ * @param[in] count The count before the part
+ * @return The count after the part
+ */
+static size_t count_padding(const unsigned char *data, size_t len,
+                            size_t count)
+{
+    size_t end = len;
+    while (end > 0 && data[end - 1] == PADDING)
+        end--;
+    return (end == 0) ? count + len : len - end;
+}
+
+/**
+ * @brief Start encrypting a stream
+ * @param[out] enc The encoder
+ * @param[out] out Where to write the cipher text
+ * @param[in] keys The keys to use for encryption
+ * @param[in] num_keys The number of keys being used for encryption
+ * @return EEA_OK, or EEA_ERR_NO_MEMORY
+ */
+static int encoder_init(stream_encoder_t *enc, FILE *out, const char **keys,
+                        int num_keys)
+{
+    memset(enc, 0, sizeof(*enc));
+    enc->out = out;
+    enc->num_keys = num_keys;
+    enc->key_len = strlen(keys[0]);
+    enc->part_len = get_part_len(enc->key_len);
+    enc->buf = malloc(enc->part_len);
+    enc->encoded = malloc(enc->part_len / 3 * 4 + 1);
+    enc->tails = xor_tails_from_keys(keys, num_keys, enc->key_len);
+    enc->checksummed = checksums;
+    checksum_init(&enc->sum);
+    if (enc->buf == NULL || enc->encoded == NULL || enc->tails == NULL)
+        return EEA_ERR_NO_MEMORY;
+    return EEA_OK;
+}
+
+/**
+ * @brief Free an encoder
+ * @param[in] enc The encoder
+ */
+static void encoder_free(stream_encoder_t *enc)
+{
+    free(enc->buf);
+    free(enc->encoded);
+    free(enc->tails);
+    checksum_free(&enc->sum);
+}
+
+/**
+ * @brief Write cipher text, checksumming it while it is still in cache if
+ * the cipher text ends in checksums
+ * @param[in,out] enc The encoder
+ * @param[in] data The cipher text
+ * @param[in] len The length of the cipher text
+ * @return 0 on success, 1 on failure
+ */
+static int encoder_write(stream_encoder_t *enc, const void *data, size_t len)
+{
+    return (enc->checksummed && checksum_update(&enc->sum, data, len))
+           || fwrite(data, 1, len, enc->out) != len;
+}
+
+/**
+ * @brief Write the line of checksums that ends the cipher text
+ * @param[in,out] enc The encoder
+ * @return 0 on success, 1 on failure
+ */
+static int encoder_write_checksums(stream_encoder_t *enc)
+{
+    size_t len = 0;
+    char *trailer = checksum_trailer(&enc->sum, &len);
+    if (trailer == NULL)
+        return 1;
+    int failed = fwrite(trailer, 1, len, enc->out) != len;
+    free(trailer);
+    return failed;
+}
+
+/**
+ * @brief Encrypt and write what the encoder holds
+ * @param[in,out] enc The encoder
+ * @param[in] last If the stream has ended, so the end is padded to a whole
+ * block, and an empty stream to one block, as encrypt() does, and the
+ * checksums, if there are any, are written after it
+ * @return 0 on success, 1 if writing failed
+ */
+static int encoder_flush(stream_encoder_t *enc, int last)
+{
+    size_t len = enc->have;
+    if (last)
+    {
+        size_t padded = (enc->total == 0)
+                            ? enc->key_len
+                            : (len + enc->key_len - 1) / enc->key_len
+                                  * enc->key_len;
+        memset(enc->buf + len, PADDING, padded - len);
+        len = padded;
+    }
+    enc->have = 0;
+    if (len > 0)
+    {
+        xor_encrypt_chained(enc->buf, len, enc->tails, enc->num_keys,
+                            enc->key_len, chunk_size);
+        size_t encoded_len = base64_encode_block(enc->buf, len, enc->encoded);
+        if (encoder_write(enc, enc->encoded, encoded_len))
+            return 1;
+    }
+    return last && enc->checksummed && encoder_write_checksums(enc);
+}
+
+/**
+ * @brief A sink that encrypts the plain text with an encoder's keys
+ * @param[in] ctx The stream_encoder_t
+ * @param[in] data The next part of the plain text
+ * @param[in] len The length of the part
+ * @return 0 on success, 1 if writing failed
+ */
+static int encoder_sink(void *ctx, const unsigned char *data, size_t len)
+{
+    stream_encoder_t *enc = (stream_encoder_t *) ctx;
+    enc->total += len;
+    enc->padding = count_padding(data, len, enc->padding);
+    while (len > 0)
+    {
+        size_t take = enc->part_len - enc->have;
+        if (take > len)
+            take = len;
+        memcpy(enc->buf + enc->have, data, take);
+        enc->have += take;
+        data += take;
+        len -= take;
+        if (enc->have == enc->part_len && encoder_flush(enc, 0))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Compress a stream a chunk at a time, and encrypt the frames
+ * @param[in] in The plain text
+ * @param[in,out] enc The encoder to send the frames to
+ * @return EEA_OK, or one of EeaErrors
+ */
+static int compress_to_encoder(FILE *in, stream_encoder_t *enc)
+{
+    unsigned char *plain = malloc(COMPRESS_CHUNK);
+    unsigned char *frame = malloc(compress_frame_bound(COMPRESS_CHUNK));
+    int ret = (plain == NULL || frame == NULL) ? EEA_ERR_NO_MEMORY : EEA_OK;
+    if (ret == EEA_OK
+        && encoder_write(enc, COMPRESSED_PREFIX, strlen(COMPRESSED_PREFIX)))
+        ret = EEA_ERR_IO;
+
+    int eof = 0;
+    while (ret == EEA_OK && !eof)
+    {
+        size_t len = read_part(in, plain, COMPRESS_CHUNK, &eof);
+        if (len == (size_t) -1)
+            ret = EEA_ERR_IO;
+        else if (len > 0)
+        {
+            size_t frame_len = compress_frame(plain, len, frame);
+            if (encoder_sink(enc, frame, frame_len))
+                ret = EEA_ERR_IO;
+        }
+    }
+    if (ret == EEA_OK
+        && (encoder_sink(enc, frame, compress_end_frame(frame))
+            || encoder_flush(enc, 1)))
+        ret = EEA_ERR_IO;
+
+    free(plain);
+    free(frame);
+    return ret;
+}
+
+int encrypt_stream(FILE *in, FILE *out, const char **keys, int num_keys,
+                   size_t *trailing_padding)
+{
+    stream_encoder_t enc;
+    int ret = encoder_init(&enc, out, keys, num_keys);
+    int eof = 0;
+    if (ret == EEA_OK && compression)
+    {
+        // The frames keep any zero bytes at the end of the plain text
+        ret = compress_to_encoder(in, &enc);
+        eof = 1;
+        enc.padding = 0;
+    }
+    while (ret == EEA_OK && !eof)
+    {
+        // Read straight into the encoder, a part at a time
+        size_t len = read_part(in, enc.buf, enc.part_len, &eof);
+        if (len == (size_t) -1)
+        {
+            ret = EEA_ERR_IO;
+            break;
+        }
+        enc.total += len;
+        enc.padding = count_padding(enc.buf, len, enc.padding);
+        enc.have = len;
+        if (encoder_flush(&enc, eof))
+            ret = EEA_ERR_IO;
+    }
+    if (ret == EEA_OK && fflush(out) != 0)
+        ret = EEA_ERR_IO;
+    if (trailing_padding != NULL)
+        *trailing_padding = enc.padding;
+
+    encoder_free(&enc);
+    return ret;
+}
+
+/**
+ * @brief Decrypt a stream of base64 cipher text a part at a time, sending
+ * the plain text to a sink
+ * @param[in] in The cipher text
+ * @param[in] head The start of the cipher text, already read from in
+ * @param[in] head_len The length of the start, at most 16 bytes
+ * @param[in] sink Where to send the plain text, without the padding
+ * @param[in] ctx The sink's state
+ * @param[in] keys The keys to use for decryption
+ * @param[in] num_keys The number of keys being used for decryption
+ * @return EEA_OK, or one of EeaErrors
+ */
+static int decrypt_to_sink(FILE *in, const unsigned char *head,
+                           size_t head_len, stream_sink_t sink, void *ctx,
+                           const char **keys, int num_keys)
+{
+    size_t key_len = strlen(keys[0]);
+    size_t part_len = get_part_len(key_len);
+    size_t text_len = part_len / 3 * 4;
+    unsigned char *text = malloc(text_len);
+    // Room for a part, and the end of a block left over from the last one
+    unsigned char *raw = malloc(part_len + key_len + 1);
+    unsigned char *tails = xor_tails_from_keys(keys, num_keys, key_len);
+    if (text == NULL || raw == NULL || tails == NULL)
+    {
+        free(text);
+        free(raw);
+        free(tails);
+        return EEA_ERR_NO_MEMORY;
+    }
+
+    int ret = EEA_OK;
+    // The checksums after the cipher text aren't read
+    int eof = 0, ended = 0;
+    memcpy(text, head, head_len);
+    size_t text_have = strip_whitespace(text, head_len, &eof);
+    size_t raw_have = 0, total = 0, held = 0;
+    while (!eof && ret == EEA_OK)
+    {
+        size_t len = read_part(in, text + text_have, text_len - text_have,
+                               &eof);
+        if (len == (size_t) -1)
+        {
+            ret = EEA_ERR_IO;
+            break;
+        }
+        text_have += strip_whitespace(text + text_have, len, &eof);
+
+        // Decode whole base64 groups, keeping the rest for the next part
+        size_t usable = text_have - text_have % 4;
+        if ((eof && usable != text_have) || (ended && usable > 0))
+        {
+            ret = EEA_ERR_INVALID_DATA;
+            break;
+        }
+        if (usable == 0)
+            continue;
+        size_t decoded = base64_decode_block((const char *) text, usable,
+                                             raw + raw_have);
+        if (decoded == (size_t) -1)
+        {
+            ret = EEA_ERR_INVALID_DATA;
+            break;
+        }
+        // Padding only comes at the end of the cipher text
+        ended = (text[usable - 1] == '=');
+        memmove(text, text + usable, text_have - usable);
+        text_have -= usable;
+        raw_have += decoded;
+        total += decoded;
+
+        // Decrypt whole blocks, keeping the rest for the next part
+        size_t blocks = raw_have - raw_have % key_len;
+        xor_decrypt_chained(raw, blocks, tails, num_keys, key_len, chunk_size);
+        if (send_unpadded(sink, ctx, raw, blocks, &held))
+            ret = EEA_ERR_IO;
+        memmove(raw, raw + blocks, raw_have - blocks);
+        raw_have -= blocks;
+    }
+
+    // The cipher text must be a whole number of blocks
+    if (ret == EEA_OK && (total == 0 || raw_have != 0))
+        ret = EEA_ERR_INVALID_DATA;
+
+    free(text);
+    free(raw);
+    free(tails);
+    return ret;
+}
+
+/**
+ * @brief Read the start of a stream of cipher text, to see if its plain
+ * text was compressed
+ * @param[in] in The cipher text
+ * @param[out] head Set to what was read, if it wasn't the prefix. Must be
+ * at least sizeof(COMPRESSED_PREFIX) bytes.
+ * @param[out] head_len Set to the length of what was read
+ * @return 1 if it starts with COMPRESSED_PREFIX, 0 otherwise
+ */
+static int read_compressed_prefix(FILE *in, unsigned char *head,
+                                  size_t *head_len)
+{
+    size_t prefix_len = strlen(COMPRESSED_PREFIX);
+    *head_len = fread(head, 1, prefix_len, in);
+    if (*head_len == prefix_len
+        && memcmp(head, COMPRESSED_PREFIX, prefix_len) == 0)
+    {
+        *head_len = 0;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @struct frame_sink_t
+ * @brief A sink that decompresses the plain text as it is decrypted
+ */
+typedef struct
+{
+    frame_reader_t reader;
+    // Why the frames couldn't be read
+    int ret;
+} frame_sink_t;
+
+/**
+ * @brief A sink that gives the decrypted frames to a frame reader
+ * @param[in] ctx The frame_sink_t
+ * @param[in] data The next part of the frames
+ * @param[in] len The length of the part
+ * @return 0 on success, 1 on failure
+ */
+static int frame_sink(void *ctx, const unsigned char *data, size_t len)
+{
+    frame_sink_t *frames = (frame_sink_t *) ctx;
+    frames->ret = frame_reader_feed(&frames->reader, data, len);
+    return frames->ret != EEA_OK;
+}
+
+int decrypt_stream(FILE *in, FILE *out, const char **keys, int num_keys)
+{
+    unsigned char head[sizeof(COMPRESSED_PREFIX)];
+    size_t head_len = 0;
+    int ret = EEA_OK;
+    if (!read_compressed_prefix(in, head, &head_len))
+        ret = decrypt_to_sink(in, head, head_len, file_sink, out, keys,
+                              num_keys);
+    else
+    {
+        frame_sink_t frames;
+        frames.ret = EEA_OK;
+        ret = frame_reader_init(&frames.reader, file_sink, out);
+        if (ret == EEA_OK)
+            ret = decrypt_to_sink(in, head, 0, frame_sink, &frames, keys,
+                                  num_keys);
+        // Tell bad frames from a failed write
+        if (ret == EEA_ERR_IO && frames.ret != EEA_OK)
+            ret = frames.ret;
+        if (ret == EEA_OK)
+            ret = frame_reader_finish(&frames.reader);
+        frame_reader_free(&frames.reader);
+    }
+    if (ret == EEA_OK && fflush(out) != 0)
+        ret = EEA_ERR_IO;
+    return ret;
+}
+
+int rekey_stream(FILE *in, FILE *out, const char **old_keys,
+                 int old_num_keys, const char **new_keys, int new_num_keys)
+{
+    // The plain text only ever exists a part at a time, in memory
+    stream_encoder_t enc;
+    int ret = encoder_init(&enc, out, new_keys, new_num_keys);
+
+    // Compressed frames are re-encrypted as they are
+    unsigned char head[sizeof(COMPRESSED_PREFIX)];
+    size_t head_len = 0;
+    if (ret == EEA_OK && read_compressed_prefix(in, head, &head_len)
+        && encoder_write(&enc, COMPRESSED_PREFIX, strlen(COMPRESSED_PREFIX)))
+        ret = EEA_ERR_IO;
+    if (ret == EEA_OK)
+        ret = decrypt_to_sink(in, head, head_len, encoder_sink, &enc,
+                              old_keys, old_num_keys);
+    if (ret == EEA_OK && (encoder_flush(&enc, 1) || fflush(out) != 0))
+        ret = EEA_ERR_IO;
+    encoder_free(&enc);
+    return ret;
+}
+
+/**
+ * @struct fanout_t
+ * @brief What the reader and the threads encrypting a stream for each
+ * keyset share. The reader fills two buffers in turn, and a buffer is only
+ * refilled once every thread is done with what was last read into it.
+ */
+typedef struct
+{
+    unsigned char *bufs[2];
+    size_t lens[2];
+    // When compressing, the plain text is read into this, and the frames,
+    // compressed once for every keyset, go in the buffers
+    unsigned char *plain;
+    // The number of parts read, and the part the stream ended in
+    size_t read;
+    size_t last;
+    int ended;
+    // Set if reading failed, so the threads stop
+    int failed;
+    // The number of parts each thread is done with
+    size_t *done;
+    pthread_mutex_t lock;
+    pthread_cond_t readable;
+    pthread_cond_t consumed;
+} fanout_t;
+
+/**
+ * @struct fanout_thread_t
+ * @brief What each thread encrypting for a keyset is given
+ */
+typedef struct
+{
+    fanout_t *fanout;
+    int index;
+    stream_encoder_t enc;
+    int ret;
+} fanout_thread_t;
+
+/**
+ * @brief Function called by pthread_create to encrypt each part read for
+ * one keyset
+ * @param[in] args The thread's fanout_thread_t
+ */
+static void *fanout_thread(void *args)
+{
+    fanout_thread_t *thread = (fanout_thread_t *) args;
+    fanout_t *fanout = thread->fanout;
+    for (size_t part = 0;; part++)
+    {
+        pthread_mutex_lock(&fanout->lock);
+        while (fanout->read <= part && !fanout->failed)
+            pthread_cond_wait(&fanout->readable, &fanout->lock);
+        int stop = fanout->failed;
+        int last = fanout->ended && part == fanout->last;
+        pthread_mutex_unlock(&fanout->lock);
+        if (stop)
+            break;
+
+        // After a write fails, keep up with the reader without writing
+        int slot = part % 2;
+        if (thread->ret == EEA_OK
+            && (encoder_sink(&thread->enc, fanout->bufs[slot],
+                             fanout->lens[slot])
+                || (last && encoder_flush(&thread->enc, 1))))
+            thread->ret = EEA_ERR_IO;
+
+        pthread_mutex_lock(&fanout->lock);
+        fanout->done[thread->index] = part + 1;
+        pthread_cond_signal(&fanout->consumed);
+        pthread_mutex_unlock(&fanout->lock);
+        if (last)
+            break;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Get the size of the fan-out's buffers
+ * @return The size
+ */
+static size_t fanout_buf_len(void)
+{
+    if (!compression)
+        return FANOUT_PART;
+    return FANOUT_PART / COMPRESS_CHUNK * compress_frame_bound(COMPRESS_CHUNK)
+           + 1;
+}
+
+/**
+ * @brief Read the next part of a stream into one of the fan-out's buffers,
+ * compressing it if the plain text is being compressed
+ * @param[in] in The stream to read
+ * @param[in,out] fanout What is shared with the threads
+ * @param[in] slot The buffer to read into
+ * @param[out] eof Set if the stream ended
+ * @return The length of the part, (size_t) -1 on a read error
+ */
+static size_t fanout_fill(FILE *in, fanout_t *fanout, int slot, int *eof)
+{
+    unsigned char *buf = fanout->bufs[slot];
+    if (!compression)
+        return read_part(in, buf, FANOUT_PART, eof);
+
+    size_t len = 0;
+    for (size_t read = 0; read < FANOUT_PART && !*eof;
+         read += COMPRESS_CHUNK)
+    {
+        size_t plain_len = read_part(in, fanout->plain, COMPRESS_CHUNK, eof);
+        if (plain_len == (size_t) -1)
+            return plain_len;
+        if (plain_len > 0)
+            len += compress_frame(fanout->plain, plain_len, buf + len);
+    }
+    if (*eof)
+        len += compress_end_frame(buf + len);
+    return len;
+}
+
+/**
+ * @brief Read a stream into the fan-out's buffers until it ends, waiting
+ * for the threads to be done with a buffer before refilling it
+ * @param[in] in The stream to read
+ * @param[in,out] fanout What is shared with the threads
+ * @param[in] count The number of threads
+ * @return EEA_OK, or EEA_ERR_IO if reading failed
+ */
+static int fanout_read(FILE *in, fanout_t *fanout, int count)
+{
+    int eof = 0;
+    for (size_t part = 0; !eof; part++)
+    {
+        int slot = part % 2;
+        pthread_mutex_lock(&fanout->lock);
+        for (int t = 0; t < count; t++)
+            while (part >= 2 && fanout->done[t] < part - 1)
+                pthread_cond_wait(&fanout->consumed, &fanout->lock);
+        pthread_mutex_unlock(&fanout->lock);
+
+        size_t len = fanout_fill(in, fanout, slot, &eof);
+        pthread_mutex_lock(&fanout->lock);
+        if (len == (size_t) -1)
+            fanout->failed = 1;
+        else
+        {
+            fanout->lens[slot] = len;
+            fanout->read = part + 1;
+            fanout->last = part;
+            fanout->ended = eof;
+        }
+        pthread_cond_broadcast(&fanout->readable);
+        pthread_mutex_unlock(&fanout->lock);
+        if (len == (size_t) -1)
+            return EEA_ERR_IO;
+    }
+    return EEA_OK;
+}
+
+int encrypt_stream_fanout(FILE *in, FILE **outs, const char ***keys,
+                          const int *num_keys, int count,
+                          size_t *trailing_padding)
+{
+    fanout_t fanout;
+    memset(&fanout, 0, sizeof(fanout));
+    fanout.bufs[0] = malloc(fanout_buf_len());
+    fanout.bufs[1] = malloc(fanout_buf_len());
+    if (compression)
+        fanout.plain = malloc(COMPRESS_CHUNK);
+    fanout.done = calloc(count, sizeof(size_t));
+    fanout_thread_t *threads = calloc(count, sizeof(fanout_thread_t));
+    pthread_t *pool = malloc(count * sizeof(pthread_t));
+
+    int ret = EEA_OK;
+    int ready = 0;
+    if (fanout.bufs[0] == NULL || fanout.bufs[1] == NULL
+        || fanout.done == NULL || threads == NULL || pool == NULL
+        || (compression && fanout.plain == NULL))
+        ret = EEA_ERR_NO_MEMORY;
+    for (; ret == EEA_OK && ready < count; ready++)
+    {
+        threads[ready].fanout = &fanout;
+        threads[ready].index = ready;
+        ret = encoder_init(&threads[ready].enc, outs[ready], keys[ready],
+                           num_keys[ready]);
+        if (ret == EEA_OK && compression
+            && encoder_write(&threads[ready].enc, COMPRESSED_PREFIX,
+                             strlen(COMPRESSED_PREFIX)))
+            ret = EEA_ERR_IO;
+    }
+
+    pthread_mutex_init(&fanout.lock, NULL);
+    pthread_cond_init(&fanout.readable, NULL);
+    pthread_cond_init(&fanout.consumed, NULL);
+    int started = 0;
+    for (; ret == EEA_OK && started < count; started++)
+        if (pthread_create(&pool[started], NULL, fanout_thread,
+                           &threads[started]) != 0)
+        {
+            ret = EEA_ERR_NO_MEMORY;
+            break;
+        }
+
+    if (ret == EEA_OK)
+        ret = fanout_read(in, &fanout, count);
+    else
+    {
+        // Stop any threads that did start
+        pthread_mutex_lock(&fanout.lock);
+        fanout.failed = 1;
+        pthread_cond_broadcast(&fanout.readable);
+        pthread_mutex_unlock(&fanout.lock);
+    }
+    for (int t = 0; t < started; t++)
+        pthread_join(pool[t], NULL);
+
+    for (int t = 0; t < ready; t++)
+    {
+        if (ret == EEA_OK
+            && (threads[t].ret != EEA_OK || fflush(outs[t]) != 0))
+            ret = EEA_ERR_IO;
+        encoder_free(&threads[t].enc);
+    }
+    // Every keyset is given the same plain text, and the frames keep any
+    // zero bytes at its end
+    if (trailing_padding != NULL)
+        *trailing_padding = (ready > 0 && !compression)
+                                ? threads[0].enc.padding
+                                : 0;
+
+    pthread_cond_destroy(&fanout.consumed);
+    pthread_cond_destroy(&fanout.readable);
+    pthread_mutex_destroy(&fanout.lock);
+    free(fanout.bufs[0]);
+    free(fanout.bufs[1]);
+    free(fanout.plain);
+    free(fanout.done);
+    free(threads);
+    free(pool);
+    return ret;
+}
@@ -1,218 +1,597 @@
-#include <pthread.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-
-#include "decrypt.h"
-#include "encrypt.h"
-#include "file_handling.h"
-#include "globals.h"
-#include "utils.h"
-
-/**
- * @struct thread_data_t
- * @brief Simple struct to hold all the data each thread will need
- */
-typedef struct
-{
-    char **files_list;
-    int start;
-    int end;
-    const char **keys;
-    int num_keys;
-    int overwrite;
-    int encrypting;
-} thread_data_t;
-
-static volatile int running_threads = 0;
-static pthread_mutex_t running_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-/**
- * @brief Encrypt all files in the provided list
- * @param[in] files_list The list files to be encrypted
- * @param[in] start Index in the files list to start
- * @param[in] end Index in the files list to end
- * @param[in] keys The keys to be used for encryption
- * @param[in] num_keys The number of keys
- * @param[in] overwrite Should the files be overwritten
- * @note The array of files will be freed
- */
-static void encrypt_list_of_files(char **files_list, int start, int end,
-                                  const char **keys, int num_keys,
-                                  int overwrite)
-{
-    for (int f = start; f < end; f++)
-    {
-        int encryption_success = encrypt_file(files_list[f], keys, num_keys);
-        if (encryption_success)
-            fprintf(stdout, "%sEncryption success:%s %s\n",
-                    colors[COLOR_SUCCESS], colors[COLOR_RESET], files_list[f]);
-        else
-            fprintf(stderr, "%sEncryption failed:%s  %s\n",
-                    colors[COLOR_ERROR], colors[COLOR_RESET], files_list[f]);
-
-        if (encryption_success && overwrite)
-            remove(files_list[f]);
-
-        free(files_list[f]);
-    }
-    pthread_mutex_lock(&running_mutex);
-    running_threads--;
-    pthread_mutex_unlock(&running_mutex);
-}
-
-/**
- * @brief Decrypt all files in the provided list
- * @param[in] files_list The list files to be decrypted
- * @param[in] start Index in the files list to start
- * @param[in] end Index in the files list to end
- * @param[in] keys The keys to be used for decryption
- * @param[in] num_keys The number of keys
- * @param[in] overwrite Should the files be overwritten
- * @note The array of files will be freed
- */
-static void decrypt_list_of_files(char **files_list, int start, int end,
-                                  const char **keys, int num_keys,
-                                  int overwrite)
-{
-    for (int f = start; f < end; f++)
-    {
-        int decryption_success = 0;
-        if (is_of_filetype(files_list[f], EEA_FILE_EXTENTION))
-            decryption_success = decrypt_file(files_list[f], keys, num_keys);
-        else
-        {
-            free(files_list[f]);
-            continue;
-        }
-
-        if (decryption_success)
-            fprintf(stdout, "%sDecryption success:%s %s\n",
-                    colors[COLOR_SUCCESS], colors[COLOR_RESET], files_list[f]);
-        else
-            fprintf(stderr, "%sDecryption failed:%s  %s\n",
-                    colors[COLOR_ERROR], colors[COLOR_RESET], files_list[f]);
-
-        if (decryption_success && overwrite)
-            remove(files_list[f]);
-
-        free(files_list[f]);
-    }
-    pthread_mutex_lock(&running_mutex);
-    running_threads--;
-    pthread_mutex_unlock(&running_mutex);
-}
-
-/**
- * @brief Function called by pthread_create to start each thread
- * @param[in] args A thread_data_t struct to house the data for the thread
- */
-static void *start_thread(void *args)
-{
-    thread_data_t *data = (thread_data_t *) args;
-    pthread_mutex_lock(&running_mutex);
-    running_threads++;
-    pthread_mutex_unlock(&running_mutex);
-    if (data->encrypting)
-        encrypt_list_of_files(data->files_list, data->start, data->end,
-                              data->keys, data->num_keys, data->overwrite);
-
-    else
-        decrypt_list_of_files(data->files_list, data->start, data->end,
-                              data->keys, data->num_keys, data->overwrite);
-    return NULL;
-}
-
-/**
- * @brief Function to initialize the threads and set the thread_data_t data
- * @param[in] files_list The list files to be decrypted
- * @param[in] num_files The number of files to be decrypted
- * @param[in] keys The keys to be used for decryption
- * @param[in] num_keys The number of keys
- * @param[in] overwrite Should the files be overwritten
- * @param[in] threads The number of threads to use
- * @param[in] encrypting Are we encrypting the files
- */
-void init_threads(char **files_list, int num_files, const char **keys,
-                  int num_keys, int overwrite, int threads, int encrypting)
-{
-    int files_per_thread = num_files / threads;
-    int leftover = num_files % threads;
-    int start = 0;
-
-    thread_data_t data[threads];
-    pthread_t threadPool[threads];
-    for (int t = 0; t < threads; t++)
-    {
-        int end = start + files_per_thread;
-        if (leftover > 0)
-        {
-            end++;
-            leftover--;
-        }
-
-        data[t].files_list = files_list;
-        data[t].start = start;
-        data[t].end = end;
-        data[t].keys = keys;
-        data[t].num_keys = num_keys;
-        data[t].overwrite = overwrite;
-        data[t].encrypting = encrypting;
-
-        pthread_create(&threadPool[t], NULL, start_thread, &data[t]);
-        start = end;
-    }
-
-    // Make sure all threads finish running before returning
-    // Fixes issue on Windows where the function returns, and frees
-    // the file_list before the threads finish causing them to crash
-    struct timespec ts;
-
-    // Sleep for a quarter second
-    ts.tv_sec = 250 / 1000;
-    ts.tv_nsec = (250 % 1000) * 1000000;
-
-    while (running_threads > 0)
-        nanosleep(&ts, &ts);
-
-    for (int t = 0; t < threads; t++)
-        pthread_join(threadPool[t], NULL);
-}
-
-void start_dir_encrypt_threads(char **files_list, int num_files,
-                               const char **keys, int num_keys, int overwrite,
-                               int threads)
-{
-    if (threads > num_files)
-        threads = num_files;
-
-    if (threads <= 1)
-    {
-        encrypt_list_of_files(files_list, 0, num_files, keys, num_keys,
-                              overwrite);
-        free(files_list);
-        return;
-    }
-    init_threads(files_list, num_files, keys, num_keys, overwrite, threads, 1);
-    free(files_list);
-}
-
-void start_dir_decrypt_threads(char **files_list, int num_files,
-                               const char **keys, int num_keys, int overwrite,
-                               int threads)
-{
-    if (threads > num_files)
-        threads = num_files;
-
-    if (threads <= 1)
-    {
-        decrypt_list_of_files(files_list, 0, num_files, keys, num_keys,
-                              overwrite);
-        free(files_list);
-        return;
-    }
-
-    init_threads(files_list, num_files, keys, num_keys, overwrite, threads, 0);
-    free(files_list);
-}
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "decrypt.h"
+#include "eea.h"
+#include "encrypt.h"
+#include "file_handling.h"
+#include "file_index.h"
+#include "globals.h"
+#include "histogram.h"
+#include "journal.h"
+#include "memprof.h"
+#include "path_set.h"
+#include "progress.h"
+#include "stats.h"
+#include "trace.h"
+#include "utils.h"
+#include "watch.h"
+#include "work_queue.h"
+
+/**
+ * @struct queued_file_t
+ * @brief A file waiting in the queue to be encrypted/decrypted
+ */
+typedef struct
+{
+    char *path;
+    // When the file was found, or when it was written to in watch mode
+    uint64_t queued_ns;
+} queued_file_t;
+
+/**
+ * @struct thread_data_t
+ * @brief Simple struct to hold all the data each thread will need
+ */
+typedef struct
+{
+    work_queue_t *queue;
+    journal_t *journal;
+    file_index_t *index;
+    progress_t *progress;
+    // The outputs of the files queued so far, which the walk can find as
+    // the directory is read while the files are handled
+    path_set_t *outputs;
+    const char **keys;
+    int num_keys;
+    int overwrite;
+    int encrypting;
+    int watching;
+    // Time from a file landing to its output being saved, in watch mode
+    histogram_t *latency;
+} thread_data_t;
+
+// How many files, per thread, the directory walk can get ahead of
+// the threads doing the encryption/decryption
+static const size_t QUEUE_DEPTH_PER_THREAD = 64;
+
+static volatile int running_threads = 0;
+static pthread_mutex_t running_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Report and record the result of encrypting/decrypting a file
+ * @param[in] data The thread data for the job
+ * @param[in] file The file that was processed
+ * @param[in] success If the file was processed successfully
+ * @param[in] bytes_in The size of the file
+ * @param[in] bytes_out The size of the output
+ */
+static void finish_file(thread_data_t *data, const queued_file_t *file,
+                        int success, size_t bytes_in, size_t bytes_out)
+{
+    // Printing a line per file costs more than encrypting small files, so
+    // it's left to the reporter unless asked for
+    int verbose = (output_mode == OUTPUT_VERBOSE);
+    const char *type = data->encrypting ? "Encryption" : "Decryption";
+    if (!success)
+    {
+        if (verbose)
+            fprintf(stderr, "%s%s failed:%s  %s\n", colors[COLOR_ERROR], type,
+                    colors[COLOR_RESET], file->path);
+        progress_file_failed(data->progress, file->path);
+        return;
+    }
+    progress_file_done(data->progress, bytes_in, bytes_out);
+
+    if (data->watching)
+    {
+        uint64_t latency = get_time_ns() - file->queued_ns;
+        if (verbose)
+            fprintf(stdout, "%s%s success:%s %s (%.1f ms)\n",
+                    colors[COLOR_SUCCESS], type, colors[COLOR_RESET],
+                    file->path, latency / 1e6);
+        pthread_mutex_lock(&running_mutex);
+        histogram_record(data->latency, latency);
+        pthread_mutex_unlock(&running_mutex);
+    }
+    else if (verbose)
+        fprintf(stdout, "%s%s success:%s %s\n", colors[COLOR_SUCCESS], type,
+                colors[COLOR_RESET], file->path);
+
+    // The journal removes the file itself, once the commit is on disk
+    if (data->journal != NULL)
+        journal_commit(data->journal, file->path);
+    else if (data->overwrite)
+        remove(file->path);
+}
+
+/**
+ * @brief Encrypt all files taken from the queue until it is closed
+ * @param[in] data The thread data with the queue of files to be encrypted
+ * @note Each file taken from the queue will be freed
+ */
+static void encrypt_list_of_files(thread_data_t *data)
+{
+    queued_file_t *file;
+    while ((file = work_queue_pop(data->queue)) != NULL)
+    {
+        uint64_t file_start = trace_file != NULL ? get_time_ns() : 0;
+        index_entry_t current;
+        if (data->index != NULL
+            && file_index_unchanged(data->index, file->path, &current))
+        {
+            progress_file_skipped(data->progress);
+            free(file->path);
+            free(file);
+            continue;
+        }
+
+        journal_record(data->journal, file->path, JOURNAL_IN_PROGRESS);
+        size_t bytes_in = 0, bytes_out = 0;
+        int encryption_success = (encrypt_file(file->path, data->keys,
+                                               data->num_keys, &bytes_in,
+                                               &bytes_out)
+                                  == EEA_OK);
+
+        if (encryption_success && data->index != NULL)
+        {
+            char *output = get_output_filename(file->path, 1);
+            if (output != NULL)
+                file_index_update(data->index, &current, output);
+            free(output);
+        }
+        finish_file(data, file, encryption_success, bytes_in, bytes_out);
+        if (trace_file != NULL)
+            trace_span("encrypt_file", file->path, file_start, get_time_ns(),
+                       bytes_in);
+
+        free(file->path);
+        free(file);
+    }
+    pthread_mutex_lock(&running_mutex);
+    running_threads--;
+    pthread_mutex_unlock(&running_mutex);
+}
+
+/**
+ * @brief Decrypt all files taken from the queue until it is closed
+ * @param[in] data The thread data with the queue of files to be decrypted
+ * @note Each file taken from the queue will be freed
+ */
+static void decrypt_list_of_files(thread_data_t *data)
+{
+    queued_file_t *file;
+    while ((file = work_queue_pop(data->queue)) != NULL)
+    {
+        uint64_t file_start = trace_file != NULL ? get_time_ns() : 0;
+        journal_record(data->journal, file->path, JOURNAL_IN_PROGRESS);
+        size_t bytes_in = 0, bytes_out = 0;
+        int decryption_success = (decrypt_file(file->path, data->keys,
+                                               data->num_keys, &bytes_in,
+                                               &bytes_out)
+                                  == EEA_OK);
+        finish_file(data, file, decryption_success, bytes_in, bytes_out);
+        if (trace_file != NULL)
+            trace_span("decrypt_file", file->path, file_start, get_time_ns(),
+                       bytes_in);
+
+        free(file->path);
+        free(file);
+    }
+    pthread_mutex_lock(&running_mutex);
+    running_threads--;
+    pthread_mutex_unlock(&running_mutex);
+}
+
+/**
+ * @brief Function called by pthread_create to start each thread
+ * @param[in] args A thread_data_t struct to house the data for the thread
+ */
+static void *start_thread(void *args)
+{
+    thread_data_t *data = (thread_data_t *) args;
+    progress_register_worker(data->progress);
+    trace_name_thread("worker");
+    memprof_name_thread("worker");
+    if (data->encrypting)
+        encrypt_list_of_files(data);
+    else
+        decrypt_list_of_files(data);
+    stats_flush_thread();
+    return NULL;
+}
+
+/**
+ * @brief Add a file to the queue for the threads to work on
+ * @param[in] data The thread data with the queue to add to
+ * @param[in] path Path to the file
+ * @param[in] queued_ns When the file was found or written to
+ * @return If the file was added to the queue
+ */
+static int push_file(thread_data_t *data, const char *path,
+                     uint64_t queued_ns)
+{
+    queued_file_t *file = malloc(sizeof(queued_file_t));
+    if (file == NULL)
+        return 0;
+
+    file->path = strdup(path);
+    file->queued_ns = queued_ns;
+    if (file->path == NULL)
+    {
+        free(file);
+        return 0;
+    }
+
+    journal_record(data->journal, file->path, JOURNAL_QUEUED);
+    if (!work_queue_push(data->queue, file))
+    {
+        free(file->path);
+        free(file);
+        return 0;
+    }
+    progress_file_queued(data->progress);
+    return 1;
+}
+
+/**
+ * @brief walk_dir() callback that adds each file found to the queue
+ * @param[in] path Path to the file that was found
+ * @param[in] args A thread_data_t struct with the queue to add to
+ * @return 1 to keep walking, 0 if the file could not be queued
+ */
+static int queue_file(const char *path, void *args)
+{
+    thread_data_t *data = (thread_data_t *) args;
+    if (path_set_contains(data->outputs, path))
+        return 1;
+
+    // Only '.eea' files can be decrypted, so don't bother queueing the rest
+    if (!data->encrypting && !is_of_filetype(path, EEA_FILE_EXTENTION))
+        return 1;
+
+    // Either one of ours being saved, or left behind by a save that was
+    // interrupted, which is counted as skipped
+    if (ends_with(path, PARTIAL_FILE_EXTENTION))
+    {
+        size_t len = strlen(path) - strlen(PARTIAL_FILE_EXTENTION);
+        char output[len + 1];
+        memcpy(output, path, len);
+        output[len] = '\0';
+        if (!path_set_contains(data->outputs, output))
+        {
+            progress_file_queued(data->progress);
+            progress_file_skipped(data->progress);
+        }
+        return 1;
+    }
+
+    int skip = journal_should_skip(data->journal, path);
+    if (skip == JOURNAL_COMMITTED)
+    {
+        // Counted the same as a file the index skips, so a resumed job
+        // adds up to the whole directory
+        progress_file_queued(data->progress);
+        progress_file_skipped(data->progress);
+        return 1;
+    }
+    if (skip)
+        return 1;
+
+    if (data->index != NULL)
+    {
+        if (ends_with(path, INDEX_FILE))
+            return 1;
+
+        // Don't encrypt the output from the last run a second time
+        if (is_of_filetype(path, EEA_FILE_EXTENTION))
+        {
+            char *input = get_output_filename(path, 0);
+            int is_output = (input != NULL && file_exists(input));
+            free(input);
+            if (is_output)
+                return 1;
+        }
+    }
+
+    char *output = get_output_filename(path, data->encrypting);
+    int added = (output != NULL && path_set_add(data->outputs, output));
+    free(output);
+    return added && push_file(data, path, get_time_ns());
+}
+
+/**
+ * @brief watch_dir() callback that adds each file that lands to the queue
+ * @param[in] path Path to the file that landed
+ * @param[in] closed_ns When the file was last written to
+ * @param[in] args A thread_data_t struct with the queue to add to
+ * @return 1 to keep watching, 0 if the file could not be queued
+ */
+static int queue_watched_file(const char *path, uint64_t closed_ns,
+                              void *args)
+{
+    thread_data_t *data = (thread_data_t *) args;
+
+    // When encrypting, '.eea' files are our own output landing. When
+    // decrypting, they are the only files that can be decrypted.
+    if (data->encrypting == is_of_filetype(path, EEA_FILE_EXTENTION))
+        return 1;
+
+    // Left behind by a save that was interrupted, which still closes it
+    if (ends_with(path, PARTIAL_FILE_EXTENTION))
+        return 1;
+
+    return push_file(data, path, closed_ns);
+}
+
+/**
+ * @brief Start recording the timeline of a job, if it was asked for
+ * @param[in] dir_name The directory the job is for
+ * @param[in] encrypting Are we encrypting the files
+ * @param[in] producer Name for the thread that queues the files
+ */
+static void start_trace(const char *dir_name, int encrypting,
+                        const char *producer)
+{
+    if (trace_file == NULL)
+        return;
+
+    size_t name_len = strlen(dir_name) + 9;
+    char name[name_len];
+    snprintf(name, name_len, "%s %s", encrypting ? "encrypt" : "decrypt",
+             dir_name);
+    trace_begin_job(name);
+    trace_name_thread(producer);
+}
+
+/**
+ * @brief Set up the thread data for a job
+ * @param[out] data The thread data to set up
+ * @param[in] keys The keys to be used for encryption/decryption
+ * @param[in] num_keys The number of keys
+ * @param[in] overwrite Should the files be overwritten
+ * @param[in] threads The number of threads that will be used
+ * @param[in] encrypting Are we encrypting the files
+ * @return If the thread data was set up
+ */
+static int init_thread_data(thread_data_t *data, const char **keys,
+                            int num_keys, int overwrite, int threads,
+                            int encrypting)
+{
+    memset(data, 0, sizeof(thread_data_t));
+    data->queue = work_queue_create(threads * QUEUE_DEPTH_PER_THREAD);
+    data->outputs = path_set_create();
+    if (data->queue == NULL || data->outputs == NULL)
+    {
+        fprintf(stderr, "%sError:%s Failed to allocate memory. Aborting...\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        if (data->queue != NULL)
+            work_queue_free(data->queue);
+        path_set_free(data->outputs);
+        return 0;
+    }
+    data->progress = progress_start(threads, encrypting, output_mode);
+    if (data->progress == NULL)
+    {
+        fprintf(stderr, "%sError:%s Failed to allocate memory. Aborting...\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        work_queue_free(data->queue);
+        path_set_free(data->outputs);
+        return 0;
+    }
+    data->keys = keys;
+    data->num_keys = num_keys;
+    data->overwrite = overwrite;
+    data->encrypting = encrypting;
+    return 1;
+}
+
+/**
+ * @brief Start the threads that work on the files in the queue
+ * @param[in] data The thread data shared by the threads
+ * @param[out] threadPool The threads that were started
+ * @param[in] threads The number of threads to start
+ * @return The number of threads that were started
+ */
+static int start_threads(thread_data_t *data, pthread_t *threadPool,
+                         int threads)
+{
+    int started = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_mutex_lock(&running_mutex);
+        running_threads++;
+        pthread_mutex_unlock(&running_mutex);
+
+        if (pthread_create(&threadPool[started], NULL, start_thread, data)
+            != 0)
+        {
+            pthread_mutex_lock(&running_mutex);
+            running_threads--;
+            pthread_mutex_unlock(&running_mutex);
+            continue;
+        }
+        started++;
+    }
+
+    if (started == 0)
+        fprintf(stderr, "%sError:%s Failed to start any threads\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+    return started;
+}
+
+/**
+ * @brief Close the queue and wait for the threads to finish the files
+ * left in it
+ * @param[in] data The thread data shared by the threads
+ * @param[in] threadPool The threads that were started
+ * @param[in] started The number of threads that were started
+ */
+static void stop_threads(thread_data_t *data, pthread_t *threadPool,
+                         int started)
+{
+    work_queue_close(data->queue);
+
+    // Make sure all threads finish running before returning
+    // Fixes issue on Windows where the function returns, and frees
+    // the queue before the threads finish causing them to crash
+    struct timespec ts;
+
+    // Sleep for a quarter second
+    ts.tv_sec = 250 / 1000;
+    ts.tv_nsec = (250 % 1000) * 1000000;
+
+    while (running_threads > 0)
+        nanosleep(&ts, &ts);
+
+    for (int t = 0; t < started; t++)
+        pthread_join(threadPool[t], NULL);
+
+    // Free anything left behind if the threads couldn't be started
+    queued_file_t *file;
+    while ((file = work_queue_pop(data->queue)) != NULL)
+    {
+        free(file->path);
+        free(file);
+    }
+    work_queue_free(data->queue);
+    path_set_free(data->outputs);
+}
+
+/**
+ * @brief Function to initialize the threads and feed them the files in
+ * the directory as it is walked
+ * @param[in] dir_name The directory to walk
+ * @param[in] keys The keys to be used for encryption/decryption
+ * @param[in] num_keys The number of keys
+ * @param[in] overwrite Should the files be overwritten
+ * @param[in] threads The number of threads to use
+ * @param[in] encrypting Are we encrypting the files
+ * @param[in] resume Resume the job from its journal
+ */
+void init_threads(const char *dir_name, const char **keys, int num_keys,
+                  int overwrite, int threads, int encrypting, int resume)
+{
+    if (threads < 1)
+        threads = 1;
+
+    thread_data_t data;
+    if (!init_thread_data(&data, keys, num_keys, overwrite, threads,
+                          encrypting))
+        return;
+
+    // Overwritten files are gone after the run, so there is nothing to
+    // compare against next time
+    if (encrypting && !overwrite && incremental_index)
+        data.index = file_index_open(dir_name, index_content_hash, keys,
+                                     num_keys);
+    data.journal = journal_open(dir_name, encrypting, overwrite, resume);
+    if (data.journal == NULL)
+        fprintf(stderr,
+                "%sWarning:%s Unable to create the job journal. The job "
+                "will not be resumable\n",
+                colors[COLOR_WARNING], colors[COLOR_RESET]);
+
+    stats_begin_job();
+    memprof_begin_job();
+    start_trace(dir_name, encrypting, "walk_dir");
+    memprof_name_thread("walk_dir");
+    pthread_t threadPool[threads];
+    int started = start_threads(&data, threadPool, threads);
+
+    // The threads start working on files as soon as the walk finds them
+    int walked = 0;
+    uint64_t walk_start = trace_file != NULL ? get_time_ns() : 0;
+    if (started > 0)
+        walked = walk_dir(dir_name, queue_file, &data);
+    trace_span("walk_dir", dir_name, walk_start, get_time_ns(), 0);
+    progress_walk_done(data.progress);
+    stop_threads(&data, threadPool, started);
+
+    uint64_t failures = progress_failures(data.progress);
+    progress_stop(data.progress);
+    stats_end_job(started, output_mode == OUTPUT_JSON);
+    memprof_end_job(output_mode == OUTPUT_JSON);
+    trace_end_job();
+
+    int finished = walked && failures == 0;
+    journal_close(data.journal, finished);
+    file_index_close(data.index, walked);
+    if (!finished && data.journal != NULL)
+        printf("The job did not finish, %" PRIu64 " file(s) failed. Run the "
+               "job on \'%s\' again to resume it.\n",
+               failures, dir_name);
+}
+
+void start_dir_encrypt_threads(const char *dir_name, const char **keys,
+                               int num_keys, int overwrite, int threads,
+                               int resume)
+{
+    init_threads(dir_name, keys, num_keys, overwrite, threads, 1, resume);
+}
+
+void start_dir_decrypt_threads(const char *dir_name, const char **keys,
+                               int num_keys, int overwrite, int threads,
+                               int resume)
+{
+    init_threads(dir_name, keys, num_keys, overwrite, threads, 0, resume);
+}
+
+void start_dir_watch_threads(const char *dir_name, const char **keys,
+                             int num_keys, int overwrite, int threads,
+                             int encrypting)
+{
+    if (threads < 1)
+        threads = 1;
+
+    histogram_t *latency = histogram_create();
+    if (latency == NULL)
+    {
+        fprintf(stderr, "%sError:%s Failed to allocate memory. Aborting...\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+        return;
+    }
+
+    thread_data_t data;
+    if (!init_thread_data(&data, keys, num_keys, overwrite, threads,
+                          encrypting))
+    {
+        histogram_free(latency);
+        return;
+    }
+    data.watching = 1;
+    data.latency = latency;
+
+    stats_begin_job();
+    memprof_begin_job();
+    start_trace(dir_name, encrypting, "watch_dir");
+    memprof_name_thread("watch_dir");
+    pthread_t threadPool[threads];
+    int started = start_threads(&data, threadPool, threads);
+    if (started > 0)
+    {
+        printf("Watching \'%s\' for new files to %s.\n"
+               "Enter 'q' to stop watching.\n",
+               dir_name, encrypting ? "encrypt" : "decrypt");
+        watch_dir(dir_name, queue_watched_file, &data);
+    }
+    stop_threads(&data, threadPool, started);
+    progress_stop(data.progress);
+    stats_end_job(started, output_mode == OUTPUT_JSON);
+    memprof_end_job(output_mode == OUTPUT_JSON);
+    trace_end_job();
+
+    if (latency->total > 0)
+        printf("%" PRIu64 " file(s) %s. Time from landing to saved: "
+               "%.1f ms average, %.1f ms p50, %.1f ms p99, %.1f ms max\n",
+               latency->total, encrypting ? "encrypted" : "decrypted",
+               histogram_mean(latency) / 1e6,
+               histogram_percentile(latency, 50) / 1e6,
+               histogram_percentile(latency, 99) / 1e6, latency->max / 1e6);
+    histogram_free(latency);
+}
@@ -0,0 +1,209 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "progress.h"
+#include "trace.h"
+#include "utils.h"
+
+/**
+ * @struct trace_event_t
+ * @brief A single span of time on a thread
+ */
+typedef struct
+{
+    const char *name;
+    char *detail;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t bytes;
+} trace_event_t;
+
+/**
+ * @struct trace_buffer_t
+ * @brief The spans recorded by a single thread. Only the thread that owns
+ * it writes to it, and it is only read once the thread has finished.
+ */
+typedef struct trace_buffer
+{
+    int tid;
+    char *thread_name;
+    trace_event_t *events;
+    size_t num_events;
+    size_t max_events;
+    struct trace_buffer *next;
+} trace_buffer_t;
+
+static trace_buffer_t *buffers = NULL;
+static int next_tid = 1;
+static unsigned int job_id = 0;
+static int job_active = 0;
+static uint64_t job_start_ns = 0;
+static char *job_name = NULL;
+// Only taken when a thread records its first span of a job
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local trace_buffer_t *local_buffer = NULL;
+static _Thread_local unsigned int local_job = 0;
+
+/**
+ * @brief Get the calling thread's buffer for the current job, creating it
+ * if this is the thread's first span
+ * @return The buffer, NULL if allocating it failed
+ */
+static trace_buffer_t *get_buffer(void)
+{
+    if (local_buffer != NULL && local_job == job_id)
+        return local_buffer;
+
+    trace_buffer_t *buffer = calloc(1, sizeof(trace_buffer_t));
+    if (buffer == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&buffers_mutex);
+    buffer->tid = next_tid++;
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&buffers_mutex);
+
+    local_buffer = buffer;
+    local_job = job_id;
+    return buffer;
+}
+
+void trace_begin_job(const char *name)
+{
+    if (trace_file == NULL)
+        return;
+
+    pthread_mutex_lock(&buffers_mutex);
+    job_id++;
+    next_tid = 1;
+    free(job_name);
+    job_name = strdup(name);
+    job_start_ns = get_time_ns();
+    job_active = 1;
+    pthread_mutex_unlock(&buffers_mutex);
+}
+
+void trace_name_thread(const char *name)
+{
+    if (trace_file == NULL || !job_active)
+        return;
+
+    trace_buffer_t *buffer = get_buffer();
+    if (buffer == NULL)
+        return;
+    free(buffer->thread_name);
+    buffer->thread_name = strdup(name);
+}
+
+void trace_span(const char *name, const char *detail, uint64_t start_ns,
+                uint64_t end_ns, uint64_t bytes)
+{
+    if (trace_file == NULL || !job_active)
+        return;
+
+    trace_buffer_t *buffer = get_buffer();
+    if (buffer == NULL)
+        return;
+
+    if (buffer->num_events == buffer->max_events)
+    {
+        size_t new_max = buffer->max_events ? buffer->max_events * 2 : 1024;
+        trace_event_t *tmp = realloc(buffer->events,
+                                     sizeof(trace_event_t) * new_max);
+        if (tmp == NULL)
+            return;
+        buffer->events = tmp;
+        buffer->max_events = new_max;
+    }
+
+    trace_event_t *event = &buffer->events[buffer->num_events++];
+    event->name = name;
+    event->detail = detail != NULL ? strdup(detail) : NULL;
+    event->start_ns = start_ns;
+    event->end_ns = end_ns;
+    event->bytes = bytes;
+}
+
+/**
+ * @brief Write a thread's spans to the trace file
+ * @param[in] fout The trace file
+ * @param[in] buffer The thread's buffer
+ */
+static void write_buffer(FILE *fout, const trace_buffer_t *buffer)
+{
+    if (buffer->thread_name != NULL)
+    {
+        fprintf(fout,
+                ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":"
+                "\"thread_name\",\"args\":{\"name\":",
+                buffer->tid);
+        print_json_string(fout, buffer->thread_name);
+        fprintf(fout, "}}");
+    }
+
+    for (size_t e = 0; e < buffer->num_events; e++)
+    {
+        const trace_event_t *event = &buffer->events[e];
+        // Chrome traces are in microseconds
+        fprintf(fout,
+                ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":\"%s\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"bytes\":%" PRIu64,
+                buffer->tid, event->name,
+                (event->start_ns - job_start_ns) / 1e3,
+                (event->end_ns - event->start_ns) / 1e3,
+                event->bytes);
+        if (event->detail != NULL)
+        {
+            fprintf(fout, ",\"file\":");
+            print_json_string(fout, event->detail);
+        }
+        fprintf(fout, "}}");
+    }
+}
+
+void trace_end_job(void)
+{
+    if (trace_file == NULL || !job_active)
+        return;
+
+    pthread_mutex_lock(&buffers_mutex);
+    job_active = 0;
+    FILE *fout = fopen(trace_file, "w");
+    if (fout == NULL)
+        fprintf(stderr, "%sError:%s Failed to open the trace file \'%s\'\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], trace_file);
+    else
+    {
+        fprintf(fout, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                      "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+                      "\"args\":{\"name\":");
+        print_json_string(fout, job_name != NULL ? job_name : "eea");
+        fprintf(fout, "}}");
+        for (trace_buffer_t *b = buffers; b != NULL; b = b->next)
+            write_buffer(fout, b);
+        fprintf(fout, "\n]}\n");
+        fclose(fout);
+        if (output_mode != OUTPUT_JSON)
+            printf("Wrote the timeline of the job to \'%s\'\n", trace_file);
+    }
+
+    while (buffers != NULL)
+    {
+        trace_buffer_t *next = buffers->next;
+        for (size_t e = 0; e < buffers->num_events; e++)
+            free(buffers->events[e].detail);
+        free(buffers->events);
+        free(buffers->thread_name);
+        free(buffers);
+        buffers = next;
+    }
+    free(job_name);
+    job_name = NULL;
+    pthread_mutex_unlock(&buffers_mutex);
+}
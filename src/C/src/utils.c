@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <openssl/rand.h>
 
@@ -31,13 +32,7 @@ char *get_random_hexstr(size_t size)
     } while (rc != 1 && tries < MAX_TRIES);
 
     if (rc != 1)
-    {
-        fprintf(stderr,
-                "%sError:%s Exceeded the max tries to get random "
-                "bytes\n",
-                colors[COLOR_ERROR], colors[COLOR_RESET]);
-        exit(rc);
-    }
+        return NULL;
 
     char *hexstr = malloc((sizeof(buffer) * 2) + 1);
     if (hexstr == NULL)
@@ -175,73 +170,6 @@ size_t find_key_len(const char *keys_string)
     return -1;
 }
 
-char **load_keys(int *num_keys)
-{
-    if (!keys_file_exists())
-    {
-        printf("You don't have any keys files\n");
-        return NULL;
-    }
-    do
-    {
-        size_t num_key_files = 0;
-        char **keys_files_list = get_all_keys_files(&num_key_files);
-        if (keys_files_list == NULL)
-            return NULL;
-
-        printf("Select which keys file would you like to use:\n");
-        for (size_t f = 0; f < num_key_files; f++)
-            printf("%zu: %s\n", (f + 1), keys_files_list[f]);
-        if (num_key_files > 1)
-            printf("(1-%zu) or 'q' to quit: ", num_key_files);
-        else
-            printf("(1) or 'q' to quit: ");
-
-        char *line = NULL;
-        size_t line_len = 0;
-        line_len = getline(&line, &line_len, stdin);
-        // Replace new line with null terminator
-        line[line_len - 1] = '\0';
-
-        if (strcmp(line, "q") == 0 || strcmp(line, "Q") == 0)
-        {
-            free(line);
-            for (size_t f = 0; f < num_key_files; f++)
-                free(keys_files_list[f]);
-            free(keys_files_list);
-            return NULL;
-        }
-
-        int selection = 0;
-        if (strcmp(line, "") == 0)
-            selection = 1;
-        else
-            selection = strtol(line, NULL, 10);
-
-        free(line);
-        if (selection <= 0 || selection > num_key_files)
-        {
-            printf("Invalid selection.\n");
-            continue;
-        }
-
-        char **keys_decrypted = NULL;
-        size_t key_len = 0;
-        char *key_file = get_keys_path(keys_files_list[selection - 1]);
-        keys_decrypted = load_keys_from_file(key_file, num_keys, &key_len);
-        if (key_file != NULL)
-            free(key_file);
-
-        for (size_t f = 0; f < num_key_files; f++)
-            free(keys_files_list[f]);
-        free(keys_files_list);
-
-        return keys_decrypted;
-
-    } while (keys_file_exists());
-    return NULL;
-}
-
 void free_keys(char **keys, int num, const char *print)
 {
     if (print != NULL)
@@ -279,3 +207,25 @@ int buff_resize(char **buffer, size_t *max, size_t required)
     *max = new_size;
     return 0;
 }
+
+void print_json_string(FILE *fout, const char *str)
+{
+    fputc('"', fout);
+    for (const unsigned char *c = (const unsigned char *) str; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(fout, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(fout, "\\u%04x", *c);
+        else
+            fputc(*c, fout);
+    }
+    fputc('"', fout);
+}
+
+uint64_t get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,345 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "checksum.h"
+#include "eea.h"
+#include "file_handling.h"
+#include "globals.h"
+#include "utils.h"
+#include "verify.h"
+#include "work_queue.h"
+
+// How much of the end of a file is read at first to find its checksums,
+// enough for a file of about 500 MB
+static const size_t VERIFY_TAIL = (size_t) 4 << 10;
+
+/**
+ * @struct verify_job_t
+ * @brief What the threads checking files share
+ */
+typedef struct
+{
+    work_queue_t *queue;
+    int allow_missing;
+    pthread_mutex_t lock;
+    size_t files;
+    size_t failed;
+    size_t unchecked;
+    size_t bytes;
+} verify_job_t;
+
+/**
+ * @brief Read the line of checksums at the end of a file, reading more of
+ * the end until the whole line is in memory
+ * @param[in] in The file
+ * @param[in] size The size of the file
+ * @param[out] line_start Set to where the line starts in the file, size if
+ * there are no checksums
+ * @return The line, null terminated, or an empty string if there are no
+ * checksums. NULL if reading it failed.
+ * @note The returned buffer must be freed
+ */
+static unsigned char *read_checksum_line(FILE *in, size_t size,
+                                         size_t *line_start)
+{
+    unsigned char *tail = NULL;
+    size_t tail_len = VERIFY_TAIL;
+    for (;;)
+    {
+        if (tail_len > size)
+            tail_len = size;
+        unsigned char *tmp = realloc(tail, tail_len + 1);
+        if (tmp == NULL)
+        {
+            free(tail);
+            return NULL;
+        }
+        tail = tmp;
+        if (fseek(in, (long) (size - tail_len), SEEK_SET) != 0
+            || fread(tail, 1, tail_len, in) != tail_len)
+        {
+            free(tail);
+            return NULL;
+        }
+        tail[tail_len] = '\0';
+
+        // Stop once the new line before the last line has been read
+        if (tail_len == size || (tail_len > 1
+                                 && memchr(tail, '\n', tail_len - 1) != NULL))
+            break;
+        tail_len *= 4;
+    }
+
+    size_t start = checksum_line_start(tail, tail_len);
+    *line_start = (start == tail_len) ? size : size - tail_len + start;
+    // Leave the line at the start of the buffer
+    memmove(tail, tail + start, tail_len - start + 1);
+    return tail;
+}
+
+/**
+ * @brief Parse a line of checksums
+ * @param[in] line The line, null terminated, from CHECKSUM_MARKER
+ * @param[out] chunk Set to how much of the cipher text each checksum covers
+ * @param[out] count Set to the number of checksums
+ * @return The checksums, NULL if the line isn't valid or allocating them
+ * failed
+ * @note The returned checksums must be freed
+ */
+static uint32_t *parse_checksum_line(const char *line, size_t *chunk,
+                                     size_t *count)
+{
+    const char *pos = line + strlen(CHECKSUM_MARKER);
+    char *end = NULL;
+    unsigned long long chunk_len = strtoull(pos, &end, 10);
+    if (end == pos || *end != ':' || chunk_len == 0
+        || chunk_len > CHECKSUM_MAX_CHUNK)
+        return NULL;
+    pos = end + 1;
+
+    size_t digits = strcspn(pos, "\r\n");
+    if (digits % 8 != 0 || strspn(pos, "0123456789abcdef") != digits)
+        return NULL;
+    *chunk = chunk_len;
+    *count = digits / 8;
+    uint32_t *crcs = malloc((*count + 1) * sizeof(uint32_t));
+    if (crcs == NULL)
+        return NULL;
+    for (size_t c = 0; c < *count; c++)
+    {
+        char hex[9];
+        memcpy(hex, pos + c * 8, 8);
+        hex[8] = '\0';
+        crcs[c] = (uint32_t) strtoul(hex, NULL, 16);
+    }
+    return crcs;
+}
+
+/**
+ * @brief Record a damaged chunk
+ * @param[in,out] result What has been found so far
+ * @param[in] offset Where the chunk starts
+ */
+static void add_damaged(verify_result_t *result, size_t offset)
+{
+    if (result->damaged == 0)
+        result->first_damaged = offset;
+    result->damaged++;
+}
+
+int verify_file(const char *path, verify_result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    struct stat path_stat;
+    if (stat(path, &path_stat) != 0)
+        return EEA_ERR_IO;
+    result->bytes = path_stat.st_size;
+
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+        return EEA_ERR_IO;
+    size_t line_start = result->bytes;
+    unsigned char *line = (result->bytes > 0)
+                              ? read_checksum_line(in, result->bytes,
+                                                   &line_start)
+                              : NULL;
+    if (line == NULL || line_start == result->bytes)
+    {
+        free(line);
+        fclose(in);
+        return (result->bytes > 0 && line == NULL) ? EEA_ERR_IO : EEA_OK;
+    }
+    result->has_checksums = 1;
+
+    // A line that can't be read, or doesn't cover the cipher text before
+    // it, means the line itself is damaged
+    size_t chunk = 0, count = 0;
+    size_t body_len = line_start - 1;
+    uint32_t *crcs = parse_checksum_line((const char *) line, &chunk, &count);
+    free(line);
+    if (crcs == NULL || count != (body_len + chunk - 1) / chunk)
+    {
+        free(crcs);
+        fclose(in);
+        result->bad_checksums = 1;
+        return EEA_OK;
+    }
+
+    // The chunks are read in order, so the file is read at the disk's speed
+    int ret = EEA_OK;
+    unsigned char *buf = malloc(chunk);
+    if (buf == NULL)
+        ret = EEA_ERR_NO_MEMORY;
+    else if (fseek(in, 0, SEEK_SET) != 0)
+        ret = EEA_ERR_IO;
+    for (size_t c = 0; ret == EEA_OK && c < count; c++)
+    {
+        size_t offset = c * chunk;
+        size_t len = (body_len - offset < chunk) ? body_len - offset : chunk;
+        if (fread(buf, 1, len, in) != len)
+            ret = EEA_ERR_IO;
+        else if (crc32c(0, buf, len) != crcs[c])
+            add_damaged(result, offset);
+        result->chunks++;
+    }
+
+    free(buf);
+    free(crcs);
+    fclose(in);
+    return ret;
+}
+
+/**
+ * @brief Check a file, recording how it went
+ * @param[in,out] job What the threads share
+ * @param[in] path The file
+ */
+static void verify_one(verify_job_t *job, const char *path)
+{
+    verify_result_t result;
+    int ret = verify_file(path, &result);
+    if (ret != EEA_OK)
+        fprintf(stderr, "%sError:%s Failed to check \'%s\': %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path,
+                eea_strerror(ret));
+    else if (result.bad_checksums)
+        fprintf(stderr, "%sError:%s \'%s\' is damaged: its checksums are "
+                "unreadable or cut short\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path);
+    else if (result.damaged > 0)
+        fprintf(stderr, "%sError:%s \'%s\' is damaged: %zu of %zu chunks "
+                "don't match, the first is the chunk starting at byte %zu\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path,
+                result.damaged, result.chunks, result.first_damaged);
+    else if (!result.has_checksums && job->allow_missing)
+        fprintf(stderr, "%sWARNING%s \'%s\' has no checksums to check\n",
+                colors[COLOR_WARNING], colors[COLOR_RESET], path);
+    else if (!result.has_checksums)
+        fprintf(stderr, "%sError:%s \'%s\' has no checksums: it was cut "
+                "short, or encrypted without\nthem (see --allow-missing)\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path);
+
+    // Without checksums a file can't be told apart from one that was cut
+    // short, so it only passes when that is allowed
+    int unchecked = (ret == EEA_OK && !result.has_checksums);
+    pthread_mutex_lock(&job->lock);
+    job->files++;
+    if (unchecked && job->allow_missing)
+        job->unchecked++;
+    else if (unchecked || ret != EEA_OK || result.bad_checksums
+             || result.damaged > 0)
+        job->failed++;
+    job->bytes += result.bytes;
+    pthread_mutex_unlock(&job->lock);
+}
+
+/**
+ * @brief Function called by pthread_create to check queued files
+ * @param[in] args The verify_job_t the threads share
+ */
+static void *verify_thread(void *args)
+{
+    verify_job_t *job = (verify_job_t *) args;
+    char *path = NULL;
+    while ((path = work_queue_pop(job->queue)) != NULL)
+    {
+        verify_one(job, path);
+        free(path);
+    }
+    return NULL;
+}
+
+/**
+ * @brief walk_dir() callback that queues each .eea file found
+ * @param[in] path Path to the file that was found
+ * @param[in] args The verify_job_t with the queue to add to
+ * @return 1 to keep walking, 0 if the file could not be queued
+ */
+static int queue_verify_file(const char *path, void *args)
+{
+    verify_job_t *job = (verify_job_t *) args;
+    if (!is_of_filetype(path, EEA_FILE_EXTENTION))
+        return 1;
+
+    char *copy = strdup(path);
+    if (copy == NULL || !work_queue_push(job->queue, copy))
+    {
+        free(copy);
+        return 0;
+    }
+    return 1;
+}
+
+int verify_paths(char **paths, int num_paths, int threads,
+                 int allow_missing)
+{
+    verify_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.allow_missing = allow_missing;
+    if (threads < 1)
+        threads = 1;
+
+    pthread_t *pool = malloc(threads * sizeof(pthread_t));
+    job.queue = work_queue_create(threads * 4);
+    if (pool == NULL || job.queue == NULL)
+    {
+        free(pool);
+        if (job.queue != NULL)
+            work_queue_free(job.queue);
+        return 1;
+    }
+    pthread_mutex_init(&job.lock, NULL);
+
+    int started = 0;
+    for (; started < threads; started++)
+        if (pthread_create(&pool[started], NULL, verify_thread, &job) != 0)
+            break;
+
+    int queued = (started > 0);
+    uint64_t start = get_time_ns();
+    for (int p = 0; p < num_paths && queued; p++)
+    {
+        int type = get_file_type(paths[p]);
+        if (type == FILE_TYPE_DIR)
+            queued = walk_dir(paths[p], queue_verify_file, &job);
+        else if (type == FILE_TYPE_REG
+                 && is_of_filetype(paths[p], EEA_FILE_EXTENTION))
+            queued = queue_verify_file(paths[p], &job);
+        else
+        {
+            fprintf(stderr, "%sError:%s \'%s\' isn't a %s file or a "
+                    "directory\n",
+                    colors[COLOR_ERROR], colors[COLOR_RESET], paths[p],
+                    EEA_FILE_EXTENTION);
+            pthread_mutex_lock(&job.lock);
+            job.files++;
+            job.failed++;
+            pthread_mutex_unlock(&job.lock);
+        }
+    }
+
+    work_queue_close(job.queue);
+    for (int t = 0; t < started; t++)
+        pthread_join(pool[t], NULL);
+    double seconds = (get_time_ns() - start) / 1e9;
+
+    if (!queued)
+        fprintf(stderr, "%sError:%s Failed to queue every file\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET]);
+    printf("Verified %zu of %zu files, %.1f MB in %.2f s (%.1f MB/s)",
+           job.files - job.failed - job.unchecked, job.files,
+           job.bytes / 1e6, seconds,
+           seconds > 0 ? job.bytes / 1e6 / seconds : 0);
+    if (job.unchecked > 0)
+        printf(", %zu without checksums", job.unchecked);
+    printf("\n");
+
+    int ret = (!queued || job.failed > 0);
+    pthread_mutex_destroy(&job.lock);
+    work_queue_free(job.queue);
+    free(pool);
+    return ret;
+}
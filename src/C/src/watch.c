@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "watch.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "file_handling.h"
+
+// How long a file has to go without being written to before it is handled
+static const uint64_t WATCH_DEBOUNCE_NS = 200 * 1000000ULL;
+static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY
+                                   | IN_CREATE;
+
+/**
+ * @struct watched_dir_t
+ * @brief A directory being watched and its inotify watch descriptor
+ */
+typedef struct
+{
+    int wd;
+    char *path;
+} watched_dir_t;
+
+/**
+ * @struct pending_file_t
+ * @brief A file that was written to, waiting to settle before it's handled
+ */
+typedef struct
+{
+    char *path;
+    uint64_t closed_ns;
+} pending_file_t;
+
+/**
+ * @struct watcher_t
+ * @brief All the state for watching a directory
+ */
+typedef struct
+{
+    int fd;
+    watched_dir_t *dirs;
+    size_t num_dirs;
+    size_t max_dirs;
+    pending_file_t *pending;
+    size_t num_pending;
+    size_t max_pending;
+} watcher_t;
+
+int watch_supported(void)
+{
+    return 1;
+}
+
+/**
+ * @brief Add a file to the pending list, or push back when it will be
+ * handled if it is already on it
+ * @param[in] w The watcher
+ * @param[in] path The file that was written to
+ * @param[in] now The time the file was written to
+ * @param[in] only_existing Only update the file if it is already pending
+ */
+static void mark_pending(watcher_t *w, const char *path, uint64_t now,
+                         int only_existing)
+{
+    for (size_t p = 0; p < w->num_pending; p++)
+    {
+        if (strcmp(w->pending[p].path, path) == 0)
+        {
+            w->pending[p].closed_ns = now;
+            return;
+        }
+    }
+    if (only_existing)
+        return;
+
+    if (w->num_pending == w->max_pending)
+    {
+        size_t new_max = w->max_pending ? w->max_pending * 2 : 16;
+        pending_file_t *tmp = realloc(w->pending,
+                                      sizeof(pending_file_t) * new_max);
+        if (tmp == NULL)
+            return;
+        w->pending = tmp;
+        w->max_pending = new_max;
+    }
+
+    char *pending = strdup(path);
+    if (pending == NULL)
+        return;
+    w->pending[w->num_pending].path = pending;
+    w->pending[w->num_pending].closed_ns = now;
+    w->num_pending++;
+}
+
+/**
+ * @brief Watch a directory and all of its sub-directories
+ * @param[in] w The watcher
+ * @param[in] path The directory to watch
+ * @param[in] scan Add the files already in the directory to the pending
+ * list. Used for directories created while watching, since files can land
+ * in them before the watch is added.
+ * @return If the directory is being watched
+ */
+static int add_watch(watcher_t *w, const char *path, int scan)
+{
+    if (w->num_dirs == w->max_dirs)
+    {
+        size_t new_max = w->max_dirs ? w->max_dirs * 2 : 16;
+        watched_dir_t *tmp = realloc(w->dirs, sizeof(watched_dir_t) * new_max);
+        if (tmp == NULL)
+            return 0;
+        w->dirs = tmp;
+        w->max_dirs = new_max;
+    }
+
+    int wd = inotify_add_watch(w->fd, path, WATCH_MASK);
+    if (wd < 0)
+    {
+        fprintf(stderr, "%sError:%s Unable to watch \'%s\': %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], path,
+                strerror(errno));
+        return 0;
+    }
+    char *dir_path = strdup(path);
+    if (dir_path == NULL)
+    {
+        inotify_rm_watch(w->fd, wd);
+        return 0;
+    }
+    w->dirs[w->num_dirs].wd = wd;
+    w->dirs[w->num_dirs].path = dir_path;
+    w->num_dirs++;
+
+    DIR *dir = opendir(path);
+    if (!dir)
+        return 1;
+
+    uint64_t now = get_time_ns();
+    struct dirent *dp;
+    while ((dp = readdir(dir)) != NULL)
+    {
+        if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
+            continue;
+
+        size_t path_len = (strlen(path) + strlen(dp->d_name) + 2);
+        char child[path_len];
+        snprintf(child, path_len, "%s/%s", path, dp->d_name);
+
+        int type = get_file_type(child);
+        if (type == FILE_TYPE_DIR)
+            add_watch(w, child, scan);
+        else if (type == FILE_TYPE_REG && scan)
+            mark_pending(w, child, now, 0);
+    }
+    closedir(dir);
+    return 1;
+}
+
+/**
+ * @brief Find the directory a watch descriptor belongs to
+ * @param[in] w The watcher
+ * @param[in] wd The watch descriptor
+ * @return Path to the directory, NULL if it isn't known
+ */
+static const char *dir_for_wd(watcher_t *w, int wd)
+{
+    for (size_t d = 0; d < w->num_dirs; d++)
+        if (w->dirs[d].wd == wd)
+            return w->dirs[d].path;
+    return NULL;
+}
+
+/**
+ * @brief Read in all the available events and update the pending list
+ * @param[in] w The watcher
+ */
+static void read_events(watcher_t *w)
+{
+    char buffer[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(w->fd, buffer, sizeof(buffer))) > 0)
+    {
+        uint64_t now = get_time_ns();
+        for (char *ptr = buffer; ptr < buffer + len;)
+        {
+            const struct inotify_event *event = (const struct inotify_event *)
+                ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                fprintf(stderr,
+                        "%sWarning:%s Too many files landed at once, "
+                        "some may have been missed\n",
+                        colors[COLOR_WARNING], colors[COLOR_RESET]);
+                continue;
+            }
+
+            const char *dir = dir_for_wd(w, event->wd);
+            if (dir == NULL || event->len == 0)
+                continue;
+
+            size_t path_len = (strlen(dir) + strlen(event->name) + 2);
+            char path[path_len];
+            snprintf(path, path_len, "%s/%s", dir, event->name);
+
+            if (event->mask & IN_ISDIR)
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    add_watch(w, path, 1);
+            }
+            else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                mark_pending(w, path, now, 0);
+            else if (event->mask & IN_MODIFY)
+                mark_pending(w, path, now, 1);
+        }
+    }
+}
+
+/**
+ * @brief Hand the files that have settled to the callback
+ * @param[in] w The watcher
+ * @param[in] callback Function to call for each file
+ * @param[in] ctx Pointer passed through to the callback
+ * @return 1 to keep watching, 0 if the callback stopped the watch
+ */
+static int handle_settled(watcher_t *w, watch_callback_t callback, void *ctx)
+{
+    uint64_t now = get_time_ns();
+    int keep_watching = 1;
+    size_t p = 0;
+    while (p < w->num_pending)
+    {
+        pending_file_t *file = &w->pending[p];
+        if (file->closed_ns + WATCH_DEBOUNCE_NS > now)
+        {
+            p++;
+            continue;
+        }
+
+        if (keep_watching && get_file_type(file->path) == FILE_TYPE_REG)
+            keep_watching = callback(file->path, file->closed_ns, ctx);
+        free(file->path);
+        w->pending[p] = w->pending[--w->num_pending];
+    }
+    return keep_watching;
+}
+
+/**
+ * @brief Work out how long to wait for the next event
+ * @param[in] w The watcher
+ * @return Milliseconds until the next pending file settles, -1 to wait
+ * until the next event if nothing is pending
+ */
+static int next_timeout_ms(watcher_t *w)
+{
+    if (w->num_pending == 0)
+        return -1;
+
+    uint64_t now = get_time_ns();
+    uint64_t next = UINT64_MAX;
+    for (size_t p = 0; p < w->num_pending; p++)
+        if (w->pending[p].closed_ns + WATCH_DEBOUNCE_NS < next)
+            next = w->pending[p].closed_ns + WATCH_DEBOUNCE_NS;
+
+    if (next <= now)
+        return 0;
+    // Round up so we don't wake up just before the file settles
+    return (int) ((next - now + 999999) / 1000000);
+}
+
+int watch_dir(const char *dir_name, watch_callback_t callback, void *ctx)
+{
+    watcher_t w;
+    memset(&w, 0, sizeof(w));
+    w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w.fd < 0)
+    {
+        fprintf(stderr, "%sError:%s Unable to start watching: %s\n",
+                colors[COLOR_ERROR], colors[COLOR_RESET], strerror(errno));
+        return 0;
+    }
+
+    int watching = add_watch(&w, dir_name, 0);
+    int quit = 0;
+    int stdin_open = 1;
+    while (watching && !quit)
+    {
+        struct pollfd fds[2];
+        fds[0].fd = w.fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = STDIN_FILENO;
+        fds[1].events = POLLIN;
+
+        int rc = poll(fds, stdin_open ? 2 : 1, next_timeout_ms(&w));
+        if (rc < 0 && errno != EINTR)
+        {
+            watching = 0;
+            break;
+        }
+
+        if (rc > 0 && (fds[0].revents & POLLIN))
+            read_events(&w);
+
+        if (rc > 0 && stdin_open && (fds[1].revents & (POLLIN | POLLHUP)))
+        {
+            char *line = NULL;
+            size_t line_len = 0;
+            if (getline(&line, &line_len, stdin) == -1)
+                // Nobody can type 'q' anymore, keep watching until killed
+                stdin_open = 0;
+            else
+                quit = (line[0] == 'q' || line[0] == 'Q');
+            free(line);
+        }
+
+        watching = handle_settled(&w, callback, ctx);
+    }
+
+    // Don't leave behind files that landed right before quitting
+    if (watching)
+    {
+        for (size_t p = 0; p < w.num_pending; p++)
+            w.pending[p].closed_ns = 0;
+        watching = handle_settled(&w, callback, ctx);
+    }
+
+    for (size_t d = 0; d < w.num_dirs; d++)
+        free(w.dirs[d].path);
+    for (size_t p = 0; p < w.num_pending; p++)
+        free(w.pending[p].path);
+    free(w.dirs);
+    free(w.pending);
+    close(w.fd);
+    return watching;
+}
+
+#else
+
+int watch_supported(void)
+{
+    return 0;
+}
+
+int watch_dir(const char *dir_name, watch_callback_t callback, void *ctx)
+{
+    fprintf(stderr,
+            "%sError:%s Watching directories is only supported on Linux\n",
+            colors[COLOR_ERROR], colors[COLOR_RESET]);
+    return 0;
+}
+
+#endif
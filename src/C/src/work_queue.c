@@ -0,0 +1,117 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "work_queue.h"
+
+struct work_queue
+{
+    void **items;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    int closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+work_queue_t *work_queue_create(size_t capacity)
+{
+    if (capacity == 0)
+        capacity = 1;
+
+    work_queue_t *queue = calloc(1, sizeof(work_queue_t));
+    if (queue == NULL)
+        return NULL;
+
+    queue->items = calloc(capacity, sizeof(void *));
+    if (queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->capacity = capacity;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return queue;
+}
+
+/**
+ * @brief Add an item to the end of the queue
+ * @param[in] queue The queue, with its mutex held and room for the item
+ * @param[in] item The item to add
+ */
+static void add_item(work_queue_t *queue, void *item)
+{
+    size_t tail = (queue->head + queue->count) % queue->capacity;
+    queue->items[tail] = item;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+}
+
+int work_queue_push(work_queue_t *queue, void *item)
+{
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->capacity && !queue->closed)
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+
+    if (queue->closed)
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        return 0;
+    }
+
+    add_item(queue, item);
+    pthread_mutex_unlock(&queue->mutex);
+    return 1;
+}
+
+int work_queue_try_push(work_queue_t *queue, void *item)
+{
+    pthread_mutex_lock(&queue->mutex);
+    int added = (queue->count < queue->capacity && !queue->closed);
+    if (added)
+        add_item(queue, item);
+    pthread_mutex_unlock(&queue->mutex);
+    return added;
+}
+
+void *work_queue_pop(work_queue_t *queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0 && !queue->closed)
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+
+    void *item = NULL;
+    if (queue->count > 0)
+    {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return item;
+}
+
+void work_queue_close(work_queue_t *queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+void work_queue_free(work_queue_t *queue)
+{
+    if (queue == NULL)
+        return;
+
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+    free(queue);
+}
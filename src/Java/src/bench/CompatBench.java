@@ -0,0 +1,183 @@
+package bench;
+
+import encryptionUtilities.EEA;
+import java.io.BufferedReader;
+import java.io.FileReader;
+import java.io.IOException;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.Arrays;
+
+/**
+ * Runs the cross-implementation test vectors against this implementation.
+ * Prints a line per vector of "name digest round_trip enc_ns dec_ns", the
+ * same format as the C and Swift harnesses.
+ * @author DarkAssassin23 - Will Jones
+ *
+ */
+public class CompatBench
+{
+    // Repeat small inputs until each sample takes at least this long, so the
+    // clock's resolution doesn't matter
+    static final private long MIN_SAMPLE_NS = 10L * 1000000L;
+    static final private int DEFAULT_REPS = 5;
+    static final private char[] HEX = "0123456789abcdef".toCharArray();
+
+    final private EEA eea = new EEA();
+    private long state;
+
+    /**
+     * Gets the next value from the splitmix64 generator. This must match the
+     * generator in the C and Swift harnesses.
+     * @return The next value
+     */
+    private long nextRandom()
+    {
+        state += 0x9E3779B97F4A7C15L;
+        long z = state;
+        z = (z ^ (z >>> 30)) * 0xBF58476D1CE4E5B9L;
+        z = (z ^ (z >>> 27)) * 0x94D049BB133111EBL;
+        return z ^ (z >>> 31);
+    }
+
+    /**
+     * Time encrypting or decrypting
+     * @param encrypting If encrypting should be timed, otherwise decrypting
+     * @param input The input to time it on
+     * @param keys The keys
+     * @param reps The number of samples, the median is returned
+     * @return The median time of a single call, in nanoseconds
+     */
+    private long timeCrypt(boolean encrypting, byte[] input, String[] keys,
+                           int reps)
+    {
+        long iters = 0;
+        long[] ns = new long[reps];
+        for (int r = 0; r < reps; r++)
+        {
+            long start = System.nanoTime(), elapsed = 0, runs = 0;
+            do
+            {
+                if (encrypting)
+                    eea.encryptData(input, keys);
+                else
+                    eea.decryptData(input, keys);
+                runs++;
+                elapsed = System.nanoTime() - start;
+            } while ((iters == 0 && elapsed < MIN_SAMPLE_NS) || runs < iters);
+            // The first sample works out how many runs make up a sample
+            if (iters == 0)
+                iters = runs;
+            ns[r] = elapsed / runs;
+        }
+        Arrays.sort(ns);
+        return ns[reps / 2];
+    }
+
+    /**
+     * Encrypt a vector, check it decrypts back to the plain text, and time it
+     * @param fields The name, key size, key count, size and seed of the vector
+     * @param reps The number of samples to time, 0 to not time it
+     * @return The result line for the vector
+     * @throws NoSuchAlgorithmException If SHA-256 isn't available
+     */
+    private String runVector(String[] fields, int reps)
+        throws NoSuchAlgorithmException
+    {
+        int keyLen = Integer.parseInt(fields[1]) / 4;
+        int numKeys = Integer.parseInt(fields[2]);
+        int size = Integer.parseInt(fields[3]);
+        state = Long.parseUnsignedLong(fields[4]);
+
+        String[] keys = new String[numKeys];
+        for (int k = 0; k < numKeys; k++)
+        {
+            char[] key = new char[keyLen];
+            for (int c = 0; c < keyLen; c++)
+                key[c] = HEX[(int) (nextRandom() & 0xF)];
+            keys[k] = new String(key);
+        }
+
+        byte[] plainText = new byte[size];
+        for (int x = 0; x < size; x++)
+            plainText[x] = (byte) nextRandom();
+        if (plainText[size - 1] == 0)
+            plainText[size - 1] = 1;
+
+        byte[] cipherText = eea.encryptData(plainText, keys);
+        StringBuilder digest = new StringBuilder();
+        for (byte b : MessageDigest.getInstance("SHA-256").digest(cipherText))
+            digest.append(String.format("%02x", b));
+
+        boolean roundTrip =
+            Arrays.equals(eea.decryptData(cipherText, keys), plainText);
+
+        long encNs = 0, decNs = 0;
+        if (reps > 0)
+        {
+            encNs = timeCrypt(true, plainText, keys, reps);
+            decNs = timeCrypt(false, cipherText, keys, reps);
+        }
+        return fields[0] + " " + digest + " " + (roundTrip ? 1 : 0) + " "
+            + encNs + " " + decNs;
+    }
+
+    public static void main(String[] args)
+    {
+        String filename = null;
+        int reps = DEFAULT_REPS;
+        for (int a = 0; a < args.length; a++)
+        {
+            if (args[a].equals("--reps") && a + 1 < args.length)
+                reps = Integer.parseInt(args[++a]);
+            else if (!args[a].startsWith("-") && filename == null)
+                filename = args[a];
+            else
+                filename = null;
+        }
+        if (filename == null || reps < 0)
+        {
+            System.err.println(
+                "Usage: java -cp bin bench.CompatBench [--reps <n>] "
+                + "<vectors file>");
+            System.exit(1);
+        }
+
+        CompatBench bench = new CompatBench();
+        int ret = 0;
+        try (BufferedReader reader =
+                 new BufferedReader(new FileReader(filename)))
+        {
+            String line;
+            while ((line = reader.readLine()) != null)
+            {
+                if (line.isEmpty() || line.startsWith("#"))
+                    continue;
+                String[] fields = line.trim().split("\\s+");
+                if (fields.length < 5)
+                {
+                    System.err.println("Invalid vector: " + line);
+                    ret = 1;
+                    continue;
+                }
+                try
+                {
+                    System.out.println(bench.runVector(fields, reps));
+                }
+                catch (RuntimeException e)
+                {
+                    // Report it, so one bad vector doesn't hide the rest
+                    System.err.println("Unable to run " + fields[0] + ": "
+                                       + e);
+                    ret = 1;
+                }
+            }
+        }
+        catch (IOException | NoSuchAlgorithmException e)
+        {
+            System.err.println(e.getMessage());
+            ret = 1;
+        }
+        System.exit(ret);
+    }
+}
@@ -17,7 +17,8 @@ var useLocalDependencies: Bool {
             .macOS(.v10_15)
         ],
         products: [
-            .executable(name: "EEA", targets: ["EEA"])
+            .executable(name: "EEA", targets: ["EEA"]),
+            .executable(name: "EEACompat", targets: ["EEACompat"]),
         ],
         dependencies: dependencies,
         targets: [
@@ -33,6 +34,13 @@ var useLocalDependencies: Bool {
                     "EEAUtils"
                 ]
             ),
+            .executableTarget(
+                name: "EEACompat",
+                dependencies: [
+                    "EEAUtils",
+                    .product(name: "Crypto", package: "swift-crypto"),
+                ]
+            ),
             .testTarget(
                 name: "EEATests",
                 dependencies: [
@@ -70,7 +78,8 @@ var useLocalDependencies: Bool {
             .macOS(.v10_15)
         ],
         products: [
-            .executable(name: "EEA", targets: ["EEA"])
+            .executable(name: "EEA", targets: ["EEA"]),
+            .executable(name: "EEACompat", targets: ["EEACompat"]),
         ],
         dependencies: dependencies,
         targets: [
@@ -86,6 +95,13 @@ var useLocalDependencies: Bool {
                     "EEAUtils"
                 ]
             ),
+            .executableTarget(
+                name: "EEACompat",
+                dependencies: [
+                    "EEAUtils",
+                    .product(name: "Crypto", package: "swift-crypto"),
+                ]
+            ),
             .testTarget(
                 name: "EEATests",
                 dependencies: [
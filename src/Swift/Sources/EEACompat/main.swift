@@ -0,0 +1,171 @@
+import Crypto
+import EEAUtils
+import Foundation
+
+// Runs the cross-implementation test vectors against this implementation.
+// Prints a line per vector of "name digest round_trip enc_ns dec_ns", the
+// same format as the C and Java harnesses.
+
+// Repeat small inputs until each sample takes at least this long, so the
+// clock's resolution doesn't matter
+let minSampleNs: UInt64 = 10 * 1_000_000
+let defaultReps: Int = 5
+let hexChars: [Character] = Array("0123456789abcdef")
+
+/// The splitmix64 generator. This must match the generator in the C and Java
+/// harnesses.
+struct SplitMix64 {
+    var state: UInt64
+
+    mutating func next() -> UInt64 {
+        state &+= 0x9E37_79B9_7F4A_7C15
+        var z = state
+        z = (z ^ (z >> 30)) &* 0xBF58_476D_1CE4_E5B9
+        z = (z ^ (z >> 27)) &* 0x94D0_49BB_1331_11EB
+        return z ^ (z >> 31)
+    }
+}
+
+/// Print a message to stderr, so it doesn't get mixed in with the results
+/// - Parameter message: The message to print
+func printError(_ message: String) {
+    FileHandle.standardError.write(Data((message + "\n").utf8))
+}
+
+/// Encrypt the data the same way encryptFile does, returning the base64
+/// cipher text
+/// - Parameters:
+///   - eea: The EEA instance
+///   - data: The plain text
+///   - keys: The keys
+/// - Returns: The cipher text encoded in base64
+func encryptData(_ eea: EEA, _ data: [UInt8], _ keys: [String]) throws
+    -> [UInt8]
+{
+    let cipherData = try eea.encrypt(data: data, keys: keys)
+    return Array(try eea.encode(data: cipherData).utf8)
+}
+
+/// Time encrypting or decrypting
+/// - Parameters:
+///   - reps: The number of samples, the median is returned
+///   - body: The call to time
+/// - Returns: The median time of a single call, in nanoseconds
+func timeCrypt(reps: Int, _ body: () throws -> Void) rethrows -> UInt64 {
+    var iters: UInt64 = 0
+    var ns: [UInt64] = []
+    for _ in 0..<reps {
+        let start = DispatchTime.now().uptimeNanoseconds
+        var elapsed: UInt64 = 0
+        var runs: UInt64 = 0
+        repeat {
+            try body()
+            runs += 1
+            elapsed = DispatchTime.now().uptimeNanoseconds - start
+        } while (iters == 0 && elapsed < minSampleNs) || runs < iters
+        // The first sample works out how many runs make up a sample
+        if iters == 0 {
+            iters = runs
+        }
+        ns.append(elapsed / runs)
+    }
+    ns.sort()
+    return ns[reps / 2]
+}
+
+/// Encrypt a vector, check it decrypts back to the plain text, and time it
+/// - Parameters:
+///   - fields: The name, key size, key count, size and seed of the vector
+///   - reps: The number of samples to time, 0 to not time it
+/// - Returns: The result line for the vector, nil if the vector is invalid
+func runVector(_ fields: [Substring], reps: Int) throws -> String? {
+    guard let keyBits = Int(fields[1]), let numKeys = Int(fields[2]),
+        let size = Int(fields[3]), let seed = UInt64(fields[4]),
+        numKeys > 0, size > 0
+    else {
+        return nil
+    }
+
+    var rng = SplitMix64(state: seed)
+    var keys: [String] = []
+    for _ in 0..<numKeys {
+        var key = ""
+        for _ in 0..<(keyBits / 4) {
+            key.append(hexChars[Int(rng.next() & 0xF)])
+        }
+        keys.append(key)
+    }
+
+    var plainText = [UInt8](repeating: 0, count: size)
+    for x in 0..<size {
+        plainText[x] = UInt8(truncatingIfNeeded: rng.next())
+    }
+    if plainText[size - 1] == 0 {
+        plainText[size - 1] = 1
+    }
+
+    let eea = EEA()
+    let cipherText = try encryptData(eea, plainText, keys)
+    let digest = SHA256.hash(data: cipherText)
+        .map { String(format: "%02x", $0) }.joined()
+    let roundTrip = eea.decrypt(data: cipherText, keys: keys) == plainText
+
+    var encNs: UInt64 = 0
+    var decNs: UInt64 = 0
+    if reps > 0 {
+        encNs = try timeCrypt(reps: reps) {
+            _ = try encryptData(eea, plainText, keys)
+        }
+        decNs = timeCrypt(reps: reps) {
+            _ = eea.decrypt(data: cipherText, keys: keys)
+        }
+    }
+    return "\(fields[0]) \(digest) \(roundTrip ? 1 : 0) \(encNs) \(decNs)"
+}
+
+func main() -> Int32 {
+    var filename: String?
+    var reps = defaultReps
+    var args = CommandLine.arguments.dropFirst().makeIterator()
+    while let arg = args.next() {
+        if arg == "--reps", let n = args.next().flatMap({ Int($0) }) {
+            reps = n
+        } else if !arg.hasPrefix("-") && filename == nil {
+            filename = arg
+        } else {
+            filename = nil
+            break
+        }
+    }
+    guard let filename = filename, reps >= 0,
+        let contents = try? String(contentsOfFile: filename, encoding: .utf8)
+    else {
+        printError("Usage: EEACompat [--reps <n>] <vectors file>")
+        return 1
+    }
+
+    var ret: Int32 = 0
+    for line in contents.split(separator: "\n") {
+        if line.isEmpty || line.hasPrefix("#") {
+            continue
+        }
+        let fields = line.split(separator: " ")
+        do {
+            guard fields.count >= 5,
+                let result = try runVector(fields, reps: reps)
+            else {
+                printError("Invalid vector: \(line)")
+                ret = 1
+                continue
+            }
+            print(result)
+        } catch (let e) {
+            // Report it, so one bad vector doesn't hide the rest
+            printError("Unable to run \(fields[0]): \(e)")
+            ret = 1
+        }
+    }
+    return ret
+}
+
+exit(main())
@@ -0,0 +1,125 @@
+#!/usr/bin/env bash
+# Checks that the C, Java and Swift implementations produce the same cipher
+# text for the test vectors in vectors.txt, and compares their throughput on
+# the same inputs.
+#
+# Usage: ./compat.sh [--reps <n>] [--generate]
+#   --reps <n>  Samples per vector, the median is reported, 0 to only check
+#               the cipher text (default: 5)
+#   --generate  Regenerate vectors.txt from the C implementation first
+#
+# Implementations whose toolchain isn't installed are skipped. Exits non-zero
+# if any implementation that ran disagrees with the vectors.
+
+set -euo pipefail
+
+DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+SRC="$(dirname "$DIR")"
+VECTORS="$DIR/vectors.txt"
+REPS=5
+GENERATE=0
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --reps)
+            REPS="$2"
+            shift 2
+            ;;
+        --generate)
+            GENERATE=1
+            shift
+            ;;
+        *)
+            sed -n '5,9s/^# \{0,1\}//p' "$0" >&2
+            exit 1
+            ;;
+    esac
+done
+
+OUT="$(mktemp -d)"
+trap 'rm -rf "$OUT"' EXIT
+
+make -s -C "$SRC/C" bench >&2
+if [ "$GENERATE" -eq 1 ]; then
+    "$SRC/C/eea_compat" --generate "$VECTORS"
+fi
+
+echo "Running C..." >&2
+"$SRC/C/eea_compat" --reps "$REPS" "$VECTORS" > "$OUT/C" || true
+
+if command -v javac > /dev/null && command -v java > /dev/null; then
+    echo "Running Java..." >&2
+    make -s -C "$SRC/Java" bench >&2
+    java -cp "$SRC/Java/bin" bench.CompatBench --reps "$REPS" "$VECTORS" \
+        > "$OUT/Java" || true
+else
+    echo "Skipping Java: javac not found" >&2
+fi
+
+if command -v swift > /dev/null; then
+    echo "Running Swift..." >&2
+    make -s -C "$SRC/Swift" compat >&2
+    "$SRC/Swift/.build/release/EEACompat" --reps "$REPS" "$VECTORS" \
+        > "$OUT/Swift" || true
+else
+    echo "Skipping Swift: swift not found" >&2
+fi
+
+# Join the results on the vector name. Throughput is in MB/s of plain text,
+# and each implementation's column is "ok" when its cipher text matches the
+# vector and decrypts back to the plain text, "diff" when the cipher text
+# doesn't match, "rt" when it doesn't round trip, "miss" when it failed to
+# run the vector, and "-" when the implementation wasn't run at all.
+awk -v impls="C Java Swift" -v out="$OUT" '
+function rate(size, ns) {
+    return ns > 0 ? sprintf("%.1f", size * 1000 / ns) : "-"
+}
+BEGIN {
+    n = split(impls, names, " ")
+    for (i = 1; i <= n; i++) {
+        file = out "/" names[i]
+        while ((r = (getline line < file)) > 0) {
+            split(line, f, " ")
+            digest[names[i], f[1]] = f[2]
+            trip[names[i], f[1]] = f[3]
+            enc[names[i], f[1]] = f[4]
+            dec[names[i], f[1]] = f[5]
+        }
+        ran[names[i]] = (r == 0)
+    }
+    printf "%-20s", "vector"
+    for (i = 1; i <= n; i++)
+        printf " %10s %10s", names[i] " enc", names[i] " dec"
+    for (i = 1; i <= n; i++)
+        printf " %6s", names[i]
+    printf "\n"
+}
+/^#/ || NF < 6 { next }
+{
+    printf "%-20s", $1
+    for (i = 1; i <= n; i++)
+        printf " %10s %10s", rate($4, enc[names[i], $1]),
+            rate($4, dec[names[i], $1])
+    for (i = 1; i <= n; i++) {
+        status = ran[names[i]] ? "miss" : "-"
+        if ((names[i], $1) in digest) {
+            if (digest[names[i], $1] != $6)
+                status = "diff"
+            else if (trip[names[i], $1] != 1)
+                status = "rt"
+            else
+                status = "ok"
+        }
+        if (status != "ok" && status != "-")
+            failed++
+        printf " %6s", status
+    }
+    printf "\n"
+}
+END {
+    if (failed) {
+        printf "\n%d result(s) disagree with the vectors\n", failed
+        exit 1
+    }
+}
+' "$VECTORS"